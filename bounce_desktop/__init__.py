@@ -6,6 +6,6 @@ __version__ = "0.0.2"
 
 _package_dir = Path(__file__).parent
 
-from ._core import Desktop
+from ._core import CgroupLimits, Desktop, TrajectoryReader
 
-__all__ = ["Desktop"]
+__all__ = ["CgroupLimits", "Desktop", "TrajectoryReader"]
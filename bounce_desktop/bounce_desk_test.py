@@ -1,6 +1,29 @@
+import os
+import sys
+import tempfile
+import time
 import unittest
 
-from bounce_desktop import Desktop
+from bounce_desktop import CgroupLimits, Desktop, TrajectoryReader
+
+
+def _pids_controller_delegated():
+    """Returns whether this process's cgroup can enable the pids controller
+    for desktops' cgroups."""
+    with open("/proc/self/mounts") as f:
+        mounts = [line.split() for line in f]
+    mount = next((m[1] for m in mounts if m[2] == "cgroup2"), None)
+    with open("/proc/self/cgroup") as f:
+        own = next((l[3:].strip() for l in f if l.startswith("0::")), None)
+    if mount is None or own is None:
+        return False
+    cgroup = mount + own
+    try:
+        with open(os.path.join(cgroup, "cgroup.controllers")) as f:
+            controllers = f.read().split()
+    except OSError:
+        return False
+    return "pids" in controllers and os.access(cgroup, os.W_OK)
 
 
 class TestDesktop(unittest.TestCase):
@@ -9,6 +32,140 @@ class TestDesktop(unittest.TestCase):
         frame = d.get_frame()
         self.assertEqual(frame.shape, (300, 200, 4))
 
+    def test_reset(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"])
+        d.reset(["sleep", "10000"])
+        frame = d.get_frame()
+        self.assertEqual(frame.shape, (300, 200, 4))
+        self.assertEqual(d.teardown_stats().count, 1)
+
+    def test_zygote_reset(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"])
+        command = [sys.executable, "-c", "import time; time.sleep(10000)"]
+        d.reset(command, use_zygote=True, preload=["json"])
+        d.reset(command, use_zygote=True, preload=["json"])
+        frame = d.get_frame()
+        self.assertEqual(frame.shape, (300, 200, 4))
+        self.assertEqual(d.teardown_stats().count, 2)
+
+    def test_logs(self):
+        command = ["sh", "-c", "echo hi from app; sleep 10000"]
+        d = Desktop.create(300, 200, command)
+        for _ in range(100):
+            if "hi from app" in d.logs().get("app", ""):
+                break
+            time.sleep(0.05)
+        logs = d.logs()
+        self.assertIn("hi from app", logs["app"])
+        self.assertIn("weston", logs)
+
+    def test_resource_usage(self):
+        if not _pids_controller_delegated():
+            self.skipTest("The pids cgroup controller isn't delegated.")
+        d = Desktop.create(300, 200, ["sleep", "10000"],
+                           limits=CgroupLimits(pids_max=512))
+        usage = d.resource_usage()
+        self.assertGreater(usage.cpu_usage_us, 0)
+        self.assertGreaterEqual(usage.pids_current, 1)
+
+    def test_cpu_placement(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"], cpus_per_desktop=1)
+        cpus = d.cpus()
+        self.assertEqual(len(cpus), 1)
+        d.pin([])
+        self.assertEqual(d.cpus(), [])
+        d.pin(cpus)
+        self.assertEqual(d.cpus(), cpus)
+
+        # Another desktop can't pin itself to CPUs that are reserved.
+        other = Desktop.create(300, 200, ["sleep", "10000"])
+        with self.assertRaises(RuntimeError):
+            other.pin(cpus)
+        d.pin([])
+        other.pin(cpus)
+        self.assertEqual(other.cpus(), cpus)
+
+    def test_pooled_cpu_placement(self):
+        Desktop.enable_pool(300, 200, size=1, cpus_per_desktop=1)
+        try:
+            d = Desktop.create(300, 200, ["sleep", "10000"],
+                               cpus_per_desktop=1)
+            names = [phase.name for phase in d.startup_profile().phases]
+            self.assertIn("claim_session", names)
+            self.assertEqual(len(d.cpus()), 1)
+        finally:
+            Desktop.disable_pool(300, 200)
+
+    def test_startup_profile(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"])
+        d.get_frame()
+        profile = d.startup_profile()
+        names = [phase.name for phase in profile.phases]
+        self.assertIn("weston_ready", names)
+        self.assertEqual(names[-2:], ["connect", "first_frame"])
+        self.assertGreater(profile.total_s(), 0)
+
+    def test_get_new_frame(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"])
+        d.get_frame()
+        # Nothing draws in the session, so there's never a new frame.
+        with self.assertRaises(RuntimeError):
+            d.get_frame(wait_for_new_commit=True, timeout=0.5)
+
+    def test_recording(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"])
+        with tempfile.TemporaryDirectory() as dir:
+            path = os.path.join(dir, "run.traj")
+            d.start_recording(path)
+            with self.assertRaises(ValueError):
+                d.start_recording(path)
+            d.get_frame()
+            d.key_press(63)
+            d.key_release(63)
+            stats = d.stop_recording()
+            self.assertEqual(stats.frames, 1)
+            self.assertEqual(stats.events, 2)
+            self.assertGreater(os.path.getsize(path), 300 * 200 * 4)
+
+            reader = TrajectoryReader.open(path)
+            self.assertEqual(len(reader), 1)
+            frame = reader.frame(0)
+            self.assertEqual(frame.shape, (300, 200, 4))
+            self.assertFalse(frame.flags.writeable)
+            events = reader.events(0, 2**63 - 1)
+            self.assertEqual([e.keysym for e in events], [63, 63])
+            self.assertEqual([e.pressed for e in events], [True, False])
+            self.assertEqual(reader.frame_at(events[0].timestamp_ns), 0)
+        with self.assertRaises(ValueError):
+            d.stop_recording()
+
+    def test_without_xwayland(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"], xwayland=False)
+        self.assertEqual(d.get_frame().shape, (300, 200, 4))
+
+    def test_virtual_clock(self):
+        d = Desktop.create(300, 200, ["sleep", "10000"], virtual_clock=True)
+        d.set_time_speed(0)
+        start = d.virtual_time()
+        d.advance_time(2.5)
+        self.assertAlmostEqual(d.virtual_time() - start, 2.5)
+        self.assertEqual(d.time_speed(), 0)
+        with self.assertRaises(ValueError):
+            d.set_time_speed(-1)
+
+        plain = Desktop.create(300, 200, ["sleep", "10000"])
+        with self.assertRaises(ValueError):
+            plain.advance_time(1)
+
+    def test_pooled_create(self):
+        Desktop.enable_pool(300, 200, size=1)
+        try:
+            d = Desktop.create(300, 200, ["sleep", "10000"])
+            frame = d.get_frame()
+            self.assertEqual(frame.shape, (300, 200, 4))
+        finally:
+            Desktop.disable_pool(300, 200)
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,189 @@
+"""A fork server for Python apps.
+
+Imports the modules listed in BOUNCE_ZYGOTE_PRELOAD once, and then forks apps
+from that warm state on request, so that relaunched apps skip interpreter start
+up and those imports. See src/zygote/zygote.h for the launching side and
+src/zygote/protocol.h for the protocol.
+"""
+
+import importlib
+import os
+import runpy
+import select
+import signal
+import socket
+import struct
+import sys
+import time
+import traceback
+
+_IPC_FILE_VAR = "BOUNCE_ZYGOTE_IPC_FILE"
+_PRELOAD_VAR = "BOUNCE_ZYGOTE_PRELOAD"
+_GRACE_MS_VAR = "BOUNCE_ZYGOTE_GRACE_MS"
+
+_FORMAT = "=iiii4096s"
+_SIZE = struct.calcsize(_FORMAT)
+
+FORK, KILL, READY, FORKED, FORK_FAILED, KILLED = range(6)
+
+
+def _send(sock, code, request_id=0, pid=-1):
+    sock.send(struct.pack(_FORMAT, code, request_id, pid, 0, b""))
+
+
+def _run_app(args):
+    """Runs 'args' the way 'python <args>' would."""
+    if args[0] == "-c":
+        sys.argv = ["-c"] + args[2:]
+        sys.path[0] = ""
+        exec(compile(args[1], "<string>", "exec"), {"__name__": "__main__"})
+    elif args[0] == "-m":
+        sys.argv = args[1:]
+        sys.path[0] = os.getcwd()
+        runpy.run_module(args[1], run_name="__main__", alter_sys=True)
+    else:
+        sys.argv = list(args)
+        sys.path[0] = os.path.dirname(os.path.abspath(args[0]))
+        runpy.run_path(args[0], run_name="__main__")
+
+
+def _fork(sock, args):
+    """Forks a child that runs 'args' in its own process group.
+
+    Returns the child's pid, or -1 if 'args' isn't a runnable command line.
+    """
+    if not args or (args[0] in ("-c", "-m") and len(args) < 2):
+        return -1
+
+    pid = os.fork()
+    if pid == 0:
+        code = 0
+        try:
+            sock.close()
+            os.setpgid(0, 0)
+            _run_app(args)
+        except SystemExit as e:
+            if e.code is None or isinstance(e.code, int):
+                code = e.code or 0
+            else:
+                print(e.code, file=sys.stderr)
+                code = 1
+        except BaseException:
+            traceback.print_exc()
+            code = 1
+        finally:
+            sys.stdout.flush()
+            sys.stderr.flush()
+            os._exit(code)
+
+    # Also set the child's group from here, so that the group exists as soon
+    # as we report the child as forked.
+    try:
+        os.setpgid(pid, pid)
+    except OSError:
+        pass
+    return pid
+
+
+def _group_alive(pgid):
+    try:
+        os.killpg(pgid, 0)
+        return True
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        return True
+
+
+def _signal_group(pgid, sig):
+    try:
+        os.killpg(pgid, sig)
+    except (ProcessLookupError, PermissionError):
+        pass
+
+
+def _wait_exit(pid, timeout):
+    """Waits up to 'timeout' seconds, or forever if it's None, for our child
+    'pid' to exit, and reaps it. Returns whether the child's exited."""
+    try:
+        fd = os.pidfd_open(pid)
+    except ProcessLookupError:
+        # We've already reaped it.
+        return True
+    try:
+        if not select.select([fd], [], [], timeout)[0]:
+            return False
+        os.waitpid(pid, 0)
+        return True
+    except ChildProcessError:
+        return True
+    finally:
+        os.close(fd)
+
+
+def _kill(pid, grace):
+    """Terminates the app 'pid' and its process group, giving them 'grace'
+    seconds to exit after SIGTERM before SIGKILLing them."""
+    deadline = time.monotonic() + grace
+    _signal_group(pid, signal.SIGTERM)
+    exited = _wait_exit(pid, grace)
+    while exited and _group_alive(pid) and time.monotonic() < deadline:
+        time.sleep(0.01)
+    if not exited or _group_alive(pid):
+        _signal_group(pid, signal.SIGKILL)
+        if not exited:
+            _wait_exit(pid, None)
+
+
+def _reap_exited(children):
+    while children:
+        try:
+            pid, _ = os.waitpid(-1, os.WNOHANG)
+        except ChildProcessError:
+            return
+        if pid == 0:
+            return
+        children.discard(pid)
+
+
+def main():
+    token = os.environ.pop(_IPC_FILE_VAR)
+    preload = [m for m in os.environ.pop(_PRELOAD_VAR, "").split(",") if m]
+    grace = int(os.environ.pop(_GRACE_MS_VAR, "1000")) / 1000
+
+    # Connect before preloading, so that the launcher sees a failed import as
+    # the zygote hanging up rather than as a timeout.
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+    sock.connect(token)
+
+    # Resolve preloads from the working directory, like 'python -m' does.
+    sys.path[0] = os.getcwd()
+    for module in preload:
+        importlib.import_module(module)
+    _send(sock, READY)
+
+    children = set()
+    while True:
+        data = sock.recv(_SIZE)
+        if not data:
+            break
+        code, request_id, pid, argc, raw = struct.unpack(_FORMAT, data)
+        _reap_exited(children)
+        if code == FORK:
+            args = [a.decode() for a in raw.split(b"\0")[:argc]]
+            pid = _fork(sock, args)
+            if pid > 0:
+                children.add(pid)
+            _send(sock, FORKED if pid > 0 else FORK_FAILED, request_id, pid)
+        elif code == KILL:
+            _kill(pid, grace)
+            children.discard(pid)
+            _send(sock, KILLED, request_id, pid)
+
+    # The launcher's hung up, so take our apps down with us.
+    for pid in children:
+        _kill(pid, grace)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,42 @@
+// Minimal "--name=value" flag parsing for our benchmark binaries.
+
+#ifndef BENCH_FLAGS_H_
+#define BENCH_FLAGS_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+// If 'arg' has the form "--{name}={value}", returns a pointer to 'value'.
+// Otherwise returns nullptr.
+inline const char* flag_value(const char* arg, const char* name) {
+  if (strncmp(arg, "--", 2) != 0) return nullptr;
+  arg += 2;
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') return nullptr;
+  return arg + len + 1;
+}
+
+inline bool parse_flag(const char* arg, const char* name, int* out) {
+  const char* v = flag_value(arg, name);
+  if (!v) return false;
+  *out = atoi(v);
+  return true;
+}
+
+inline bool parse_flag(const char* arg, const char* name, double* out) {
+  const char* v = flag_value(arg, name);
+  if (!v) return false;
+  *out = atof(v);
+  return true;
+}
+
+inline bool parse_flag(const char* arg, const char* name, std::string* out) {
+  const char* v = flag_value(arg, name);
+  if (!v) return false;
+  *out = v;
+  return true;
+}
+
+#endif  // BENCH_FLAGS_H_
@@ -0,0 +1,135 @@
+// A synthetic animated app that loads the compositor like a game does.
+//
+// Usage: load_app [--fps=60] [--width=800] [--height=600] [--damage=1.0]
+//
+// Each frame, load_app redraws a band of 'damage' * height rows with a
+// pattern that changes every frame and presents just that band. The band
+// scrolls down the window, so over several frames the whole window changes.
+//
+// Rendering is done on the CPU into SDL's window surface, so load_app needs
+// no GPU and no licensed software, just SDL2.
+
+#include <SDL.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "bench/flags.h"
+
+namespace {
+struct Conf {
+  int fps = 60;
+  int width = 800;
+  int height = 600;
+  double damage = 1.0;
+};
+
+// Fills rows [y0, y1) of 'surface' with a pattern that depends on 'frame'.
+void draw_rows(SDL_Surface* surface, int y0, int y1, uint32_t frame) {
+  for (int y = y0; y < y1; ++y) {
+    uint32_t* row =
+        (uint32_t*)((uint8_t*)surface->pixels + (size_t)y * surface->pitch);
+    for (int x = 0; x < surface->w; ++x) {
+      uint32_t r = (x + frame * 3) & 0xff;
+      uint32_t g = (y + frame * 2) & 0xff;
+      uint32_t b = ((x ^ y) + frame) & 0xff;
+      row[x] = 0xff000000 | (r << 16) | (g << 8) | b;
+    }
+  }
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Conf conf;
+  for (int i = 1; i < argc; ++i) {
+    if (parse_flag(argv[i], "fps", &conf.fps)) continue;
+    if (parse_flag(argv[i], "width", &conf.width)) continue;
+    if (parse_flag(argv[i], "height", &conf.height)) continue;
+    if (parse_flag(argv[i], "damage", &conf.damage)) continue;
+    fprintf(stderr,
+            "Usage: %s [--fps=60] [--width=800] [--height=600] "
+            "[--damage=1.0]\n",
+            argv[0]);
+    return 1;
+  }
+  if (conf.fps <= 0 || conf.width <= 0 || conf.height <= 0 ||
+      conf.damage <= 0 || conf.damage > 1) {
+    fprintf(stderr, "load_app: fps, width, height, and damage must be "
+                    "positive and damage must be at most 1.\n");
+    return 1;
+  }
+
+  // Keep SDL from backing the window surface with a GL texture.
+  SDL_SetHint(SDL_HINT_FRAMEBUFFER_ACCELERATION, "0");
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+    return 1;
+  }
+  SDL_Window* window =
+      SDL_CreateWindow("load_app", SDL_WINDOWPOS_UNDEFINED,
+                       SDL_WINDOWPOS_UNDEFINED, conf.width, conf.height,
+                       SDL_WINDOW_SHOWN | SDL_WINDOW_BORDERLESS);
+  if (!window) {
+    fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
+    SDL_Quit();
+    return 1;
+  }
+
+  const auto frame_time = std::chrono::nanoseconds(1'000'000'000 / conf.fps);
+  auto next_frame = std::chrono::steady_clock::now();
+  uint32_t frame = 0;
+  int band_y = 0;
+  bool quit = false;
+  while (!quit) {
+    SDL_Event e;
+    while (SDL_PollEvent(&e)) {
+      if (e.type == SDL_QUIT) quit = true;
+    }
+
+    // The window surface is invalidated by resizes, so we fetch it per frame.
+    SDL_Surface* surface = SDL_GetWindowSurface(window);
+    if (!surface || surface->format->BytesPerPixel != 4) {
+      fprintf(stderr, "load_app needs a 32-bit window surface: %s\n",
+              SDL_GetError());
+      break;
+    }
+    const int h = surface->h;
+    const int rows = std::clamp((int)(conf.damage * h), 1, h);
+    band_y %= h;
+
+    // The band may wrap around the bottom of the window, in which case we
+    // present it as two rects.
+    SDL_Rect rects[2];
+    int num_rects = 0;
+    SDL_LockSurface(surface);
+    int y = band_y;
+    int remaining = rows;
+    while (remaining > 0) {
+      int n = std::min(remaining, h - y);
+      draw_rows(surface, y, y + n, frame);
+      rects[num_rects++] = SDL_Rect{.x = 0, .y = y, .w = surface->w, .h = n};
+      remaining -= n;
+      y = 0;
+    }
+    SDL_UnlockSurface(surface);
+    SDL_UpdateWindowSurfaceRects(window, rects, num_rects);
+
+    band_y += rows;
+    frame++;
+    next_frame += frame_time;
+    auto now = std::chrono::steady_clock::now();
+    if (next_frame > now) {
+      std::this_thread::sleep_until(next_frame);
+    } else {
+      // Don't try to catch up on frames we've fallen behind on.
+      next_frame = now;
+    }
+  }
+
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include "bench/proc_stats.h"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+std::vector<int> get_children(int pid) {
+  std::vector<int> children;
+  std::error_code error;
+  std::filesystem::path task_dir =
+      std::filesystem::path("/proc") / std::to_string(pid) / "task";
+  for (const auto& entry :
+       std::filesystem::directory_iterator(task_dir, error)) {
+    std::ifstream in(entry.path() / "children");
+    int child;
+    while (in >> child) {
+      children.push_back(child);
+    }
+  }
+  return children;
+}
+
+// Reads utime + stime in clock ticks from /proc/<pid>/stat.
+bool read_cpu_ticks(int pid, int64_t* ticks) {
+  std::ifstream in("/proc/" + std::to_string(pid) + "/stat");
+  std::string stat;
+  if (!std::getline(in, stat)) return false;
+
+  // The command name field can contain spaces, so skip past its closing
+  // paren before splitting the remaining fields.
+  size_t comm_end = stat.rfind(')');
+  if (comm_end == std::string::npos) return false;
+  std::istringstream fields(stat.substr(comm_end + 2));
+
+  // Fields are numbered from 1 with 'state' at 3. utime and stime are 14
+  // and 15.
+  std::string field;
+  for (int i = 3; i < 14; ++i) {
+    if (!(fields >> field)) return false;
+  }
+  int64_t utime, stime;
+  if (!(fields >> utime >> stime)) return false;
+  *ticks = utime + stime;
+  return true;
+}
+
+bool read_rss_pages(int pid, int64_t* pages) {
+  std::ifstream in("/proc/" + std::to_string(pid) + "/statm");
+  int64_t size;
+  return (bool)(in >> size >> *pages);
+}
+}  // namespace
+
+std::vector<int> get_proc_tree(int pid) {
+  std::vector<int> tree = {pid};
+  for (size_t i = 0; i < tree.size(); ++i) {
+    std::vector<int> children = get_children(tree[i]);
+    tree.insert(tree.end(), children.begin(), children.end());
+  }
+  return tree;
+}
+
+ProcTreeStats get_proc_tree_stats(const std::vector<int>& root_pids) {
+  static const double kTicksPerSecond = sysconf(_SC_CLK_TCK);
+  static const int64_t kPageSize = sysconf(_SC_PAGESIZE);
+
+  ProcTreeStats stats;
+  for (int root : root_pids) {
+    if (root <= 0) continue;
+    for (int pid : get_proc_tree(root)) {
+      int64_t ticks, pages;
+      if (!read_cpu_ticks(pid, &ticks) || !read_rss_pages(pid, &pages)) {
+        continue;
+      }
+      stats.num_processes++;
+      stats.cpu_seconds += ticks / kTicksPerSecond;
+      stats.rss_bytes += pages * kPageSize;
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,21 @@
+#ifndef BENCH_PROC_STATS_H_
+#define BENCH_PROC_STATS_H_
+
+#include <cstdint>
+#include <vector>
+
+struct ProcTreeStats {
+  int num_processes = 0;
+  // User plus system CPU time.
+  double cpu_seconds = 0;
+  int64_t rss_bytes = 0;
+};
+
+// Returns 'pid' and all of its living descendants.
+std::vector<int> get_proc_tree(int pid);
+
+// Sums CPU time and resident memory over the given processes' trees. Processes
+// that exit while we're reading /proc are skipped.
+ProcTreeStats get_proc_tree_stats(const std::vector<int>& root_pids);
+
+#endif  // BENCH_PROC_STATS_H_
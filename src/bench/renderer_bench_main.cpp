@@ -0,0 +1,173 @@
+// Compares Weston's renderers by the CPU they spend per captured frame and by
+// get_frame() latency, at several resolutions.
+//
+// Usage: renderer_bench [--renderers=pixman,gl] [--sizes=640x480,1280x720,
+//                       1920x1080] [--seconds=10] [--fps=60] [--damage=1.0]
+//
+// For each renderer and size, we start a WestonBackend running load_app, let it
+// reach a steady state, and then call get_frame() in a loop for 'seconds'. CPU
+// covers Weston's process tree (Weston, Xwayland, export_display) plus the
+// app's, and is reported per frame the client captured. Use this to check
+// renderer resolution's AUTO choice on a new kind of machine: without a GPU,
+// GL renders through llvmpipe.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench/flags.h"
+#include "bench/proc_stats.h"
+#include "desktop/client.h"
+#include "desktop/weston_backend.h"
+#include "paths.h"
+#include "third_party/status/status_or.h"
+#include "time_aliases.h"
+#include "weston/launch_weston.h"
+
+namespace {
+struct Conf {
+  std::string renderers = "pixman,gl";
+  std::string sizes = "640x480,1280x720,1920x1080";
+  int seconds = 10;
+  int fps = 60;
+  double damage = 1.0;
+};
+
+struct Size {
+  int width = 0;
+  int height = 0;
+};
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep)) {
+    if (!part.empty()) parts.push_back(part);
+  }
+  return parts;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(sc_now() - start).count();
+}
+
+// Returns the 'p'th percentile of the sorted 'values'.
+double percentile(const std::vector<double>& values, double p) {
+  if (values.empty()) return 0;
+  size_t i = std::min(values.size() - 1, (size_t)(p * values.size()));
+  return values[i];
+}
+
+void run(const Conf& conf, Renderer renderer, Size size) {
+  std::vector<std::string> command = {
+      get_load_app_path(),
+      std::format("--fps={}", conf.fps),
+      std::format("--width={}", size.width),
+      std::format("--height={}", size.height),
+      std::format("--damage={}", conf.damage),
+  };
+  BackendOptions options;
+  options.weston.renderer = renderer;
+
+  auto start = sc_now();
+  std::unique_ptr<WestonBackend> backend =
+      WestonBackend::start_server(/*port_offset=*/5900, size.width,
+                                  size.height, command,
+                                  ProcessOutConf{
+                                      .stdout = StreamOutConf::DevNull(),
+                                      .stderr = StreamOutConf::DevNull(),
+                                  },
+                                  options)
+          .value_or_die();
+  std::unique_ptr<BounceDeskClient> client =
+      BounceDeskClient::connect(backend->port()).value_or_die();
+  client->get_frame();
+  double startup_s = seconds_since(start);
+
+  // Let the app reach a steady state before measuring.
+  sleep_for(1s);
+
+  std::vector<int> pids = {backend->weston_pid(), backend->app_pid()};
+  ProcTreeStats start_stats = get_proc_tree_stats(pids);
+  std::vector<double> latencies_ms;
+  start = sc_now();
+  const auto duration = std::chrono::seconds(conf.seconds);
+  while (sc_now() - start < duration) {
+    auto frame_start = sc_now();
+    client->get_frame();
+    latencies_ms.push_back(seconds_since(frame_start) * 1000);
+  }
+  double elapsed = seconds_since(start);
+  ProcTreeStats end_stats = get_proc_tree_stats(pids);
+
+  std::sort(latencies_ms.begin(), latencies_ms.end());
+  double mean_ms = 0;
+  for (double l : latencies_ms) mean_ms += l;
+  mean_ms /= std::max<size_t>(latencies_ms.size(), 1);
+  double cpu_s = end_stats.cpu_seconds - start_stats.cpu_seconds;
+  int frames = latencies_ms.size();
+  printf(
+      "renderer: %s, size: %dx%d, startup: %.3f s, fps: %.1f, cpu: %.1f%%, "
+      "cpu/frame: %.2f ms, latency mean: %.2f ms, p50: %.2f ms, p99: %.2f "
+      "ms\n",
+      renderer_name(renderer), size.width, size.height, startup_s,
+      frames / elapsed, cpu_s / elapsed * 100,
+      cpu_s * 1000 / std::max(frames, 1), mean_ms,
+      percentile(latencies_ms, 0.5), percentile(latencies_ms, 0.99));
+  fflush(stdout);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Conf conf;
+  for (int i = 1; i < argc; ++i) {
+    if (parse_flag(argv[i], "renderers", &conf.renderers)) continue;
+    if (parse_flag(argv[i], "sizes", &conf.sizes)) continue;
+    if (parse_flag(argv[i], "seconds", &conf.seconds)) continue;
+    if (parse_flag(argv[i], "fps", &conf.fps)) continue;
+    if (parse_flag(argv[i], "damage", &conf.damage)) continue;
+    fprintf(stderr,
+            "Usage: %s [--renderers=pixman,gl] "
+            "[--sizes=640x480,1280x720,1920x1080] [--seconds=10] [--fps=60] "
+            "[--damage=1.0]\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::vector<Renderer> renderers;
+  for (const std::string& name : split(conf.renderers, ',')) {
+    StatusOr<Renderer> r = parse_renderer(name);
+    if (!r.ok()) {
+      fprintf(stderr, "%s\n", r.status().to_string().c_str());
+      return 1;
+    }
+    renderers.push_back(r.value());
+  }
+  std::vector<Size> sizes;
+  for (const std::string& s : split(conf.sizes, ',')) {
+    Size size;
+    if (sscanf(s.c_str(), "%dx%d", &size.width, &size.height) != 2 ||
+        size.width <= 0 || size.height <= 0) {
+      fprintf(stderr, "Invalid size: \"%s\". Expected WIDTHxHEIGHT.\n",
+              s.c_str());
+      return 1;
+    }
+    sizes.push_back(size);
+  }
+
+  printf("auto resolves to: %s\n",
+         renderer_name(resolve_renderer(Renderer::AUTO)));
+  for (Renderer renderer : renderers) {
+    for (Size size : sizes) {
+      run(conf, renderer, size);
+    }
+  }
+  return 0;
+}
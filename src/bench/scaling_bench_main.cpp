@@ -0,0 +1,225 @@
+// Starts increasing numbers of desktops running load_app and reports how
+// startup time, captured FPS, CPU, memory, and teardown time scale with the
+// desktop count.
+//
+// Usage: scaling_bench [--max_desktops=8] [--seconds=10] [--fps=60]
+//                      [--width=800] [--height=600] [--damage=1.0]
+//                      [--renderer=auto] [--xwayland=1]
+//
+// For each power of two N up to max_desktops, we start N WestonBackends,
+// connect a client to each, and then round-robin get_frame() calls across the
+// clients for 'seconds'. Per-desktop CPU and RSS cover Weston's process tree (Weston,
+// Xwayland, export_display) plus the app's process tree. Startup's broken
+// down into the phases of each desktop's StartupProfile.
+//
+// Note: This runs multiple clients in one process, which is still experimental
+// (see readme.md), so the clients are connected with 'allow_unsafe' set.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench/flags.h"
+#include "bench/proc_stats.h"
+#include "desktop/client.h"
+#include "desktop/weston_backend.h"
+#include "paths.h"
+#include "third_party/status/status_or.h"
+#include "time_aliases.h"
+#include "weston/launch_weston.h"
+#include "weston/startup_profile.h"
+
+namespace {
+struct Conf {
+  int max_desktops = 8;
+  int seconds = 10;
+  int fps = 60;
+  int width = 800;
+  int height = 600;
+  double damage = 1.0;
+  Renderer renderer = Renderer::AUTO;
+  // 0 starts the desktops without Xwayland, which only suits Wayland-native
+  // apps like load_app.
+  int xwayland = 1;
+};
+
+struct BenchDesktop {
+  // Declared before 'client' so that clients disconnect before their
+  // backends exit.
+  std::unique_ptr<WestonBackend> backend;
+  std::unique_ptr<BounceDeskClient> client;
+  double startup_s = 0;
+  StartupProfile profile;
+  int frames = 0;
+  ProcTreeStats start_stats;
+  ProcTreeStats end_stats;
+
+  std::vector<int> pids() const {
+    return {backend->weston_pid(), backend->app_pid()};
+  }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(sc_now() - start).count();
+}
+
+void run(const Conf& conf, int n) {
+  std::vector<std::string> command = {
+      get_load_app_path(),
+      std::format("--fps={}", conf.fps),
+      std::format("--width={}", conf.width),
+      std::format("--height={}", conf.height),
+      std::format("--damage={}", conf.damage),
+  };
+
+  BackendOptions options;
+  options.weston.renderer = conf.renderer;
+  options.weston.xwayland = conf.xwayland != 0;
+
+  std::vector<BenchDesktop> desktops(n);
+  for (BenchDesktop& d : desktops) {
+    auto start = sc_now();
+    d.backend = std::move(WestonBackend::start_server(
+                              /*port_offset=*/5900, conf.width, conf.height,
+                              command, ProcessOutConf{
+                                           .stdout = StreamOutConf::DevNull(),
+                                           .stderr = StreamOutConf::DevNull(),
+                                       },
+                              options)
+                              .value_or_die());
+    StartupProfile client_phases;
+    auto phase_start = sc_now();
+    d.client = std::move(
+        BounceDeskClient::connect(d.backend->port(), /*allow_unsafe=*/true)
+            .value_or_die());
+    phase_start = client_phases.add("connect", phase_start);
+    d.client->get_frame();
+    client_phases.add("first_frame", phase_start);
+    d.startup_s = seconds_since(start);
+    // Xwayland warms up in the background, so it doesn't count toward the
+    // desktop's startup.
+    StatusVal s = d.backend->wait_for_xwayland(5s);
+    if (!s.ok()) fprintf(stderr, "%s\n", s.to_string().c_str());
+    d.profile = d.backend->startup_profile();
+    d.profile.append(client_phases);
+  }
+
+  // Let the apps reach a steady state before measuring.
+  sleep_for(1s);
+
+  for (BenchDesktop& d : desktops) {
+    d.start_stats = get_proc_tree_stats(d.pids());
+  }
+  auto start = sc_now();
+  const auto duration = std::chrono::seconds(conf.seconds);
+  while (sc_now() - start < duration) {
+    for (BenchDesktop& d : desktops) {
+      d.client->get_frame();
+      d.frames++;
+    }
+  }
+  double elapsed = seconds_since(start);
+  for (BenchDesktop& d : desktops) {
+    d.end_stats = get_proc_tree_stats(d.pids());
+  }
+
+  int frames = 0;
+  double startup_s = 0;
+  double max_startup_s = 0;
+  // Each startup phase's mean and max time over the desktops, in the order
+  // the phases first ran.
+  std::vector<std::string> phase_names;
+  std::map<std::string, double> phase_total_s;
+  std::map<std::string, double> phase_max_s;
+  int port_retries = 0;
+  for (size_t i = 0; i < desktops.size(); ++i) {
+    const BenchDesktop& d = desktops[i];
+    double cpu = (d.end_stats.cpu_seconds - d.start_stats.cpu_seconds) /
+                 elapsed * 100;
+    std::string xwayland = "none";
+    if (d.profile.xwayland_s) {
+      xwayland = std::format("{:.3f} s", d.profile.xwayland_s);
+    }
+    printf(
+        "  desktop %zu: startup %.3f s, xwayland %s, %.1f fps, cpu %.1f%%, "
+        "rss %.1f MiB, %d processes\n",
+        i, d.startup_s, xwayland.c_str(), d.frames / elapsed, cpu,
+        d.end_stats.rss_bytes / (1024.0 * 1024.0), d.end_stats.num_processes);
+    frames += d.frames;
+    startup_s += d.startup_s;
+    max_startup_s = std::max(max_startup_s, d.startup_s);
+    for (const StartupPhase& phase : d.profile.phases) {
+      if (std::find(phase_names.begin(), phase_names.end(), phase.name) ==
+          phase_names.end()) {
+        phase_names.push_back(phase.name);
+      }
+    }
+    for (const auto& [name, s] : d.profile.totals()) {
+      phase_total_s[name] += s;
+      phase_max_s[name] = std::max(phase_max_s[name], s);
+    }
+    port_retries += d.profile.port_retries;
+  }
+  printf("  startup phases (mean / max), %d port retries:\n", port_retries);
+  for (const std::string& name : phase_names) {
+    printf("    %-14s %.3f s / %.3f s\n", name.c_str(),
+           phase_total_s[name] / n, phase_max_s[name]);
+  }
+
+  // Tear the desktops down one at a time to measure per-desktop teardown.
+  double teardown_s = 0;
+  double max_teardown_s = 0;
+  for (BenchDesktop& d : desktops) {
+    auto teardown_start = sc_now();
+    d.client.reset();
+    d.backend.reset();
+    double s = seconds_since(teardown_start);
+    teardown_s += s;
+    max_teardown_s = std::max(max_teardown_s, s);
+  }
+  printf(
+      "desktops: %d, aggregate fps: %.1f, mean startup: %.3f s, max startup: "
+      "%.3f s, mean teardown: %.3f s, max teardown: %.3f s\n",
+      n, frames / elapsed, startup_s / n, max_startup_s, teardown_s / n,
+      max_teardown_s);
+  fflush(stdout);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Conf conf;
+  std::string renderer = "auto";
+  for (int i = 1; i < argc; ++i) {
+    if (parse_flag(argv[i], "max_desktops", &conf.max_desktops)) continue;
+    if (parse_flag(argv[i], "seconds", &conf.seconds)) continue;
+    if (parse_flag(argv[i], "fps", &conf.fps)) continue;
+    if (parse_flag(argv[i], "width", &conf.width)) continue;
+    if (parse_flag(argv[i], "height", &conf.height)) continue;
+    if (parse_flag(argv[i], "damage", &conf.damage)) continue;
+    if (parse_flag(argv[i], "renderer", &renderer)) continue;
+    if (parse_flag(argv[i], "xwayland", &conf.xwayland)) continue;
+    fprintf(stderr,
+            "Usage: %s [--max_desktops=8] [--seconds=10] [--fps=60] "
+            "[--width=800] [--height=600] [--damage=1.0] [--renderer=auto] "
+            "[--xwayland=1]\n",
+            argv[0]);
+    return 1;
+  }
+  StatusOr<Renderer> r = parse_renderer(renderer);
+  if (!r.ok()) {
+    fprintf(stderr, "%s\n", r.status().to_string().c_str());
+    return 1;
+  }
+  conf.renderer = r.value();
+
+  for (int n = 1; n <= conf.max_desktops; n *= 2) {
+    run(conf, n);
+  }
+  return 0;
+}
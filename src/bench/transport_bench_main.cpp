@@ -0,0 +1,73 @@
+// Compares VNC frame throughput over TCP loopback and over a Unix
+// socketpair.
+//
+// Usage: transport_bench [--seconds=5]
+//
+// Frames are served by MockVncServer, which sends its whole 300x200
+// framebuffer for each get_frame() call, so the results mostly reflect
+// transport and protocol overhead rather than compositor costs.
+
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "bench/flags.h"
+#include "desktop/client.h"
+#include "third_party/status/status_or.h"
+#include "time_aliases.h"
+#include "vnc_test/mock_vnc_server.h"
+
+namespace {
+const int kTcpPort = 5990;
+const int kUdsPort = 5991;
+
+void run(const std::string& name, BounceDeskClient* client, int seconds) {
+  // Warm up.
+  for (int i = 0; i < 10; ++i) client->get_frame();
+
+  int frames = 0;
+  size_t bytes = 0;
+  auto start = sc_now();
+  const auto duration = std::chrono::seconds(seconds);
+  while (sc_now() - start < duration) {
+    Frame f = client->get_frame();
+    bytes += 4 * f.width * f.height;
+    frames++;
+  }
+  double elapsed = std::chrono::duration<double>(sc_now() - start).count();
+  printf("%s: %.1f fps, %.1f MiB/s, %.3f ms/frame\n", name.c_str(),
+         frames / elapsed, bytes / elapsed / (1024.0 * 1024.0),
+         elapsed * 1000 / frames);
+  fflush(stdout);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int seconds = 5;
+  for (int i = 1; i < argc; ++i) {
+    if (parse_flag(argv[i], "seconds", &seconds)) continue;
+    fprintf(stderr, "Usage: %s [--seconds=5]\n", argv[0]);
+    return 1;
+  }
+
+  {
+    auto server = MockVncServer::start_server(kTcpPort).value_or_die();
+    auto client = BounceDeskClient::connect(kTcpPort).value_or_die();
+    run("tcp", client.get(), seconds);
+  }
+
+  {
+    // Listens on a port too, but the client only uses the socketpair.
+    auto server = MockVncServer::start_server(kUdsPort).value_or_die();
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+    server->add_client(Fd::take(fds[0]));
+    auto client =
+        BounceDeskClient::connect_fd(Fd::take(fds[1])).value_or_die();
+    run("unix", client.get(), seconds);
+  }
+  return 0;
+}
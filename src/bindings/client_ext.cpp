@@ -4,38 +4,361 @@
 
 #include <nanobind/nanobind.h>
 #include <nanobind/ndarray.h>
+#include <nanobind/stl/map.h>
+#include <nanobind/stl/optional.h>
 #include <nanobind/stl/string.h>
 #include <nanobind/stl/unique_ptr.h>
 #include <nanobind/stl/vector.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "bindings/trajectory_ext.h"
 #include "desktop/frame.h"
 #include "third_party/status/exceptions.h"
 
 namespace nb = nanobind;
 
+namespace {
+const int32_t kPortOffset = 5900;
+
+struct Pool {
+  // Shared, so that create() can claim from the pool outside of 'pools_mu'
+  // while the pool's replaced or disabled.
+  std::shared_ptr<WestonPool> sessions = nullptr;
+  // The options the sessions were started with, which create() has to ask
+  // for to use them.
+  std::optional<CgroupLimits> limits;
+  int cpus_per_desktop = 0;
+  std::string renderer;
+};
+
+std::mutex pools_mu;
+// Pools keyed by (width, height).
+std::map<std::pair<int32_t, int32_t>, Pool> pools;
+
+std::mutex logs_mu;
+LogOptions log_options;
+
+// Returns the options for new backends. All backends share one log collector,
+// which is never destroyed since pools and desktops can outlive any other
+// owner.
+BackendOptions backend_options(const std::optional<CgroupLimits>& limits,
+                               int cpus_per_desktop,
+                               const std::string& renderer,
+                               bool virtual_clock = false,
+                               bool xwayland = true) {
+  static LogCollector* collector =
+      LogCollector::create().value_or_die().release();
+  static CpuAllocator* cpu_allocator = new CpuAllocator();
+  BackendOptions options;
+  options.log_collector = collector;
+  options.cgroup = limits;
+  // Every backend shares the allocator, so that pin() never overlaps another
+  // desktop's CPUs, even for desktops created without 'cpus_per_desktop'.
+  options.cpu_allocator = cpu_allocator;
+  options.cpus_per_session = cpus_per_desktop;
+  ASSIGN_OR_RAISE(options.weston.renderer, parse_renderer(renderer));
+  options.virtual_clock = virtual_clock;
+  options.weston.xwayland = xwayland;
+  std::lock_guard l(logs_mu);
+  options.logs = log_options;
+  return options;
+}
+}  // namespace
+
 std::unique_ptr<Desktop> Desktop::create(
-    int32_t width, int32_t height, const std::vector<std::string>& command) {
-  ASSIGN_OR_RAISE(auto backend,
-                  WestonBackend::start_server(
-                      /*port_offset=*/5900, width, height, command));
+    int32_t width, int32_t height, const std::vector<std::string>& command,
+    const std::optional<CgroupLimits>& limits, int cpus_per_desktop,
+    const std::string& renderer, bool virtual_clock, bool xwayland) {
+  auto start = std::chrono::steady_clock::now();
+  StartupProfile profile;
+  std::unique_ptr<WestonBackend> backend;
+  std::shared_ptr<WestonPool> pool;
+  if (!virtual_clock && xwayland) {
+    std::lock_guard l(pools_mu);
+    auto it = pools.find({width, height});
+    if (it != pools.end() && it->second.limits == limits &&
+        it->second.cpus_per_desktop == cpus_per_desktop &&
+        it->second.renderer == renderer) {
+      pool = it->second.sessions;
+    }
+  }
+  // Claimed outside of the lock, since an empty pool starts a session
+  // synchronously, which mustn't hold up other desktops' creation.
+  if (pool) {
+    ASSIGN_OR_RAISE(backend, pool->claim());
+    // If the pool was disabled meanwhile, it shuts down here.
+    pool.reset();
+  }
+
+  if (backend) {
+    start = profile.add("claim_session", start);
+    RAISE_IF_ERROR(backend->launch_app(command));
+    start = profile.add("launch_app", start);
+  } else {
+    ASSIGN_OR_RAISE(backend, WestonBackend::start_server(
+                                 kPortOffset, width, height, command,
+                                 ProcessOutConf(),
+                                 backend_options(limits, cpus_per_desktop,
+                                                 renderer, virtual_clock,
+                                                 xwayland)));
+    profile = backend->startup_profile();
+    start = std::chrono::steady_clock::now();
+  }
   auto desktop = std::unique_ptr<Desktop>(new Desktop());
   desktop->backend_ = std::move(backend);
   RAISE_IF_ERROR(desktop->connect_impl(desktop->backend_->port()));
+  desktop->connected_at_ = profile.add("connect", start);
+  desktop->profile_ = std::move(profile);
+  if (!desktop->backend_->cpus().empty()) {
+    RAISE_IF_ERROR(desktop->pin_loop(desktop->backend_->cpus()));
+  }
   return desktop;
 }
 
+void Desktop::reset(const std::vector<std::string>& command, bool use_zygote,
+                    const std::vector<std::string>& preload) {
+  if (!use_zygote) {
+    RAISE_IF_ERROR(backend_->restart_app(command));
+    return;
+  }
+  ZygoteOptions options{.preload = preload};
+  RAISE_IF_ERROR(
+      backend_->restart_app(command, ProcessOutConf(), &options));
+}
+
+void Desktop::enable_pool(int32_t width, int32_t height, int size,
+                          const std::optional<CgroupLimits>& limits,
+                          int cpus_per_desktop, const std::string& renderer) {
+  Pool pool = {.limits = limits,
+               .cpus_per_desktop = cpus_per_desktop,
+               .renderer = renderer};
+  ASSIGN_OR_RAISE(pool.sessions,
+                  WestonPool::create(
+                      kPortOffset, width, height, size,
+                      backend_options(limits, cpus_per_desktop, renderer)));
+  {
+    std::lock_guard l(pools_mu);
+    std::swap(pools[{width, height}], pool);
+  }
+  // Any replaced pool shuts down here, outside of the lock, unless create()
+  // is still claiming from it.
+}
+
+void Desktop::pin(const std::vector<int>& cpus) {
+  RAISE_IF_ERROR(backend_->pin(cpus));
+  RAISE_IF_ERROR(pin_loop(cpus.empty() ? allowed_cpus() : cpus));
+}
+
+StartupProfile Desktop::startup_profile() {
+  StartupProfile profile = profile_;
+  std::optional<std::chrono::steady_clock::time_point> first_update =
+      first_update_time();
+  if (first_update) {
+    profile.phases.push_back(StartupPhase{
+        .name = "first_frame",
+        .seconds = std::chrono::duration<double>(
+                       std::max(*first_update, connected_at_) - connected_at_)
+                       .count()});
+  }
+  return profile;
+}
+
+void Desktop::start_recording(const std::string& path,
+                              const std::string& compression,
+                              bool changed_tiles) {
+  if (recording_) {
+    raise_status(InvalidArgumentError("The desktop's already recording to " +
+                                      recording_->path() + "."));
+  }
+  RecorderOptions options{.changed_tiles = changed_tiles};
+  ASSIGN_OR_RAISE(options.compression, parse_compression(compression));
+  ASSIGN_OR_RAISE(recording_, TrajectoryRecorder::create(path, options));
+  set_recorder(recording_);
+}
+
+RecorderStats Desktop::stop_recording() {
+  if (!recording_) {
+    raise_status(InvalidArgumentError("The desktop isn't recording."));
+  }
+  set_recorder(nullptr);
+  // Frames and events that are still being recorded hold their own
+  // references, and fail with ABORTED once it's closed.
+  std::shared_ptr<TrajectoryRecorder> recorder = std::move(recording_);
+  RAISE_IF_ERROR(recorder->close());
+  return recorder->stats();
+}
+
+VirtualClock* Desktop::clock() const {
+  if (!backend_->clock()) {
+    raise_status(InvalidArgumentError(
+        "The desktop wasn't created with virtual_clock=True."));
+  }
+  return backend_->clock();
+}
+
+void Desktop::set_time_speed(double speed) {
+  RAISE_IF_ERROR(clock()->set_speed(speed));
+}
+
+double Desktop::time_speed() const { return clock()->speed(); }
+
+void Desktop::advance_time(double seconds) {
+  RAISE_IF_ERROR(clock()->advance(std::chrono::nanoseconds(
+      (int64_t)std::llround(seconds * 1e9))));
+}
+
+double Desktop::virtual_time() const {
+  return std::chrono::duration<double>(clock()->now()).count();
+}
+
+CgroupUsage Desktop::resource_usage() const {
+  ASSIGN_OR_RAISE(CgroupUsage usage, backend_->resource_usage());
+  return usage;
+}
+
+void Desktop::configure_logs(size_t ring_bytes, const std::string& log_dir,
+                             size_t max_file_bytes, int max_files) {
+  std::lock_guard l(logs_mu);
+  log_options = LogOptions{.ring_bytes = ring_bytes,
+                           .dir = log_dir,
+                           .max_file_bytes = max_file_bytes,
+                           .max_files = max_files};
+}
+
+void Desktop::disable_pool(int32_t width, int32_t height) {
+  std::shared_ptr<WestonPool> pool;
+  {
+    std::lock_guard l(pools_mu);
+    auto it = pools.find({width, height});
+    if (it == pools.end()) return;
+    pool = std::move(it->second.sessions);
+    pools.erase(it);
+  }
+}
+
 NB_MODULE(_core, m) {
   nb::module_::import_("numpy");
 
+  nb::class_<TeardownStats>(m, "TeardownStats")
+      .def_ro("count", &TeardownStats::count)
+      .def_ro("last_s", &TeardownStats::last_s)
+      .def_ro("total_s", &TeardownStats::total_s)
+      .def_ro("max_s", &TeardownStats::max_s);
+
+  nb::class_<StartupPhase>(m, "StartupPhase")
+      .def_ro("name", &StartupPhase::name)
+      .def_ro("seconds", &StartupPhase::seconds);
+
+  nb::class_<StartupProfile>(m, "StartupProfile")
+      .def_ro("phases", &StartupProfile::phases)
+      .def_ro("port_retries", &StartupProfile::port_retries)
+      .def("total_s", &StartupProfile::total_s)
+      .def("totals", &StartupProfile::totals);
+
+  bind_trajectory(m);
+
+  nb::class_<RecorderStats>(m, "RecorderStats")
+      .def_ro("frames", &RecorderStats::frames)
+      .def_ro("events", &RecorderStats::events)
+      .def_ro("chunks", &RecorderStats::chunks)
+      .def_ro("raw_bytes", &RecorderStats::raw_bytes)
+      .def_ro("stored_bytes", &RecorderStats::stored_bytes)
+      .def_ro("stall_s", &RecorderStats::stall_s);
+
+  nb::class_<CgroupLimits>(m, "CgroupLimits")
+      .def(
+          "__init__",
+          [](CgroupLimits* l, int cpu_weight, double cpu_quota,
+             int64_t memory_max, int64_t pids_max) {
+            new (l) CgroupLimits{.cpu_weight = cpu_weight,
+                                 .cpu_quota = cpu_quota,
+                                 .memory_max = memory_max,
+                                 .pids_max = pids_max};
+          },
+          nb::arg("cpu_weight") = 0, nb::arg("cpu_quota") = 0.0,
+          nb::arg("memory_max") = 0, nb::arg("pids_max") = 0)
+      .def_rw("cpu_weight", &CgroupLimits::cpu_weight)
+      .def_rw("cpu_quota", &CgroupLimits::cpu_quota)
+      .def_rw("memory_max", &CgroupLimits::memory_max)
+      .def_rw("pids_max", &CgroupLimits::pids_max);
+
+  nb::class_<Pressure>(m, "Pressure")
+      .def_ro("some_avg10", &Pressure::some_avg10)
+      .def_ro("some_avg60", &Pressure::some_avg60)
+      .def_ro("full_avg10", &Pressure::full_avg10)
+      .def_ro("full_avg60", &Pressure::full_avg60)
+      .def_ro("some_total_us", &Pressure::some_total_us)
+      .def_ro("full_total_us", &Pressure::full_total_us);
+
+  nb::class_<CgroupUsage>(m, "ResourceUsage")
+      .def_ro("cpu_usage_us", &CgroupUsage::cpu_usage_us)
+      .def_ro("cpu_user_us", &CgroupUsage::cpu_user_us)
+      .def_ro("cpu_system_us", &CgroupUsage::cpu_system_us)
+      .def_ro("memory_current", &CgroupUsage::memory_current)
+      .def_ro("memory_peak", &CgroupUsage::memory_peak)
+      .def_ro("pids_current", &CgroupUsage::pids_current)
+      .def_ro("cpu_pressure", &CgroupUsage::cpu_pressure)
+      .def_ro("memory_pressure", &CgroupUsage::memory_pressure)
+      .def_ro("io_pressure", &CgroupUsage::io_pressure);
+
   nb::class_<Desktop>(m, "Desktop")
-      .def("create", &Desktop::create)
+      .def_static("create", &Desktop::create, nb::arg("width"),
+                  nb::arg("height"), nb::arg("command"),
+                  nb::arg("limits") = nb::none(),
+                  nb::arg("cpus_per_desktop") = 0, nb::arg("renderer") = "auto",
+                  nb::arg("virtual_clock") = false, nb::arg("xwayland") = true)
+      .def_static("enable_pool", &Desktop::enable_pool, nb::arg("width"),
+                  nb::arg("height"), nb::arg("size") = 2,
+                  nb::arg("limits") = nb::none(),
+                  nb::arg("cpus_per_desktop") = 0, nb::arg("renderer") = "auto")
+      .def_static("disable_pool", &Desktop::disable_pool)
+      .def_static("configure_logs", &Desktop::configure_logs,
+                  nb::arg("ring_bytes") = LogOptions().ring_bytes,
+                  nb::arg("log_dir") = "",
+                  nb::arg("max_file_bytes") = LogOptions().max_file_bytes,
+                  nb::arg("max_files") = LogOptions().max_files)
+      .def("logs", &Desktop::logs)
+      .def("resource_usage", &Desktop::resource_usage)
+      .def("set_time_speed", &Desktop::set_time_speed, nb::arg("speed"))
+      .def("time_speed", &Desktop::time_speed)
+      .def("advance_time", &Desktop::advance_time, nb::arg("seconds"))
+      .def("virtual_time", &Desktop::virtual_time)
+      .def("pin", &Desktop::pin, nb::arg("cpus"))
+      .def("cpus", &Desktop::cpus)
+      .def("reset", &Desktop::reset, nb::arg("command"),
+           nb::arg("use_zygote") = false,
+           nb::arg("preload") = std::vector<std::string>())
+      .def("startup_profile", &Desktop::startup_profile)
+      .def("start_recording", &Desktop::start_recording, nb::arg("path"),
+           nb::arg("compression") = "none", nb::arg("changed_tiles") = false)
+      .def("stop_recording", &Desktop::stop_recording)
+      .def("teardown_stats", &Desktop::teardown_stats,
+           nb::rv_policy::reference_internal)
       .def("key_press", &Desktop::key_press)
       .def("key_release", &Desktop::key_release)
       .def("move_mouse", &Desktop::move_mouse)
       .def("mouse_press", &Desktop::mouse_press)
       .def("mouse_release", &Desktop::mouse_release)
-      .def("get_frame", [](Desktop& d) {
-        Frame f = d.get_frame();
+      .def("get_frame", [](Desktop& d, bool wait_for_new_commit,
+                           double timeout) {
+        Frame f;
+        {
+          // Lets other threads, e.g. ones driving other desktops, run while
+          // this one waits on the server.
+          nb::gil_scoped_release release;
+          if (wait_for_new_commit) {
+            ASSIGN_OR_RAISE(f, d.get_new_frame(std::chrono::milliseconds(
+                                   (int64_t)std::llround(timeout * 1000))));
+          } else {
+            f = d.get_frame();
+          }
+        }
 
         uint8_t* data = f.take_pixels().release();
         nb::capsule owner(data, [](void* p) noexcept { free((uint8_t*)p); });
@@ -43,5 +366,5 @@ NB_MODULE(_core, m) {
         return nb::ndarray<uint8_t, nb::numpy, nb::shape<-1, -1, 4>,
                            nb::c_contig>(
             data, {(uint32_t)f.width, (uint32_t)f.height, 4}, owner);
-      });
+      }, nb::arg("wait_for_new_commit") = false, nb::arg("timeout") = 3.0);
 }
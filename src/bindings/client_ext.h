@@ -1,26 +1,134 @@
 #ifndef BINDINGS_CLIENT_EXT_H_
 #define BINDINGS_CLIENT_EXT_H_
 
+#include <chrono>
+#include <map>
 #include <memory>
+#include <optional>
 
 #include "desktop/client.h"
 #include "third_party/status/status_or.h"
 #include "desktop/weston_backend.h"
+#include "desktop/weston_pool.h"
+#include "record/trajectory_recorder.h"
+#include "weston/startup_profile.h"
 
 class Desktop : public BounceDeskClient {
  public:
+  // Creates a desktop running 'command'. If a pool's enabled for the given
+  // resolution, the desktop uses one of the pool's warm Weston sessions.
+  //
+  // With 'limits', the desktop runs in a cgroup of its own with those limits.
+  // With 'cpus_per_desktop', the desktop's processes and this client's VNC
+  // thread are pinned to that many CPUs that no other desktop's pinned to,
+  // on a single NUMA node where possible. 'renderer' picks Weston's renderer:
+  // "gl", "pixman", or "auto", which uses GL only if the machine has a GPU
+  // render node. With 'virtual_clock', the app runs on a clock that
+  // set_time_speed() and advance_time() control. Without 'xwayland', the
+  // desktop only runs Wayland apps, but starts faster and uses less memory.
+  // A desktop only uses a pool that was enabled with the same 'limits',
+  // 'cpus_per_desktop', and 'renderer', and desktops with a virtual clock or
+  // without Xwayland never use one. Pooled desktops are pinned just like
+  // others.
   static std::unique_ptr<Desktop> create(
-      int32_t width, int32_t height, const std::vector<std::string>& command);
+      int32_t width, int32_t height, const std::vector<std::string>& command,
+      const std::optional<CgroupLimits>& limits = std::nullopt,
+      int cpus_per_desktop = 0, const std::string& renderer = "auto",
+      bool virtual_clock = false, bool xwayland = true);
+
+  // Keeps 'size' warm Weston sessions at the given resolution running in the
+  // background for create() to use. Replaces any existing pool for that
+  // resolution. 'limits', 'cpus_per_desktop', and 'renderer' apply to each
+  // session, as in create().
+  static void enable_pool(
+      int32_t width, int32_t height, int size,
+      const std::optional<CgroupLimits>& limits = std::nullopt,
+      int cpus_per_desktop = 0, const std::string& renderer = "auto");
+  static void disable_pool(int32_t width, int32_t height);
+
+  // Sets how Weston's and apps' output is kept for desktops and pools that
+  // are created afterwards: the most recent 'ring_bytes' of each stream in
+  // memory, and, if 'log_dir' is set, all of it in rotated files in
+  // 'log_dir'.
+  static void configure_logs(size_t ring_bytes, const std::string& log_dir,
+                             size_t max_file_bytes, int max_files);
+
+  // Returns the recent output of the desktop's Weston and app, keyed by
+  // "weston" and "app".
+  std::map<std::string, std::string> logs() const { return backend_->logs(); }
+
+  // Pins the desktop's processes and this client's VNC thread to 'cpus', or
+  // unpins them if 'cpus' is empty. The desktop's reserved CPUs are replaced
+  // by 'cpus', or released when it's unpinned, and pinning fails if another
+  // desktop has reserved any of 'cpus'.
+  void pin(const std::vector<int>& cpus);
+  // The CPUs the desktop's pinned to, or an empty list if it isn't pinned.
+  std::vector<int> cpus() const { return backend_->cpus(); }
+
+  // Returns the resource usage of the desktop's Weston, Xwayland, and app.
+  // Only available for desktops that run in a cgroup.
+  CgroupUsage resource_usage() const;
+
+  // Runs the app's clock at 'speed' times real time. 0 pauses it. Only
+  // available for desktops created with a virtual clock.
+  void set_time_speed(double speed);
+  double time_speed() const;
+  // Moves the app's clock forward by 'seconds' at once. Advancing a paused
+  // clock steps the app in fixed increments of time.
+  void advance_time(double seconds);
+  // Returns the app's monotonic clock time in seconds.
+  double virtual_time() const;
+
+  // Kills the desktop's app and launches 'command' in its place, keeping the
+  // desktop's Weston session and VNC connection alive.
+  //
+  // With 'use_zygote', 'command' must run python, and it's forked from a
+  // warm interpreter that's already imported 'preload', which makes
+  // relaunches much faster. The interpreter's kept between resets that use
+  // the same python and preloads.
+  void reset(const std::vector<std::string>& command, bool use_zygote = false,
+             const std::vector<std::string>& preload = {});
+
+  // How long each phase of this desktop's creation took, from preparing its
+  // session to its first frame. Desktops that came from a pool start with
+  // claiming their session, since the session was started in the background.
+  StartupProfile startup_profile();
+
+  // Starts recording the frames get_frame() returns and the input events this
+  // desktop sends to a trajectory file at 'path' (see
+  // record/trajectory_format.h). 'compression' is "none" or "zstd". With
+  // 'changed_tiles', frames after the first in each chunk only store the
+  // tiles that changed. Raises if the desktop's already recording.
+  void start_recording(const std::string& path,
+                       const std::string& compression = "none",
+                       bool changed_tiles = false);
+  // Finishes the recording and returns its stats. Raises if the desktop
+  // isn't recording, or if the recording failed.
+  RecorderStats stop_recording();
+
+  // How long stopping this desktop's apps has taken, e.g. in reset().
+  const TeardownStats& teardown_stats() const {
+    return backend_->app_teardown_stats();
+  }
 
  private:
   Desktop() {};
 
+  // Returns the desktop's virtual clock, or raises if it doesn't have one.
+  VirtualClock* clock() const;
+
   // Hide BounceDeskClient methods that don't belong in Desktop's interface.
   using BounceDeskClient::connect;
+  using BounceDeskClient::connect_fd;
+  using BounceDeskClient::connect_unix;
   using BounceDeskClient::get_frame_impl;
   using BounceDeskClient::resize;
 
   std::unique_ptr<WestonBackend> backend_;
+  // The phases of create() up to connecting, and when connecting finished.
+  StartupProfile profile_;
+  std::chrono::steady_clock::time_point connected_at_;
+  std::shared_ptr<TrajectoryRecorder> recording_;
 };
 
 #endif  // BINDINGS_CLIENT_EXT_H_
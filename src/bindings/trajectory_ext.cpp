@@ -0,0 +1,103 @@
+// A nanobind wrapper of record/trajectory_reader.h
+
+#include "bindings/trajectory_ext.h"
+
+#include <nanobind/ndarray.h>
+#include <nanobind/stl/string.h>
+#include <nanobind/stl/unique_ptr.h>
+#include <nanobind/stl/vector.h>
+
+#include "record/trajectory_reader.h"
+#include "third_party/status/exceptions.h"
+
+namespace nb = nanobind;
+
+void bind_trajectory(nb::module_& m) {
+  nb::class_<TrajectoryEvent>(m, "TrajectoryEvent")
+      .def_ro("timestamp_ns", &TrajectoryEvent::timestamp_ns)
+      .def_prop_ro("is_key",
+                   [](const TrajectoryEvent& e) {
+                     return e.event.type == Event::Type::KEYBOARD;
+                   })
+      .def_prop_ro("keysym",
+                   [](const TrajectoryEvent& e) { return e.event.keysym; })
+      .def_prop_ro("pressed",
+                   [](const TrajectoryEvent& e) {
+                     return e.event.key_direction == Event::Direction::PRESS;
+                   })
+      .def_prop_ro("mouse_x",
+                   [](const TrajectoryEvent& e) { return e.event.mouse_x; })
+      .def_prop_ro("mouse_y",
+                   [](const TrajectoryEvent& e) { return e.event.mouse_y; })
+      .def_prop_ro("button_mask", [](const TrajectoryEvent& e) {
+        return e.event.button_mask;
+      });
+
+  nb::class_<TrajectoryReader>(m, "TrajectoryReader")
+      .def_static(
+          "open",
+          [](const std::string& path, int decode_threads, int prefetch_chunks,
+             int cache_chunks) {
+            ASSIGN_OR_RAISE(
+                std::unique_ptr<TrajectoryReader> reader,
+                TrajectoryReader::open(
+                    path, ReaderOptions{.decode_threads = decode_threads,
+                                        .prefetch_chunks = prefetch_chunks,
+                                        .cache_chunks = cache_chunks}));
+            return reader;
+          },
+          nb::arg("path"),
+          nb::arg("decode_threads") = ReaderOptions().decode_threads,
+          nb::arg("prefetch_chunks") = ReaderOptions().prefetch_chunks,
+          nb::arg("cache_chunks") = ReaderOptions().cache_chunks)
+      .def("__len__", &TrajectoryReader::num_frames)
+      .def("num_events", &TrajectoryReader::num_events)
+      .def("num_chunks", &TrajectoryReader::num_chunks)
+      .def("path", &TrajectoryReader::path)
+      .def(
+          "frame",
+          [](TrajectoryReader& r, uint64_t n) {
+            TrajectoryFrame frame;
+            {
+              // Lets other threads read while this one waits on decoding.
+              nb::gil_scoped_release release;
+              ASSIGN_OR_RAISE(frame, r.frame(n));
+            }
+            // The array holds the frame's owner, so that it stays valid
+            // whether its pixels are in the file's mapping, a decompressed
+            // chunk, or a rebuilt frame, even after the reader's closed.
+            auto* owner = new std::shared_ptr<const void>(
+                std::move(frame.owner));
+            nb::capsule capsule(owner, [](void* p) noexcept {
+              delete (std::shared_ptr<const void>*)p;
+            });
+            // Read-only, and shaped like Desktop.get_frame()'s frames.
+            return nb::ndarray<const uint8_t, nb::numpy, nb::shape<-1, -1, 4>,
+                               nb::c_contig>(
+                frame.pixels,
+                {(uint32_t)frame.width, (uint32_t)frame.height, 4}, capsule);
+          },
+          nb::arg("n"))
+      .def(
+          "timestamp_ns",
+          [](TrajectoryReader& r, uint64_t n) {
+            ASSIGN_OR_RAISE(int64_t timestamp_ns, r.timestamp_ns(n));
+            return timestamp_ns;
+          },
+          nb::arg("n"))
+      .def(
+          "frame_at",
+          [](TrajectoryReader& r, int64_t timestamp_ns) {
+            ASSIGN_OR_RAISE(uint64_t n, r.frame_at(timestamp_ns));
+            return n;
+          },
+          nb::arg("timestamp_ns"))
+      .def(
+          "events",
+          [](TrajectoryReader& r, int64_t start_ns, int64_t end_ns) {
+            ASSIGN_OR_RAISE(std::vector<TrajectoryEvent> events,
+                            r.events(start_ns, end_ns));
+            return events;
+          },
+          nb::arg("start_ns"), nb::arg("end_ns"));
+}
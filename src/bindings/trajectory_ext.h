@@ -0,0 +1,9 @@
+#ifndef BINDINGS_TRAJECTORY_EXT_H_
+#define BINDINGS_TRAJECTORY_EXT_H_
+
+#include <nanobind/nanobind.h>
+
+// Adds TrajectoryReader and TrajectoryEvent to 'm'.
+void bind_trajectory(nanobind::module_& m);
+
+#endif  // BINDINGS_TRAJECTORY_EXT_H_
@@ -1,14 +1,21 @@
 #include "desktop/client.h"
 
 #include <gvnc-1.0/gvnc.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <future>
 #include <thread>
 
 #include "desktop/mouse_button.h"
+#include "libc_error.h"
+#include "process/cpu_affinity.h"
 #include "third_party/status/status_or.h"
 #include "time_aliases.h"
 
@@ -53,7 +60,7 @@ void on_initialized(VncConnection* c, void* data) {
   client->resize(width, height);
   CHECK(
       vnc_connection_framebuffer_update_request(c, false, 0, 0, width, height));
-  client->initialized_ = true;
+  client->set_initialized();
 }
 
 void on_resize(VncConnection* c, uint16_t width, uint16_t height, void* data) {
@@ -93,7 +100,46 @@ StatusOr<std::unique_ptr<BounceDeskClient>> BounceDeskClient::connect(
   return client;
 }
 
+StatusOr<std::unique_ptr<BounceDeskClient>> BounceDeskClient::connect_fd(
+    Fd&& fd, bool allow_unsafe) {
+  auto client = std::unique_ptr<BounceDeskClient>(new BounceDeskClient());
+  RETURN_IF_ERROR(client->connect_fd_impl(std::move(fd), allow_unsafe));
+  return client;
+}
+
+StatusOr<std::unique_ptr<BounceDeskClient>> BounceDeskClient::connect_unix(
+    const std::string& socket_path, bool allow_unsafe) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    return InvalidArgumentError("Unix socket path is too long: " +
+                                socket_path);
+  }
+  strcpy(addr.sun_path, socket_path.c_str());
+
+  Fd fd = Fd::take(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (*fd == -1) {
+    return InternalError("Failed to create unix socket: " +
+                         libc_error_name(errno));
+  }
+  if (::connect(*fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+    return UnavailableError("Failed to connect to " + socket_path + ": " +
+                            libc_error_name(errno));
+  }
+  return connect_fd(std::move(fd), allow_unsafe);
+}
+
 StatusVal BounceDeskClient::connect_impl(int32_t port, bool allow_unsafe) {
+  port_ = port;
+  return start(allow_unsafe);
+}
+
+StatusVal BounceDeskClient::connect_fd_impl(Fd&& fd, bool allow_unsafe) {
+  socket_ = std::move(fd);
+  return start(allow_unsafe);
+}
+
+StatusVal BounceDeskClient::start(bool allow_unsafe) {
   int last_open = num_open.fetch_add(1);
   if (last_open > 0 && !allow_unsafe) {
     return InternalError(
@@ -101,15 +147,13 @@ StatusVal BounceDeskClient::connect_impl(int32_t port, bool allow_unsafe) {
         "want to test running multiple instances in a process.");
   }
 
-  port_ = port;
   vnc_loop_ = std::thread(&BounceDeskClient::vnc_loop, this);
 
   // Block until the client's finished start up so that subsequent member
   // functions don't race with the start up.
-  auto start = sc_now();
-  while (sc_now() - start < 5s) {
-    if (initialized_) break;
-    sleep_for(50us);
+  {
+    std::unique_lock l(initialized_mu_);
+    initialized_cv_.wait_for(l, 5s, [this] { return initialized_.load(); });
   }
   if (!initialized_) {
     exited_ = true;
@@ -138,6 +182,14 @@ BounceDeskClient::~BounceDeskClient() {
   }
 }
 
+void BounceDeskClient::set_initialized() {
+  {
+    std::lock_guard l(initialized_mu_);
+    initialized_ = true;
+  }
+  initialized_cv_.notify_all();
+}
+
 void BounceDeskClient::resize(int width, int height) {
   int old_width = -1;
   int old_height = -1;
@@ -171,6 +223,11 @@ static int request_frame(void* data) {
   vnc_connection_framebuffer_update_request(c, false, 0, 0, width, height);
   return G_SOURCE_REMOVE;
 }
+
+static int request_new_frame(void* data) {
+  ((BounceDeskClient*)data)->request_new_frame();
+  return G_SOURCE_REMOVE;
+}
 Frame BounceDeskClient::get_frame() {
   std::promise<Frame>* request = new std::promise<Frame>();
   {
@@ -184,42 +241,85 @@ Frame BounceDeskClient::get_frame() {
   }
   Frame f = future.get();
   delete request;
+  record_frame(f);
+  return f;
+}
+
+StatusOr<Frame> BounceDeskClient::get_new_frame(
+    std::chrono::milliseconds timeout) {
+  std::promise<Frame>* request = new std::promise<Frame>();
+  std::future<Frame> future = request->get_future();
+  {
+    std::lock_guard l(pending_requests_mu_);
+    pending_requests_.push_back(request);
+  }
+  g_main_context_invoke(NULL, ::request_new_frame, this);
+  if (future.wait_for(timeout) == std::future_status::timeout) {
+    std::lock_guard l(pending_requests_mu_);
+    auto it =
+        std::find(pending_requests_.begin(), pending_requests_.end(), request);
+    // Unless an update resolved the request after all.
+    if (it != pending_requests_.end()) {
+      pending_requests_.erase(it);
+      delete request;
+      return DeadlineExceededError("Nothing new was drawn before the timeout.");
+    }
+  }
+  Frame f = future.get();
+  delete request;
+  record_frame(f);
   return f;
 }
 
-// Create a frame from the buffer held by 'fb' and allocate a new uninitialized
-// buffer into fb.
-static Frame move_frame(VncConnection* c, VncFramebuffer** fb_ptr) {
-  // libgvnc doesn't expose a way to change the buffer of a VncFramebuffer,
-  // so we create a new VncFramebuffer every time we want to take the
-  // buffer from the vnc and create a new one in its place.
-  VncFramebuffer* fb = *fb_ptr;
+// Copies the framebuffer's contents into a new frame. The framebuffer keeps its
+// buffer, so that incremental updates apply on top of what's been received.
+// Handing the buffer itself out, as get_frame() once did, would leave the
+// next incremental update without a baseline, and any client can switch to
+// get_new_frame() at any time.
+static Frame copy_frame(VncFramebuffer* fb) {
   int width = vnc_framebuffer_get_width(fb);
   int height = vnc_framebuffer_get_height(fb);
-  uint8_t* old_buffer = vnc_framebuffer_get_buffer(fb);
-  uint8_t* new_buffer = (uint8_t*)malloc(4 * width * height);
-  const VncPixelFormat* local_format = vnc_framebuffer_get_local_format(fb);
-  const VncPixelFormat* remote_format = vnc_framebuffer_get_remote_format(fb);
-
-  Frame f{.width = width, .height = height, .pixels = UniquePtrBuf(old_buffer)};
-  *fb_ptr = VNC_FRAMEBUFFER(vnc_base_framebuffer_new(
-      new_buffer, width, height, 4 * width, local_format, remote_format));
-  vnc_connection_set_framebuffer(c, *fb_ptr);
-  g_object_unref(fb);
-  return f;
+  uint8_t* pixels = (uint8_t*)malloc(4 * width * height);
+  CHECK(pixels);
+  memcpy(pixels, vnc_framebuffer_get_buffer(fb), 4 * width * height);
+  return Frame{
+      .width = width, .height = height, .pixels = UniquePtrBuf(pixels)};
 }
+
 void BounceDeskClient::fb_update() {
   std::lock_guard l(pending_requests_mu_);
+  if (!first_update_) first_update_ = sc_now();
   if (pending_requests_.size() == 0) {
+    unclaimed_update_ = true;
     return;
   }
 
-  Frame f = move_frame(c_, &fb_);
-  pending_requests_[0]->set_value(std::move(f));
+  pending_requests_[0]->set_value(copy_frame(fb_));
   pending_requests_.erase(pending_requests_.begin());
+  unclaimed_update_ = false;
+}
+
+std::optional<std::chrono::steady_clock::time_point>
+BounceDeskClient::first_update_time() {
+  std::lock_guard l(pending_requests_mu_);
+  return first_update_;
+}
+
+void BounceDeskClient::request_new_frame() {
+  std::lock_guard l(pending_requests_mu_);
+  if (unclaimed_update_ && !pending_requests_.empty()) {
+    pending_requests_[0]->set_value(copy_frame(fb_));
+    pending_requests_.erase(pending_requests_.begin());
+    unclaimed_update_ = false;
+    return;
+  }
+  vnc_connection_framebuffer_update_request(c_, true, 0, 0,
+                                            vnc_connection_get_width(c_),
+                                            vnc_connection_get_height(c_));
 }
 
 void BounceDeskClient::vnc_loop() {
+  vnc_loop_tid_ = gettid();
   c_ = vnc_connection_new();
   g_object_set_data(G_OBJECT(c_), kPtrKey, this);
 
@@ -240,8 +340,13 @@ void BounceDeskClient::vnc_loop() {
                    NULL);
   g_signal_connect(c_, "vnc-error", G_CALLBACK(on_error), NULL);
 
-  std::string port_str = std::to_string(port_);
-  CHECK(vnc_connection_open_host(c_, "127.0.0.1", port_str.c_str()));
+  if (*socket_ != -1) {
+    // libgvnc takes ownership of the fd.
+    CHECK(vnc_connection_open_fd(c_, socket_.release()));
+  } else {
+    std::string port_str = std::to_string(port_);
+    CHECK(vnc_connection_open_host(c_, "127.0.0.1", port_str.c_str()));
+  }
 
   while (!exit_ || g_main_context_pending(NULL)) {
     g_main_context_iteration(NULL, /*may_block=*/true);
@@ -277,12 +382,14 @@ void BounceDeskClient::key_press(int keysym) {
   DoKeyEvent ke = DoKeyEvent{.c = c_, .down = true, .keysym = keysym};
   g_main_context_invoke(NULL, do_key_event, &ke);
   ke.ret.get_future().get();
+  record_event(Event::key_press(keysym));
 }
 
 void BounceDeskClient::key_release(int keysym) {
   DoKeyEvent ke = DoKeyEvent{.c = c_, .down = false, .keysym = keysym};
   g_main_context_invoke(NULL, do_key_event, &ke);
   ke.ret.get_future().get();
+  record_event(Event::key_release(keysym));
 }
 
 void BounceDeskClient::move_mouse(int x, int y) {
@@ -301,6 +408,13 @@ void BounceDeskClient::mouse_release(int button) {
   send_pointer_event();
 }
 
+StatusVal BounceDeskClient::pin_loop(const std::vector<int>& cpus) {
+  if (vnc_loop_tid_ == -1) {
+    return NotFoundError("The client's vnc loop isn't running.");
+  }
+  return set_cpu_affinity(vnc_loop_tid_, cpus);
+}
+
 struct DoPointerEvent {
   VncConnection* c;
   int mask;
@@ -324,4 +438,42 @@ void BounceDeskClient::send_pointer_event() {
   };
   g_main_context_invoke(NULL, do_pointer_event, &pe);
   pe.ret.get_future().get();
+  record_event(Event::mouse_event(mouse_x_, mouse_y_, button_mask_));
+}
+
+void BounceDeskClient::set_recorder(
+    std::shared_ptr<TrajectoryRecorder> recorder) {
+  std::lock_guard l(recorder_mu_);
+  recorder_ = std::move(recorder);
+}
+
+std::shared_ptr<TrajectoryRecorder> BounceDeskClient::recorder() {
+  std::lock_guard l(recorder_mu_);
+  return recorder_;
+}
+
+void BounceDeskClient::record_frame(const Frame& frame) {
+  std::shared_ptr<TrajectoryRecorder> recorder = this->recorder();
+  if (!recorder) return;
+  StatusVal s = recorder->add_frame(frame);
+  if (!s.ok()) detach_recorder(recorder.get(), s);
+}
+
+void BounceDeskClient::record_event(const Event& event) {
+  std::shared_ptr<TrajectoryRecorder> recorder = this->recorder();
+  if (!recorder) return;
+  StatusVal s = recorder->add_event(event);
+  if (!s.ok()) detach_recorder(recorder.get(), s);
+}
+
+void BounceDeskClient::detach_recorder(const TrajectoryRecorder* recorder,
+                                       const StatusVal& error) {
+  std::lock_guard l(recorder_mu_);
+  // Only the first failure's logged, in case another thread's failed too.
+  // Recordings that were closed after being unset fail too, and aren't
+  // logged.
+  if (recorder_.get() != recorder) return;
+  recorder_.reset();
+  ERROR("Stopped recording to %s: %s", recorder->path().c_str(),
+        error.to_string().c_str());
 }
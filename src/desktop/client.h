@@ -5,19 +5,32 @@
 #include <stdint.h>
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 
+#include "desktop/event.h"
 #include "desktop/frame.h"
+#include "process/fd.h"
+#include "record/trajectory_recorder.h"
 #include "third_party/status/status_or.h"
 
 class BounceDeskClient {
  public:
   static StatusOr<std::unique_ptr<BounceDeskClient>> connect(
       int32_t port, bool allow_unsafe = false);
+  // Connects over an already connected stream socket, e.g. one end of a
+  // socketpair, instead of TCP.
+  static StatusOr<std::unique_ptr<BounceDeskClient>> connect_fd(
+      Fd&& fd, bool allow_unsafe = false);
+  // Connects to a VNC server listening on the Unix socket at 'socket_path'.
+  static StatusOr<std::unique_ptr<BounceDeskClient>> connect_unix(
+      const std::string& socket_path, bool allow_unsafe = false);
   ~BounceDeskClient();
 
   // Delete copy and move operators, since we rely on pointer stability when
@@ -31,6 +44,15 @@ class BounceDeskClient {
   // of our internal glib main thread. They'll deadlock if called from
   // the glib thread.
   Frame get_frame();
+  // Returns a frame once something new has been drawn since the last frame
+  // this client returned, e.g. once the app has presented a new buffer. This
+  // sends an incremental update request, which the server only answers once
+  // it has new damage, so there's no need to sleep between frames or to drop
+  // duplicates. Damage that arrives between calls counts as new.
+  //
+  // Returns DEADLINE_EXCEEDED if nothing new's drawn within 'timeout'.
+  StatusOr<Frame> get_new_frame(
+      std::chrono::milliseconds timeout = std::chrono::seconds(3));
   // Shouldn't be called directly.
   Frame get_frame_impl();
 
@@ -46,21 +68,54 @@ class BounceDeskClient {
   void mouse_press(int button);
   void mouse_release(int button);
 
+  // Pins the client's VNC loop thread to 'cpus' (see process/cpu_affinity.h),
+  // e.g. to the CPUs of the desktop it's connected to.
+  StatusVal pin_loop(const std::vector<int>& cpus);
+
+  // When the client received its first framebuffer update, which the client
+  // requests as soon as it connects, if it has.
+  std::optional<std::chrono::steady_clock::time_point> first_update_time();
+
+  // Records the frames this client returns and the input events it sends to
+  // 'recorder', until it's set to nullptr. Frames and events already being
+  // recorded keep the recorder alive until they're done, so it can be closed
+  // as soon as it's unset. If recording fails, the error's logged and
+  // recording stops.
+  void set_recorder(std::shared_ptr<TrajectoryRecorder> recorder);
+
   // Exposed to simplify vnc_loop() implementation. Not part of the public API.
   void resize(int w, int h);
   void fb_update();
+  void request_new_frame();
+  void set_initialized();
   std::atomic<bool> initialized_ = false;
 
  protected:
   StatusVal connect_impl(int32_t port, bool allow_unsafe = false);
+  StatusVal connect_fd_impl(Fd&& fd, bool allow_unsafe = false);
   BounceDeskClient() = default;
 
  private:
+  // Starts the vnc loop and waits for the connection to initialize.
+  StatusVal start(bool allow_unsafe);
   void vnc_loop();
   void send_pointer_event();
-
-  int port_;
+  void record_frame(const Frame& frame);
+  void record_event(const Event& event);
+  // Returns the recorder, or null if the client isn't recording.
+  std::shared_ptr<TrajectoryRecorder> recorder();
+  // Logs a recording error and stops recording to 'recorder'.
+  void detach_recorder(const TrajectoryRecorder* recorder,
+                       const StatusVal& error);
+
+  // The server's TCP port, used if socket_ isn't set.
+  int port_ = -1;
+  // A connected socket to the server. Ownership passes to libgvnc once the
+  // vnc loop opens the connection.
+  Fd socket_;
   std::thread vnc_loop_;
+  // The vnc loop thread's tid.
+  std::atomic<int> vnc_loop_tid_ = -1;
   Frame frame_;
 
   std::atomic<bool> exit_ = false;
@@ -68,8 +123,18 @@ class BounceDeskClient {
   VncFramebuffer* fb_ = nullptr;
   std::atomic<bool> exited_ = false;
 
+  std::mutex initialized_mu_;
+  std::condition_variable initialized_cv_;
+
   std::mutex pending_requests_mu_;
   std::vector<std::promise<Frame>*> pending_requests_;
+  // Whether the framebuffer's received updates since the last frame was
+  // returned, i.e. late answers to incremental requests that timed out.
+  bool unclaimed_update_ = false;
+  std::optional<std::chrono::steady_clock::time_point> first_update_;
+
+  std::mutex recorder_mu_;
+  std::shared_ptr<TrajectoryRecorder> recorder_;
 
   int mouse_x_ = 10;
   int mouse_y_ = 10;
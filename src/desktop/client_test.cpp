@@ -2,11 +2,16 @@
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <thread>
+
 #include "vnc_test/mock_vnc_server.h"
 #include "desktop/mouse_button.h"
 #include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
 #include "desktop/weston_backend.h"
 
 const int32_t kPortOffset = 5900;
@@ -52,3 +57,96 @@ TEST(Client, sends_input_events_correctly) {
 
   EXPECT_THAT(server->get_events(), testing::ContainerEq(expected_events));
 }
+
+TEST(Client, connects_over_socketpair) {
+  ASSERT_OK_AND_ASSIGN(auto server, MockVncServer::start_server(5968));
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+  server->add_client(Fd::take(fds[0]));
+  ASSERT_OK_AND_ASSIGN(auto client,
+                       BounceDeskClient::connect_fd(Fd::take(fds[1])));
+  EXPECT_OK(server->wait_for_connection());
+
+  client->key_press(63);
+  const Frame& frame = client->get_frame();
+  EXPECT_EQ(frame.width, 300);
+  EXPECT_EQ(frame.height, 200);
+  EXPECT_THAT(server->get_events(),
+              testing::ElementsAre(Event::key_press(63)));
+}
+
+TEST(Client, get_new_frame_waits_for_new_damage) {
+  ASSERT_OK_AND_ASSIGN(auto server, MockVncServer::start_server(5969));
+  ASSERT_OK_AND_ASSIGN(auto client, BounceDeskClient::connect(5969));
+  EXPECT_OK(server->wait_for_connection());
+  client->get_frame();
+
+  EXPECT_THAT(client->get_new_frame(200ms),
+              StatusIs(StatusCode::DEADLINE_EXCEEDED));
+
+  server->fill(10, 10, 20, 20, 0xffffffff);
+  ASSERT_OK_AND_ASSIGN(Frame frame, client->get_new_frame(1s));
+  const uint8_t* pixel = frame.pixels.get() + 4 * (15 * frame.width + 15);
+  EXPECT_EQ(pixel[0], 255);
+  EXPECT_EQ(pixel[1], 255);
+  EXPECT_EQ(pixel[2], 255);
+
+  // The fill's been returned, so there's nothing new.
+  EXPECT_THAT(client->get_new_frame(200ms),
+              StatusIs(StatusCode::DEADLINE_EXCEEDED));
+}
+
+TEST(Client, connect_unix_without_server_is_unavailable) {
+  EXPECT_THAT(BounceDeskClient::connect_unix("/tmp/no_bounce_vnc_socket"),
+              StatusIs(StatusCode::UNAVAILABLE));
+}
+
+TEST(Client, records_frames_and_events) {
+  ASSERT_OK_AND_ASSIGN(auto server, MockVncServer::start_server(5970));
+  ASSERT_OK_AND_ASSIGN(auto client, BounceDeskClient::connect(5970));
+  EXPECT_OK(server->wait_for_connection());
+  std::string path = "/tmp/bounce_client_test_" + std::to_string(getpid());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<TrajectoryRecorder> recorder,
+                       TrajectoryRecorder::create(path));
+
+  client->set_recorder(recorder);
+  client->get_frame();
+  client->key_press(63);
+  client->move_mouse(50, 50);
+  client->set_recorder(nullptr);
+  client->key_release(63);
+
+  StatusVal s = recorder->close();
+  EXPECT_OK(s);
+  RecorderStats stats = recorder->stats();
+  EXPECT_EQ(stats.frames, 1u);
+  EXPECT_EQ(stats.events, 2u);
+  unlink(path.c_str());
+}
+
+TEST(Client, stops_recording_while_recording_events) {
+  ASSERT_OK_AND_ASSIGN(auto server, MockVncServer::start_server(5971));
+  ASSERT_OK_AND_ASSIGN(auto client, BounceDeskClient::connect(5971));
+  EXPECT_OK(server->wait_for_connection());
+  std::string path = "/tmp/bounce_client_test_" + std::to_string(getpid());
+
+  std::atomic<bool> done = false;
+  std::thread typist([&]() {
+    while (!done) client->key_press(63);
+  });
+  for (int i = 0; i < 20; ++i) {
+    std::shared_ptr<TrajectoryRecorder> recorder =
+        TrajectoryRecorder::create(path).value_or_die();
+    client->set_recorder(recorder);
+    std::this_thread::sleep_for(1ms);
+    client->set_recorder(nullptr);
+    // Key presses that are still being recorded mustn't outlive the
+    // recorder's memory or recording.
+    StatusVal s = recorder->close();
+    EXPECT_OK(s);
+    recorder.reset();
+  }
+  done = true;
+  typist.join();
+  unlink(path.c_str());
+}
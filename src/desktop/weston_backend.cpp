@@ -2,49 +2,435 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <filesystem>
 #include <format>
 #include <thread>
 
-#include "weston/display_vars.h"
 #include "weston/launch_weston.h"
 #include "paths.h"
+#include "time_aliases.h"
+
+namespace {
+// Returns the directory for reaper IPC sockets, creating it if needed.
+StatusOr<std::string> get_reaper_ipc_dir() {
+  std::string dir = std::format("/run/user/{}/bounce_desktop_reaper", getuid());
+  std::error_code error;
+  std::filesystem::create_directories(dir, error);
+  if (error) {
+    return InternalError(std::format("Failed to create reaper IPC dir {}: {}",
+                                     dir, error.message()));
+  }
+  return dir;
+}
+
+// Numbers the cgroups of this process's sessions.
+std::atomic<int> next_cgroup_id = 0;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(sc_now() - start).count();
+}
+}  // namespace
 
 StatusOr<std::unique_ptr<WestonBackend>> WestonBackend::start_server(
     int32_t port_offset, int32_t width, int32_t height,
-    const std::vector<std::string>& command, ProcessOutConf&& command_out) {
+    const std::vector<std::string>& command, ProcessOutConf&& command_out,
+    const BackendOptions& options) {
+  auto start = sc_now();
+  auto backend = std::unique_ptr<WestonBackend>(
+      new WestonBackend(PortLease(), width, height, options));
+  StartupProfile& profile = backend->profile_;
+  if (options.cgroup) {
+    ASSIGN_OR_RETURN(
+        Cgroup cgroup,
+        Cgroup::create_limited(
+            std::format("bounce_desktop_{}_{}", getpid(), next_cgroup_id++),
+            *options.cgroup));
+    backend->cgroup_.emplace(std::move(cgroup));
+  }
+  if (options.cpu_allocator && options.cpus_per_session > 0) {
+    ASSIGN_OR_RETURN(backend->cpu_lease_, options.cpu_allocator->allocate(
+                                              options.cpus_per_session));
+    backend->cpus_ = backend->cpu_lease_.cpus();
+  }
+  if (options.virtual_clock) {
+    ASSIGN_OR_RETURN(backend->clock_, VirtualClock::create());
+  }
+  LaunchWestonOpts weston_opts = options.weston;
+  if (options.weston_config) {
+    WestonConfig config = *options.weston_config;
+    if (weston_opts.xwayland && config.xwayland_path.empty()) {
+      config.xwayland_path = get_xwayland_wrapper_path();
+    }
+    ASSIGN_OR_RETURN(backend->weston_ini_, WestonIniFile::create(config));
+    weston_opts.config_file = backend->weston_ini_.path();
+  }
+
+  start = profile.add("prepare", start);
+
+  // Runs Weston under a reaper that's stored in 'backend'. The reaper process
+  // stands in for Weston's process, since the reaper and Weston share their
+  // stdout, and terminating the reaper terminates Weston.
+  Spawner spawn_reaped = [&](const std::vector<std::string>& args,
+                             EnvVars* env,
+                             ProcessOutConf&& process_out) -> StatusOr<Process> {
+    ASSIGN_OR_RETURN(std::string ipc_dir, get_reaper_ipc_dir());
+    ASSIGN_OR_RETURN(
+        reaper::Reaper reaper,
+        reaper::Reaper::create(reaper::shell_join(args), ipc_dir,
+                               options.reaper_grace));
+    RETURN_IF_ERROR(
+        reaper.launch(env, std::move(process_out), backend->launch_opts()));
+    Process p = std::move(reaper.process());
+    backend->weston_reaper_.emplace(std::move(reaper));
+    return p;
+  };
+  // Runs Weston directly, but in the session's cgroup and on its CPUs.
+  Spawner spawn_with_opts = [&](const std::vector<std::string>& args,
+                                EnvVars* env, ProcessOutConf&& process_out) {
+    return launch_process(args, env, std::move(process_out),
+                          backend->launch_opts());
+  };
+  Spawner spawn = nullptr;
+  if (options.reap_weston) {
+    spawn = spawn_reaped;
+  } else if (backend->cgroup_ || !backend->cpus_.empty()) {
+    spawn = spawn_with_opts;
+  }
+
+  PortLease port_lease;
   Process weston;
-  std::string instance_name;
-  int port = port_offset;
-  for (;; port++) {
-    instance_name = std::format("vnc_{}", port);
+  DisplayVars dpy_vars;
+  int next_port = port_offset;
+  while (true) {
+    ASSIGN_OR_RETURN(port_lease, reserve_port(next_port));
+    int port = port_lease.port();
+    start = profile.add("reserve_port", start);
     StatusOr<Process> weston_or = launch_weston(
-        port, {get_export_display_path(), instance_name}, width, height);
+        port, {get_export_display_path()}, width, height, &dpy_vars, spawn,
+        weston_opts, &profile);
+    // Processes that don't use the port allocator can still take the port
+    // between our reservation and Weston binding it.
     if (!weston_or.ok() &&
         weston_or.status().code() == StatusCode::UNAVAILABLE) {
+      backend->weston_reaper_.reset();
+      next_port = port + 1;
+      start = profile.add("port_taken", start);
+      profile.port_retries++;
       continue;
     }
     RETURN_IF_ERROR(weston_or);
     weston = std::move(weston_or.value());
+    start = sc_now();
     break;
   }
-  LOG(kLogVnc, "Weston started on port: %d", port);
+  LOG(kLogVnc, "Weston started on port: %d", port_lease.port());
 
-  DisplayVars dpy_vars;
-  bool r = read_vars(instance_name, &dpy_vars);
-  if (!r) return UnknownError("Failed to read display vars.");
+  backend->port_lease_ = std::move(port_lease);
+  backend->port_ = backend->port_lease_.port();
+  backend->weston_ = std::move(weston);
+  backend->dpy_vars_ = std::move(dpy_vars);
+  if (options.warm_xwayland && !backend->dpy_vars_.x_display.empty()) {
+    // The warm-up's best effort, since X apps start Xwayland anyway.
+    backend->xwayland_warmup_start_ = sc_now();
+    StatusOr<XwaylandWarmup> warmup =
+        XwaylandWarmup::start(backend->dpy_vars_.x_display);
+    if (warmup.ok()) {
+      backend->xwayland_warmup_ = std::move(warmup.value());
+    } else {
+      ERROR("Not warming up Xwayland: %s",
+            warmup.status().to_string().c_str());
+    }
+    start = profile.add("warm_xwayland", start);
+  }
+  if (options.log_collector && backend->weston_.stdout.is_pipe()) {
+    ASSIGN_OR_RETURN(backend->weston_log_,
+                     options.log_collector->add(
+                         backend->weston_.stdout.take_fd(),
+                         std::format("weston_{}", backend->port_),
+                         options.logs));
+  }
+  start = profile.add("collect_logs", start);
+  if (!command.empty()) {
+    RETURN_IF_ERROR(backend->launch_app(command, std::move(command_out)));
+    profile.add("launch_app", start);
+  }
+  return backend;
+}
+
+WestonBackend::~WestonBackend() {
+  stop_app();
+  if (weston_.pid == -1 && !weston_reaper_) return;
+
+  auto start = sc_now();
+  if (weston_reaper_) {
+    weston_reaper_->clean_up();
+    weston_reaper_.reset();
+  }
+  weston_ = Process();
+  // Take down anything that escaped its process group, so that the cgroup
+  // can be removed.
+  if (cgroup_) {
+    cgroup_->kill();
+    StatusVal s = cgroup_->wait_empty(1000ms);
+    if (!s.ok()) ERROR("%s", s.to_string().c_str());
+  }
+  LOG(kLogVnc, "Weston on port %d took %.3f s to tear down.", port_,
+      seconds_since(start));
+  if (weston_log_) options_.log_collector->remove(*weston_log_);
+  if (app_log_) options_.log_collector->remove(*app_log_);
+}
+
+StatusVal WestonBackend::launch_app(const std::vector<std::string>& command,
+                                    ProcessOutConf&& command_out) {
+  EnvVars env_vars = app_env();
+  return launch_app_with_env(command, &env_vars, std::move(command_out));
+}
+
+StatusVal WestonBackend::wait_for_xwayland(std::chrono::milliseconds timeout) {
+  if (!xwayland_warmup_) return OkStatus();
+  StatusVal s = xwayland_warmup_->wait(timeout);
+  if (s.code() == StatusCode::DEADLINE_EXCEEDED) return s;
+  if (s.ok()) {
+    profile_.xwayland_s = seconds_since(xwayland_warmup_start_);
+    LOG(kLogVnc, "Xwayland on port %d started in %.3f s.", port_,
+        profile_.xwayland_s);
+  } else {
+    ERROR("Xwayland warm-up failed: %s", s.to_string().c_str());
+  }
+  xwayland_warmup_.reset();
+  return s;
+}
 
+LaunchOpts WestonBackend::launch_opts() const {
+  LaunchOpts opts;
+  if (cgroup_) opts.cgroup = cgroup_->path();
+  opts.cpus = cpus_;
+  return opts;
+}
+
+EnvVars WestonBackend::app_env() const {
   EnvVars env_vars = EnvVars::environ();
-  env_vars.set_var("DISPLAY", dpy_vars.x_display.c_str());
-  env_vars.set_var("WAYLAND_DISPLAY", dpy_vars.wayland_display.c_str());
+  // Sessions without Xwayland have no DISPLAY, and apps shouldn't fall back
+  // to ours.
+  if (dpy_vars_.x_display.empty()) {
+    env_vars.unset_var("DISPLAY");
+  } else {
+    env_vars.set_var("DISPLAY", dpy_vars_.x_display);
+  }
+  env_vars.set_var("WAYLAND_DISPLAY", dpy_vars_.wayland_display);
+  if (clock_) clock_->set_env(&env_vars);
+  return env_vars;
+}
+
+StatusVal WestonBackend::launch_app_with_env(
+    const std::vector<std::string>& command, EnvVars* env_vars,
+    ProcessOutConf&& command_out) {
+  if (has_app()) {
+    return InvalidArgumentError(
+        std::format("Weston session on port {} already has an app running.",
+                    port_));
+  }
+
+  // Collect the app's output if the caller didn't direct it anywhere.
+  bool directed = command_out.stdout.kind() != StreamKind::NONE ||
+                  command_out.stderr.kind() != StreamKind::NONE;
+  bool mux = options_.reap_app && options_.mux_reaper;
+  if (mux && (directed || !command_out.inherit_fds.empty())) {
+    return InvalidArgumentError(
+        "Apps run by a mux reaper share its output and can't be passed fds.");
+  }
+  bool collect = options_.log_collector && !directed && !mux;
+  if (collect) {
+    command_out.stdout = StreamOutConf::Pipe();
+    command_out.stderr = StreamOutConf::StdoutPipe();
+  }
+
   printf(
       "===================== Running on DISPLAY: %s, WAYLAND_DISPLAY: %s "
       "==============\n",
-      dpy_vars.x_display.c_str(), dpy_vars.wayland_display.c_str());
+      dpy_vars_.x_display.c_str(), dpy_vars_.wayland_display.c_str());
+
+  if (mux) {
+    ASSIGN_OR_RETURN(app_group_, options_.mux_reaper->launch(
+                                     reaper::shell_join(command), env_vars));
+    // The mux reaper launches the app itself, so pin it once it's running.
+    if (!cpus_.empty()) {
+      StatusVal s =
+          set_tree_cpu_affinity(options_.mux_reaper->pid(*app_group_), cpus_);
+      if (!s.ok()) ERROR("%s", s.to_string().c_str());
+    }
+    return OkStatus();
+  }
+
+  if (options_.reap_app) {
+    ASSIGN_OR_RETURN(std::string ipc_dir, get_reaper_ipc_dir());
+    ASSIGN_OR_RETURN(reaper::Reaper reaper,
+                     reaper::Reaper::create(reaper::shell_join(command),
+                                            ipc_dir, options_.reaper_grace));
+    RETURN_IF_ERROR(
+        reaper.launch(env_vars, std::move(command_out), launch_opts()));
+    app_reaper_.emplace(std::move(reaper));
+    if (collect) collect_app_logs(&app_reaper_->process());
+    return OkStatus();
+  }
+
+  // Run the app in its own process group so that restart_app() can clean up
+  // any processes the app spawns.
+  LaunchOpts opts = launch_opts();
+  opts.new_process_group = true;
+  ASSIGN_OR_RETURN(subproc_, launch_process(command, env_vars,
+                                            std::move(command_out), opts));
+  if (collect) collect_app_logs(&subproc_);
+  return OkStatus();
+}
+
+void WestonBackend::collect_app_logs(Process* app) {
+  if (!app->stdout.is_pipe()) return;
+  // Drop the previous app's logs.
+  if (app_log_) options_.log_collector->remove(*app_log_);
+  app_log_.reset();
+  StatusOr<LogCollector::StreamId> id = options_.log_collector->add(
+      app->stdout.take_fd(), std::format("app_{}", port_), options_.logs);
+  if (!id.ok()) {
+    ERROR("Not collecting the app's logs: %s",
+          id.status().to_string().c_str());
+    return;
+  }
+  app_log_ = id.value();
+}
+
+std::map<std::string, std::string> WestonBackend::logs() const {
+  std::map<std::string, std::string> logs;
+  auto read = [&](const char* key, std::optional<LogCollector::StreamId> id) {
+    if (!id) return;
+    StatusOr<std::string> out = options_.log_collector->read(*id);
+    if (out.ok()) logs[key] = std::move(out.value());
+  };
+  read("weston", weston_log_);
+  read("app", app_log_);
+  return logs;
+}
+
+StatusVal WestonBackend::restart_app(const std::vector<std::string>& command,
+                                     ProcessOutConf&& command_out,
+                                     const ZygoteOptions* zygote) {
+  if (!zygote) {
+    stop_app();
+    return launch_app(command, std::move(command_out));
+  }
+
+  if (command.size() < 2) {
+    return InvalidArgumentError(
+        "Zygote commands must run a python interpreter with args.");
+  }
+  if (zygote_ && zygote_->python() == command[0] &&
+      zygote_->options().preload == zygote->preload) {
+    stop_zygote_app();
+  } else {
+    stop_app();
+    RETURN_IF_ERROR(start_zygote(command[0], *zygote, std::move(command_out)));
+  }
+  ASSIGN_OR_RETURN(zygote_app_, zygote_->fork(command));
+  return OkStatus();
+}
 
-  ASSIGN_OR_RETURN(Process subproc,
-                   launch_process(command, &env_vars, std::move(command_out)));
+StatusVal WestonBackend::start_zygote(const std::string& python,
+                                      const ZygoteOptions& options,
+                                      ProcessOutConf&& command_out) {
+  ASSIGN_OR_RETURN(std::string ipc_dir, get_reaper_ipc_dir());
+  ASSIGN_OR_RETURN(zygote_, Zygote::create(ipc_dir, python, options));
+  EnvVars env_vars = app_env();
+  zygote_->set_env(&env_vars);
+  StatusVal s =
+      launch_app_with_env(zygote_->command(), &env_vars, std::move(command_out));
+  if (s.ok()) s = zygote_->wait_ready(30s);
+  if (!s.ok()) {
+    stop_app();
+    zygote_.reset();
+    return s;
+  }
+  return OkStatus();
+}
+
+int WestonBackend::app_pid() const {
+  if (zygote_app_ != -1) return zygote_app_;
+  if (app_reaper_) return app_reaper_->process().pid;
+  if (app_group_) return options_.mux_reaper->pid(*app_group_);
+  return subproc_.pid;
+}
+
+void WestonBackend::stop_zygote_app() {
+  if (zygote_app_ == -1) return;
+
+  auto start = sc_now();
+  StatusVal s = zygote_->kill(zygote_app_);
+  if (!s.ok()) ERROR("%s", s.to_string().c_str());
+  zygote_app_ = -1;
+  record_teardown(start);
+}
+
+void WestonBackend::stop_app() {
+  if (!has_app()) return;
+
+  auto start = sc_now();
+  if (zygote_app_ != -1) {
+    StatusVal s = zygote_->kill(zygote_app_);
+    if (!s.ok()) ERROR("%s", s.to_string().c_str());
+    zygote_app_ = -1;
+  }
+  // The zygote exits once it's disconnected, and the app slot's teardown
+  // below cleans it up either way.
+  zygote_.reset();
+  if (app_reaper_) {
+    app_reaper_->clean_up();
+    app_reaper_.reset();
+  }
+  if (app_group_) {
+    StatusVal s = options_.mux_reaper->kill(*app_group_);
+    if (!s.ok()) ERROR("%s", s.to_string().c_str());
+    app_group_.reset();
+  }
+  // Assigning over subproc_ terminates the app's process group.
+  subproc_ = Process();
+  record_teardown(start);
+}
+
+void WestonBackend::record_teardown(
+    std::chrono::steady_clock::time_point start) {
+  double s = seconds_since(start);
+  app_teardowns_.count++;
+  app_teardowns_.last_s = s;
+  app_teardowns_.total_s += s;
+  app_teardowns_.max_s = std::max(app_teardowns_.max_s, s);
+}
 
-  return std::unique_ptr<WestonBackend>(
-      new WestonBackend(port, std::move(weston), std::move(subproc)));
+StatusVal WestonBackend::pin(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    cpu_lease_ = CpuLease();
+  } else if (options_.cpu_allocator) {
+    ASSIGN_OR_RETURN(cpu_lease_,
+                     options_.cpu_allocator->reserve(cpus, &cpu_lease_));
+  }
+  cpus_ = cpus;
+  const std::vector<int>& tree_cpus = cpus.empty() ? allowed_cpus() : cpus;
+  int app_root = subproc_.pid;
+  if (app_reaper_) app_root = app_reaper_->process().pid;
+  if (app_group_) app_root = options_.mux_reaper->pid(*app_group_);
+  for (int root : {weston_.pid, app_root}) {
+    if (root == -1) continue;
+    StatusVal s = set_tree_cpu_affinity(root, tree_cpus);
+    if (!s.ok() && s.code() != StatusCode::NOT_FOUND) return s;
+  }
+  return OkStatus();
+}
+
+StatusOr<CgroupUsage> WestonBackend::resource_usage() const {
+  if (!cgroup_) {
+    return NotFoundError(std::format(
+        "Weston session on port {} doesn't have a cgroup.", port_));
+  }
+  return cgroup_->usage();
 }
@@ -1,29 +1,242 @@
 #ifndef DESKTOP_WESTON_BACKEND_H_
 #define DESKTOP_WESTON_BACKEND_H_
 
+#include <chrono>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "process/cgroup.h"
+#include "process/cpu_affinity.h"
+#include "process/log_collector.h"
 #include "process/process.h"
+#include "reaper/mux_reaper.h"
+#include "reaper/reaper.h"
 #include "third_party/status/status_or.h"
+#include "vclock/virtual_clock.h"
+#include "weston/display_vars.h"
+#include "weston/launch_weston.h"
+#include "weston/port_allocator.h"
+#include "weston/weston_config.h"
+#include "weston/xwayland.h"
+#include "zygote/zygote.h"
+
+struct BackendOptions {
+  // Run the app under a reaper, so that its whole process tree is cleaned up
+  // when the app's stopped, and even if this process crashes.
+  bool reap_app = true;
+  // Run Weston, and so Xwayland, under a reaper too. Note: Weston's early exits
+  // are only detected by launch_weston()'s timeout in this mode, since the
+  // reaper holds Weston's output pipe open.
+  bool reap_weston = false;
+  // How long reaped processes get to exit after SIGTERM before they're
+  // SIGKILLed.
+  std::chrono::milliseconds reaper_grace =
+      std::chrono::milliseconds(kDefaultReaperGraceMs);
+  // If set, reaped apps run as groups of this shared reaper instead of each
+  // getting a reaper process of their own. The app's output then goes to this
+  // process's stdout and stderr, so launches that direct the app's output
+  // elsewhere are rejected. The shared reaper's grace period applies. Must
+  // outlive the backend.
+  reaper::MuxReaper* mux_reaper = nullptr;
+  // If set, Weston's output, and the app's when the app's launched without
+  // its own output conf, is collected here instead of being left in pipes
+  // that nobody reads. Apps run by a mux_reaper aren't collected. Must outlive
+  // the backend.
+  LogCollector* log_collector = nullptr;
+  // The options for the collected streams, which are named 'weston_<port>' and
+  // 'app_<port>'.
+  LogOptions logs;
+  // If set, Weston, Xwayland, and the app run in a cgroup of their own with
+  // these limits, and resource_usage() reports on that cgroup. Unset limits
+  // still get the session its own cgroup for accounting. Apps run by a
+  // mux_reaper stay in the mux reaper's cgroups.
+  std::optional<CgroupLimits> cgroup = std::nullopt;
+  // If set, the session reserves the CPUs it's pin()ned to from this
+  // allocator, so that sessions sharing it never overlap. If
+  // 'cpus_per_session' is positive, the session also starts pinned to that
+  // many CPUs from it. Must outlive the backend.
+  CpuAllocator* cpu_allocator = nullptr;
+  int cpus_per_session = 0;
+  // Weston's renderer, whether it starts Xwayland, and any extra compositor
+  // flags.
+  LaunchWestonOpts weston = {};
+  // If set, the session's Weston runs with a weston.ini generated from this
+  // config, which is removed with the backend. The defaults turn off
+  // animations, idling, and locking. Otherwise Weston uses 'weston's
+  // config_file, if any, or searches the user's config dirs.
+  std::optional<WestonConfig> weston_config = WestonConfig();
+  // Start the session's Xwayland as soon as Weston's up, instead of when the
+  // first X app connects, so that it starts while the rest of the session's
+  // set up. See weston/xwayland.h.
+  bool warm_xwayland = true;
+  // If set, the session's apps run on a virtual clock of their own (see
+  // vclock/virtual_clock.h), which clock() controls. Weston keeps real time.
+  bool virtual_clock = false;
+};
+
+// How long stopping the backend's apps has taken.
+struct TeardownStats {
+  int count = 0;
+  double last_s = 0;
+  double total_s = 0;
+  double max_s = 0;
+};
 
 class WestonBackend {
  public:
+  // Starts a Weston session and launches 'command' into it. If 'command' is
+  // empty, the session's started without an app, and one can be launched
+  // later with launch_app().
   static StatusOr<std::unique_ptr<WestonBackend>> start_server(
       int32_t port_offset, int32_t width, int32_t height,
       const std::vector<std::string>& command,
-      ProcessOutConf&& command_out = ProcessOutConf());
+      ProcessOutConf&& command_out = ProcessOutConf(),
+      const BackendOptions& options = BackendOptions());
+
+  // Stops the app and then Weston.
+  ~WestonBackend();
+
+  // Launches 'command' into the session with the session's DISPLAY and
+  // WAYLAND_DISPLAY set. DISPLAY is unset in sessions without Xwayland.
+  //
+  // Returns INVALID_ARGUMENT if the session already has an app, or if
+  // 'command_out' directs the output of, or passes fds to, an app run by
+  // options.mux_reaper.
+  StatusVal launch_app(const std::vector<std::string>& command,
+                       ProcessOutConf&& command_out = ProcessOutConf());
+
+  // Terminates the running app, if any, along with the rest of its process
+  // tree, and launches 'command' into the same session. Weston, Xwayland, and
+  // any connected VNC clients keep running throughout.
+  //
+  // If 'zygote' is set, 'command' must run a Python interpreter, and it's
+  // forked from a zygote (zygote/zygote.h) that runs that interpreter with
+  // 'zygote's preloads. The zygote's started in the app's place, with
+  // 'command_out', on the first such restart and reused by later restarts
+  // with the same interpreter and preloads, whose apps share its output.
+  StatusVal restart_app(const std::vector<std::string>& command,
+                        ProcessOutConf&& command_out = ProcessOutConf(),
+                        const ZygoteOptions* zygote = nullptr);
 
   int port() { return port_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  bool has_app() const {
+    return app_reaper_ || app_group_ || subproc_.pid != -1;
+  }
+  const DisplayVars& display_vars() const { return dpy_vars_; }
+  // With reaping enabled, these are the pids of the reapers, whose process
+  // trees contain Weston and the app. With a mux_reaper, the app's pid is its
+  // shell's. Apps forked from a zygote report their own pid.
+  int weston_pid() const { return weston_.pid; }
+  int app_pid() const;
+  const TeardownStats& app_teardown_stats() const { return app_teardowns_; }
+
+  // Returns the recent output of Weston and of the latest app, keyed by
+  // "weston" and "app", for the streams that options.log_collector collects.
+  std::map<std::string, std::string> logs() const;
+
+  // Pins Weston, Xwayland, and the app, along with any apps launched later,
+  // to 'cpus'. An empty list unpins them. With options.cpu_allocator, the
+  // session's reserved CPUs are replaced by 'cpus', or released when it's
+  // unpinned.
+  //
+  // Returns UNAVAILABLE if another session sharing the allocator has
+  // reserved any of 'cpus', and INVALID_ARGUMENT if any isn't the
+  // allocator's.
+  StatusVal pin(const std::vector<int>& cpus);
+  // The CPUs the session's pinned to, or an empty list if it isn't pinned.
+  const std::vector<int>& cpus() const { return cpus_; }
+
+  // Waits for the session's Xwayland to finish starting, if it's being warmed
+  // up, and records how long it took to start in the startup profile's
+  // xwayland_s. That's measured until wait_for_xwayland() sees Xwayland
+  // running, so call it before Xwayland's likely to be up for an exact time.
+  //
+  // Returns DEADLINE_EXCEEDED if Xwayland doesn't start within 'timeout'.
+  StatusVal wait_for_xwayland(std::chrono::milliseconds timeout);
+
+  // How long each phase of start_server() took. Sessions started without an
+  // app don't have a "launch_app" phase.
+  const StartupProfile& startup_profile() const { return profile_; }
+
+  // The clock that the session's apps run on, or null if the session wasn't
+  // started with options.virtual_clock.
+  VirtualClock* clock() const { return clock_.get(); }
+
+  // Returns the resource usage of the session's cgroup.
+  //
+  // Returns NOT_FOUND if the session wasn't started with options.cgroup.
+  StatusOr<CgroupUsage> resource_usage() const;
 
  private:
-  WestonBackend(int port, Process&& weston, Process&& subproc)
-      : port_(port), weston_(std::move(weston)), subproc_(std::move(subproc)) {}
+  WestonBackend(PortLease&& port_lease, int width, int height,
+                const BackendOptions& options)
+      : port_lease_(std::move(port_lease)),
+        port_(port_lease_.port()),
+        width_(width),
+        height_(height),
+        options_(options) {}
+
+  // Returns the options that start processes in the session's cgroup and on
+  // its CPUs.
+  LaunchOpts launch_opts() const;
+
+  // Returns the environment apps run with.
+  EnvVars app_env() const;
+  // Launches 'command' with 'env' into the app slot.
+  StatusVal launch_app_with_env(const std::vector<std::string>& command,
+                                EnvVars* env, ProcessOutConf&& command_out);
+
+  // Starts a zygote for 'python' in the app slot and waits for it to be ready.
+  StatusVal start_zygote(const std::string& python,
+                         const ZygoteOptions& options,
+                         ProcessOutConf&& command_out);
+  // Stops the app forked from the zygote, if any, and records how long that
+  // took. The zygote keeps running.
+  void stop_zygote_app();
+
+  // Hands the app's output pipe, if it has one, to options_.log_collector.
+  void collect_app_logs(Process* app);
+
+  // Stops the app and its process tree, and records how long that took.
+  void stop_app();
+  void record_teardown(std::chrono::steady_clock::time_point start);
 
+  // Declared before weston_ so that we hold the port until Weston's exited.
+  PortLease port_lease_;
   int port_;
+  int width_;
+  int height_;
+  BackendOptions options_;
+  // Declared before the session's processes so that it's removed after
+  // they've exited.
+  std::optional<Cgroup> cgroup_;
+  CpuLease cpu_lease_;
+  std::unique_ptr<VirtualClock> clock_;
+  std::vector<int> cpus_;
+  std::optional<reaper::Reaper> weston_reaper_;
+  // Declared before 'weston_' so that the file outlives Weston.
+  WestonIniFile weston_ini_;
   Process weston_;
+  DisplayVars dpy_vars_;
+  std::optional<XwaylandWarmup> xwayland_warmup_;
+  std::chrono::steady_clock::time_point xwayland_warmup_start_;
+  StartupProfile profile_;
+  std::optional<reaper::Reaper> app_reaper_;
+  // The app's group in options_.mux_reaper.
+  std::optional<reaper::MuxReaper::GroupId> app_group_;
   Process subproc_;
+  // When set, the app slot runs this zygote, and zygote_app_ is the pid of the
+  // app it forked, if any.
+  std::unique_ptr<Zygote> zygote_;
+  int zygote_app_ = -1;
+  std::optional<LogCollector::StreamId> weston_log_;
+  std::optional<LogCollector::StreamId> app_log_;
+  TeardownStats app_teardowns_;
 };
 
 #endif  // DESKTOP_WESTON_BACKEND_H_
@@ -0,0 +1,105 @@
+#include "desktop/weston_pool.h"
+
+#include <format>
+
+#include "time_aliases.h"
+
+namespace {
+// How long the refill thread waits before retrying after a failed start up.
+const auto kRetryDelay = 1s;
+}  // namespace
+
+StatusOr<std::unique_ptr<WestonPool>> WestonPool::create(
+    int32_t port_offset, int32_t width, int32_t height, int size,
+    const BackendOptions& options) {
+  if (size < 1) {
+    return InvalidArgumentError(
+        std::format("WestonPool size must be positive, got: {}", size));
+  }
+  auto pool = std::unique_ptr<WestonPool>(
+      new WestonPool(port_offset, width, height, size, options));
+  pool->refill_thread_ = std::thread(&WestonPool::refill_loop, pool.get());
+  return pool;
+}
+
+WestonPool::~WestonPool() {
+  {
+    std::lock_guard l(mu_);
+    exit_ = true;
+  }
+  cv_.notify_all();
+  if (refill_thread_.joinable()) {
+    refill_thread_.join();
+  }
+}
+
+StatusOr<std::unique_ptr<WestonBackend>> WestonPool::claim() {
+  {
+    std::lock_guard l(mu_);
+    if (!idle_.empty()) {
+      std::unique_ptr<WestonBackend> backend = std::move(idle_.front());
+      idle_.pop_front();
+      cv_.notify_all();
+      return backend;
+    }
+  }
+  cv_.notify_all();
+  LOG(kLogVnc, "WestonPool is empty, starting a session synchronously.");
+  return WestonBackend::start_server(port_offset_, width_, height_,
+                                     /*command=*/{}, ProcessOutConf(),
+                                     options_);
+}
+
+StatusVal WestonPool::wait_until_full(std::chrono::milliseconds timeout) {
+  std::unique_lock l(mu_);
+  bool full = cv_.wait_for(l, timeout, [this] {
+    return (int)idle_.size() >= size_ || !last_error_.ok();
+  });
+  if (!last_error_.ok()) return last_error_;
+  if (!full) {
+    return DeadlineExceededError(
+        std::format("WestonPool had {} of {} sessions after waiting {} ms.",
+                    idle_.size(), size_, timeout.count()));
+  }
+  return OkStatus();
+}
+
+int WestonPool::num_idle() {
+  std::lock_guard l(mu_);
+  return idle_.size();
+}
+
+void WestonPool::refill_loop() {
+  std::unique_lock l(mu_);
+  while (true) {
+    cv_.wait(l, [this] { return exit_ || (int)idle_.size() < size_; });
+    if (exit_) break;
+
+    // Start sessions without holding the lock so that claims aren't blocked
+    // on start up.
+    l.unlock();
+    StatusOr<std::unique_ptr<WestonBackend>> backend =
+        WestonBackend::start_server(port_offset_, width_, height_,
+                                    /*command=*/{}, ProcessOutConf(),
+                                    options_);
+    l.lock();
+
+    if (!backend.ok()) {
+      ERROR("WestonPool failed to start a session: %s",
+            backend.status().to_string().c_str());
+      last_error_ = backend.status();
+      cv_.notify_all();
+      cv_.wait_for(l, kRetryDelay, [this] { return exit_; });
+      continue;
+    }
+    last_error_ = OkStatus();
+    idle_.push_back(std::move(backend.value()));
+    cv_.notify_all();
+  }
+
+  // Shut down idle sessions outside of the lock, since tearing down a session
+  // can take a while.
+  std::deque<std::unique_ptr<WestonBackend>> idle = std::move(idle_);
+  l.unlock();
+  idle.clear();
+}
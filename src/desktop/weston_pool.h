@@ -0,0 +1,76 @@
+// A pool of idle, pre-started Weston sessions.
+//
+// Starting a session (Weston, Xwayland, and export_display) takes most of the
+// time in creating a desktop, so the pool starts sessions ahead of time on a
+// background thread. Callers claim a warm session and launch their app into
+// it with WestonBackend::launch_app(), and the pool refills itself
+// asynchronously.
+//
+// Idle sessions run only export_display, which acts as the session's
+// placeholder app until the session's claimed.
+
+#ifndef DESKTOP_WESTON_POOL_H_
+#define DESKTOP_WESTON_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "desktop/weston_backend.h"
+#include "third_party/status/status_or.h"
+
+class WestonPool {
+ public:
+  // Creates a pool that keeps 'size' idle sessions of the given resolution
+  // running. Sessions are started in the background, so the pool is empty
+  // right after creation.
+  static StatusOr<std::unique_ptr<WestonPool>> create(
+      int32_t port_offset, int32_t width, int32_t height, int size,
+      const BackendOptions& options = BackendOptions());
+  // Stops refilling and shuts down all idle sessions.
+  ~WestonPool();
+
+  WestonPool(const WestonPool&) = delete;
+  WestonPool& operator=(const WestonPool&) = delete;
+
+  // Returns an idle session if one's available and otherwise starts a new one
+  // synchronously. Either way, wakes the refill thread to replace it.
+  StatusOr<std::unique_ptr<WestonBackend>> claim();
+
+  // Blocks until the pool is full or until 'timeout' elapses. Returns the
+  // refill thread's last error if its most recent start up attempt failed.
+  StatusVal wait_until_full(std::chrono::milliseconds timeout);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int num_idle();
+
+ private:
+  WestonPool(int32_t port_offset, int32_t width, int32_t height, int size,
+             const BackendOptions& options)
+      : port_offset_(port_offset),
+        width_(width),
+        height_(height),
+        size_(size),
+        options_(options) {}
+
+  void refill_loop();
+
+  const int32_t port_offset_;
+  const int32_t width_;
+  const int32_t height_;
+  const int size_;
+  const BackendOptions options_;
+
+  std::mutex mu_;
+  // Signaled when sessions are added or claimed, and on shut down.
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<WestonBackend>> idle_;
+  StatusVal last_error_ = OkStatus();
+  bool exit_ = false;
+  std::thread refill_thread_;
+};
+
+#endif  // DESKTOP_WESTON_POOL_H_
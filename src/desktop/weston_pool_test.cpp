@@ -0,0 +1,42 @@
+#include "desktop/weston_pool.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <signal.h>
+
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+TEST(WestonPool, non_positive_size_is_invalid) {
+  EXPECT_THAT(WestonPool::create(5960, 300, 200, 0),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST(WestonPool, claimed_session_runs_app) {
+  ASSERT_OK_AND_ASSIGN(auto pool, WestonPool::create(5960, 300, 200, 1));
+  StatusVal full = pool->wait_until_full(10s);
+  ASSERT_OK(full);
+
+  ASSERT_OK_AND_ASSIGN(auto backend, pool->claim());
+  EXPECT_EQ(backend->width(), 300);
+  EXPECT_EQ(backend->height(), 200);
+  EXPECT_FALSE(backend->has_app());
+  StatusVal launched = backend->launch_app({"sleep", "100"});
+  EXPECT_OK(launched);
+  EXPECT_TRUE(backend->has_app());
+  EXPECT_EQ(kill(backend->app_pid(), 0), 0);
+  EXPECT_THAT(backend->launch_app({"sleep", "100"}),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+
+  // The pool refills itself after a claim.
+  full = pool->wait_until_full(10s);
+  EXPECT_OK(full);
+  EXPECT_EQ(pool->num_idle(), 1);
+}
+
+TEST(WestonPool, empty_pool_starts_session_on_claim) {
+  ASSERT_OK_AND_ASSIGN(auto pool, WestonPool::create(5965, 300, 200, 1));
+  ASSERT_OK_AND_ASSIGN(auto a, pool->claim());
+  ASSERT_OK_AND_ASSIGN(auto b, pool->claim());
+  EXPECT_NE(a->port(), b->port());
+}
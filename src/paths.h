@@ -32,6 +32,26 @@ inline std::string get_export_display_path() {
   return get_package_path() + "/bin/export_display";
 }
 
+inline std::string get_xwayland_wrapper_path() {
+  return get_package_path() + "/bin/xwayland_wrapper";
+}
+
+inline std::string get_reaper_path() {
+  return get_package_path() + "/bin/reaper";
+}
+
+inline std::string get_load_app_path() {
+  return get_package_path() + "/bin/load_app";
+}
+
+inline std::string get_zygote_path() {
+  return get_package_path() + "/zygote.py";
+}
+
+inline std::string get_vclock_shim_path() {
+  return get_package_path() + "/lib/libbounce_vclock.so";
+}
+
 inline std::string get_weston_bin() {
   return get_package_path() + "/_vendored/weston/bin/weston";
 }
@@ -0,0 +1,342 @@
+#include "process/cgroup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include "libc_error.h"
+#include "process/fd.h"
+#include "time_aliases.h"
+
+namespace {
+// Returns where cgroup v2 is mounted, or an empty string if it isn't.
+std::string get_cgroup2_mount() {
+  std::ifstream mounts("/proc/self/mounts");
+  std::string line;
+  while (std::getline(mounts, line)) {
+    std::istringstream fields(line);
+    std::string device, mount_point, type;
+    fields >> device >> mount_point >> type;
+    if (type == "cgroup2") return mount_point;
+  }
+  return "";
+}
+
+// Returns the calling process's cgroup v2 path relative to the cgroup2 mount.
+std::string get_own_cgroup() {
+  std::ifstream cgroups("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(cgroups, line)) {
+    // The cgroup v2 entry has hierarchy ID 0 and no controllers.
+    if (line.starts_with("0::")) return line.substr(3);
+  }
+  return "";
+}
+
+StatusVal write_file(const std::string& path, const std::string& value) {
+  Fd fd = Fd::take(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+  if (*fd == -1) {
+    return UnavailableError(
+        std::format("Failed to open {}: {}", path, libc_error_name(errno)));
+  }
+  if (write(*fd, value.data(), value.size()) != (ssize_t)value.size()) {
+    return UnavailableError(std::format("Failed to write {} to {}: {}", value,
+                                        path, libc_error_name(errno)));
+  }
+  return OkStatus();
+}
+
+// Reads the first integer in 'path', or returns -1 if there isn't one.
+int64_t read_int(const std::string& path) {
+  std::ifstream in(path);
+  int64_t v = -1;
+  in >> v;
+  return in ? v : -1;
+}
+
+// Parses a pressure file, with lines like:
+//   some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+Pressure read_pressure(const std::string& path) {
+  Pressure p;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    double avg10 = 0, avg60 = 0, avg300 = 0;
+    unsigned long long total = 0;
+    char kind[8] = {};
+    if (sscanf(line.c_str(), "%7s avg10=%lf avg60=%lf avg300=%lf total=%llu",
+               kind, &avg10, &avg60, &avg300, &total) != 5) {
+      continue;
+    }
+    if (std::string(kind) == "some") {
+      p.some_avg10 = avg10;
+      p.some_avg60 = avg60;
+      p.some_total_us = total;
+    } else if (std::string(kind) == "full") {
+      p.full_avg10 = avg10;
+      p.full_avg60 = avg60;
+      p.full_total_us = total;
+    }
+  }
+  return p;
+}
+
+std::vector<int> read_pids(const std::string& cgroup) {
+  std::vector<int> pids;
+  std::ifstream procs(cgroup + "/cgroup.procs");
+  int pid;
+  while (procs >> pid) {
+    pids.push_back(pid);
+  }
+  return pids;
+}
+
+// Reads a cgroup.controllers or cgroup.subtree_control file.
+std::set<std::string> read_controllers(const std::string& path) {
+  std::ifstream in(path);
+  std::set<std::string> controllers;
+  std::string controller;
+  while (in >> controller) controllers.insert(controller);
+  return controllers;
+}
+
+// Guards the paths below, which are set up the first time limits are applied.
+std::mutex limits_mu;
+// The calling process's cgroup when limits were first applied. It's cached,
+// since its processes may then have been moved into a leaf.
+std::string limits_own;
+// '<limits_own>/bounce_desktop', which holds every cgroup with limits.
+std::string limits_parent;
+
+// Moves every process in 'cgroup' into its 'bounce_main' child, so that
+// 'cgroup' can enable controllers for its children.
+StatusVal move_processes_to_leaf(const std::string& cgroup) {
+  std::string leaf = cgroup + "/bounce_main";
+  if (mkdir(leaf.c_str(), 0755) == -1 && errno != EEXIST) {
+    return UnavailableError(std::format("Failed to create cgroup {}: {}", leaf,
+                                        libc_error_name(errno)));
+  }
+  // Processes can fork while they're being moved, so move until none are
+  // left. Moves of processes that have since exited fail, and are ignored.
+  for (int i = 0; i < 100; ++i) {
+    std::vector<int> pids = read_pids(cgroup);
+    if (pids.empty()) return OkStatus();
+    for (int pid : pids) {
+      write_file(leaf + "/cgroup.procs", std::to_string(pid));
+    }
+  }
+  return UnavailableError(
+      std::format("Failed to move the processes out of cgroup {}.", cgroup));
+}
+
+// Enables 'controller' for limits_parent's children, first enabling it for
+// limits_own's children if it isn't yet. Must be called with 'limits_mu'
+// held.
+StatusVal enable_controller(const std::string& controller) {
+  std::string parent_control = limits_parent + "/cgroup.subtree_control";
+  if (read_controllers(parent_control).contains(controller)) {
+    return OkStatus();
+  }
+  if (!read_controllers(limits_parent + "/cgroup.controllers")
+           .contains(controller)) {
+    if (!read_controllers(limits_own + "/cgroup.controllers")
+             .contains(controller)) {
+      return UnavailableError(
+          std::format("The {} controller isn't delegated to cgroup {}.",
+                      controller, limits_own));
+    }
+    // The root cgroup's exempt from the no internal processes rule.
+    bool root = limits_own == get_cgroup2_mount() + "/";
+    if (!root) RETURN_IF_ERROR(move_processes_to_leaf(limits_own));
+    RETURN_IF_ERROR(write_file(limits_own + "/cgroup.subtree_control",
+                               "+" + controller));
+  }
+  return write_file(parent_control, "+" + controller);
+}
+
+// Returns limits_parent once it enables 'controllers' for its children.
+StatusOr<std::string> get_limits_parent(
+    const std::set<std::string>& controllers) {
+  std::lock_guard l(limits_mu);
+  if (limits_parent.empty()) {
+    std::string mount = get_cgroup2_mount();
+    if (mount.empty()) return UnavailableError("cgroup v2 isn't mounted.");
+    std::string own = mount + get_own_cgroup();
+    std::string parent = own + "/bounce_desktop";
+    if (mkdir(parent.c_str(), 0755) == -1 && errno != EEXIST) {
+      return UnavailableError(std::format("Failed to create cgroup {}: {}",
+                                          parent, libc_error_name(errno)));
+    }
+    limits_own = own;
+    limits_parent = parent;
+  }
+  for (const std::string& controller : controllers) {
+    RETURN_IF_ERROR(enable_controller(controller));
+  }
+  return limits_parent;
+}
+
+bool events_show_populated(int events_fd) {
+  char buf[256];
+  ssize_t r = pread(events_fd, buf, sizeof(buf) - 1, 0);
+  if (r <= 0) return false;
+  buf[r] = '\0';
+  return std::string(buf).find("populated 1") != std::string::npos;
+}
+}  // namespace
+
+StatusOr<Cgroup> Cgroup::create(const std::string& name) {
+  std::string mount = get_cgroup2_mount();
+  if (mount.empty()) return UnavailableError("cgroup v2 isn't mounted.");
+  std::string own = get_own_cgroup();
+
+  std::string path = std::format("{}{}/{}", mount, own, name);
+  if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST) {
+    return UnavailableError(std::format("Failed to create cgroup {}: {}", path,
+                                        libc_error_name(errno)));
+  }
+  return Cgroup(path);
+}
+
+StatusOr<Cgroup> Cgroup::create_limited(const std::string& name,
+                                        const CgroupLimits& limits) {
+  std::set<std::string> controllers;
+  if (limits.cpu_weight > 0 || limits.cpu_quota > 0) controllers.insert("cpu");
+  if (limits.memory_max > 0) controllers.insert("memory");
+  if (limits.pids_max > 0) controllers.insert("pids");
+  ASSIGN_OR_RETURN(std::string parent, get_limits_parent(controllers));
+
+  std::string path = parent + "/" + name;
+  if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST) {
+    return UnavailableError(std::format("Failed to create cgroup {}: {}", path,
+                                        libc_error_name(errno)));
+  }
+  Cgroup cgroup(path);
+  RETURN_IF_ERROR(cgroup.set_limits(limits));
+  return cgroup;
+}
+
+Cgroup::~Cgroup() {
+  if (path_.empty()) return;
+  rmdir(path_.c_str());
+}
+
+Cgroup::Cgroup(Cgroup&& other) : path_(std::move(other.path_)) {
+  other.path_.clear();
+}
+
+Cgroup& Cgroup::operator=(Cgroup&& other) {
+  if (this == &other) return *this;
+  if (!path_.empty()) rmdir(path_.c_str());
+  path_ = std::move(other.path_);
+  other.path_.clear();
+  return *this;
+}
+
+StatusVal Cgroup::add_process(int pid) {
+  return write_file(path_ + "/cgroup.procs", std::to_string(pid));
+}
+
+std::vector<int> Cgroup::processes() const { return read_pids(path_); }
+
+void Cgroup::signal(int sig) const {
+  for (int pid : processes()) {
+    ::kill(pid, sig);
+  }
+}
+
+void Cgroup::kill() const {
+  // cgroup.kill was added in Linux 5.14.
+  if (write_file(path_ + "/cgroup.kill", "1").ok()) return;
+  // Without cgroup.kill, processes can fork while we're signaling, so keep
+  // signaling until the cgroup's empty.
+  for (int i = 0; i < 100 && populated(); ++i) {
+    signal(SIGKILL);
+  }
+}
+
+bool Cgroup::populated() const {
+  Fd events = Fd::take(open((path_ + "/cgroup.events").c_str(),
+                            O_RDONLY | O_CLOEXEC));
+  if (*events == -1) return false;
+  return events_show_populated(*events);
+}
+
+StatusVal Cgroup::wait_empty(std::chrono::milliseconds timeout) const {
+  Fd events = Fd::take(open((path_ + "/cgroup.events").c_str(),
+                            O_RDONLY | O_CLOEXEC));
+  if (*events == -1) {
+    return UnavailableError(std::format("Failed to open {}/cgroup.events: {}",
+                                        path_, libc_error_name(errno)));
+  }
+
+  // Changes to cgroup.events wake pollers with POLLPRI.
+  const auto deadline = sc_now() + timeout;
+  while (events_show_populated(*events)) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - sc_now());
+    if (remaining.count() <= 0) {
+      return DeadlineExceededError(
+          std::format("cgroup {} still has processes.", path_));
+    }
+    pollfd p = {.fd = *events, .events = POLLPRI, .revents = 0};
+    int r = poll(&p, 1, remaining.count());
+    if (r == -1 && errno != EINTR) {
+      return InternalError(std::format("Polling {}/cgroup.events failed: {}",
+                                       path_, libc_error_name(errno)));
+    }
+  }
+  return OkStatus();
+}
+
+StatusVal Cgroup::set_limits(const CgroupLimits& limits) {
+  std::vector<std::pair<std::string, std::string>> files;
+  if (limits.cpu_weight > 0) {
+    files.push_back({"cpu.weight", std::to_string(limits.cpu_weight)});
+  }
+  if (limits.cpu_quota > 0) {
+    const int kPeriodUs = 100'000;
+    int64_t quota_us = limits.cpu_quota * kPeriodUs;
+    files.push_back({"cpu.max", std::format("{} {}", quota_us, kPeriodUs)});
+  }
+  if (limits.memory_max > 0) {
+    files.push_back({"memory.max", std::to_string(limits.memory_max)});
+  }
+  if (limits.pids_max > 0) {
+    files.push_back({"pids.max", std::to_string(limits.pids_max)});
+  }
+
+  for (const auto& [file, value] : files) {
+    RETURN_IF_ERROR(write_file(path_ + "/" + file, value));
+  }
+  return OkStatus();
+}
+
+CgroupUsage Cgroup::usage() const {
+  CgroupUsage usage;
+  std::ifstream cpu_stat(path_ + "/cpu.stat");
+  std::string key;
+  uint64_t value;
+  while (cpu_stat >> key >> value) {
+    if (key == "usage_usec") usage.cpu_usage_us = value;
+    if (key == "user_usec") usage.cpu_user_us = value;
+    if (key == "system_usec") usage.cpu_system_us = value;
+  }
+  usage.memory_current = read_int(path_ + "/memory.current");
+  usage.memory_peak = read_int(path_ + "/memory.peak");
+  usage.pids_current = read_int(path_ + "/pids.current");
+  usage.cpu_pressure = read_pressure(path_ + "/cpu.pressure");
+  usage.memory_pressure = read_pressure(path_ + "/memory.pressure");
+  usage.io_pressure = read_pressure(path_ + "/io.pressure");
+  return usage;
+}
@@ -0,0 +1,130 @@
+// A cgroup v2 leaf that holds a process tree, so that the tree can be
+// signaled, killed, and waited on as a unit, even if its processes daemonize
+// or change process groups.
+
+#ifndef PROCESS_CGROUP_H_
+#define PROCESS_CGROUP_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "third_party/status/status_or.h"
+
+// Resource limits for a cgroup's processes. Zero leaves a limit unset.
+struct CgroupLimits {
+  // The cgroup's share of CPU time relative to its siblings, from 1 to 10000.
+  // Cgroups default to 100.
+  int cpu_weight = 0;
+  // The most CPU time the cgroup can use, in CPUs, e.g. 1.5.
+  double cpu_quota = 0;
+  // The most memory the cgroup can use, in bytes, before its processes are
+  // OOM killed.
+  int64_t memory_max = 0;
+  // The most processes and threads the cgroup can have.
+  int64_t pids_max = 0;
+
+  bool operator==(const CgroupLimits& other) const = default;
+};
+
+// Pressure stall information for one resource: how much of the time some, or
+// all, of a cgroup's tasks were stalled waiting on it.
+struct Pressure {
+  // Percentages over the last 10 and 60 seconds.
+  double some_avg10 = 0;
+  double some_avg60 = 0;
+  double full_avg10 = 0;
+  double full_avg60 = 0;
+  // Total stall times.
+  uint64_t some_total_us = 0;
+  uint64_t full_total_us = 0;
+};
+
+struct CgroupUsage {
+  uint64_t cpu_usage_us = 0;
+  uint64_t cpu_user_us = 0;
+  uint64_t cpu_system_us = 0;
+  // These are -1 if the cgroup's memory or pids controllers aren't enabled.
+  // memory_peak is also -1 before Linux 5.19.
+  int64_t memory_current = -1;
+  int64_t memory_peak = -1;
+  int64_t pids_current = -1;
+  // These are all zeros if the kernel doesn't track pressure.
+  Pressure cpu_pressure;
+  Pressure memory_pressure;
+  Pressure io_pressure;
+};
+
+class Cgroup {
+ public:
+  // Creates a cgroup named 'name' as a child of the calling process's cgroup.
+  //
+  // Returns UNAVAILABLE if cgroup v2 isn't mounted or if we aren't allowed to
+  // create cgroups under our own.
+  static StatusOr<Cgroup> create(const std::string& name);
+
+  // Creates a cgroup named 'name' with 'limits' in
+  // '<own cgroup>/bounce_desktop', a cgroup without processes of its own that
+  // enables the controllers the limits need for its children.
+  //
+  // cgroup v2 only lets a cgroup without processes enable controllers for its
+  // children (the "no internal processes" rule). So if the calling process's
+  // cgroup isn't the root and the controllers aren't enabled for its children
+  // yet, its processes, including the caller, are first moved into a new
+  // '<own cgroup>/bounce_main' leaf.
+  //
+  // Returns UNAVAILABLE if cgroup v2 isn't mounted, or if the controllers
+  // aren't delegated to the calling process's cgroup.
+  static StatusOr<Cgroup> create_limited(const std::string& name,
+                                         const CgroupLimits& limits);
+
+  // Removes the cgroup. Removal fails if the cgroup still has processes, in
+  // which case the cgroup's left in place.
+  ~Cgroup();
+
+  Cgroup(Cgroup&& other);
+  Cgroup& operator=(Cgroup&& other);
+  Cgroup(const Cgroup&) = delete;
+  Cgroup& operator=(const Cgroup&) = delete;
+
+  // Moves 'pid' into the cgroup. Processes the pid forks afterwards start in
+  // the cgroup too.
+  StatusVal add_process(int pid);
+
+  // Returns the pids of the processes in the cgroup.
+  std::vector<int> processes() const;
+
+  // Sends 'sig' to every process in the cgroup.
+  void signal(int sig) const;
+
+  // SIGKILLs every process in the cgroup, using cgroup.kill if the kernel
+  // supports it.
+  void kill() const;
+
+  // Returns whether any processes are in the cgroup.
+  bool populated() const;
+
+  // Waits for the cgroup to become empty by watching cgroup.events.
+  //
+  // Returns DEADLINE_EXCEEDED if the cgroup still has processes after
+  // 'timeout'.
+  StatusVal wait_empty(std::chrono::milliseconds timeout) const;
+
+  // Returns the cgroup's resource usage so far.
+  CgroupUsage usage() const;
+
+  const std::string& path() const { return path_; }
+
+ private:
+  explicit Cgroup(const std::string& path) : path_(path) {}
+
+  // Writes 'limits' to the cgroup's interface files. The parent must already
+  // enable the controllers they need.
+  StatusVal set_limits(const CgroupLimits& limits);
+
+  std::string path_;
+};
+
+#endif  // PROCESS_CGROUP_H_
@@ -0,0 +1,144 @@
+#include "process/cgroup.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <sstream>
+
+#include "process/process.h"
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+// Returns a cgroup for the test, or skips the test if cgroups aren't
+// available.
+#define CREATE_OR_SKIP(cgroup, name)                                 \
+  StatusOr<Cgroup> cgroup##_or =                                     \
+      Cgroup::create(std::format("{}_{}", name, getpid()));          \
+  if (cgroup##_or.status().code() == StatusCode::UNAVAILABLE) {      \
+    GTEST_SKIP() << cgroup##_or.status().to_string();                \
+  }                                                                  \
+  ASSERT_OK(cgroup##_or);                                            \
+  Cgroup cgroup = std::move(cgroup##_or.value());
+
+// Returns whether this process's cgroup can create children and has
+// 'controllers' to enable for them.
+bool controllers_delegated(const std::vector<std::string>& controllers) {
+  std::string mount;
+  std::ifstream mounts("/proc/self/mounts");
+  std::string line;
+  while (std::getline(mounts, line)) {
+    std::istringstream fields(line);
+    std::string device, mount_point, type;
+    fields >> device >> mount_point >> type;
+    if (type == "cgroup2") mount = mount_point;
+  }
+  std::string own;
+  std::ifstream cgroups("/proc/self/cgroup");
+  while (std::getline(cgroups, line)) {
+    if (line.starts_with("0::")) own = mount + line.substr(3);
+  }
+  if (mount.empty() || own.empty() || access(own.c_str(), W_OK) != 0) {
+    return false;
+  }
+
+  std::ifstream available(own + "/cgroup.controllers");
+  std::vector<std::string> found;
+  std::string controller;
+  while (available >> controller) found.push_back(controller);
+  for (const std::string& c : controllers) {
+    if (std::find(found.begin(), found.end(), c) == found.end()) return false;
+  }
+  return true;
+}
+}  // namespace
+
+TEST(CgroupTest, kill_empties_cgroup) {
+  CREATE_OR_SKIP(cgroup, "bounce_cgroup_test_kill");
+  ASSERT_OK_AND_ASSIGN(Process p,
+                       launch_process({"sh", "-c", "sleep 100 & sleep 100"}));
+  StatusVal added = cgroup.add_process(p.pid);
+  ASSERT_OK(added);
+  EXPECT_THAT(cgroup.processes(), testing::Contains(p.pid));
+  EXPECT_TRUE(cgroup.populated());
+
+  cgroup.kill();
+  StatusVal emptied = cgroup.wait_empty(1000ms);
+  EXPECT_OK(emptied);
+  EXPECT_FALSE(cgroup.populated());
+}
+
+TEST(CgroupTest, wait_empty_times_out) {
+  CREATE_OR_SKIP(cgroup, "bounce_cgroup_test_timeout");
+  ASSERT_OK_AND_ASSIGN(Process p, launch_process({"sleep", "100"}));
+  StatusVal added = cgroup.add_process(p.pid);
+  ASSERT_OK(added);
+  EXPECT_THAT(cgroup.wait_empty(50ms),
+              StatusIs(StatusCode::DEADLINE_EXCEEDED));
+
+  cgroup.signal(SIGTERM);
+  StatusVal emptied = cgroup.wait_empty(1000ms);
+  EXPECT_OK(emptied);
+}
+
+TEST(CgroupTest, launch_opts_start_process_trees_in_cgroup) {
+  CREATE_OR_SKIP(cgroup, "bounce_cgroup_test_launch");
+  ASSERT_OK_AND_ASSIGN(
+      Process p, launch_process({"sh", "-c", "sleep 100 & sleep 100"}, nullptr,
+                                ProcessOutConf(),
+                                LaunchOpts{.cgroup = cgroup.path()}));
+  auto start = sc_now();
+  while (cgroup.processes().size() < 2 && sc_now() - start < 1s) {
+    sleep_for(5ms);
+  }
+  EXPECT_THAT(cgroup.processes(), testing::Contains(p.pid));
+  EXPECT_GE(cgroup.processes().size(), 2);
+
+  cgroup.kill();
+  StatusVal emptied = cgroup.wait_empty(1000ms);
+  EXPECT_OK(emptied);
+}
+
+TEST(CgroupTest, usage_reports_cpu_time) {
+  CREATE_OR_SKIP(cgroup, "bounce_cgroup_test_usage");
+  ASSERT_OK_AND_ASSIGN(
+      Process p,
+      launch_process(
+          {"sh", "-c", "i=0; while [ $i -lt 100000 ]; do i=$((i+1)); done"},
+          nullptr, ProcessOutConf(), LaunchOpts{.cgroup = cgroup.path()}));
+  ASSERT_OK_AND_ASSIGN(int status, p.wait_for(10s));
+  EXPECT_EQ(status, 0);
+
+  CgroupUsage usage = cgroup.usage();
+  EXPECT_GT(usage.cpu_usage_us, 0);
+  EXPECT_GE(usage.cpu_usage_us, usage.cpu_user_us);
+}
+
+TEST(CgroupTest, create_limited) {
+  // Only skips when the controllers aren't delegated at all. If they are,
+  // the limits must be applied, even though this process's cgroup holds
+  // processes.
+  if (!controllers_delegated({"cpu", "pids"})) {
+    GTEST_SKIP() << "The cpu and pids controllers aren't delegated.";
+  }
+  ASSERT_OK_AND_ASSIGN(
+      Cgroup cgroup,
+      Cgroup::create_limited(
+          std::format("bounce_cgroup_test_limits_{}", getpid()),
+          CgroupLimits{.cpu_quota = 1.5, .pids_max = 64}));
+
+  std::ifstream cpu_max(cgroup.path() + "/cpu.max");
+  std::string max, period;
+  cpu_max >> max >> period;
+  EXPECT_EQ(max, "150000");
+  EXPECT_EQ(period, "100000");
+  std::ifstream pids_max(cgroup.path() + "/pids.max");
+  int64_t pids;
+  pids_max >> pids;
+  EXPECT_EQ(pids, 64);
+}
@@ -0,0 +1,279 @@
+#include "process/cpu_affinity.h"
+
+#include <errno.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "libc_error.h"
+
+namespace {
+std::string trim(const std::string& s) {
+  size_t start = s.find_first_not_of(" \t\n");
+  if (start == std::string::npos) return "";
+  size_t end = s.find_last_not_of(" \t\n");
+  return s.substr(start, end - start + 1);
+}
+
+// Parses a non-negative int, or returns -1.
+int parse_int(const std::string& s) {
+  if (s.empty() || s.size() > 9 ||
+      !std::all_of(s.begin(), s.end(), ::isdigit)) {
+    return -1;
+  }
+  return std::stoi(s);
+}
+
+std::vector<int> intersect(const std::vector<int>& a,
+                           const std::vector<int>& b) {
+  std::vector<int> out;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::back_inserter(out));
+  return out;
+}
+}  // namespace
+
+StatusOr<std::vector<int>> parse_cpu_list(const std::string& list) {
+  std::set<int> cpus;
+  std::stringstream ss(trim(list));
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    range = trim(range);
+    size_t dash = range.find('-');
+    int first = parse_int(range.substr(0, dash));
+    int last =
+        dash == std::string::npos ? first : parse_int(range.substr(dash + 1));
+    if (first < 0 || last < first) {
+      return InvalidArgumentError(
+          std::format("Invalid CPU list \"{}\" at \"{}\".", list, range));
+    }
+    for (int cpu = first; cpu <= last; ++cpu) cpus.insert(cpu);
+  }
+  return std::vector<int>(cpus.begin(), cpus.end());
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+  std::vector<int> sorted = cpus;
+  std::sort(sorted.begin(), sorted.end());
+  std::string out;
+  for (size_t i = 0; i < sorted.size();) {
+    size_t j = i;
+    while (j + 1 < sorted.size() && sorted[j + 1] == sorted[j] + 1) ++j;
+    if (!out.empty()) out += ",";
+    out += j == i ? std::to_string(sorted[i])
+                  : std::format("{}-{}", sorted[i], sorted[j]);
+    i = j + 1;
+  }
+  return out;
+}
+
+std::vector<int> allowed_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int> cpus;
+  if (sched_getaffinity(0, sizeof(set), &set) == -1) return cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+std::vector<NumaNode> numa_nodes() {
+  std::vector<int> allowed = allowed_cpus();
+  std::vector<NumaNode> nodes;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator(
+           "/sys/devices/system/node", error)) {
+    std::string name = entry.path().filename();
+    if (!name.starts_with("node")) continue;
+    int id = parse_int(name.substr(4));
+    if (id < 0) continue;
+
+    std::ifstream in(entry.path() / "cpulist");
+    std::string list;
+    std::getline(in, list);
+    StatusOr<std::vector<int>> cpus = parse_cpu_list(list);
+    if (!cpus.ok()) continue;
+    std::vector<int> node_cpus = intersect(cpus.value(), allowed);
+    if (node_cpus.empty()) continue;
+    nodes.push_back(NumaNode{.id = id, .cpus = std::move(node_cpus)});
+  }
+  if (nodes.empty()) return {NumaNode{.id = 0, .cpus = allowed}};
+  std::sort(nodes.begin(), nodes.end(),
+            [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+  return nodes;
+}
+
+StatusVal set_cpu_affinity(int tid, const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return InvalidArgumentError(std::format("Invalid CPU: {}", cpu));
+    }
+    CPU_SET(cpu, &set);
+  }
+  if (sched_setaffinity(tid, sizeof(set), &set) == -1) {
+    if (errno == ESRCH) {
+      return NotFoundError(std::format("Thread {} has exited.", tid));
+    }
+    return InvalidArgumentError(
+        std::format("Failed to pin thread {} to CPUs {}: {}", tid,
+                    format_cpu_list(cpus), libc_error_name(errno)));
+  }
+  return OkStatus();
+}
+
+StatusVal set_tree_cpu_affinity(int pid, const std::vector<int>& cpus) {
+  std::string task_dir = std::format("/proc/{}/task", pid);
+  std::error_code error;
+  auto tasks = std::filesystem::directory_iterator(task_dir, error);
+  if (error) {
+    return NotFoundError(std::format("Process {} has exited.", pid));
+  }
+  for (const auto& task : tasks) {
+    int tid = parse_int(task.path().filename());
+    if (tid < 0) continue;
+    StatusVal s = set_cpu_affinity(tid, cpus);
+    if (!s.ok() && s.code() != StatusCode::NOT_FOUND) return s;
+
+    std::ifstream children(task.path() / "children");
+    int child;
+    while (children >> child) {
+      s = set_tree_cpu_affinity(child, cpus);
+      if (!s.ok() && s.code() != StatusCode::NOT_FOUND) return s;
+    }
+  }
+  return OkStatus();
+}
+
+struct CpuLease::State {
+  std::mutex mu;
+  std::vector<NumaNode> nodes;
+  std::set<int> used;
+};
+
+CpuLease::~CpuLease() { release(); }
+
+CpuLease& CpuLease::operator=(CpuLease&& other) {
+  if (this == &other) return *this;
+  release();
+  state_ = std::move(other.state_);
+  cpus_ = std::move(other.cpus_);
+  numa_node_ = other.numa_node_;
+  return *this;
+}
+
+void CpuLease::release() {
+  if (!state_) return;
+  std::lock_guard l(state_->mu);
+  for (int cpu : cpus_) state_->used.erase(cpu);
+  state_.reset();
+}
+
+CpuAllocator::CpuAllocator() : CpuAllocator(numa_nodes()) {}
+
+CpuAllocator::CpuAllocator(std::vector<NumaNode> nodes)
+    : state_(std::make_shared<CpuLease::State>()) {
+  state_->nodes = std::move(nodes);
+}
+
+StatusOr<CpuLease> CpuAllocator::allocate(int count) {
+  if (count < 1) {
+    return InvalidArgumentError(
+        std::format("Can't allocate {} CPUs.", count));
+  }
+  std::lock_guard l(state_->mu);
+
+  // Find each node's free CPUs, with the emptiest nodes first.
+  std::vector<std::pair<int, std::vector<int>>> free;
+  size_t total_free = 0;
+  for (const NumaNode& node : state_->nodes) {
+    std::vector<int> node_free;
+    for (int cpu : node.cpus) {
+      if (!state_->used.contains(cpu)) node_free.push_back(cpu);
+    }
+    total_free += node_free.size();
+    free.push_back({node.id, std::move(node_free)});
+  }
+  if (total_free < (size_t)count) {
+    return UnavailableError(std::format(
+        "Only {} CPUs are free, but {} were requested.", total_free, count));
+  }
+  std::stable_sort(free.begin(), free.end(), [](const auto& a, const auto& b) {
+    return a.second.size() > b.second.size();
+  });
+
+  CpuLease lease;
+  lease.state_ = state_;
+  if (free[0].second.size() >= (size_t)count) {
+    lease.numa_node_ = free[0].first;
+  }
+  for (const auto& [node, cpus] : free) {
+    for (int cpu : cpus) {
+      if (lease.cpus_.size() == (size_t)count) break;
+      lease.cpus_.push_back(cpu);
+      state_->used.insert(cpu);
+    }
+  }
+  std::sort(lease.cpus_.begin(), lease.cpus_.end());
+  return lease;
+}
+
+StatusOr<CpuLease> CpuAllocator::reserve(const std::vector<int>& cpus,
+                                         CpuLease* replaced) {
+  std::set<int> wanted(cpus.begin(), cpus.end());
+  if (wanted.empty()) return InvalidArgumentError("Can't reserve no CPUs.");
+  if (replaced && replaced->state_ && replaced->state_ != state_) {
+    return InvalidArgumentError("The replaced lease is another allocator's.");
+  }
+  std::lock_guard l(state_->mu);
+
+  std::set<int> replaced_cpus;
+  if (replaced && replaced->state_) {
+    replaced_cpus.insert(replaced->cpus_.begin(), replaced->cpus_.end());
+  }
+  std::set<int> nodes;
+  for (int cpu : wanted) {
+    auto node = std::find_if(
+        state_->nodes.begin(), state_->nodes.end(), [&](const NumaNode& n) {
+          return std::find(n.cpus.begin(), n.cpus.end(), cpu) != n.cpus.end();
+        });
+    if (node == state_->nodes.end()) {
+      return InvalidArgumentError(
+          std::format("CPU {} can't be reserved.", cpu));
+    }
+    if (state_->used.contains(cpu) && !replaced_cpus.contains(cpu)) {
+      return UnavailableError(
+          std::format("CPU {} is already reserved.", cpu));
+    }
+    nodes.insert(node->id);
+  }
+
+  if (replaced && replaced->state_) {
+    for (int cpu : replaced->cpus_) state_->used.erase(cpu);
+    replaced->state_.reset();
+    replaced->cpus_.clear();
+    replaced->numa_node_ = -1;
+  }
+  CpuLease lease;
+  lease.state_ = state_;
+  lease.cpus_.assign(wanted.begin(), wanted.end());
+  if (nodes.size() == 1) lease.numa_node_ = *nodes.begin();
+  state_->used.insert(wanted.begin(), wanted.end());
+  return lease;
+}
+
+int CpuAllocator::num_free() const {
+  std::lock_guard l(state_->mu);
+  int free = 0;
+  for (const NumaNode& node : state_->nodes) {
+    for (int cpu : node.cpus) free += !state_->used.contains(cpu);
+  }
+  return free;
+}
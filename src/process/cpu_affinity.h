@@ -0,0 +1,98 @@
+// CPU placement for processes and threads: pinning them to sets of CPUs, and
+// handing out disjoint, NUMA-local CPU sets to concurrent desktops.
+
+#ifndef PROCESS_CPU_AFFINITY_H_
+#define PROCESS_CPU_AFFINITY_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "third_party/status/status_or.h"
+
+// Parses a kernel CPU list, e.g. "0-3,8,10-11".
+StatusOr<std::vector<int>> parse_cpu_list(const std::string& list);
+// Formats 'cpus' as a kernel CPU list.
+std::string format_cpu_list(const std::vector<int>& cpus);
+
+// Returns the CPUs that the calling thread may run on.
+std::vector<int> allowed_cpus();
+
+struct NumaNode {
+  int id = 0;
+  std::vector<int> cpus;
+};
+
+// Returns the machine's NUMA nodes that have allowed_cpus(), with just those
+// CPUs. Machines without NUMA information have a single node 0.
+std::vector<NumaNode> numa_nodes();
+
+// Pins the thread 'tid', or the calling thread if 'tid' is 0, to 'cpus'.
+//
+// Returns NOT_FOUND if the thread's exited.
+StatusVal set_cpu_affinity(int tid, const std::vector<int>& cpus);
+
+// Pins every thread of 'pid' and of its descendants to 'cpus'. Descendants
+// that have been reparented elsewhere, e.g. by daemonizing, aren't found.
+StatusVal set_tree_cpu_affinity(int pid, const std::vector<int>& cpus);
+
+class CpuAllocator;
+
+// A set of CPUs reserved from a CpuAllocator. The reservation lasts for as long
+// as the lease exists.
+class CpuLease {
+ public:
+  CpuLease() = default;
+  ~CpuLease();
+
+  CpuLease(CpuLease&& other) = default;
+  CpuLease& operator=(CpuLease&& other);
+  CpuLease(const CpuLease&) = delete;
+  CpuLease& operator=(const CpuLease&) = delete;
+
+  const std::vector<int>& cpus() const { return cpus_; }
+  // The NUMA node the CPUs are on, or -1 if they span nodes.
+  int numa_node() const { return numa_node_; }
+
+ private:
+  friend class CpuAllocator;
+  struct State;
+
+  void release();
+
+  std::shared_ptr<State> state_;
+  std::vector<int> cpus_;
+  int numa_node_ = -1;
+};
+
+// Hands out disjoint sets of CPUs, keeping each set on a single NUMA node when
+// one has enough free CPUs. Thread safe. Leases can outlive their allocator.
+class CpuAllocator {
+ public:
+  // Allocates from numa_nodes().
+  CpuAllocator();
+  explicit CpuAllocator(std::vector<NumaNode> nodes);
+
+  // Reserves 'count' free CPUs, from the NUMA node with the most free CPUs if
+  // any node has enough of them.
+  //
+  // Returns UNAVAILABLE if fewer than 'count' CPUs are free.
+  StatusOr<CpuLease> allocate(int count);
+
+  // Reserves exactly 'cpus'. The CPUs of 'replaced', if set, count as free,
+  // and are released once the new lease is reserved, so that a lease can be
+  // swapped for an overlapping one.
+  //
+  // Returns INVALID_ARGUMENT if any of 'cpus' isn't the allocator's, and
+  // UNAVAILABLE if any is already reserved.
+  StatusOr<CpuLease> reserve(const std::vector<int>& cpus,
+                             CpuLease* replaced = nullptr);
+
+  int num_free() const;
+
+ private:
+  std::shared_ptr<CpuLease::State> state_;
+};
+
+#endif  // PROCESS_CPU_AFFINITY_H_
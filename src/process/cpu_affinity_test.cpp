@@ -0,0 +1,132 @@
+#include "process/cpu_affinity.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <format>
+#include <fstream>
+
+#include "process/process.h"
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+// Returns the CPUs 'pid' may run on, as listed in /proc.
+std::string cpus_allowed_list(int pid) {
+  std::ifstream status(std::format("/proc/{}/status", pid));
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.starts_with("Cpus_allowed_list:")) {
+      return line.substr(line.find_first_not_of(" \t", 18));
+    }
+  }
+  return "";
+}
+
+// Two nodes of four CPUs each.
+std::vector<NumaNode> two_nodes() {
+  return {NumaNode{.id = 0, .cpus = {0, 1, 2, 3}},
+          NumaNode{.id = 1, .cpus = {4, 5, 6, 7}}};
+}
+}  // namespace
+
+TEST(CpuAffinityTest, parses_and_formats_cpu_lists) {
+  ASSERT_OK_AND_ASSIGN(std::vector<int> cpus,
+                       parse_cpu_list("0-3,8,10-11\n"));
+  EXPECT_EQ(cpus, (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  ASSERT_OK_AND_ASSIGN(cpus, parse_cpu_list(""));
+  EXPECT_TRUE(cpus.empty());
+  EXPECT_THAT(parse_cpu_list("3-1"), StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_THAT(parse_cpu_list("a"), StatusIs(StatusCode::INVALID_ARGUMENT));
+
+  EXPECT_EQ(format_cpu_list({11, 0, 1, 2, 3, 8, 10}), "0-3,8,10-11");
+  EXPECT_EQ(format_cpu_list({}), "");
+}
+
+TEST(CpuAffinityTest, numa_nodes_cover_allowed_cpus) {
+  std::vector<int> cpus;
+  for (const NumaNode& node : numa_nodes()) {
+    cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+  }
+  std::sort(cpus.begin(), cpus.end());
+  EXPECT_EQ(cpus, allowed_cpus());
+}
+
+TEST(CpuAffinityTest, allocator_keeps_leases_disjoint_and_numa_local) {
+  CpuAllocator allocator(two_nodes());
+  ASSERT_OK_AND_ASSIGN(CpuLease a, allocator.allocate(2));
+  EXPECT_EQ(a.cpus(), (std::vector<int>{0, 1}));
+  EXPECT_EQ(a.numa_node(), 0);
+
+  // Node 1 has the most free CPUs now.
+  ASSERT_OK_AND_ASSIGN(CpuLease b, allocator.allocate(3));
+  EXPECT_EQ(b.cpus(), (std::vector<int>{4, 5, 6}));
+  EXPECT_EQ(b.numa_node(), 1);
+
+  // No node has three free CPUs, so the lease spans nodes.
+  ASSERT_OK_AND_ASSIGN(CpuLease c, allocator.allocate(3));
+  EXPECT_EQ(c.cpus(), (std::vector<int>{2, 3, 7}));
+  EXPECT_EQ(c.numa_node(), -1);
+
+  EXPECT_EQ(allocator.num_free(), 0);
+  EXPECT_THAT(allocator.allocate(1), StatusIs(StatusCode::UNAVAILABLE));
+}
+
+TEST(CpuAffinityTest, leases_release_their_cpus) {
+  CpuAllocator allocator(two_nodes());
+  {
+    ASSERT_OK_AND_ASSIGN(CpuLease a, allocator.allocate(8));
+    EXPECT_EQ(allocator.num_free(), 0);
+    CpuLease moved = std::move(a);
+    EXPECT_EQ(allocator.num_free(), 0);
+  }
+  EXPECT_EQ(allocator.num_free(), 8);
+}
+
+TEST(CpuAffinityTest, reserves_explicit_cpus) {
+  CpuAllocator allocator(two_nodes());
+  ASSERT_OK_AND_ASSIGN(CpuLease a, allocator.allocate(2));
+  EXPECT_THAT(allocator.reserve({1, 2}), StatusIs(StatusCode::UNAVAILABLE));
+  EXPECT_THAT(allocator.reserve({8}), StatusIs(StatusCode::INVALID_ARGUMENT));
+
+  // Replacing 'a' frees its CPUs for the new lease.
+  ASSERT_OK_AND_ASSIGN(CpuLease b, allocator.reserve({1, 2}, &a));
+  EXPECT_EQ(b.cpus(), (std::vector<int>{1, 2}));
+  EXPECT_EQ(b.numa_node(), 0);
+  EXPECT_TRUE(a.cpus().empty());
+  EXPECT_EQ(allocator.num_free(), 6);
+  ASSERT_OK_AND_ASSIGN(CpuLease c, allocator.allocate(2));
+  EXPECT_EQ(c.cpus(), (std::vector<int>{4, 5}));
+}
+
+TEST(CpuAffinityTest, launch_pins_process) {
+  std::vector<int> before = allowed_cpus();
+  std::vector<int> cpus = {before.back()};
+  ASSERT_OK_AND_ASSIGN(
+      Process p, launch_process({"sleep", "100"}, nullptr, ProcessOutConf(),
+                                LaunchOpts{.cpus = cpus}));
+  EXPECT_EQ(cpus_allowed_list(p.pid), format_cpu_list(cpus));
+  // The launching thread's affinity is restored.
+  EXPECT_EQ(allowed_cpus(), before);
+}
+
+TEST(CpuAffinityTest, pins_process_trees) {
+  std::vector<int> cpus = {allowed_cpus().front()};
+  ASSERT_OK_AND_ASSIGN(Process p,
+                       launch_process({"sh", "-c", "sleep 100 & wait"}));
+  // Wait for the shell to fork its child.
+  std::string children_path =
+      std::format("/proc/{}/task/{}/children", p.pid, p.pid);
+  int child = -1;
+  auto start = sc_now();
+  while (child == -1 && sc_now() - start < 1s) {
+    std::ifstream(children_path) >> child;
+    sleep_for(5ms);
+  }
+  ASSERT_NE(child, -1);
+
+  StatusVal s = set_tree_cpu_affinity(p.pid, cpus);
+  EXPECT_OK(s);
+  EXPECT_EQ(cpus_allowed_list(p.pid), format_cpu_list(cpus));
+  EXPECT_EQ(cpus_allowed_list(child), format_cpu_list(cpus));
+}
@@ -38,6 +38,8 @@ void EnvVars::prepend_var(const std::string& var, const std::string& val) {
   vars_[var] = val + vars_[var];
 }
 
+void EnvVars::unset_var(const std::string& var) { vars_.erase(var); }
+
 EnvVars EnvVars::environ() { return EnvVars(::environ); }
 
 char** EnvVars::vars() {
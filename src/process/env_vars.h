@@ -21,6 +21,9 @@ class EnvVars {
   // string.
   void prepend_var(const std::string& var, const std::string& val);
 
+  // Removes the given variable, if it's set.
+  void unset_var(const std::string& var);
+
   // Returns a copy of the process's environment.
   static EnvVars environ();
 
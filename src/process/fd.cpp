@@ -15,6 +15,12 @@ Fd Fd::dup(int fd) {
   return Fd(new_fd);
 }
 
+int Fd::release() {
+  int fd = fd_;
+  fd_ = -1;
+  return fd;
+}
+
 Fd::~Fd() {
   if (fd_ != -1) {
     int r = close(fd_);
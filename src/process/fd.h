@@ -23,6 +23,9 @@ class Fd {
 
   int operator*() const { return fd_; }
 
+  // Gives up ownership of the fd without closing it and returns it.
+  int release();
+
  private:
   Fd(int fd) : fd_(fd) {}
   int fd_ = -1;
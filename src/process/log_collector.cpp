@@ -0,0 +1,252 @@
+#include "process/log_collector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <format>
+#include <vector>
+
+#include "libc_error.h"
+
+namespace {
+// The epoll data of the collector's wake fd. Stream ids start at 1.
+const uint64_t kWakeId = 0;
+// How much is read from a stream at a time.
+const size_t kReadSize = 64 * 1024;
+// How many reads a stream gets per wake up before other streams get a turn.
+const int kMaxReadsPerEvent = 16;
+}  // namespace
+
+struct LogCollector::Stream {
+  // Only closed by the loop, with the collector's 'mu_' held.
+  Fd fd;
+  std::string name;
+  LogOptions options;
+
+  // Guards the ring, which read() copies while the loop appends to it.
+  std::mutex ring_mu;
+  // A ring of the stream's most recent output.
+  std::vector<char> ring;
+  size_t ring_start = 0;
+  size_t ring_size = 0;
+
+  // The stream's log file, if it has one. Only used by the loop, once the
+  // stream's been added.
+  Fd file;
+  size_t file_bytes = 0;
+
+  std::string path() const { return options.dir + "/" + name + ".log"; }
+
+  // Opens the log file for appending, so that a stream that reuses an earlier
+  // stream's name, e.g. a restarted app's, doesn't wipe its log.
+  StatusVal open_file() {
+    int f = open(path().c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                 0644);
+    if (f == -1) {
+      return InternalError(std::format("Failed to open log file {}: {}",
+                                       path(), libc_error_name(errno)));
+    }
+    file = Fd::take(f);
+    struct stat st;
+    file_bytes = fstat(*file, &st) == 0 ? st.st_size : 0;
+    return OkStatus();
+  }
+
+  // Writes the file first, so that output that's been read from the ring is
+  // also in the file.
+  void append(const char* data, size_t size) {
+    if (*file != -1) append_to_file(data, size);
+    std::lock_guard l(ring_mu);
+    append_to_ring(data, size);
+  }
+
+  void append_to_ring(const char* data, size_t size) {
+    size_t cap = ring.size();
+    if (size >= cap) {
+      std::copy(data + size - cap, data + size, ring.begin());
+      ring_start = 0;
+      ring_size = cap;
+      return;
+    }
+    size_t end = (ring_start + ring_size) % cap;
+    size_t first = std::min(size, cap - end);
+    std::copy(data, data + first, ring.begin() + end);
+    std::copy(data + first, data + size, ring.begin());
+    size_t overflow = ring_size + size > cap ? ring_size + size - cap : 0;
+    ring_start = (ring_start + overflow) % cap;
+    ring_size = std::min(ring_size + size, cap);
+  }
+
+  void append_to_file(const char* data, size_t size) {
+    while (size > 0) {
+      ssize_t w = write(*file, data, size);
+      if (w == -1 && errno == EINTR) continue;
+      if (w == -1) {
+        ERROR("Stopped writing log file %s: %s", path().c_str(),
+              libc_error_name(errno).c_str());
+        file = Fd();
+        return;
+      }
+      data += w;
+      size -= w;
+      file_bytes += w;
+    }
+    if (file_bytes >= options.max_file_bytes) rotate();
+  }
+
+  void rotate() {
+    std::string base = path();
+    for (int i = options.max_files - 1; i >= 1; --i) {
+      rename(std::format("{}.{}", base, i).c_str(),
+             std::format("{}.{}", base, i + 1).c_str());
+    }
+    if (options.max_files > 0) rename(base.c_str(), (base + ".1").c_str());
+    StatusVal s = open_file();
+    if (!s.ok()) ERROR("%s", s.to_string().c_str());
+  }
+
+  std::string contents() {
+    std::lock_guard l(ring_mu);
+    std::string out;
+    out.reserve(ring_size);
+    size_t first = std::min(ring_size, ring.size() - ring_start);
+    out.append(ring.data() + ring_start, first);
+    out.append(ring.data(), ring_size - first);
+    return out;
+  }
+};
+
+StatusOr<std::unique_ptr<LogCollector>> LogCollector::create() {
+  int e = epoll_create1(EPOLL_CLOEXEC);
+  if (e == -1) {
+    return InternalError("epoll_create1 failed: " + libc_error_name(errno));
+  }
+  Fd epoll_fd = Fd::take(e);
+  int w = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (w == -1) {
+    return InternalError("eventfd failed: " + libc_error_name(errno));
+  }
+  Fd wake_fd = Fd::take(w);
+
+  epoll_event ev = {.events = EPOLLIN, .data = {.u64 = kWakeId}};
+  if (epoll_ctl(*epoll_fd, EPOLL_CTL_ADD, *wake_fd, &ev) == -1) {
+    return InternalError("epoll_ctl failed: " + libc_error_name(errno));
+  }
+
+  auto collector = std::unique_ptr<LogCollector>(
+      new LogCollector(std::move(epoll_fd), std::move(wake_fd)));
+  collector->thread_ = std::thread(&LogCollector::loop, collector.get());
+  return collector;
+}
+
+LogCollector::LogCollector(Fd epoll_fd, Fd wake_fd)
+    : epoll_fd_(std::move(epoll_fd)), wake_fd_(std::move(wake_fd)) {}
+
+LogCollector::~LogCollector() {
+  uint64_t one = 1;
+  CHECK(write(*wake_fd_, &one, sizeof(one)) == sizeof(one));
+  thread_.join();
+}
+
+StatusOr<LogCollector::StreamId> LogCollector::add(Fd fd,
+                                                   const std::string& name,
+                                                   const LogOptions& options) {
+  int flags = fcntl(*fd, F_GETFL, 0);
+  if (flags == -1 || fcntl(*fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    return InvalidArgumentError("Can't collect logs from fd: " +
+                                libc_error_name(errno));
+  }
+
+  auto stream = std::make_shared<Stream>();
+  stream->fd = std::move(fd);
+  stream->name = name;
+  stream->options = options;
+  stream->ring.resize(std::max<size_t>(options.ring_bytes, 1));
+  if (!options.dir.empty()) {
+    RETURN_IF_ERROR(stream->open_file());
+    if (stream->file_bytes >= options.max_file_bytes) stream->rotate();
+  }
+
+  std::lock_guard l(mu_);
+  StreamId id = next_id_++;
+  epoll_event ev = {.events = EPOLLIN, .data = {.u64 = id}};
+  if (epoll_ctl(*epoll_fd_, EPOLL_CTL_ADD, *stream->fd, &ev) == -1) {
+    return InternalError("epoll_ctl failed: " + libc_error_name(errno));
+  }
+  streams_[id] = std::move(stream);
+  return id;
+}
+
+StatusOr<std::string> LogCollector::read(StreamId id) {
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard l(mu_);
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+      return NotFoundError(std::format("No log stream with id {}.", id));
+    }
+    stream = it->second;
+  }
+  return stream->contents();
+}
+
+void LogCollector::remove(StreamId id) {
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard l(mu_);
+    auto it = streams_.find(id);
+    if (it == streams_.end()) return;
+    stream = std::move(it->second);
+    streams_.erase(it);
+    if (*stream->fd != -1) {
+      epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, *stream->fd, nullptr);
+    }
+  }
+  // The stream's fds close here, outside of the lock, unless the loop's
+  // still draining the stream.
+}
+
+void LogCollector::loop() {
+  epoll_event events[64];
+  while (true) {
+    int n = epoll_wait(*epoll_fd_, events, 64, -1);
+    if (n == -1 && errno == EINTR) continue;
+    CHECK(n != -1);
+
+    // Looks the streams up under the lock, and drains them outside of it, so
+    // that slow log file writes don't hold up add(), read(), and remove().
+    std::vector<std::shared_ptr<Stream>> ready;
+    {
+      std::lock_guard l(mu_);
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.u64 == kWakeId) return;
+        // The stream may have been removed since epoll_wait() returned.
+        auto it = streams_.find(events[i].data.u64);
+        if (it != streams_.end()) ready.push_back(it->second);
+      }
+    }
+    for (const std::shared_ptr<Stream>& stream : ready) {
+      if (drain(stream.get())) continue;
+      std::lock_guard l(mu_);
+      epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, *stream->fd, nullptr);
+      stream->fd = Fd();
+    }
+  }
+}
+
+bool LogCollector::drain(Stream* stream) {
+  char buf[kReadSize];
+  for (int i = 0; i < kMaxReadsPerEvent; ++i) {
+    ssize_t r = ::read(*stream->fd, buf, sizeof(buf));
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (r <= 0) return false;
+    stream->append(buf, r);
+  }
+  return true;
+}
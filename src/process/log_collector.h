@@ -0,0 +1,86 @@
+// Collects the output of many processes on one background thread.
+//
+// Pipes that nobody reads fill up and then block their writers, which stalls
+// e.g. Weston once launch_weston() stops draining its output. LogCollector
+// epolls every pipe that's added to it, keeps the most recent output of each
+// in a bounded in-memory ring, and can also append the output to a file that's
+// rotated once it gets too large.
+
+#ifndef PROCESS_LOG_COLLECTOR_H_
+#define PROCESS_LOG_COLLECTOR_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "process/fd.h"
+#include "third_party/status/status_or.h"
+
+struct LogOptions {
+  // How many of the stream's most recent bytes are kept in memory.
+  size_t ring_bytes = 256 * 1024;
+  // If set, the stream's also appended to '<dir>/<name>.log'. Streams with the
+  // same name append to the same file.
+  std::string dir = "";
+  // Once the log file passes this size, it's rotated to '<name>.log.1', the
+  // previous '<name>.log.1' to '<name>.log.2', and so on, keeping at most
+  // 'max_files' rotated files.
+  size_t max_file_bytes = 16 * 1024 * 1024;
+  int max_files = 3;
+};
+
+class LogCollector {
+ public:
+  using StreamId = uint64_t;
+
+  // Creates a collector and starts its thread.
+  static StatusOr<std::unique_ptr<LogCollector>> create();
+
+  // Stops the collector's thread and closes any streams that are still open.
+  ~LogCollector();
+
+  LogCollector(const LogCollector&) = delete;
+  LogCollector& operator=(const LogCollector&) = delete;
+
+  // Starts collecting the output read from 'fd', typically a pipe from a
+  // Process's stdout. 'name' names the stream's log file.
+  //
+  // Returns INTERNAL if the log file can't be opened.
+  StatusOr<StreamId> add(Fd fd, const std::string& name,
+                         const LogOptions& options = LogOptions());
+
+  // Returns the stream's buffered output, oldest first. Streams keep their
+  // output after their writers close them, until they're removed.
+  //
+  // Returns NOT_FOUND if there's no such stream.
+  StatusOr<std::string> read(StreamId id);
+
+  // Stops collecting the stream and drops its buffered output.
+  void remove(StreamId id);
+
+ private:
+  struct Stream;
+
+  LogCollector(Fd epoll_fd, Fd wake_fd);
+
+  void loop();
+  // Reads what's available from 'stream'. Returns false once the stream's
+  // been closed by its writers.
+  bool drain(Stream* stream);
+
+  Fd epoll_fd_;
+  // An eventfd that wakes the loop up to exit.
+  Fd wake_fd_;
+
+  std::mutex mu_;
+  // Shared with the loop, which drains streams outside of 'mu_'.
+  std::map<StreamId, std::shared_ptr<Stream>> streams_;
+  StreamId next_id_ = 1;
+  std::thread thread_;
+};
+
+#endif  // PROCESS_LOG_COLLECTOR_H_
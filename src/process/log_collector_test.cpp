@@ -0,0 +1,158 @@
+#include "process/log_collector.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+
+struct Pipe {
+  Fd read;
+  Fd write;
+};
+
+Pipe make_pipe() {
+  int fds[2];
+  CHECK(pipe2(fds, O_CLOEXEC) == 0);
+  return Pipe{.read = Fd::take(fds[0]), .write = Fd::take(fds[1])};
+}
+
+void write_all(const Fd& fd, const std::string& data) {
+  CHECK(write(*fd, data.data(), data.size()) == (ssize_t)data.size());
+}
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// Waits for the stream's buffered output to equal 'expected', and returns the
+// last output read.
+std::string wait_for_output(LogCollector* c, LogCollector::StreamId id,
+                            const std::string& expected) {
+  std::string out;
+  auto start = sc_now();
+  while (sc_now() - start < 5s) {
+    out = c->read(id).value_or_die();
+    if (out == expected) break;
+    sleep_for(5ms);
+  }
+  return out;
+}
+
+}  // namespace
+
+class LogCollectorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::format("/tmp/bounce_log_collector_test_{}", getpid());
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+    collector_ = LogCollector::create().value_or_die();
+  }
+
+  void TearDown() override {
+    collector_.reset();
+    std::filesystem::remove_all(dir_);
+  }
+
+  std::string dir_;
+  std::unique_ptr<LogCollector> collector_;
+};
+
+TEST_F(LogCollectorTest, collects_output) {
+  Pipe p = make_pipe();
+  ASSERT_OK_AND_ASSIGN(auto id, collector_->add(std::move(p.read), "out"));
+  write_all(p.write, "hello ");
+  write_all(p.write, "world");
+  EXPECT_EQ(wait_for_output(collector_.get(), id, "hello world"),
+            "hello world");
+}
+
+TEST_F(LogCollectorTest, keeps_only_the_most_recent_output) {
+  Pipe p = make_pipe();
+  ASSERT_OK_AND_ASSIGN(
+      auto id, collector_->add(std::move(p.read), "out",
+                               LogOptions{.ring_bytes = 8}));
+  write_all(p.write, "0123456789");
+  EXPECT_EQ(wait_for_output(collector_.get(), id, "23456789"), "23456789");
+  write_all(p.write, "abc");
+  EXPECT_EQ(wait_for_output(collector_.get(), id, "56789abc"), "56789abc");
+}
+
+TEST_F(LogCollectorTest, keeps_output_after_writers_close) {
+  Pipe p = make_pipe();
+  ASSERT_OK_AND_ASSIGN(auto id, collector_->add(std::move(p.read), "out"));
+  write_all(p.write, "last words");
+  p.write = Fd();
+  EXPECT_EQ(wait_for_output(collector_.get(), id, "last words"),
+            "last words");
+  sleep_for(50ms);
+  EXPECT_EQ(collector_->read(id).value_or_die(), "last words");
+}
+
+TEST_F(LogCollectorTest, drains_pipes_that_would_block_their_writers) {
+  Pipe p = make_pipe();
+  ASSERT_OK_AND_ASSIGN(
+      auto id, collector_->add(std::move(p.read), "out",
+                               LogOptions{.ring_bytes = 16}));
+  // Much more than a pipe's 64 KiB buffer. This would block if nothing read
+  // the pipe.
+  std::string chunk(64 * 1024, 'x');
+  for (int i = 0; i < 32; ++i) write_all(p.write, chunk);
+  write_all(p.write, "0123456789abcdef");
+  EXPECT_EQ(wait_for_output(collector_.get(), id, "0123456789abcdef"),
+            "0123456789abcdef");
+}
+
+TEST_F(LogCollectorTest, rotates_log_files) {
+  Pipe p = make_pipe();
+  ASSERT_OK_AND_ASSIGN(
+      auto id, collector_->add(std::move(p.read), "app",
+                               LogOptions{.dir = dir_,
+                                          .max_file_bytes = 4,
+                                          .max_files = 2}));
+  // Write each chunk only once the previous one's been collected, so that each
+  // read holds exactly one chunk.
+  std::string all;
+  for (std::string chunk : {"aaaa", "bbbb", "cccc", "dd"}) {
+    write_all(p.write, chunk);
+    all += chunk;
+    ASSERT_EQ(wait_for_output(collector_.get(), id, all), all);
+  }
+  std::string base = dir_ + "/app.log";
+  EXPECT_EQ(read_file(base), "dd");
+  EXPECT_EQ(read_file(base + ".1"), "cccc");
+  EXPECT_EQ(read_file(base + ".2"), "bbbb");
+  EXPECT_FALSE(std::filesystem::exists(base + ".3"));
+}
+
+TEST_F(LogCollectorTest, streams_with_the_same_name_append) {
+  for (std::string line : {"first\n", "second\n"}) {
+    Pipe p = make_pipe();
+    ASSERT_OK_AND_ASSIGN(auto id, collector_->add(std::move(p.read), "app",
+                                                  LogOptions{.dir = dir_}));
+    write_all(p.write, line);
+    ASSERT_EQ(wait_for_output(collector_.get(), id, line), line);
+    collector_->remove(id);
+  }
+  EXPECT_EQ(read_file(dir_ + "/app.log"), "first\nsecond\n");
+}
+
+TEST_F(LogCollectorTest, removed_streams_are_not_found) {
+  Pipe p = make_pipe();
+  ASSERT_OK_AND_ASSIGN(auto id, collector_->add(std::move(p.read), "out"));
+  collector_->remove(id);
+  EXPECT_THAT(collector_->read(id), StatusIs(StatusCode::NOT_FOUND));
+  EXPECT_THAT(collector_->read(12345), StatusIs(StatusCode::NOT_FOUND));
+}
@@ -1,51 +1,177 @@
 #include "process/process.h"
 
+#include <poll.h>
 #include <signal.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <format>
+
+#include "process/cpu_affinity.h"
 #include "time_aliases.h"
 
 namespace {
-void terminate_process(int pid) {
-  if (pid == -1) return;
-  kill(pid, SIGTERM);
-  auto start = sc_now();
-  while (sc_now() - start < 1000ms) {
-    sleep_for(10ms);
-    int r = waitpid(pid, nullptr, WNOHANG);
-    if (r == -1 && errno != ECHILD) perror("terminate_process waitpid");
-    if (r == 0) continue;
-    if (r > 0) return;
-  }
-  kill(pid, SIGKILL);
-}
+// How long terminate() gives a process, or its group, to exit after SIGTERM.
+const auto kTerminateTimeout = 1000ms;
 }  // namespace
 
-Process::~Process() { terminate_process(pid); }
+Process::~Process() { terminate(); }
 
-Process::Process(Process&& other) {
-  pid = other.pid;
+Process::Process(Process&& other)
+    : pid(other.pid),
+      stdout(std::move(other.stdout)),
+      stderr(std::move(other.stderr)),
+      group_leader(other.group_leader),
+      pidfd(std::move(other.pidfd)),
+      exit_status_(other.exit_status_) {
   other.pid = -1;
-
-  stdout = std::move(other.stdout);
-  stderr = std::move(other.stderr);
+  other.exit_status_.reset();
 }
 
 Process& Process::operator=(Process&& other) {
+  if (this == &other) return *this;
+  terminate();
   pid = other.pid;
+  group_leader = other.group_leader;
+  pidfd = std::move(other.pidfd);
+  exit_status_ = other.exit_status_;
   other.pid = -1;
+  other.exit_status_.reset();
 
   stdout = std::move(other.stdout);
   stderr = std::move(other.stderr);
   return *this;
 }
 
-StatusOr<Process> launch_process(const std::vector<std::string>& args,
+StatusVal Process::signal(int sig) const {
+  if (pid == -1 || reaped()) {
+    return NotFoundError("The process has exited.");
+  }
+  int r = *pidfd != -1
+              ? syscall(SYS_pidfd_send_signal, *pidfd, sig, nullptr, 0)
+              : kill(pid, sig);
+  if (r == -1 && errno == ESRCH) {
+    return NotFoundError("The process has exited.");
+  }
+  if (r == -1) {
+    return InternalError("Failed to signal process: " + libc_error_name(errno));
+  }
+  return OkStatus();
+}
+
+StatusOr<int> Process::wait_for(std::chrono::milliseconds timeout) {
+  if (exit_status_) return *exit_status_;
+  if (pid == -1) return NotFoundError("There's no process to wait for.");
+
+  const auto deadline = sc_now() + timeout;
+  while (true) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - sc_now());
+    if (*pidfd != -1) {
+      pollfd p = {.fd = *pidfd, .events = POLLIN, .revents = 0};
+      int r = poll(&p, 1, std::max<int>(remaining.count(), 0));
+      if (r == -1 && errno == EINTR) continue;
+      if (r == -1) {
+        // Falling through to waitpid() would block without a timeout.
+        return InternalError("poll failed: " + libc_error_name(errno));
+      }
+      if (r == 0) {
+        return DeadlineExceededError(
+            std::format("Process {} is still running.", pid));
+      }
+    }
+
+    int status;
+    int r = waitpid(pid, &status, *pidfd != -1 ? 0 : WNOHANG);
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1 && errno != ECHILD) {
+      return InternalError("waitpid failed: " + libc_error_name(errno));
+    }
+    if (r == 0) {
+      // Without a pidfd, poll for the process's exit.
+      if (remaining.count() <= 0) {
+        return DeadlineExceededError(
+            std::format("Process {} is still running.", pid));
+      }
+      sleep_for(std::min<std::chrono::milliseconds>(remaining, 10ms));
+      continue;
+    }
+    exit_status_ = r == -1 ? -1 : status;
+    pidfd = Fd();
+    return *exit_status_;
+  }
+}
+
+int Process::release() {
+  int released = pid;
+  pid = -1;
+  pidfd = Fd();
+  exit_status_.reset();
+  return released;
+}
+
+// Sends SIGTERM to the process, or to its process group if it's a group
+// leader, and sends SIGKILL if the process or any of its group are still
+// running after kTerminateTimeout. Reaps the process.
+void Process::terminate() {
+  if (pid == -1) return;
+  if (reaped() && !group_leader) {
+    pid = -1;
+    return;
+  }
+
+  const auto deadline = sc_now() + kTerminateTimeout;
+  if (group_leader) {
+    kill(-pid, SIGTERM);
+  } else {
+    signal(SIGTERM);
+  }
+  bool exited = wait_for(kTerminateTimeout).ok();
+  if (exited && group_leader) {
+    // Processes in the group don't have pidfds we can wait on, so poll for
+    // the group to empty.
+    while (kill(-pid, 0) == 0 && sc_now() < deadline) {
+      sleep_for(10ms);
+    }
+  }
+  if (!exited || (group_leader && kill(-pid, 0) == 0)) {
+    if (group_leader) {
+      kill(-pid, SIGKILL);
+    } else {
+      signal(SIGKILL);
+    }
+    if (!reaped()) waitpid(pid, nullptr, 0);
+  }
+  pid = -1;
+  pidfd = Fd();
+  exit_status_.reset();
+}
+
+StatusOr<Process> launch_process(const std::vector<std::string>& command,
                                  EnvVars* env_vars,
-                                 ProcessOutConf&& process_out) {
+                                 ProcessOutConf&& process_out,
+                                 const LaunchOpts& opts) {
   RETURN_IF_ERROR(validate_process_out_conf(process_out));
 
+  // posix_spawn can't start a process in a cgroup, so have a shell move
+  // itself into the cgroup and then exec the command.
+  std::vector<std::string> args;
+  if (!opts.cgroup.empty()) {
+    args = {"/bin/sh", "-c", "echo 0 > \"$0/cgroup.procs\" && exec \"$@\"",
+            opts.cgroup};
+  }
+  args.insert(args.end(), command.begin(), command.end());
+
+  // Children inherit the spawning thread's CPU affinity, so pin this thread
+  // until the child's spawned.
+  std::vector<int> thread_cpus;
+  if (!opts.cpus.empty()) {
+    thread_cpus = allowed_cpus();
+    RETURN_IF_ERROR(set_cpu_affinity(0, opts.cpus));
+  }
+
   char** argv = static_cast<char**>(malloc(sizeof(char*) * (args.size() + 1)));
   for (size_t i = 0; i < args.size(); ++i) {
     argv[i] = strdup(args[i].c_str());
@@ -57,8 +183,23 @@ StatusOr<Process> launch_process(const std::vector<std::string>& args,
 
   PrelaunchOut prelaunch;
   process_streams_prelaunch(std::move(process_out), &prelaunch);
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  // Start the child with no signals blocked, even if we block signals to read
+  // them from a signalfd, since the child would otherwise inherit our mask.
+  short flags = POSIX_SPAWN_SETSIGMASK;
+  sigset_t no_signals;
+  sigemptyset(&no_signals);
+  posix_spawnattr_setsigmask(&attr, &no_signals);
+  if (opts.new_process_group) {
+    flags |= POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setpgroup(&attr, 0);
+  }
+  posix_spawnattr_setflags(&attr, flags);
   int r =
-      posix_spawnp(&pid, argv[0], &prelaunch.file_actions, nullptr, argv, env);
+      posix_spawnp(&pid, argv[0], &prelaunch.file_actions, &attr, argv, env);
+  if (!thread_cpus.empty()) CHECK_OK(set_cpu_affinity(0, thread_cpus));
+  posix_spawnattr_destroy(&attr);
   if (r != 0) {
     return InvalidArgumentError(
         "Failed to launch process: " + std::string(argv[0]) +
@@ -66,6 +207,10 @@ StatusOr<Process> launch_process(const std::vector<std::string>& args,
   }
   Process p;
   p.pid = pid;
+  p.group_leader = opts.new_process_group;
+  // The child can't be reaped, and so its pid can't be reused, before we've
+  // opened the pidfd.
+  p.pidfd = Fd::take(syscall(SYS_pidfd_open, pid, 0));
   posix_spawn_file_actions_destroy(&prelaunch.file_actions);
   p.stdout = std::move(prelaunch.stdout);
   p.stderr = std::move(prelaunch.stderr);
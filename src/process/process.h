@@ -4,11 +4,14 @@
 #include <spawn.h>
 #include <string.h>
 
+#include <chrono>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "libc_error.h"
 #include "process/env_vars.h"
+#include "process/fd.h"
 #include "process/process_helpers.h"
 #include "process/stream.h"
 #include "third_party/status/status_or.h"
@@ -18,6 +21,13 @@ class Process {
   int pid = -1;
   StreamOut stdout;
   StreamOut stderr;
+  // Whether the process leads its own process group, in which case the whole
+  // group is terminated along with the process.
+  bool group_leader = false;
+  // A pidfd for the process. It polls readable once the process has exited,
+  // so a single poll or epoll loop can watch many processes. -1 if the process
+  // has been reaped or the kernel doesn't support pidfds.
+  Fd pidfd;
 
   Process() = default;
   Process(Process&& other);
@@ -25,6 +35,46 @@ class Process {
   Process(const Process& other) = delete;
   Process& operator=(Process& other) = delete;
   ~Process();
+
+  // Sends 'sig' to the process. Unlike kill(), this never signals an
+  // unrelated process that's reused the pid.
+  //
+  // Returns NOT_FOUND if the process has exited.
+  StatusVal signal(int sig) const;
+
+  // Waits up to 'timeout' for the process to exit, reaps it, and returns its
+  // wait status (see waitpid()). The status is -1 if something else reaped
+  // the process.
+  //
+  // Returns DEADLINE_EXCEEDED if the process is still running after
+  // 'timeout'.
+  StatusOr<int> wait_for(std::chrono::milliseconds timeout);
+
+  // Returns whether the process has been reaped by wait_for().
+  bool reaped() const { return exit_status_.has_value(); }
+
+  // Stops managing the process without terminating it and returns its pid.
+  int release();
+
+ private:
+  void terminate();
+
+  std::optional<int> exit_status_;
+};
+
+struct LaunchOpts {
+  // Launch the process as the leader of a new process group, so that
+  // terminating it also terminates any descendants that haven't moved to
+  // another process group or session.
+  bool new_process_group = false;
+  // If set, the process moves itself into this cgroup (see cgroup.h) before it
+  // runs the command, so that everything the command forks starts out in the
+  // cgroup too. A missing command then shows up as the process exiting with
+  // status 127, rather than as a launch error.
+  std::string cgroup = "";
+  // If set, the process starts pinned to these CPUs (see cpu_affinity.h), and
+  // so do the processes it forks.
+  std::vector<int> cpus = {};
 };
 
 // Launch the given command with the given env vars. The returned Process
@@ -39,6 +89,7 @@ class Process {
 // launch process takes ownership of any specified passed in FDs.
 StatusOr<Process> launch_process(
     const std::vector<std::string>& args, EnvVars* env_vars = nullptr,
-    ProcessOutConf&& process_out = ProcessOutConf());
+    ProcessOutConf&& process_out = ProcessOutConf(),
+    const LaunchOpts& opts = LaunchOpts());
 
 #endif
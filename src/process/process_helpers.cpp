@@ -13,6 +13,13 @@ StatusVal validate_process_out_conf(const ProcessOutConf& conf) {
     return InvalidArgumentError(
         "ProcessOutConf with stdout = StdoutPipe isn't valid.");
   }
+  for (const InheritFd& inherit : conf.inherit_fds) {
+    if (inherit.child_fd <= STDERR_FILENO || *inherit.fd == -1) {
+      return InvalidArgumentError(
+          "ProcessOutConf inherit_fds need a valid fd and a child_fd above "
+          "stderr.");
+    }
+  }
   return OkStatus();
 }
 
@@ -92,4 +99,12 @@ void process_streams_prelaunch(ProcessOutConf&& out_conf,
   for (int fd : subproc_close) {
     CHECK(posix_spawn_file_actions_addclose(&actions, fd) == 0);
   }
+
+  // dup2 clears FD_CLOEXEC on the child's copy of the fd, so these fds are
+  // passed through exec even if the originals are close-on-exec.
+  for (InheritFd& inherit : out_conf.inherit_fds) {
+    CHECK(posix_spawn_file_actions_adddup2(&actions, *inherit.fd,
+                                           inherit.child_fd) == 0);
+    close_after_spawn.push_back(std::move(inherit.fd));
+  }
 }
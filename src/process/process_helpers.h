@@ -8,9 +8,17 @@
 #include "process/stream.h"
 #include "third_party/status/status_or.h"
 
+// An fd to pass to a launched process as fd number 'child_fd'.
+struct InheritFd {
+  int child_fd;
+  Fd fd;
+};
+
 struct ProcessOutConf {
   StreamOutConf stdout = StreamOutConf::None();
   StreamOutConf stderr = StreamOutConf::None();
+  // Extra fds to pass to the process. Child fd numbers should be 3 or higher.
+  std::vector<InheritFd> inherit_fds = {};
 };
 
 struct PrelaunchOut {
@@ -1,7 +1,11 @@
 #include "process/process.h"
 
 #include <gtest/gtest.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 
+#include <format>
 #include <fstream>
 
 #include "third_party/status/status_gtest.h"
@@ -11,7 +15,7 @@ StatusOr<Process> run_test(StreamOutConf&& stdout, StreamOutConf&& stderr) {
       {"sh", "-c", R"(printf "test_out"; printf "test_err" 1>&2;)"},
       /*env=*/nullptr,
       ProcessOutConf{.stdout = std::move(stdout), .stderr = std::move(stderr)});
-  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  if (p.ok()) p->wait_for(std::chrono::seconds(1));
   return p;
 }
 
@@ -122,3 +126,86 @@ TEST(ProcessTest, devnull) {
   EXPECT_NE(p.stdout.fd(), -1);
   EXPECT_NE(p.stderr.fd(), -1);
 }
+
+TEST(ProcessTest, inherit_fd) {
+  int p[2];
+  ASSERT_EQ(pipe2(p, O_CLOEXEC), 0);
+  Fd read_end = Fd::take(p[0]);
+  std::vector<InheritFd> inherit_fds;
+  inherit_fds.push_back(InheritFd{.child_fd = 5, .fd = Fd::take(p[1])});
+  ASSERT_OK_AND_ASSIGN(
+      Process proc,
+      launch_process({"sh", "-c", "printf inherited >&5"}, /*env=*/nullptr,
+                     ProcessOutConf{.inherit_fds = std::move(inherit_fds)}));
+
+  char buf[64];
+  int r = read(*read_end, &buf, 63);
+  ASSERT_GT(r, 0);
+  buf[r] = '\0';
+  EXPECT_EQ(std::string(buf), "inherited");
+}
+
+// Returns whether 'pid' is running, counting zombies as exited.
+bool is_running(int pid) {
+  std::ifstream stat(std::format("/proc/{}/stat", pid));
+  if (!stat.is_open()) return false;
+  std::string line;
+  std::getline(stat, line);
+  size_t state = line.rfind(')') + 2;
+  return state < line.size() && line[state] != 'Z';
+}
+
+TEST(ProcessTest, new_process_group_terminates_descendants) {
+  int grandchild;
+  {
+    ASSERT_OK_AND_ASSIGN(
+        Process p,
+        launch_process({"sh", "-c", "sleep 100 & echo $!; wait"},
+                       /*env=*/nullptr,
+                       ProcessOutConf{.stdout = StreamOutConf::Pipe()},
+                       LaunchOpts{.new_process_group = true}));
+    EXPECT_TRUE(p.group_leader);
+    EXPECT_EQ(getpgid(p.pid), p.pid);
+    grandchild = std::stoi(read_stdout(p));
+    EXPECT_TRUE(is_running(grandchild));
+  }
+  EXPECT_FALSE(is_running(grandchild));
+}
+
+TEST(ProcessTest, wait_for_returns_exit_status) {
+  ASSERT_OK_AND_ASSIGN(Process p, launch_process({"sh", "-c", "exit 3"}));
+  ASSERT_OK_AND_ASSIGN(int status, p.wait_for(std::chrono::seconds(1)));
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 3);
+  EXPECT_TRUE(p.reaped());
+}
+
+TEST(ProcessTest, wait_for_times_out) {
+  ASSERT_OK_AND_ASSIGN(Process p, launch_process({"sleep", "100"}));
+  EXPECT_THAT(p.wait_for(std::chrono::milliseconds(20)),
+              StatusIs(StatusCode::DEADLINE_EXCEEDED));
+  EXPECT_FALSE(p.reaped());
+}
+
+TEST(ProcessTest, signal_reaches_running_process) {
+  ASSERT_OK_AND_ASSIGN(Process p, launch_process({"sleep", "100"}));
+  StatusVal s = p.signal(SIGKILL);
+  EXPECT_OK(s);
+  ASSERT_OK_AND_ASSIGN(int status, p.wait_for(std::chrono::seconds(1)));
+  EXPECT_TRUE(WIFSIGNALED(status));
+
+  // Signaling a reaped process fails rather than reaching a process that
+  // might've reused its pid.
+  EXPECT_THAT(p.signal(SIGKILL), StatusIs(StatusCode::NOT_FOUND));
+}
+
+TEST(ProcessTest, pidfd_polls_readable_on_exit) {
+  ASSERT_OK_AND_ASSIGN(Process p,
+                       launch_process({"sh", "-c", "sleep 0.05; exit 0"}));
+  ASSERT_NE(*p.pidfd, -1);
+  pollfd fd = {.fd = *p.pidfd, .events = POLLIN, .revents = 0};
+  EXPECT_EQ(poll(&fd, 1, 0), 0);
+  EXPECT_EQ(poll(&fd, 1, 1000), 1);
+  ASSERT_OK_AND_ASSIGN(int status, p.wait_for(std::chrono::milliseconds(0)));
+  EXPECT_EQ(status, 0);
+}
@@ -55,3 +55,8 @@ StreamOut::StreamOut(StreamKind kind, Fd&& fd)
 int StreamOut::fd() const { return *fd_; }
 
 bool StreamOut::is_pipe() const { return kind_ == StreamKind::PIPE; }
+
+Fd StreamOut::take_fd() {
+  kind_ = StreamKind::NONE;
+  return std::move(fd_);
+}
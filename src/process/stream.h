@@ -48,6 +48,8 @@ class StreamOut {
   StreamOut(StreamKind kind, Fd&& fd = Fd());
   int fd() const;
   bool is_pipe() const;
+  // Gives up the stream's fd, e.g. to hand a pipe over to a LogCollector.
+  Fd take_fd();
 
  private:
   StreamKind kind_ = StreamKind::NONE;
@@ -1,5 +1,9 @@
 #include "reaper/cleanup.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -8,6 +12,9 @@
 #include <fstream>
 #include <vector>
 
+#include "process/fd.h"
+#include "time_aliases.h"
+
 namespace {
 std::vector<int> get_pid_tids(int pid) {
   std::vector<int> tids;
@@ -41,9 +48,62 @@ std::vector<int> get_children() {
   return out;
 }
 
-void sigterm(int pid) { kill(pid, SIGTERM); }
+// How long to wait for SIGKILLed processes to exit.
+const auto kKillTimeout = 1000ms;
+
+int pidfd_open(int pid) { return syscall(SYS_pidfd_open, pid, 0); }
+
+int pidfd_send_signal(int pidfd, int sig) {
+  return syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+}
+
+// Waits until every pidfd in 'pidfds' is readable, i.e. its process has
+// exited, or until 'timeout' elapses. Returns the pidfds of the processes
+// that are still running.
+std::vector<Fd> wait_for_exits(std::vector<Fd> pidfds,
+                               std::chrono::milliseconds timeout) {
+  const auto deadline = sc_now() + timeout;
+  while (!pidfds.empty()) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - sc_now());
+    if (remaining.count() <= 0) break;
+
+    std::vector<pollfd> poll_fds;
+    for (const Fd& fd : pidfds) {
+      poll_fds.push_back(pollfd{.fd = *fd, .events = POLLIN, .revents = 0});
+    }
+    int r = poll(poll_fds.data(), poll_fds.size(), remaining.count());
+    if (r == -1 && errno != EINTR) {
+      perror("wait_for_exits poll");
+      break;
+    }
+
+    std::vector<Fd> running;
+    for (size_t i = 0; i < pidfds.size(); ++i) {
+      if (!poll_fds[i].revents) running.push_back(std::move(pidfds[i]));
+    }
+    pidfds = std::move(running);
+  }
+  return pidfds;
+}
 
-void sigkill(int pid) { kill(pid, SIGKILL); }
+// Terminates 'children' using signals and sleeps. Used when the kernel
+// doesn't support pidfds.
+void close_children_without_pidfds(const std::vector<int>& children,
+                                   std::chrono::milliseconds grace) {
+  for (int child : children) {
+    kill(child, SIGTERM);
+  }
+  sleep_for(grace);
+  wait_all();
+
+  for (int child : get_children()) {
+    auto it = std::find(children.begin(), children.end(), child);
+    if (it != children.end()) {
+      kill(child, SIGKILL);
+    }
+  }
+}
 }  // namespace
 
 void wait_all() {
@@ -56,25 +116,46 @@ void wait_all() {
   }
 }
 
-void close_all_descendants() {
+void close_cgroup(const Cgroup& cgroup, std::chrono::milliseconds grace) {
+  cgroup.signal(SIGTERM);
+  if (!cgroup.wait_empty(grace).ok()) {
+    cgroup.kill();
+    cgroup.wait_empty(kKillTimeout);
+  }
+  wait_all();
+}
+
+void close_all_descendants(std::chrono::milliseconds grace) {
   while (true) {
     std::vector<int> children = get_children();
     if (children.size() == 0) {
       break;
     }
 
+    std::vector<Fd> pidfds;
+    bool have_pidfds = true;
     for (int child : children) {
-      sigterm(child);
+      Fd pidfd = Fd::take(pidfd_open(child));
+      if (*pidfd == -1) {
+        // The child's already been reaped.
+        if (errno == ESRCH) continue;
+        have_pidfds = false;
+        break;
+      }
+      pidfd_send_signal(*pidfd, SIGTERM);
+      pidfds.push_back(std::move(pidfd));
+    }
+    if (!have_pidfds) {
+      close_children_without_pidfds(children, grace);
+      wait_all();
+      continue;
     }
-    usleep(100'000);
-    wait_all();
 
-    for (int child : get_children()) {
-      auto it = std::find(children.begin(), children.end(), child);
-      if (it != children.end()) {
-        sigkill(child);
-      }
+    std::vector<Fd> running = wait_for_exits(std::move(pidfds), grace);
+    for (const Fd& pidfd : running) {
+      pidfd_send_signal(*pidfd, SIGKILL);
     }
+    wait_for_exits(std::move(running), kKillTimeout);
     wait_all();
   }
 }
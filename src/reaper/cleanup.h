@@ -1,7 +1,20 @@
 #ifndef REAPER_CLEANUP_H_
 #define REAPER_CLEANUP_H_
 
+#include <chrono>
+
+#include "process/cgroup.h"
+
 void wait_all();
-void close_all_descendants();
+
+// Terminates every process in 'cgroup': sends SIGTERM, waits up to 'grace'
+// for the cgroup to empty, and then kills whatever's left.
+void close_cgroup(const Cgroup& cgroup, std::chrono::milliseconds grace);
+
+// Terminates all of the calling process's descendants: sends SIGTERM to each
+// child, waits up to 'grace' for them to exit, and SIGKILLs those that don't.
+// Repeats until no children remain, since descendants get reparented to us
+// as their parents exit.
+void close_all_descendants(std::chrono::milliseconds grace);
 
 #endif
@@ -0,0 +1,43 @@
+#include "reaper/command.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <wordexp.h>
+
+#include <chrono>
+#include <sstream>
+
+#include "process/process.h"
+
+std::vector<std::string> simple_command_words(const std::string& command) {
+  wordexp_t w;
+  if (wordexp(command.c_str(), &w, WRDE_NOCMD) != 0) return {};
+  std::vector<std::string> words(w.we_wordv, w.we_wordv + w.we_wordc);
+  wordfree(&w);
+  if (!words.empty() && words[0].find('=') != std::string::npos) return {};
+  return words;
+}
+
+bool is_shell_builtin(const std::string& name) {
+  StatusOr<Process> p = launch_process(
+      {"sh", "-c", "command -v -- \"$1\" > /dev/null", "sh", name});
+  if (!p.ok()) return false;
+  StatusOr<int> status = p->wait_for(std::chrono::seconds(10));
+  return status.ok() && *status == 0;
+}
+
+bool sh_can_run(const std::string& name) {
+  if (name.find('/') != std::string::npos) {
+    return access(name.c_str(), X_OK) == 0;
+  }
+  // Looking through PATH here is much cheaper than asking sh, which is only
+  // needed for builtins.
+  const char* path = getenv("PATH");
+  std::istringstream dirs(path ? path : "");
+  std::string dir;
+  while (std::getline(dirs, dir, ':')) {
+    if (dir.empty()) dir = ".";
+    if (access((dir + "/" + name).c_str(), X_OK) == 0) return true;
+  }
+  return is_shell_builtin(name);
+}
@@ -0,0 +1,20 @@
+#ifndef REAPER_COMMAND_H_
+#define REAPER_COMMAND_H_
+
+#include <string>
+#include <vector>
+
+// Returns 'command' split into words the way sh would, or an empty vector if
+// it uses anything besides words, e.g. pipes, redirections, command
+// substitutions, or variable assignments, and so has to run through sh.
+std::vector<std::string> simple_command_words(const std::string& command);
+
+// Returns whether sh would run 'name' as a builtin, keyword, or function
+// rather than an executable.
+bool is_shell_builtin(const std::string& name);
+
+// Returns whether sh could run 'name': whether it's an executable, directly or
+// on PATH, or a shell builtin.
+bool sh_can_run(const std::string& name);
+
+#endif
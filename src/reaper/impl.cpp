@@ -15,12 +15,13 @@
 #include <algorithm>
 #include <cassert>
 #include <filesystem>
+#include <format>
 #include <fstream>
-#include <thread>
 #include <vector>
 
 #include "process/process.h"
 #include "reaper/cleanup.h"
+#include "reaper/command.h"
 #include "reaper/ipc.h"
 #include "reaper/protocol.h"
 #include "third_party/status/logger.h"
@@ -30,7 +31,10 @@ ReaperImpl* global_impl = nullptr;
 
 namespace {
 using std::chrono::milliseconds;
-using std::this_thread::sleep_for;
+
+// How long commands that run through sh get to fail before their launch is
+// reported as successful.
+const milliseconds kShellExitCheck(20);
 
 const int32_t kNumPolls = 3;
 enum PollSlots {
@@ -56,6 +60,24 @@ int make_sigchld_signalfd_and_block_signal() {
   return sigchld_fd;
 }
 
+// Launches 'command'. Simple commands are spawned directly, so that a command
+// that doesn't exist fails here rather than after the launch's been reported.
+// Other commands, and shell builtins, run through sh, in which case
+// 'through_sh' is set.
+//
+// Returns INVALID_ARGUMENT if the command doesn't exist.
+StatusOr<Process> launch_command(const std::string& command,
+                                 bool* through_sh) {
+  *through_sh = false;
+  std::vector<std::string> words = simple_command_words(command);
+  if (!words.empty()) {
+    StatusOr<Process> p = launch_process(words);
+    if (p.ok() || !is_shell_builtin(words[0])) return p;
+  }
+  *through_sh = true;
+  return launch_process({"sh", "-c", command});
+}
+
 void set_child_subreaper() {
   if (prctl(PR_SET_CHILD_SUBREAPER, 1)) {
     FATAL("Set child subreaper:" + libc_error_name(errno));
@@ -66,9 +88,10 @@ void exit_handler(int) { global_impl->on_exit(); }
 }  // namespace
 
 StatusOr<ReaperImpl> ReaperImpl::create(const std::string& command,
-                                        const Token& token) {
+                                        const Token& token,
+                                        std::chrono::milliseconds grace) {
   ASSIGN_OR_RETURN(auto ipc, IPC<ReaperMessage>::connect(token));
-  return ReaperImpl(command, token, std::move(ipc));
+  return ReaperImpl(command, token, grace, std::move(ipc));
 }
 
 void ReaperImpl::run() {
@@ -78,23 +101,37 @@ void ReaperImpl::run() {
   int parent_pidfd = ipc_.receive_fd().value_or_die();
   owned_files_ = OwnedFds(parent_pidfd, sigchld_signalfd);
 
-  StatusOr<Process> p = launch_process({"sh", "-c", command_});
+  bool through_sh = false;
+  StatusOr<Process> p = launch_command(command_, &through_sh);
   if (!p.ok()) {
     ipc_.send(ReaperMessage{ReaperMessageCode::INVALID_COMMAND});
     ERROR(p.to_string());
     return;
   }
 
-  // Check if the launched process exits quickly after launch. This can happen
-  // if you give the shell an invalid command and so we return an
-  // INVALID_COMMAND value.
-  sleep_for(milliseconds(20));
-  int stat;
-  int wait_pid = waitpid(p->pid, &stat, WNOHANG);
-  if (wait_pid != 0 && stat != 0) {
-    ipc_.send(ReaperMessage{ReaperMessageCode::INVALID_COMMAND});
-    ERROR("Launched program exited shortly after launch.");
-    return;
+  // Put the command's process tree in its own cgroup if we can. The command's
+  // moved in right after it's spawned, so in the rare case that it forks
+  // before the move, the fork is still cleaned up by the descendant scan in
+  // on_exit().
+  StatusOr<Cgroup> cgroup =
+      Cgroup::create(std::format("bounce_reaper_{}", getpid()));
+  if (cgroup.ok() && cgroup->add_process(p->pid).ok()) {
+    cgroup_ = std::move(cgroup.value());
+  } else {
+    LOG(kLogSubprocess, "Reaper running without a cgroup.");
+  }
+
+  // sh starts even if its command doesn't, so give commands that run through
+  // sh a moment to fail, e.g. on a typo. Directly spawned commands have
+  // already been checked.
+  if (through_sh) {
+    StatusOr<int> stat = p->wait_for(kShellExitCheck);
+    if (stat.ok() && *stat != 0) {
+      ipc_.send(ReaperMessage{ReaperMessageCode::INVALID_COMMAND});
+      ERROR("Shell command failed right after launch (wait status %d): %s",
+            *stat, command_.c_str());
+      return;
+    }
   }
 
   // Send launch success message
@@ -152,7 +189,12 @@ void ReaperImpl::on_exit() {
   sigfillset(&all_signals);
   sigprocmask(SIG_BLOCK, &all_signals, nullptr);
 
-  close_all_descendants();
+  if (cgroup_) {
+    close_cgroup(*cgroup_, grace_);
+  }
+  close_all_descendants(grace_);
+  // Remove the cgroup now, since exit() doesn't run member destructors.
+  cgroup_.reset();
 
   if (parent_died) {
     ipc_.cleanup_from_client();
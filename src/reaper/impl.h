@@ -7,8 +7,11 @@
 
 #include <unistd.h>
 
+#include <chrono>
+#include <optional>
 #include <string>
 
+#include "process/cgroup.h"
 #include "reaper/ipc.h"
 #include "reaper/protocol.h"
 
@@ -51,9 +54,12 @@ class OwnedFds {
 
 class ReaperImpl {
  public:
-  // Create a ReaperImpl instance with the given command and token.
-  static StatusOr<ReaperImpl> create(const std::string& command,
-                                     const Token& token);
+  // Create a ReaperImpl instance with the given command and token. 'grace' is
+  // how long descendants get to exit after SIGTERM during clean up.
+  static StatusOr<ReaperImpl> create(
+      const std::string& command, const Token& token,
+      std::chrono::milliseconds grace =
+          std::chrono::milliseconds(kDefaultReaperGraceMs));
 
   // Disallow default construction, copying and assignment
   ReaperImpl() = delete;
@@ -70,21 +76,31 @@ class ReaperImpl {
   void run();
 
   // Exits all of the reaper's descendants, first by trying SIGTERM, and then by
-  // SIGKILL if they don't respond to the SIGTERM. Also deletes the 'ipc_file'
-  // if the reaper is exiting because the parent has exited without calling
-  // clean_up.
+  // SIGKILL if they don't exit within the grace period. Also deletes the
+  // 'ipc_file' if the reaper is exiting because the parent has exited without
+  // calling clean_up.
+  //
+  // If the command's process tree is in a cgroup, the cgroup is torn down
+  // first, and then any remaining descendants are found by scanning the
+  // reaper's children.
   void on_exit();
 
  private:
   ReaperImpl(const std::string& command, const Token& token,
-             IPC<ReaperMessage> ipc)
-      : command_(command), token_(token), ipc_(std::move(ipc)) {}
+             std::chrono::milliseconds grace, IPC<ReaperMessage> ipc)
+      : command_(command),
+        token_(token),
+        grace_(grace),
+        ipc_(std::move(ipc)) {}
   void setup_signal_handlers();
 
   std::string command_;
   Token token_;
+  std::chrono::milliseconds grace_;
   IPC<ReaperMessage> ipc_;
   OwnedFds owned_files_;
+  // The cgroup holding the command's process tree, if we could create one.
+  std::optional<Cgroup> cgroup_;
 };
 
 #endif
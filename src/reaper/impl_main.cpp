@@ -3,9 +3,18 @@
 // Example usage:
 // $ REAPER_IPC_FILE=/tmp/my_ipc reaper "weston --xwayland -- my_app" &
 // clang-format on
+//
+// Set REAPER_GRACE_MS to change how long descendants get to exit after SIGTERM
+// during clean up.
+//
+// Run 'reaper --multiplex' instead of passing a command to serve many process
+// groups over one IPC connection. See protocol.h.
+
+#include <string.h>
 
 #include "impl.h"
 #include "ipc.h"
+#include "mux_impl.h"
 #include "protocol.h"
 
 int main(int argc, char** argv) {
@@ -27,7 +36,21 @@ int main(int argc, char** argv) {
     return -1;
   }
 
-  StatusOr<ReaperImpl> p = ReaperImpl::create(command, Token(ipc_token_var));
+  int grace_ms = kDefaultReaperGraceMs;
+  char* grace_var = getenv(kReaperGraceMsEnvVar);
+  if (grace_var) {
+    grace_ms = atoi(grace_var);
+  }
+
+  if (argc == 2 && strcmp(argv[1], kReaperMultiplexFlag) == 0) {
+    StatusOr<MuxReaperImpl> mux = MuxReaperImpl::create(
+        Token(ipc_token_var), std::chrono::milliseconds(grace_ms));
+    CHECK_OK(mux);
+    mux->run();
+  }
+
+  StatusOr<ReaperImpl> p = ReaperImpl::create(
+      command, Token(ipc_token_var), std::chrono::milliseconds(grace_ms));
   CHECK_OK(p);
   p->run();
 }
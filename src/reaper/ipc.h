@@ -1,6 +1,9 @@
 #ifndef REAPER_IPC_H_
 #define REAPER_IPC_H_
 
+#include <sys/socket.h>
+
+#include <chrono>
 #include <string>
 #include <vector>
 #include "third_party/status/status_or.h"
@@ -9,6 +12,9 @@
 using Token = std::string;
 
 // Simple bi-directional 1-to-1 fixed size message passing IPC.
+//
+// The IPC uses a SOCK_STREAM socket by default. Pass SOCK_SEQPACKET as 'type'
+// to have the socket preserve message boundaries.
 template <typename M>
 class IPC {
  public:
@@ -19,12 +25,21 @@ class IPC {
   IPC(const IPC&) = delete;
   ~IPC();
 
-  static StatusOr<IPC> create(const std::string& dir, Token* token);
-  static StatusOr<IPC> connect(const Token& token);
+  static StatusOr<IPC> create(const std::string& dir, Token* token,
+                              int type = SOCK_STREAM);
+  static StatusOr<IPC> connect(const Token& token, int type = SOCK_STREAM);
 
   StatusVal send(const M& m);
   StatusVal send_fd(int fd);
 
+  // Waits for the client to connect, so that a server doesn't block forever
+  // in its first send or receive if the client never starts. A no-op for
+  // clients.
+  //
+  // Returns DEADLINE_EXCEEDED if the client hasn't connected within
+  // 'timeout'.
+  StatusVal wait_for_connection(std::chrono::milliseconds timeout);
+
   // Returns:
   // - UnavailableError if block is false and there's no data to receive.
   // - AbortedError if the other side of the socket's closed.
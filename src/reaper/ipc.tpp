@@ -5,6 +5,7 @@
 #include <execinfo.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdint.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -65,8 +66,8 @@ sockaddr_un make_addr_un(const std::string& path) {
   return addr;
 }
 
-int make_server_socket(const std::string& path) {
-  int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+int make_server_socket(const std::string& path, int type) {
+  int sock = ::socket(AF_UNIX, type, 0);
   ccheck(sock, "sock");
   sockaddr_un addr = make_addr_un(path.c_str());
   ccheck(bind(sock, (struct sockaddr*)&addr, sizeof(sockaddr_un)), "bind");
@@ -107,7 +108,8 @@ void set_fd_blocking(int fd, bool blocking) {
 }  // namespace
 
 template <typename M>
-StatusOr<IPC<M>> IPC<M>::create(const std::string& dir, Token* token) {
+StatusOr<IPC<M>> IPC<M>::create(const std::string& dir, Token* token,
+                                int type) {
   std::string path = get_likely_available_path(dir);
   *token = path;
 
@@ -115,17 +117,17 @@ StatusOr<IPC<M>> IPC<M>::create(const std::string& dir, Token* token) {
   ipc.am_server_ = true;
   ipc.connected_ = false;
   ipc.socket_path_ = path;
-  ipc.listen_socket_ = make_server_socket(path);
+  ipc.listen_socket_ = make_server_socket(path, type);
   return ipc;
 }
 
 template <typename M>
-StatusOr<IPC<M>> IPC<M>::connect(const Token& token) {
+StatusOr<IPC<M>> IPC<M>::connect(const Token& token, int type) {
   IPC ipc;
   ipc.am_server_ = false;
   ipc.connected_ = true;
   ipc.socket_path_ = token;
-  ipc.socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ipc.socket_ = ::socket(AF_UNIX, type, 0);
   ccheck(ipc.socket_, "connect socket");
   sockaddr_un addr = make_addr_un(token.c_str());
   ccheck(::connect(ipc.socket_, (sockaddr*)&addr, sizeof(sockaddr_un)),
@@ -164,6 +166,19 @@ StatusVal IPC<M>::send_fd(int fd) {
   return OkStatus();
 }
 
+template <typename M>
+StatusVal IPC<M>::wait_for_connection(std::chrono::milliseconds timeout) {
+  if (connected_) return OkStatus();
+  pollfd p = {.fd = listen_socket_, .events = POLLIN, .revents = 0};
+  int r = poll(&p, 1, timeout.count());
+  if (r == 0) {
+    return DeadlineExceededError("Timed out waiting for the IPC's client.");
+  }
+  ccheck(r, "poll");
+  make_connection();
+  return OkStatus();
+}
+
 template <typename M>
 StatusOr<M> IPC<M>::receive(bool block) {
   if (!connected_) make_connection();
@@ -48,10 +48,11 @@ class IpcTest : public testing::Test {
     close(fd_1_);
   }
 
-  std::tuple<IPC<M>, IPC<M>> make_ipcs() {
+  std::tuple<IPC<M>, IPC<M>> make_ipcs(int type = SOCK_STREAM) {
     Token token;
-    IPC<M> a = std::move(IPC<M>::create(ipc_dir_, &token).value_or_die());
-    IPC<M> b = std::move(IPC<M>::connect(token).value_or_die());
+    IPC<M> a =
+        std::move(IPC<M>::create(ipc_dir_, &token, type).value_or_die());
+    IPC<M> b = std::move(IPC<M>::connect(token, type).value_or_die());
     return {std::move(a), std::move(b)};
   }
 
@@ -79,6 +80,23 @@ TEST_F(IpcTest, SendAndReceive) {
   EXPECT_EQ(m_1_.v, m_1_other.v);
 }
 
+TEST_F(IpcTest, SeqpacketSendAndReceive) {
+  auto [a, b] = make_ipcs(SOCK_SEQPACKET);
+
+  ASSERT_TRUE(b.send_fd(fd_0_).ok());
+  ASSERT_OK_AND_ASSIGN(int fd, a.receive_fd());
+  close(fd);
+
+  ASSERT_TRUE(a.send(m_0_).ok());
+  ASSERT_TRUE(a.send(m_1_).ok());
+
+  ASSERT_OK_AND_ASSIGN(M m_0_other, b.receive(false));
+  ASSERT_OK_AND_ASSIGN(M m_1_other, b.receive(false));
+  EXPECT_EQ(m_0_.v, m_0_other.v);
+  EXPECT_EQ(m_1_.v, m_1_other.v);
+  EXPECT_EQ(b.receive(false).status().code(), StatusCode::UNAVAILABLE);
+}
+
 TEST_F(IpcTest, SendAndReceiveFds) {
   auto [a, b] = make_ipcs();
 
@@ -147,3 +165,15 @@ TEST_F(IpcTest, ReceiveFdFromHungUpPeer) {
     EXPECT_EQ(b.receive_fd().status().code(), StatusCode::ABORTED);
   }
 }
+
+TEST_F(IpcTest, WaitForConnection) {
+  Token token;
+  IPC<M> a = std::move(IPC<M>::create(ipc_dir_, &token).value_or_die());
+  EXPECT_EQ(a.wait_for_connection(std::chrono::milliseconds(50)).code(),
+            StatusCode::DEADLINE_EXCEEDED);
+
+  IPC<M> b = std::move(IPC<M>::connect(token).value_or_die());
+  EXPECT_TRUE(a.wait_for_connection(std::chrono::milliseconds(1000)).ok());
+  EXPECT_TRUE(b.send(m_1_).ok());
+  EXPECT_EQ(a.receive().value_or_die().v, 1);
+}
@@ -0,0 +1,278 @@
+#include "reaper/mux_impl.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+
+#include "process/process.h"
+#include "reaper/cleanup.h"
+#include "reaper/command.h"
+#include "third_party/status/logger.h"
+#include "time_aliases.h"
+
+namespace {
+using std::chrono::milliseconds;
+
+const int32_t kNumPolls = 3;
+enum PollSlots {
+  kParentIdx = 0,
+  kIpcIdx = 1,
+  kSignalIdx = 2,
+};
+
+// Blocks SIGCHLD, SIGTERM, and SIGINT, and returns a signalfd to read them
+// from instead. Reading SIGTERM and SIGINT from the poll loop means we never
+// shut down in the middle of handling a request.
+int make_signalfd_and_block_signals() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGINT);
+  if (sigprocmask(SIG_BLOCK, &mask, nullptr) == -1) {
+    FATAL("sigprocmask" + libc_error_name(errno));
+  }
+
+  int fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (fd == -1) {
+    FATAL("signalfd" + libc_error_name(errno));
+  }
+  return fd;
+}
+
+void set_child_subreaper() {
+  if (prctl(PR_SET_CHILD_SUBREAPER, 1)) {
+    FATAL("Set child subreaper:" + libc_error_name(errno));
+  }
+}
+}  // namespace
+
+StatusOr<MuxReaperImpl> MuxReaperImpl::create(const Token& token,
+                                              milliseconds grace) {
+  ASSIGN_OR_RETURN(auto ipc, IPC<MuxMessage>::connect(token, SOCK_SEQPACKET));
+  return MuxReaperImpl(grace, std::move(ipc));
+}
+
+void MuxReaperImpl::run() {
+  set_child_subreaper();
+  int signal_fd = make_signalfd_and_block_signals();
+  int parent_pidfd = ipc_.receive_fd().value_or_die();
+  owned_files_ = OwnedFds(parent_pidfd, signal_fd);
+  send(MuxMessage{.code = MuxMessageCode::READY});
+
+  pollfd poll_fds[kNumPolls];
+  poll_fds[kParentIdx] =
+      pollfd{.fd = parent_pidfd, .events = POLLIN, .revents = 0};
+  poll_fds[kIpcIdx] =
+      pollfd{.fd = ipc_.socket(), .events = POLLIN, .revents = 0};
+  poll_fds[kSignalIdx] =
+      pollfd{.fd = signal_fd, .events = POLLIN, .revents = 0};
+
+  while (true) {
+    int r = poll(poll_fds, kNumPolls, poll_timeout());
+    if (r == -1 && errno == EINTR) continue;
+    CHECK(r >= 0);
+
+    if (poll_fds[kParentIdx].revents) {
+      shut_down(/*parent_died=*/true);
+    }
+
+    if (poll_fds[kSignalIdx].revents) {
+      signalfd_siginfo si;
+      while (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo != SIGCHLD) shut_down(/*parent_died=*/false);
+      }
+      wait_all();
+    }
+
+    if (poll_fds[kIpcIdx].revents) {
+      // Handle every queued request before polling again, so that a batch of
+      // requests is handled together.
+      while (true) {
+        StatusOr<MuxMessage> m = ipc_.receive(/*block=*/false);
+        if (!m.ok() && m.status().code() == StatusCode::UNAVAILABLE) break;
+        if (!m.ok()) {
+          // The client's hung up.
+          shut_down(/*parent_died=*/false);
+        }
+        handle(*m);
+      }
+    }
+
+    escalate();
+    finish_empty_groups();
+  }
+}
+
+void MuxReaperImpl::handle(const MuxMessage& m) {
+  switch (m.code) {
+    case MuxMessageCode::LAUNCH:
+      launch(m);
+      return;
+    case MuxMessageCode::KILL:
+      kill(m);
+      return;
+    default:
+      ERROR("Multiplexed reaper got an unexpected message code: %d",
+            (int)m.code);
+  }
+}
+
+void MuxReaperImpl::launch(const MuxMessage& m) {
+  MuxMessage response{.code = MuxMessageCode::LAUNCH_FAILED,
+                      .request_id = m.request_id,
+                      .group_id = m.group_id};
+  if (groups_.contains(m.group_id)) {
+    ERROR("Multiplexed reaper already has a group %lu.", m.group_id);
+    send(response);
+    return;
+  }
+
+  std::string command(m.command, strnlen(m.command, sizeof(m.command)));
+  // sh would start even if the command doesn't exist, so check simple
+  // commands' executables here, where the launch can still be failed.
+  std::vector<std::string> words = simple_command_words(command);
+  if (!words.empty() && !sh_can_run(words[0])) {
+    ERROR("Multiplexed reaper can't find %s.", words[0].c_str());
+    send(response);
+    return;
+  }
+
+  StatusOr<Cgroup> cgroup =
+      Cgroup::create(std::format("bounce_mux_{}_{}", getpid(), m.group_id));
+  std::vector<std::string> args = {"sh", "-c", command};
+  if (cgroup.ok()) {
+    // Have the shell move itself into the cgroup before it runs the command,
+    // so that none of the command's processes can start outside of it.
+    args = {"sh",
+            "-c",
+            "{ echo 0 > \"$1/cgroup.procs\"; } 2>/dev/null; exec sh -c \"$2\"",
+            "sh",
+            cgroup->path(),
+            command};
+  }
+  StatusOr<Process> p = launch_process(args, nullptr, ProcessOutConf(),
+                                       LaunchOpts{.new_process_group = true});
+  if (!p.ok()) {
+    ERROR(p.to_string());
+    send(response);
+    return;
+  }
+
+  // Also move the shell from here, so that the cgroup's populated from the
+  // start.
+  Group group;
+  group.pgid = p->pid;
+  if (cgroup.ok() && cgroup->add_process(p->pid).ok()) {
+    group.cgroup = std::move(cgroup.value());
+  } else {
+    LOG(kLogSubprocess, "Group %lu running without a cgroup.", m.group_id);
+  }
+
+  // From here on the group's terminated through groups_, so keep Process from
+  // terminating it.
+  response.code = MuxMessageCode::LAUNCHED;
+  response.pid = p->release();
+  groups_.emplace(m.group_id, std::move(group));
+  send(response);
+}
+
+void MuxReaperImpl::kill(const MuxMessage& m) {
+  auto it = groups_.find(m.group_id);
+  if (it == groups_.end()) {
+    send(MuxMessage{.code = MuxMessageCode::KILLED,
+                    .request_id = m.request_id,
+                    .group_id = m.group_id});
+    return;
+  }
+
+  Group& group = it->second;
+  group.kill_requests.push_back(m.request_id);
+  if (group.kill_deadline) return;
+
+  if (group.cgroup) group.cgroup->signal(SIGTERM);
+  ::kill(-group.pgid, SIGTERM);
+  group.kill_deadline = sc_now() + grace_;
+}
+
+void MuxReaperImpl::escalate() {
+  auto now = sc_now();
+  for (auto& [id, group] : groups_) {
+    if (!group.kill_deadline || group.sigkilled) continue;
+    if (*group.kill_deadline > now) continue;
+    if (group.cgroup) group.cgroup->kill();
+    ::kill(-group.pgid, SIGKILL);
+    group.sigkilled = true;
+  }
+}
+
+void MuxReaperImpl::finish_empty_groups() {
+  // Reap first, since zombies still count as members of their process group.
+  wait_all();
+  for (auto it = groups_.begin(); it != groups_.end();) {
+    const Group& group = it->second;
+    bool empty = group.cgroup
+                     ? !group.cgroup->populated()
+                     : ::kill(-group.pgid, 0) == -1 && errno == ESRCH;
+    if (!empty) {
+      ++it;
+      continue;
+    }
+
+    if (group.kill_requests.empty()) {
+      send(MuxMessage{.code = MuxMessageCode::EXITED, .group_id = it->first});
+    }
+    for (uint64_t request_id : group.kill_requests) {
+      send(MuxMessage{.code = MuxMessageCode::KILLED,
+                      .request_id = request_id,
+                      .group_id = it->first});
+    }
+    it = groups_.erase(it);
+  }
+}
+
+int MuxReaperImpl::poll_timeout() const {
+  std::optional<std::chrono::steady_clock::time_point> next;
+  for (const auto& [id, group] : groups_) {
+    if (!group.kill_deadline || group.sigkilled) continue;
+    if (!next || *group.kill_deadline < *next) next = group.kill_deadline;
+  }
+  if (!next) return -1;
+  auto wait = std::chrono::duration_cast<milliseconds>(*next - sc_now());
+  // Round up so that we don't wake just before the deadline.
+  return std::max<int>(0, wait.count() + 1);
+}
+
+void MuxReaperImpl::send(const MuxMessage& m) {
+  StatusVal s = ipc_.send(m);
+  if (!s.ok() && s.code() == StatusCode::ABORTED) {
+    shut_down(/*parent_died=*/false);
+  }
+  CHECK_OK(s);
+}
+
+void MuxReaperImpl::shut_down(bool parent_died) {
+  // Signal every group up front so that they all share one grace period.
+  for (const auto& [id, group] : groups_) {
+    if (group.cgroup) group.cgroup->signal(SIGTERM);
+    ::kill(-group.pgid, SIGTERM);
+  }
+  close_all_descendants(grace_);
+  for (const auto& [id, group] : groups_) {
+    if (group.cgroup) close_cgroup(*group.cgroup, grace_);
+  }
+  // Remove the cgroups now, since exit() doesn't run member destructors.
+  groups_.clear();
+
+  if (parent_died) {
+    ipc_.cleanup_from_client();
+  }
+  exit(0);
+}
@@ -0,0 +1,70 @@
+// The multiplexed reaper. See protocol.h for the protocol, and mux_reaper.h for
+// the client.
+
+#ifndef REAPER_MUX_IMPL_H_
+#define REAPER_MUX_IMPL_H_
+
+#include <chrono>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "process/cgroup.h"
+#include "reaper/impl.h"
+#include "reaper/ipc.h"
+#include "reaper/protocol.h"
+
+class MuxReaperImpl {
+ public:
+  // Connects to the client's IPC at 'token'. 'grace' is how long a group's
+  // processes get to exit after SIGTERM before they're SIGKILLed.
+  static StatusOr<MuxReaperImpl> create(const Token& token,
+                                        std::chrono::milliseconds grace);
+
+  MuxReaperImpl() = delete;
+  MuxReaperImpl(const MuxReaperImpl&) = delete;
+  MuxReaperImpl& operator=(const MuxReaperImpl&) = delete;
+  MuxReaperImpl(MuxReaperImpl&&) = default;
+  MuxReaperImpl& operator=(MuxReaperImpl&&) = delete;
+
+  // Serves requests until the client hangs up, the client exits, or we're
+  // sent SIGTERM or SIGINT. Then terminates every group and exits the
+  // process, so it never returns.
+  [[noreturn]] void run();
+
+ private:
+  struct Group {
+    int pgid = -1;
+    // The cgroup holding the group's process tree, if we could create one.
+    std::optional<Cgroup> cgroup;
+    // Set once the group's been sent SIGTERM.
+    std::optional<std::chrono::steady_clock::time_point> kill_deadline;
+    bool sigkilled = false;
+    // The KILL requests waiting on the group to exit.
+    std::vector<uint64_t> kill_requests;
+  };
+
+  MuxReaperImpl(std::chrono::milliseconds grace, IPC<MuxMessage> ipc)
+      : grace_(grace), ipc_(std::move(ipc)) {}
+
+  void handle(const MuxMessage& m);
+  void launch(const MuxMessage& m);
+  void kill(const MuxMessage& m);
+  // SIGKILLs the groups that are past their deadline.
+  void escalate();
+  // Responds to the kills, and notifies the exits, of groups that have no
+  // processes left, and forgets those groups.
+  void finish_empty_groups();
+  // Returns how long poll() can wait before a group needs to be SIGKILLed, or
+  // -1 if no group's being killed.
+  int poll_timeout() const;
+  void send(const MuxMessage& m);
+  [[noreturn]] void shut_down(bool parent_died);
+
+  std::chrono::milliseconds grace_;
+  IPC<MuxMessage> ipc_;
+  OwnedFds owned_files_;
+  std::map<uint64_t, Group> groups_;
+};
+
+#endif  // REAPER_MUX_IMPL_H_
@@ -0,0 +1,297 @@
+#include "reaper/mux_reaper.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <format>
+
+#include "paths.h"
+#include "reaper/reaper.h"
+#include "time_aliases.h"
+
+namespace reaper {
+namespace {
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+// How long kill() waits beyond the grace period for a group to exit.
+const auto kKillSlack = seconds(10);
+
+std::map<std::string, std::string> parse_env(char** env) {
+  std::map<std::string, std::string> vars;
+  for (char** v = env; v && *v; ++v) {
+    const char* eq = strchr(*v, '=');
+    if (!eq) continue;
+    vars[std::string(*v, eq - *v)] = eq + 1;
+  }
+  return vars;
+}
+
+// Returns an 'env' command that turns 'base', the reaper's environment, into
+// 'env', or an empty string if they're the same. Passing the difference keeps
+// launch messages small.
+std::string env_prefix(const std::map<std::string, std::string>& base,
+                       EnvVars* env) {
+  if (!env) return "";
+  std::map<std::string, std::string> want = parse_env(env->vars());
+  std::vector<std::string> args = {"env"};
+  for (const auto& [var, val] : base) {
+    if (!want.contains(var)) {
+      args.push_back("-u");
+      args.push_back(var);
+    }
+  }
+  for (const auto& [var, val] : want) {
+    auto it = base.find(var);
+    if (it == base.end() || it->second != val) {
+      args.push_back(var + "=" + val);
+    }
+  }
+  if (args.size() == 1) return "";
+  return shell_join(args) + " ";
+}
+}  // namespace
+
+StatusOr<std::unique_ptr<MuxReaper>> MuxReaper::start(
+    const std::string& ipc_dir, milliseconds grace) {
+  Token token;
+  ASSIGN_OR_RETURN(auto ipc,
+                   IPC<MuxMessage>::create(ipc_dir, &token, SOCK_SEQPACKET));
+  auto mux =
+      std::unique_ptr<MuxReaper>(new MuxReaper(grace, std::move(ipc)));
+
+  EnvVars env = EnvVars::environ();
+  env.set_var(kReaperIpcFileEnvVar, token);
+  env.set_var(kReaperGraceMsEnvVar, std::to_string(grace.count()));
+  mux->reaper_env_ = parse_env(env.vars());
+  ASSIGN_OR_RETURN(mux->reaper_,
+                   launch_process({get_reaper_path(), kReaperMultiplexFlag},
+                                  &env));
+
+  // Send this process's pidfd as the parent to the reaper.
+  int pidfd = syscall(SYS_pidfd_open, getpid(), 0);
+  if (pidfd < 0) {
+    return InternalError("Failed to create pidfd: " + libc_error_name(errno));
+  }
+  StatusVal s = mux->ipc_.send_fd(pidfd);
+  close(pidfd);
+  RETURN_IF_ERROR(s);
+
+  ASSIGN_OR_RETURN(MuxMessage ready, mux->ipc_.receive());
+  if (ready.code != MuxMessageCode::READY) {
+    return InternalError(std::format(
+        "Multiplexed reaper sent {} instead of READY.", (int)ready.code));
+  }
+  mux->reader_ = std::thread(&MuxReaper::read_loop, mux.get());
+  return mux;
+}
+
+MuxReaper::~MuxReaper() {
+  // Hanging up tells the reaper to terminate its groups and exit, and ends
+  // read_loop().
+  ::shutdown(ipc_.socket(), SHUT_RDWR);
+  if (reader_.joinable()) reader_.join();
+
+  // Give the reaper time to terminate its groups, since ~Process only gives
+  // it a second before SIGKILLing it.
+  reaper_.wait_for(
+      std::chrono::duration_cast<milliseconds>(grace_ + kKillSlack));
+}
+
+StatusOr<MuxReaper::GroupId> MuxReaper::launch(const std::string& command,
+                                               EnvVars* env) {
+  ASSIGN_OR_RETURN(std::vector<GroupId> groups,
+                   launch(std::vector<std::string>{command}, env));
+  return groups[0];
+}
+
+StatusOr<std::vector<MuxReaper::GroupId>> MuxReaper::launch(
+    const std::vector<std::string>& commands, EnvVars* env) {
+  std::string prefix = env_prefix(reaper_env_, env);
+  // Builds every message before sending any, so that a command that's too
+  // long doesn't leave the others launched.
+  std::vector<MuxMessage> messages;
+  for (const std::string& command : commands) {
+    std::string full = prefix.empty()
+                           ? command
+                           : prefix + "sh -c " + shell_join({command});
+    MuxMessage& m = messages.emplace_back(
+        MuxMessage{.code = MuxMessageCode::LAUNCH});
+    if (full.size() >= sizeof(m.command)) {
+      return InvalidArgumentError(std::format(
+          "Command and environment changes take {} bytes, but launches are "
+          "limited to {}.",
+          full.size(), sizeof(m.command) - 1));
+    }
+    memcpy(m.command, full.c_str(), full.size() + 1);
+  }
+
+  std::vector<GroupId> groups;
+  std::vector<RequestId> requests;
+  for (MuxMessage& m : messages) {
+    {
+      std::lock_guard lock(mu_);
+      m.group_id = next_group_++;
+    }
+    StatusOr<RequestId> request = send(m);
+    if (!request.ok()) {
+      abandon(groups, requests);
+      return request.status();
+    }
+    groups.push_back(m.group_id);
+    requests.push_back(*request);
+  }
+
+  StatusVal result = OkStatus();
+  for (size_t i = 0; i < requests.size(); ++i) {
+    StatusOr<MuxMessage> r = wait_response(requests[i], kKillSlack);
+    if (!r.ok()) {
+      abandon(groups, std::vector<RequestId>(requests.begin() + i,
+                                             requests.end()));
+      return r.status();
+    }
+    if (r->code != MuxMessageCode::LAUNCHED && result.ok()) {
+      result = InvalidArgumentError(
+          std::format("Multiplexed reaper failed to launch: {}", commands[i]));
+    }
+  }
+  if (!result.ok()) {
+    abandon(groups, {});
+    return result;
+  }
+  return groups;
+}
+
+void MuxReaper::abandon(const std::vector<GroupId>& groups,
+                        const std::vector<RequestId>& outstanding) {
+  for (RequestId request : outstanding) forget(request);
+  // The reaper handles requests in order, so each kill follows its group's
+  // launch, and groups that failed to launch are reported killed right away.
+  StatusVal s = kill(groups);
+  if (!s.ok()) {
+    ERROR("Failed to kill the groups of a failed launch: %s",
+          s.to_string().c_str());
+  }
+}
+
+StatusOr<MuxReaper::RequestId> MuxReaper::kill_async(GroupId group) {
+  return send(MuxMessage{.code = MuxMessageCode::KILL, .group_id = group});
+}
+
+StatusVal MuxReaper::wait(RequestId request, milliseconds timeout) {
+  ASSIGN_OR_RETURN(MuxMessage m, wait_response(request, timeout));
+  if (m.code != MuxMessageCode::KILLED) {
+    return InternalError(std::format(
+        "Unexpected response to request {}: {}", request, (int)m.code));
+  }
+  return OkStatus();
+}
+
+StatusVal MuxReaper::kill(GroupId group) {
+  return kill(std::vector<GroupId>{group});
+}
+
+StatusVal MuxReaper::kill(const std::vector<GroupId>& groups) {
+  std::vector<RequestId> requests;
+  StatusVal result = OkStatus();
+  for (GroupId group : groups) {
+    StatusOr<RequestId> request = kill_async(group);
+    if (!request.ok()) {
+      result = request.status();
+      break;
+    }
+    requests.push_back(*request);
+  }
+  auto timeout = std::chrono::duration_cast<milliseconds>(grace_ + kKillSlack);
+  for (RequestId request : requests) {
+    if (!result.ok()) {
+      forget(request);
+      continue;
+    }
+    result = wait(request, timeout);
+    if (!result.ok()) forget(request);
+  }
+  return result;
+}
+
+void MuxReaper::forget(RequestId request) {
+  std::lock_guard lock(mu_);
+  if (responses_.erase(request) == 0) forgotten_.insert(request);
+}
+
+int MuxReaper::pid(GroupId group) const {
+  std::lock_guard lock(mu_);
+  auto it = groups_.find(group);
+  return it == groups_.end() ? -1 : it->second;
+}
+
+bool MuxReaper::running(GroupId group) const {
+  std::lock_guard lock(mu_);
+  return groups_.contains(group);
+}
+
+StatusOr<MuxReaper::RequestId> MuxReaper::send(MuxMessage m) {
+  std::lock_guard lock(send_mu_);
+  m.request_id = next_request_++;
+  RETURN_IF_ERROR(ipc_.send(m));
+  return m.request_id;
+}
+
+StatusOr<MuxMessage> MuxReaper::wait_response(RequestId request,
+                                              milliseconds timeout) {
+  std::unique_lock lock(mu_);
+  auto deadline = sc_now() + timeout;
+  while (true) {
+    auto it = responses_.find(request);
+    if (it != responses_.end()) {
+      MuxMessage m = it->second;
+      responses_.erase(it);
+      return m;
+    }
+    if (reaper_exited_) {
+      return AbortedError("The multiplexed reaper has exited.");
+    }
+    if (response_cv_.wait_until(lock, deadline) == std::cv_status::timeout &&
+        !responses_.contains(request)) {
+      return DeadlineExceededError(
+          std::format("Timed out waiting on reaper request {}.", request));
+    }
+  }
+}
+
+void MuxReaper::read_loop() {
+  while (true) {
+    StatusOr<MuxMessage> m = ipc_.receive(/*block=*/true);
+    std::lock_guard lock(mu_);
+    if (!m.ok()) {
+      if (m.status().code() != StatusCode::ABORTED) {
+        ERROR("%s", m.to_string().c_str());
+      }
+      reaper_exited_ = true;
+      response_cv_.notify_all();
+      return;
+    }
+
+    switch (m->code) {
+      case MuxMessageCode::LAUNCHED:
+        groups_[m->group_id] = m->pid;
+        break;
+      case MuxMessageCode::KILLED:
+      case MuxMessageCode::EXITED:
+        groups_.erase(m->group_id);
+        break;
+      default:
+        break;
+    }
+    if (m->code != MuxMessageCode::EXITED &&
+        forgotten_.erase(m->request_id) == 0) {
+      responses_[m->request_id] = *m;
+      response_cv_.notify_all();
+    }
+  }
+}
+
+}  // namespace reaper
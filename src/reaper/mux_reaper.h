@@ -0,0 +1,136 @@
+#ifndef REAPER_MUX_REAPER_H_
+#define REAPER_MUX_REAPER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "process/process.h"
+#include "reaper/ipc.h"
+#include "reaper/protocol.h"
+#include "third_party/status/status_or.h"
+
+namespace reaper {
+
+// A single reaper process that runs many commands, each in its own process
+// group and cgroup, over one IPC connection. Replaces one Reaper per command
+// when running many desktops.
+//
+// MuxReaper is thread safe. Requests from different threads are pipelined over
+// the connection, so a slow kill doesn't hold up other launches or kills.
+class MuxReaper {
+ public:
+  using GroupId = uint64_t;
+  using RequestId = uint64_t;
+
+  // Launches the reaper, with its IPC socket in 'ipc_dir'. Killed groups get
+  // 'grace' to exit after SIGTERM before they're SIGKILLed.
+  static StatusOr<std::unique_ptr<MuxReaper>> start(
+      const std::string& ipc_dir,
+      std::chrono::milliseconds grace =
+          std::chrono::milliseconds(kDefaultReaperGraceMs));
+
+  // Hangs up on the reaper, which terminates every group and exits.
+  ~MuxReaper();
+
+  MuxReaper(const MuxReaper&) = delete;
+  MuxReaper& operator=(const MuxReaper&) = delete;
+
+  // Runs 'command' with 'sh -c' in a new group, with 'env' (or this process's
+  // environment if 'env' is null). The command's output goes to this process's
+  // stdout and stderr.
+  //
+  // Returns INVALID_ARGUMENT if the command can't be launched, e.g. because
+  // it's a simple command whose executable doesn't exist, or if the command
+  // and its environment don't fit in a message.
+  StatusOr<GroupId> launch(const std::string& command, EnvVars* env = nullptr);
+
+  // Launches each of 'commands', sending all of the requests before waiting on
+  // any of them. The batch launches as a whole: if any command fails to
+  // launch, or the launch fails otherwise, every group that did launch, or
+  // might still, is killed before the error's returned.
+  StatusOr<std::vector<GroupId>> launch(
+      const std::vector<std::string>& commands, EnvVars* env = nullptr);
+
+  // Requests that 'group' be terminated and returns without waiting. Wait for
+  // the group to exit with wait(), or forget() the request.
+  StatusOr<RequestId> kill_async(GroupId group);
+
+  // Drops the response to 'request', which won't be waited on. Responses are
+  // kept until they're waited on or forgotten.
+  void forget(RequestId request);
+
+  // Waits for the kill 'request' to finish.
+  //
+  // Returns DEADLINE_EXCEEDED if it hasn't finished within 'timeout', and
+  // ABORTED if the reaper's exited.
+  StatusVal wait(RequestId request, std::chrono::milliseconds timeout);
+
+  // Terminates 'group' and waits for it to exit.
+  StatusVal kill(GroupId group);
+
+  // Terminates each of 'groups' and waits for them all to exit. The groups
+  // share a grace period, so this takes no longer than killing one group.
+  StatusVal kill(const std::vector<GroupId>& groups);
+
+  // Returns the pid of the group's shell, or -1 if the group doesn't exist.
+  int pid(GroupId group) const;
+
+  // Returns whether the group's been launched and hasn't yet exited or been
+  // killed.
+  bool running(GroupId group) const;
+
+  const Process& process() const { return reaper_; }
+
+ private:
+  MuxReaper(std::chrono::milliseconds grace, IPC<MuxMessage> ipc)
+      : grace_(grace), ipc_(std::move(ipc)) {}
+
+  // Kills 'groups', the groups of a failed launch, and forgets the launch
+  // requests in 'outstanding', which haven't been answered.
+  void abandon(const std::vector<GroupId>& groups,
+               const std::vector<RequestId>& outstanding);
+  // Sends 'm' with the next request id and returns the id.
+  StatusOr<RequestId> send(MuxMessage m);
+  // Waits for the response to 'request' and returns it.
+  StatusOr<MuxMessage> wait_response(RequestId request,
+                                     std::chrono::milliseconds timeout);
+  // Receives the reaper's messages until the reaper hangs up. Runs on
+  // 'reader_', so that responses are always read promptly, even while other
+  // threads are sending.
+  void read_loop();
+
+  std::chrono::milliseconds grace_;
+  IPC<MuxMessage> ipc_;
+  Process reaper_;
+  // The reaper's environment, which its commands inherit.
+  std::map<std::string, std::string> reaper_env_;
+  std::thread reader_;
+
+  // Serializes sends.
+  std::mutex send_mu_;
+  RequestId next_request_ = 1;
+
+  mutable std::mutex mu_;
+  // Signaled whenever a response arrives or the reaper hangs up.
+  std::condition_variable response_cv_;
+  bool reaper_exited_ = false;
+  GroupId next_group_ = 1;
+  // Responses that haven't been waited on yet, by request id.
+  std::map<RequestId, MuxMessage> responses_;
+  // Forgotten requests whose responses haven't arrived yet, and are dropped
+  // when they do.
+  std::set<RequestId> forgotten_;
+  // The pids of running groups.
+  std::map<GroupId, int> groups_;
+};
+
+}  // namespace reaper
+
+#endif  // REAPER_MUX_REAPER_H_
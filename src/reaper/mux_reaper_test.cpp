@@ -0,0 +1,231 @@
+#include "reaper/mux_reaper.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+
+#include "process/cgroup.h"
+#include "process/process.h"
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+
+using reaper::MuxReaper;
+
+std::string get_ipc_dir() {
+  return "/run/user/" + std::to_string(getuid()) + "/bounce_mux_reaper_test";
+}
+
+// Returns whether 'pid' is running, counting zombies as exited, since the
+// reaper may not have reaped a process yet when it reports a group's exit.
+bool is_alive(int pid) {
+  std::ifstream stat(std::format("/proc/{}/stat", pid));
+  if (!stat.is_open()) return false;
+  std::string line;
+  std::getline(stat, line);
+  size_t state = line.rfind(')') + 2;
+  return state < line.size() && line[state] != 'Z';
+}
+
+// Returns whether any live process's command line contains 'needle'.
+bool any_running(const std::string& needle) {
+  for (const auto& entry : std::filesystem::directory_iterator("/proc")) {
+    std::string name = entry.path().filename();
+    if (name.find_first_not_of("0123456789") != std::string::npos) continue;
+    std::ifstream in(entry.path() / "cmdline");
+    std::string cmdline((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    std::replace(cmdline.begin(), cmdline.end(), '\0', ' ');
+    if (cmdline.find(needle) != std::string::npos &&
+        is_alive(std::stoi(name))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Waits for 'path' to have contents and returns them.
+std::string wait_for_file(const std::string& path) {
+  auto start = sc_now();
+  while (sc_now() - start < 2s) {
+    std::ifstream in(path);
+    std::string contents;
+    if (in && std::getline(in, contents) && !contents.empty()) {
+      return contents;
+    }
+    sleep_for(10ms);
+  }
+  return "";
+}
+
+// Returns UNAVAILABLE if this process can't create cgroups and move processes
+// into them, without which the reaper can't find daemonized descendants.
+StatusVal check_cgroups() {
+  ASSIGN_OR_RETURN(Cgroup cgroup, Cgroup::create(std::format(
+                                      "bounce_mux_reaper_test_{}", getpid())));
+  ASSIGN_OR_RETURN(Process p, launch_process({"sleep", "100"}));
+  StatusVal s = cgroup.add_process(p.pid);
+  p.signal(SIGKILL);
+  p.wait_for(1s);
+  return s;
+}
+
+}  // namespace
+
+class MuxReaperTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ipc_dir_ = get_ipc_dir();
+    std::filesystem::remove_all(ipc_dir_);
+    std::filesystem::create_directories(ipc_dir_);
+    ASSERT_OK_AND_ASSIGN(mux_, MuxReaper::start(ipc_dir_, 500ms));
+  }
+
+  void TearDown() override {
+    mux_.reset();
+    std::filesystem::remove_all(ipc_dir_);
+  }
+
+  std::string ipc_dir_;
+  std::unique_ptr<MuxReaper> mux_;
+};
+
+TEST_F(MuxReaperTest, launch_and_kill) {
+  ASSERT_OK_AND_ASSIGN(MuxReaper::GroupId group, mux_->launch("sleep 100"));
+  int pid = mux_->pid(group);
+  EXPECT_GT(pid, 0);
+  EXPECT_TRUE(mux_->running(group));
+
+  StatusVal s = mux_->kill(group);
+  EXPECT_OK(s);
+  EXPECT_FALSE(mux_->running(group));
+  EXPECT_FALSE(is_alive(pid));
+}
+
+TEST_F(MuxReaperTest, kill_terminates_daemonized_descendants) {
+  StatusVal cgroups = check_cgroups();
+  if (cgroups.code() == StatusCode::UNAVAILABLE) {
+    GTEST_SKIP() << cgroups.to_string();
+  }
+  ASSERT_OK(cgroups);
+  std::string pid_file = ipc_dir_ + "/pid";
+  ASSERT_OK_AND_ASSIGN(
+      MuxReaper::GroupId group,
+      mux_->launch("setsid sleep 100 & echo $! > " + pid_file + "; wait"));
+  int pid = std::stoi(wait_for_file(pid_file));
+  EXPECT_TRUE(is_alive(pid));
+
+  StatusVal s = mux_->kill(group);
+  EXPECT_OK(s);
+  EXPECT_FALSE(is_alive(pid));
+}
+
+TEST_F(MuxReaperTest, slow_kill_doesnt_block_other_requests) {
+  // The slow group ignores SIGTERM, so it's only SIGKILLed after the grace
+  // period.
+  ASSERT_OK_AND_ASSIGN(MuxReaper::GroupId slow,
+                       mux_->launch("trap '' TERM; sleep 100"));
+  ASSERT_OK_AND_ASSIGN(MuxReaper::RequestId slow_kill, mux_->kill_async(slow));
+
+  auto start = sc_now();
+  ASSERT_OK_AND_ASSIGN(MuxReaper::GroupId fast, mux_->launch("sleep 100"));
+  StatusVal s = mux_->kill(fast);
+  EXPECT_OK(s);
+  EXPECT_LT(sc_now() - start, 400ms);
+  EXPECT_TRUE(mux_->running(slow));
+
+  s = mux_->wait(slow_kill, 5s);
+  EXPECT_OK(s);
+  EXPECT_FALSE(mux_->running(slow));
+}
+
+TEST_F(MuxReaperTest, drops_forgotten_responses) {
+  ASSERT_OK_AND_ASSIGN(MuxReaper::GroupId group, mux_->launch("sleep 100"));
+  ASSERT_OK_AND_ASSIGN(MuxReaper::RequestId request, mux_->kill_async(group));
+  mux_->forget(request);
+  auto start = sc_now();
+  while (mux_->running(group) && sc_now() - start < 5s) sleep_for(10ms);
+  EXPECT_FALSE(mux_->running(group));
+
+  // The response was dropped when it arrived, along with the group's exit.
+  StatusVal s = mux_->wait(request, 100ms);
+  EXPECT_EQ(s.code(), StatusCode::DEADLINE_EXCEEDED);
+}
+
+TEST_F(MuxReaperTest, batches_launches_and_kills) {
+  std::vector<std::string> commands(8, "sleep 100");
+  ASSERT_OK_AND_ASSIGN(std::vector<MuxReaper::GroupId> groups,
+                       mux_->launch(commands));
+  ASSERT_EQ(groups.size(), commands.size());
+  std::vector<int> pids;
+  for (MuxReaper::GroupId group : groups) {
+    pids.push_back(mux_->pid(group));
+    EXPECT_TRUE(is_alive(pids.back()));
+  }
+
+  StatusVal s = mux_->kill(groups);
+  EXPECT_OK(s);
+  for (int pid : pids) {
+    EXPECT_FALSE(is_alive(pid));
+  }
+}
+
+TEST_F(MuxReaperTest, failed_batches_kill_their_launched_groups) {
+  // The marker's only in the valid command's processes.
+  std::string marker = std::format("100.{}", getpid());
+  EXPECT_THAT(mux_->launch({"sleep " + marker, "no_such_bounce_binary"}),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_FALSE(any_running(marker));
+
+  // A missing binary fails a launch on its own too.
+  EXPECT_THAT(mux_->launch("no_such_bounce_binary --flag"),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST_F(MuxReaperTest, passes_env) {
+  std::string out_file = ipc_dir_ + "/env";
+  EnvVars env = EnvVars::environ();
+  env.set_var("MUX_REAPER_TEST_VAR", "it's set");
+  ASSERT_OK_AND_ASSIGN(
+      MuxReaper::GroupId group,
+      mux_->launch("echo \"$MUX_REAPER_TEST_VAR\" > " + out_file, &env));
+  EXPECT_EQ(wait_for_file(out_file), "it's set");
+  StatusVal s = mux_->kill(group);
+  EXPECT_OK(s);
+}
+
+TEST_F(MuxReaperTest, notices_exited_groups) {
+  ASSERT_OK_AND_ASSIGN(MuxReaper::GroupId group, mux_->launch("true"));
+  auto start = sc_now();
+  while (mux_->running(group) && sc_now() - start < 2s) {
+    sleep_for(10ms);
+  }
+  EXPECT_FALSE(mux_->running(group));
+
+  // Killing an exited group succeeds right away.
+  StatusVal s = mux_->kill(group);
+  EXPECT_OK(s);
+}
+
+TEST_F(MuxReaperTest, shutting_down_kills_every_group) {
+  std::vector<std::string> commands(4, "sleep 100");
+  ASSERT_OK_AND_ASSIGN(std::vector<MuxReaper::GroupId> groups,
+                       mux_->launch(commands));
+  std::vector<int> pids;
+  for (MuxReaper::GroupId group : groups) {
+    pids.push_back(mux_->pid(group));
+  }
+
+  mux_.reset();
+  for (int pid : pids) {
+    EXPECT_FALSE(is_alive(pid));
+  }
+}
@@ -1,10 +1,17 @@
 #ifndef REAPER_PROTOCOL_H_
 #define REAPER_PROTOCOL_H_
 
+#include <stdint.h>
+
 // The reaper launcher passes its IPC connection token to the reaper
 // through this env var.
 inline const char* const kReaperIpcFileEnvVar = "REAPER_IPC_FILE";
 
+// The reaper reads how long it gives processes to exit after SIGTERM before
+// SIGKILLing them, in milliseconds, from this env var.
+inline const char* const kReaperGraceMsEnvVar = "REAPER_GRACE_MS";
+inline const int kDefaultReaperGraceMs = 100;
+
 enum class ReaperMessageCode {
   // Requests
   CLEAN_UP = 0,
@@ -20,4 +27,46 @@ struct ReaperMessage {
   ReaperMessageCode code;
 };
 
+// Multiplexed reaper protocol.
+//
+// 'reaper --multiplex' runs many process groups for a single client over one
+// SOCK_SEQPACKET IPC connection. Each request carries a client-chosen
+// request_id that the reaper echoes in its response. Responses are sent as
+// work completes rather than in request order, so the client can pipeline
+// requests and doesn't wait on a slow teardown to launch or kill other groups.
+inline const char* const kReaperMultiplexFlag = "--multiplex";
+inline const int kMuxCommandSize = 4096;
+
+enum class MuxMessageCode {
+  // Requests
+  // Run 'command' with 'sh -c' as process group 'group_id'.
+  LAUNCH = 0,
+  // Terminate process group 'group_id'.
+  KILL = 1,
+
+  // Responses
+  // Sent once, after the reaper's received its parent's pidfd.
+  READY = 2,
+  // 'pid' is the pid of the group's shell.
+  LAUNCHED = 3,
+  LAUNCH_FAILED = 4,
+  // Sent once the group's processes have all exited. Also sent for groups the
+  // reaper doesn't know about, since they've already exited.
+  KILLED = 5,
+
+  // Notifications
+  // Sent with a request_id of 0 when a group's processes all exit without the
+  // group being killed.
+  EXITED = 6,
+};
+
+struct MuxMessage {
+  MuxMessageCode code;
+  int32_t pid = -1;
+  uint64_t request_id = 0;
+  uint64_t group_id = 0;
+  // Null terminated. Only used by LAUNCH.
+  char command[kMuxCommandSize] = {};
+};
+
 #endif  // REAPER_PROTOCOL_H_
@@ -1,19 +1,24 @@
 #include "reaper/reaper.h"
 
+#include <poll.h>
 #include <spawn.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 
+#include "paths.h"
 #include "process/process.h"
 #include "reaper/ipc.h"
 
 namespace reaper {
 namespace {
 
+using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::chrono::steady_clock;
 
@@ -23,20 +28,43 @@ void log_error(T v) {
 }
 }  // namespace
 
+std::string shell_join(const std::vector<std::string>& args) {
+  std::string command;
+  for (const std::string& arg : args) {
+    if (!command.empty()) command += " ";
+    // Single quote each arg, and end, escape, and restart the quoting around
+    // any single quotes in the arg.
+    command += "'";
+    for (char c : arg) {
+      if (c == '\'') {
+        command += "'\\''";
+      } else {
+        command += c;
+      }
+    }
+    command += "'";
+  }
+  return command;
+}
+
 StatusOr<Reaper> Reaper::create(const std::string& command,
-                                const std::string& ipc_dir) {
+                                const std::string& ipc_dir,
+                                std::chrono::milliseconds grace) {
   // Open the IPC connection.
   Token token;
   ASSIGN_OR_RETURN(auto ipc, IPC<ReaperMessage>::create(ipc_dir, &token));
-  return Reaper(command, ipc_dir, std::move(ipc), std::move(token));
+  return Reaper(command, ipc_dir, grace, std::move(ipc), std::move(token));
 }
 
-StatusVal Reaper::launch() {
+StatusVal Reaper::launch(EnvVars* env, ProcessOutConf&& process_out,
+                         const LaunchOpts& opts) {
   // Launch the reaper.
-  EnvVars env = EnvVars::environ();
-  env.set_var(kReaperIpcFileEnvVar, ipc_token_.c_str());
+  EnvVars reaper_env = env ? EnvVars(env->vars()) : EnvVars::environ();
+  reaper_env.set_var(kReaperIpcFileEnvVar, ipc_token_.c_str());
+  reaper_env.set_var(kReaperGraceMsEnvVar, std::to_string(grace_.count()));
   ASSIGN_OR_RETURN(Process p,
-                   launch_process({"./build/reaper", command_}, &env));
+                   launch_process({get_reaper_path(), command_}, &reaper_env,
+                                  std::move(process_out), opts));
 
   // Open this process's pidfd to send to the reaper as the reaper's parent.
   int pidfd = syscall(SYS_pidfd_open, getpid(), 0);
@@ -80,16 +108,26 @@ bool Reaper::clean_up() {
     return false;
   }
 
-  auto start = steady_clock::now();
-  auto timeout = seconds(10);
-  StatusOr<ReaperMessage> m =
-      ReaperMessage{.code = ReaperMessageCode::FINISHED_CLEANING_UP};
-  while (steady_clock::now() - start < timeout) {
-    m = ipc_.receive(/*blocking=*/false);
-    if (m.ok() || m.status().code() != StatusCode::UNAVAILABLE) {
-      break;
+  // Wait for the reaper's confirmation without spinning. The reaper gets its
+  // grace period plus some slack to finish.
+  const auto deadline = steady_clock::now() + seconds(10) + grace_;
+  while (true) {
+    auto remaining = std::chrono::duration_cast<milliseconds>(
+        deadline - steady_clock::now());
+    pollfd p = {.fd = ipc_.socket(), .events = POLLIN, .revents = 0};
+    int ready = poll(&p, 1, std::max<int>(remaining.count(), 0));
+    if (ready == -1 && errno == EINTR) continue;
+    if (ready == -1) {
+      ERROR("poll failed: %s", strerror(errno));
+      return false;
+    }
+    if (ready == 0) {
+      ERROR("Timed out waiting for the reaper to clean up.");
+      return false;
     }
+    break;
   }
+  StatusOr<ReaperMessage> m = ipc_.receive(/*blocking=*/true);
   if (!m.ok()) {
     log_error(m);
     return false;
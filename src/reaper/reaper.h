@@ -3,6 +3,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include "process/process.h"
 #include "reaper/ipc.h"
@@ -11,11 +12,18 @@
 
 namespace reaper {
 
+// Joins 'args' into a command string that sh parses back into 'args'.
+std::string shell_join(const std::vector<std::string>& args);
+
 class Reaper {
  public:
-  // Create a Reaper instance with the given command and IPC directory.
-  static StatusOr<Reaper> create(const std::string& command,
-                                 const std::string& ipc_dir);
+  // Create a Reaper instance with the given command and IPC directory. During
+  // clean up, the command's processes get 'grace' to exit after SIGTERM before
+  // they're SIGKILLed.
+  static StatusOr<Reaper> create(
+      const std::string& command, const std::string& ipc_dir,
+      std::chrono::milliseconds grace =
+          std::chrono::milliseconds(kDefaultReaperGraceMs));
 
   // Disallow default construction, copying and assignment
   Reaper() = delete;
@@ -26,13 +34,25 @@ class Reaper {
   Reaper(Reaper&&) = default;
   Reaper& operator=(Reaper&&) = default;
 
-  // Runs the given 'command' under the reaper.
+  // Runs the given 'command' under the reaper. The reaper, and so the command,
+  // runs with 'env' (or this process's environment if 'env' is null) and
+  // 'process_out'. 'opts' apply to the reaper process, e.g. to start it in a
+  // cgroup, in which case the reaper's own cgroup for the command nests in
+  // that one.
+  //
+  // Simple commands are spawned directly, so only their spawn is checked.
+  // Commands that need sh, e.g. builtins, pipes, or redirections, are only
+  // checked for failing within their first 20 ms, which catches typos but not
+  // commands that fail later.
   //
-  // Returns an INVALID_ARGUMENT error if the process fails to launch, or if it
-  // exits quickly after launching.
-  StatusVal launch();
+  // Returns an INVALID_ARGUMENT error if the command fails to spawn, or if it
+  // needs sh and fails right away.
+  StatusVal launch(EnvVars* env = nullptr,
+                   ProcessOutConf&& process_out = ProcessOutConf(),
+                   const LaunchOpts& opts = LaunchOpts());
 
   Process& process() { return reaper_; }
+  const Process& process() const { return reaper_; }
 
   // Requests that the reqper stop all of its descendants and waits for a
   // confirmation from the reaper that is succeeded.
@@ -45,13 +65,15 @@ class Reaper {
 
  private:
   Reaper(const std::string& command, const std::string& ipc_dir,
-         IPC<ReaperMessage> ipc, Token token)
+         std::chrono::milliseconds grace, IPC<ReaperMessage> ipc, Token token)
       : command_(command),
         ipc_dir_(ipc_dir),
+        grace_(grace),
         ipc_(std::move(ipc)),
         ipc_token_(std::move(token)) {}
   std::string command_;
   std::string ipc_dir_;
+  std::chrono::milliseconds grace_;
   IPC<ReaperMessage> ipc_;
   Token ipc_token_;
   Process reaper_;
@@ -186,9 +186,42 @@ TEST_F(ReaperTest, InvalidCommandError) {
   EXPECT_THAT(p, StatusIs(StatusCode::INVALID_ARGUMENT));
 }
 
+TEST_F(ReaperTest, InvalidShellCommandError) {
+  // The redirection makes the command run through sh, which starts fine.
+  reaper::Reaper reaper = std::move(
+      reaper::Reaper::create("no_such_bounce_binary > /dev/null", ipc_dir_)
+          .value_or_die());
+  StatusVal s = reaper.launch();
+
+  EXPECT_THAT(s, StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST_F(ReaperTest, LaunchesShellCommands) {
+  // Builtins and pipelines aren't executables, and so run through sh.
+  for (std::string command : {"exec sleep 100", "sleep 100 | cat"}) {
+    SCOPED_TRACE(command);
+    reaper::Reaper reaper =
+        std::move(reaper::Reaper::create(command, ipc_dir_).value_or_die());
+    StatusVal s = reaper.launch();
+    EXPECT_OK(s);
+    EXPECT_TRUE(reaper.clean_up());
+  }
+}
+
 TEST_F(ReaperTest, ReaperStaysOpenAfterChildren) {
   reaper::Reaper reaper = run_reaper_ptree("50", ipc_dir_);
   sleep_for(milliseconds(1000));
   EXPECT_EQ(count_reaper(), 1);
   EXPECT_TRUE(reaper.clean_up());
 }
+
+TEST(ShellJoin, round_trips_through_sh) {
+  std::vector<std::string> args = {"printf", "%s|", "a b", "it's", "$HOME",
+                                   ""};
+  FILE* pipe = popen(reaper::shell_join(args).c_str(), "r");
+  ASSERT_NE(pipe, nullptr);
+  char buf[256];
+  size_t r = fread(buf, 1, sizeof(buf), pipe);
+  pclose(pipe);
+  EXPECT_EQ(std::string(buf, r), "a b|it's|$HOME||");
+}
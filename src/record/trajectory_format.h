@@ -0,0 +1,137 @@
+// The on-disk format of recorded trajectories: the frames a client received
+// and the input events it sent, with timestamps.
+//
+// A trajectory file is a header, a sequence of independently decodable chunks,
+// an index with one entry per chunk, and a footer that locates the index:
+//
+//   FileHeader
+//   ChunkHeader, chunk data   (repeated)
+//   IndexEntry                (one per chunk)
+//   Footer
+//
+// A chunk's data, once decompressed, is a sequence of records, each a
+// RecordHeader followed by its payload. Frames are stored whole or, in tiled
+// chunks, as the tiles that changed since the chunk's previous frame. Each
+// chunk's first frame is whole, so that a chunk decodes without the ones
+// before it. The index lets readers seek to a chunk by frame number or time.
+//
+// All integers are little-endian. Chunks, records, and the index start at
+// multiples of 8 bytes, so that readers can use them, and uncompressed
+// frames' pixels, in place from a mapped file.
+
+#ifndef RECORD_TRAJECTORY_FORMAT_H_
+#define RECORD_TRAJECTORY_FORMAT_H_
+
+#include <stdint.h>
+
+#include <bit>
+
+namespace trajectory {
+
+// Records are written in host byte order.
+static_assert(std::endian::native == std::endian::little);
+
+inline const char kFileMagic[8] = {'B', 'D', 'T', 'R', 'A', 'J', '0', '1'};
+inline const char kFooterMagic[8] = {'B', 'D', 'T', 'R', 'I', 'D', 'X', '1'};
+inline const uint32_t kChunkMagic = 0x4b4e4843;  // "CHNK"
+inline const uint32_t kVersion = 1;
+
+enum class Compression : uint32_t {
+  NONE = 0,
+  ZSTD = 1,
+};
+
+enum class RecordType : uint32_t {
+  FRAME = 1,
+  EVENT = 2,
+};
+
+enum class FrameEncoding : uint32_t {
+  // The frame's width * height * 4 bytes of BGRA pixels.
+  FULL = 0,
+  // 'num_tiles' uint32 tile indices, row major and padded to 8 bytes,
+  // followed by each tile's pixels, row by row. Edge tiles are cropped to the
+  // frame.
+  TILES = 1,
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct ChunkHeader {
+  uint32_t magic;
+  Compression compression;
+  // The sizes of the chunk's records before and after compression. The
+  // stored bytes follow the header.
+  uint64_t raw_size;
+  uint64_t stored_size;
+  uint32_t num_records;
+  uint32_t reserved;
+};
+
+struct RecordHeader {
+  RecordType type;
+  // The size of the payload that follows, padded to 8 bytes.
+  uint32_t size;
+  // CLOCK_MONOTONIC time, in ns.
+  int64_t timestamp_ns;
+};
+
+struct FrameRecord {
+  // Frames are numbered from 0 in the order they were recorded.
+  uint64_t frame_number;
+  int32_t width;
+  int32_t height;
+  FrameEncoding encoding;
+  uint32_t tile_size;
+  uint32_t num_tiles;
+  uint32_t reserved;
+};
+
+// Mirrors desktop/event.h's Event.
+struct EventRecord {
+  int32_t type;
+  int32_t keysym;
+  int32_t key_direction;
+  int32_t mouse_x;
+  int32_t mouse_y;
+  int32_t button_mask;
+};
+
+struct IndexEntry {
+  // The file offset of the chunk's header.
+  uint64_t offset;
+  // The chunk's frames are first_frame to first_frame + num_frames - 1.
+  uint64_t first_frame;
+  uint32_t num_frames;
+  uint32_t num_events;
+  // The timestamps of the chunk's first and last records.
+  int64_t first_timestamp_ns;
+  int64_t last_timestamp_ns;
+};
+
+struct Footer {
+  uint64_t index_offset;
+  uint64_t num_chunks;
+  uint64_t num_frames;
+  uint64_t num_events;
+  char magic[8];
+};
+
+static_assert(sizeof(FileHeader) == 16);
+static_assert(sizeof(ChunkHeader) == 32);
+static_assert(sizeof(RecordHeader) == 16);
+static_assert(sizeof(FrameRecord) == 32);
+static_assert(sizeof(EventRecord) == 24);
+static_assert(sizeof(IndexEntry) == 40);
+static_assert(sizeof(Footer) == 40);
+
+// Rounds 'size' up to a multiple of 8, so that records stay aligned.
+inline uint64_t padded(uint64_t size) { return (size + 7) & ~(uint64_t)7; }
+
+}  // namespace trajectory
+
+#endif  // RECORD_TRAJECTORY_FORMAT_H_
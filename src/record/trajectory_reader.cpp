@@ -0,0 +1,549 @@
+#include "record/trajectory_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+
+#ifdef BOUNCE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "libc_error.h"
+#include "process/fd.h"
+#include "record/trajectory_recorder.h"
+
+using namespace trajectory;
+
+struct TrajectoryReader::Mapping {
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  ~Mapping() {
+    if (data) munmap((void*)data, size);
+  }
+};
+
+namespace {
+template <typename T>
+T read_at(const uint8_t* data) {
+  T t;
+  memcpy(&t, data, sizeof(T));
+  return t;
+}
+
+StatusVal corrupt(const std::string& path, const std::string& what) {
+  return InvalidArgumentError(
+      std::format("{} isn't a valid trajectory: {}", path, what));
+}
+
+// Asks the kernel to read [data, data + size) ahead of its use.
+void will_need(const uint8_t* data, size_t size) {
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)data & ~(page - 1);
+  madvise((void*)start, (uintptr_t)data + size - start, MADV_WILLNEED);
+}
+}  // namespace
+
+TrajectoryReader::TrajectoryReader(std::string path,
+                                   std::shared_ptr<const Mapping> mapping,
+                                   const ReaderOptions& options)
+    : path_(std::move(path)), mapping_(std::move(mapping)), options_(options) {}
+
+StatusOr<std::unique_ptr<TrajectoryReader>> TrajectoryReader::open(
+    const std::string& path, const ReaderOptions& options) {
+  if (options.decode_threads < 0 || options.prefetch_chunks < 0 ||
+      options.cache_chunks <= options.prefetch_chunks) {
+    return InvalidArgumentError(std::format(
+        "Invalid reader options: decode_threads={}, prefetch_chunks={}, "
+        "cache_chunks={}. cache_chunks must be larger than prefetch_chunks.",
+        options.decode_threads, options.prefetch_chunks,
+        options.cache_chunks));
+  }
+
+  Fd fd = Fd::take(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (*fd == -1) {
+    std::string error = "Failed to open " + path + ": " +
+                        libc_error_name(errno);
+    if (errno == ENOENT) return NotFoundError(error);
+    return InternalError(error);
+  }
+  struct stat st;
+  if (fstat(*fd, &st) == -1) {
+    return InternalError("Failed to stat " + path + ": " +
+                         libc_error_name(errno));
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(FileHeader) + sizeof(Footer)) {
+    return corrupt(path, "it's too short.");
+  }
+  // Shared, so that every process that maps the file uses the same pages.
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, *fd, 0);
+  if (data == MAP_FAILED) {
+    return InternalError("Failed to map " + path + ": " +
+                         libc_error_name(errno));
+  }
+  auto mapping = std::make_shared<Mapping>();
+  mapping->data = (const uint8_t*)data;
+  mapping->size = size;
+  const uint8_t* file = mapping->data;
+
+  FileHeader header = read_at<FileHeader>(file);
+  if (memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0) {
+    return corrupt(path, "it doesn't start with a trajectory header.");
+  }
+  if (header.version != kVersion) {
+    return corrupt(path, std::format("it's version {}, not {}.",
+                                     header.version, kVersion));
+  }
+  Footer footer = read_at<Footer>(file + size - sizeof(Footer));
+  if (memcmp(footer.magic, kFooterMagic, sizeof(kFooterMagic)) != 0) {
+    return corrupt(path, "it has no footer. Was its recording closed?");
+  }
+  uint64_t index_end = size - sizeof(Footer);
+  if (footer.index_offset < sizeof(FileHeader) ||
+      footer.index_offset > index_end ||
+      footer.num_chunks != (index_end - footer.index_offset) /
+                               sizeof(IndexEntry) ||
+      (index_end - footer.index_offset) % sizeof(IndexEntry) != 0) {
+    return corrupt(path, "its index doesn't match its footer.");
+  }
+
+  auto reader = std::unique_ptr<TrajectoryReader>(
+      new TrajectoryReader(path, std::move(mapping), options));
+  reader->footer_ = footer;
+  reader->index_.resize(footer.num_chunks);
+  memcpy(reader->index_.data(), file + footer.index_offset,
+         footer.num_chunks * sizeof(IndexEntry));
+
+  uint64_t frames = 0;
+  uint64_t events = 0;
+  for (size_t c = 0; c < reader->index_.size(); ++c) {
+    const IndexEntry& entry = reader->index_[c];
+    if (entry.offset % 8 != 0 || entry.offset < sizeof(FileHeader) ||
+        entry.offset > footer.index_offset ||
+        footer.index_offset - entry.offset < sizeof(ChunkHeader)) {
+      return corrupt(path, std::format("chunk {}'s offset is invalid.", c));
+    }
+    ChunkHeader chunk = read_at<ChunkHeader>(file + entry.offset);
+    if (chunk.magic != kChunkMagic ||
+        chunk.stored_size > footer.index_offset - entry.offset -
+                                sizeof(ChunkHeader)) {
+      return corrupt(path, std::format("chunk {}'s header is invalid.", c));
+    }
+    if (chunk.compression == Compression::ZSTD && !has_zstd()) {
+      return InvalidArgumentError(
+          path + " is compressed with zstd, which this build doesn't have.");
+    }
+    if (chunk.compression != Compression::NONE &&
+        chunk.compression != Compression::ZSTD) {
+      return corrupt(path, std::format("chunk {}'s compression is unknown.",
+                                       c));
+    }
+    if (entry.num_frames > 0) {
+      if (entry.first_frame != frames) {
+        return corrupt(path, std::format("chunk {}'s frames aren't numbered "
+                                         "after the previous chunk's.", c));
+      }
+      reader->frame_chunks_.push_back(c);
+    }
+    frames += entry.num_frames;
+    events += entry.num_events;
+  }
+  if (frames != footer.num_frames || events != footer.num_events) {
+    return corrupt(path, "its index doesn't match its footer.");
+  }
+
+  for (int i = 0; i < options.decode_threads; ++i) {
+    reader->decoders_.emplace_back(
+        [r = reader.get()]() { r->decode_loop(); });
+  }
+  return reader;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+  {
+    std::lock_guard l(mu_);
+    exit_ = true;
+    cv_.notify_all();
+  }
+  for (std::thread& decoder : decoders_) decoder.join();
+}
+
+StatusOr<std::shared_ptr<const TrajectoryReader::Chunk>>
+TrajectoryReader::decode(size_t c) {
+  const IndexEntry& entry = index_[c];
+  const uint8_t* stored = mapping_->data + entry.offset + sizeof(ChunkHeader);
+  ChunkHeader header = read_at<ChunkHeader>(mapping_->data + entry.offset);
+  auto chunk = std::make_shared<Chunk>();
+  chunk->size = header.raw_size;
+  if (header.compression == Compression::NONE) {
+    if (header.raw_size != header.stored_size) {
+      return corrupt(path_, std::format("chunk {}'s sizes don't match.", c));
+    }
+    will_need(stored, header.stored_size);
+    // Points into the mapping, which the chunk keeps alive.
+    chunk->data = std::shared_ptr<const uint8_t>(mapping_, stored);
+  } else {
+#ifdef BOUNCE_HAVE_ZSTD
+    uint8_t* raw = (uint8_t*)malloc(std::max(header.raw_size, (uint64_t)1));
+    if (!raw) {
+      return corrupt(path_, std::format("chunk {} is too large.", c));
+    }
+    chunk->data = std::shared_ptr<const uint8_t>(
+        raw, [](const uint8_t* p) { free((void*)p); });
+    size_t size = ZSTD_decompress(raw, header.raw_size, stored,
+                                  header.stored_size);
+    if (ZSTD_isError(size) || size != header.raw_size) {
+      return corrupt(path_,
+                     std::format("chunk {} doesn't decompress.", c));
+    }
+#else
+    return InvalidArgumentError("This build can't decompress zstd.");
+#endif
+  }
+
+  const uint8_t* data = chunk->data.get();
+  uint32_t num_records = 0;
+  size_t offset = 0;
+  while (offset < chunk->size) {
+    if (chunk->size - offset < sizeof(RecordHeader)) {
+      return corrupt(path_, std::format("chunk {} is truncated.", c));
+    }
+    RecordHeader record = read_at<RecordHeader>(data + offset);
+    if (record.size > chunk->size - offset - sizeof(RecordHeader)) {
+      return corrupt(path_, std::format("chunk {} is truncated.", c));
+    }
+    if (record.type == RecordType::FRAME) {
+      if (record.size < sizeof(FrameRecord)) {
+        return corrupt(path_, std::format("chunk {} is truncated.", c));
+      }
+      FrameRecord frame =
+          read_at<FrameRecord>(data + offset + sizeof(RecordHeader));
+      uint64_t pixels = (uint64_t)frame.width * frame.height * 4;
+      bool valid = frame.width > 0 && frame.height > 0 &&
+                   frame.frame_number ==
+                       entry.first_frame + chunk->frames.size();
+      if (frame.encoding == FrameEncoding::FULL) {
+        valid = valid && record.size - sizeof(FrameRecord) >= pixels;
+      } else if (frame.encoding == FrameEncoding::TILES) {
+        // Each chunk's first frame is whole.
+        valid = valid && !chunk->frames.empty() && frame.tile_size > 0 &&
+                frame.tile_size <= 4096;
+      } else {
+        valid = false;
+      }
+      if (!valid) {
+        return corrupt(path_,
+                       std::format("frame {} is invalid.", frame.frame_number));
+      }
+      chunk->frames.push_back(offset);
+    } else if (record.type == RecordType::EVENT) {
+      if (record.size < sizeof(EventRecord)) {
+        return corrupt(path_, std::format("chunk {} is truncated.", c));
+      }
+      chunk->events.push_back(offset);
+    }
+    // Other record types are skipped, so that older readers can read files
+    // with new kinds of records.
+    offset += sizeof(RecordHeader) + record.size;
+    num_records++;
+  }
+  if (num_records != header.num_records ||
+      chunk->frames.size() != entry.num_frames ||
+      chunk->events.size() != entry.num_events) {
+    return corrupt(path_,
+                   std::format("chunk {}'s records don't match its index.", c));
+  }
+  return std::shared_ptr<const Chunk>(std::move(chunk));
+}
+
+StatusOr<std::shared_ptr<const TrajectoryReader::Chunk>>
+TrajectoryReader::chunk(size_t c) {
+  std::unique_lock l(mu_);
+  while (true) {
+    auto it = cache_.find(c);
+    if (it == cache_.end()) break;
+    if (it->second.decoding) {
+      cv_.wait(l);
+      continue;
+    }
+    it->second.last_used = ++uses_;
+    if (!it->second.status.ok()) return it->second.status;
+    return it->second.chunk;
+  }
+
+  // Decoding here is never slower than waiting for a decoder to get to it.
+  queue_.erase(std::remove(queue_.begin(), queue_.end(), c), queue_.end());
+  cache_[c] = CacheEntry{.last_used = ++uses_};
+  l.unlock();
+  StatusOr<std::shared_ptr<const Chunk>> chunk = decode(c);
+  l.lock();
+  finish_decode(c, chunk);
+  return chunk;
+}
+
+void TrajectoryReader::finish_decode(
+    size_t c, StatusOr<std::shared_ptr<const Chunk>>& chunk) {
+  CacheEntry& entry = cache_[c];
+  entry.decoding = false;
+  if (chunk.ok()) {
+    entry.chunk = *chunk;
+  } else {
+    entry.status = chunk.status();
+  }
+  cv_.notify_all();
+  evict();
+}
+
+void TrajectoryReader::evict() {
+  while (true) {
+    int decoded = 0;
+    auto oldest = cache_.end();
+    for (auto it = cache_.begin(); it != cache_.end(); ++it) {
+      if (it->second.decoding) continue;
+      decoded++;
+      if (oldest == cache_.end() ||
+          it->second.last_used < oldest->second.last_used) {
+        oldest = it;
+      }
+    }
+    if (decoded <= options_.cache_chunks) return;
+    cache_.erase(oldest);
+  }
+}
+
+void TrajectoryReader::prefetch(size_t pos) {
+  std::lock_guard l(mu_);
+  bool in_order = pos == last_pos_ + 1;
+  last_pos_ = pos;
+  if (!in_order || options_.decode_threads == 0) return;
+  size_t end = std::min(frame_chunks_.size(),
+                        pos + 1 + options_.prefetch_chunks);
+  for (size_t i = pos + 1; i < end; ++i) {
+    size_t c = frame_chunks_[i];
+    if (cache_.count(c) ||
+        std::find(queue_.begin(), queue_.end(), c) != queue_.end()) {
+      continue;
+    }
+    queue_.push_back(c);
+  }
+  cv_.notify_all();
+}
+
+void TrajectoryReader::decode_loop() {
+  std::unique_lock l(mu_);
+  while (true) {
+    cv_.wait(l, [&]() { return exit_ || !queue_.empty(); });
+    if (exit_) return;
+    size_t c = queue_.front();
+    queue_.pop_front();
+    if (cache_.count(c)) continue;
+
+    cache_[c] = CacheEntry{.last_used = ++uses_};
+    l.unlock();
+    StatusOr<std::shared_ptr<const Chunk>> chunk = decode(c);
+    l.lock();
+    finish_decode(c, chunk);
+  }
+}
+
+StatusOr<std::pair<size_t, size_t>> TrajectoryReader::find_frame(
+    uint64_t n) const {
+  if (n >= footer_.num_frames) {
+    return NotFoundError(std::format("{} has {} frames, so there's no frame "
+                                     "{}.",
+                                     path_, footer_.num_frames, n));
+  }
+  auto it = std::upper_bound(
+      frame_chunks_.begin(), frame_chunks_.end(), n,
+      [&](uint64_t frame, size_t c) { return frame < index_[c].first_frame; });
+  size_t pos = it - frame_chunks_.begin() - 1;
+  return std::make_pair(pos, n - index_[frame_chunks_[pos]].first_frame);
+}
+
+StatusOr<TrajectoryFrame> TrajectoryReader::frame(uint64_t n) {
+  ASSIGN_OR_RETURN(auto found, find_frame(n));
+  size_t pos = found.first;
+  size_t k = found.second;
+  size_t c = frame_chunks_[pos];
+  ASSIGN_OR_RETURN(std::shared_ptr<const Chunk> chunk, this->chunk(c));
+  prefetch(pos);
+
+  const uint8_t* record = chunk->data.get() + chunk->frames[k];
+  FrameRecord frame = read_at<FrameRecord>(record + sizeof(RecordHeader));
+  if (frame.encoding == FrameEncoding::TILES) return rebuild(c, *chunk, k);
+  return TrajectoryFrame{
+      .frame_number = n,
+      .timestamp_ns = read_at<RecordHeader>(record).timestamp_ns,
+      .width = frame.width,
+      .height = frame.height,
+      .pixels = record + sizeof(RecordHeader) + sizeof(FrameRecord),
+      .owner = chunk->data};
+}
+
+StatusOr<TrajectoryFrame> TrajectoryReader::rebuild(size_t c,
+                                                    const Chunk& chunk,
+                                                    size_t k) {
+  auto frame_at_index = [&](size_t i) {
+    return read_at<FrameRecord>(chunk.data.get() + chunk.frames[i] +
+                                sizeof(RecordHeader));
+  };
+  FrameRecord target = frame_at_index(k);
+  const size_t stride = (size_t)target.width * 4;
+  const size_t size = stride * target.height;
+  auto result = [&](const std::shared_ptr<const uint8_t[]>& pixels) {
+    return TrajectoryFrame{
+        .frame_number = target.frame_number,
+        .timestamp_ns =
+            read_at<RecordHeader>(chunk.data.get() + chunk.frames[k])
+                .timestamp_ns,
+        .width = target.width,
+        .height = target.height,
+        .pixels = pixels.get(),
+        .owner = pixels};
+  };
+
+  std::lock_guard l(rebuilt_mu_);
+  if (rebuilt_chunk_ == c && rebuilt_index_ == k) {
+    return result(rebuilt_pixels_);
+  }
+  // Starts from the last rebuilt frame if it's before this one in the chunk,
+  // and otherwise from the last whole frame.
+  size_t start = k;
+  const uint8_t* base = nullptr;
+  if (rebuilt_chunk_ == c && rebuilt_index_ <= k) {
+    start = rebuilt_index_;
+    base = rebuilt_pixels_.get();
+  } else {
+    while (start > 0 && frame_at_index(start).encoding != FrameEncoding::FULL) {
+      start--;
+    }
+    base = chunk.data.get() + chunk.frames[start] + sizeof(RecordHeader) +
+           sizeof(FrameRecord);
+  }
+  FrameRecord first = frame_at_index(start);
+  if (first.width != target.width || first.height != target.height) {
+    return corrupt(path_, std::format("frame {}'s tiles don't match the "
+                                      "frame before them.",
+                                      target.frame_number));
+  }
+
+  std::shared_ptr<uint8_t[]> pixels(new uint8_t[size]);
+  memcpy(pixels.get(), base, size);
+  for (size_t i = start + 1; i <= k; ++i) {
+    const uint8_t* record = chunk.data.get() + chunk.frames[i];
+    RecordHeader header = read_at<RecordHeader>(record);
+    FrameRecord frame = read_at<FrameRecord>(record + sizeof(RecordHeader));
+    const uint8_t* payload =
+        record + sizeof(RecordHeader) + sizeof(FrameRecord);
+    size_t payload_size = header.size - sizeof(FrameRecord);
+    auto invalid = [&]() {
+      return corrupt(path_, std::format("frame {}'s tiles are invalid.",
+                                        frame.frame_number));
+    };
+    if (frame.width != target.width || frame.height != target.height) {
+      return invalid();
+    }
+    if (frame.encoding == FrameEncoding::FULL) {
+      memcpy(pixels.get(), payload, size);
+      continue;
+    }
+
+    const int tile = frame.tile_size;
+    const uint32_t tiles_x = (frame.width + tile - 1) / tile;
+    const uint32_t tiles_y = (frame.height + tile - 1) / tile;
+    size_t indices_bytes = padded((uint64_t)frame.num_tiles * 4);
+    if (indices_bytes > payload_size) return invalid();
+    const uint8_t* in = payload + indices_bytes;
+    const uint8_t* end = payload + payload_size;
+    for (uint32_t t = 0; t < frame.num_tiles; ++t) {
+      uint32_t index = read_at<uint32_t>(payload + t * 4);
+      if (index >= tiles_x * tiles_y) return invalid();
+      int x0 = (index % tiles_x) * tile;
+      int y0 = (index / tiles_x) * tile;
+      int h = std::min(tile, frame.height - y0);
+      size_t row_bytes = (size_t)std::min(tile, frame.width - x0) * 4;
+      if ((size_t)(end - in) < row_bytes * h) return invalid();
+      uint8_t* out = pixels.get() + y0 * stride + x0 * 4;
+      for (int y = 0; y < h; ++y, in += row_bytes, out += stride) {
+        memcpy(out, in, row_bytes);
+      }
+    }
+  }
+
+  rebuilt_chunk_ = c;
+  rebuilt_index_ = k;
+  rebuilt_pixels_ = pixels;
+  return result(rebuilt_pixels_);
+}
+
+StatusOr<int64_t> TrajectoryReader::timestamp_ns(uint64_t n) {
+  ASSIGN_OR_RETURN(auto found, find_frame(n));
+  ASSIGN_OR_RETURN(std::shared_ptr<const Chunk> chunk,
+                   this->chunk(frame_chunks_[found.first]));
+  return read_at<RecordHeader>(chunk->data.get() +
+                               chunk->frames[found.second])
+      .timestamp_ns;
+}
+
+StatusOr<uint64_t> TrajectoryReader::frame_at(int64_t timestamp_ns) {
+  // The last chunk with frames that started by then. Its first record may be
+  // an event, in which case the frame's the previous chunk's last.
+  auto it = std::upper_bound(
+      frame_chunks_.begin(), frame_chunks_.end(), timestamp_ns,
+      [&](int64_t t, size_t c) { return t < index_[c].first_timestamp_ns; });
+  if (it == frame_chunks_.begin()) {
+    return NotFoundError(
+        std::format("No frame was recorded by {} ns.", timestamp_ns));
+  }
+  size_t c = *(it - 1);
+  ASSIGN_OR_RETURN(std::shared_ptr<const Chunk> chunk, this->chunk(c));
+  for (size_t k = chunk->frames.size(); k > 0; --k) {
+    RecordHeader record =
+        read_at<RecordHeader>(chunk->data.get() + chunk->frames[k - 1]);
+    if (record.timestamp_ns <= timestamp_ns) {
+      return index_[c].first_frame + k - 1;
+    }
+  }
+  if (it - 1 == frame_chunks_.begin()) {
+    return NotFoundError(
+        std::format("No frame was recorded by {} ns.", timestamp_ns));
+  }
+  return index_[c].first_frame - 1;
+}
+
+StatusOr<std::vector<TrajectoryEvent>> TrajectoryReader::events(
+    int64_t start_ns, int64_t end_ns) {
+  std::vector<TrajectoryEvent> events;
+  for (size_t c = 0; c < index_.size(); ++c) {
+    const IndexEntry& entry = index_[c];
+    if (entry.num_events == 0 || entry.last_timestamp_ns < start_ns ||
+        entry.first_timestamp_ns >= end_ns) {
+      continue;
+    }
+    ASSIGN_OR_RETURN(std::shared_ptr<const Chunk> chunk, this->chunk(c));
+    for (size_t offset : chunk->events) {
+      const uint8_t* record = chunk->data.get() + offset;
+      int64_t timestamp_ns = read_at<RecordHeader>(record).timestamp_ns;
+      if (timestamp_ns < start_ns || timestamp_ns >= end_ns) continue;
+      EventRecord event = read_at<EventRecord>(record + sizeof(RecordHeader));
+      events.push_back(TrajectoryEvent{
+          .timestamp_ns = timestamp_ns,
+          .event = Event{.type = (Event::Type)event.type,
+                         .keysym = event.keysym,
+                         .key_direction =
+                             (Event::Direction)event.key_direction,
+                         .mouse_x = event.mouse_x,
+                         .mouse_y = event.mouse_y,
+                         .button_mask = event.button_mask}});
+    }
+  }
+  return events;
+}
@@ -0,0 +1,167 @@
+// Random access to recorded trajectories (see record/trajectory_format.h).
+//
+// The reader maps the file read-only and shared, so processes that read the
+// same file, e.g. a training job's data loader workers, share its pages in
+// the page cache instead of each reading their own copy. Frames in
+// uncompressed chunks are returned in place from the mapping. Compressed
+// chunks are decompressed whole, on a pool of decoder threads, and the most
+// recently used ones are kept. Reading frames in order prefetches the next
+// chunks, so that sequential reads rarely wait on decoding.
+
+#ifndef RECORD_TRAJECTORY_READER_H_
+#define RECORD_TRAJECTORY_READER_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "desktop/event.h"
+#include "record/trajectory_format.h"
+#include "third_party/status/status_or.h"
+
+struct ReaderOptions {
+  // How many threads decompress chunks in the background.
+  int decode_threads = 2;
+  // How many chunks ahead to prefetch while frames are read in order.
+  int prefetch_chunks = 2;
+  // How many decoded chunks to keep. Frames that are still referenced keep
+  // their chunk's memory alive regardless.
+  int cache_chunks = 4;
+};
+
+struct TrajectoryFrame {
+  uint64_t frame_number = 0;
+  int64_t timestamp_ns = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  // width * height * 4 bytes of BGRA pixels, read-only.
+  const uint8_t* pixels = nullptr;
+  // Keeps 'pixels' alive: the file's mapping, a decompressed chunk, or a
+  // frame rebuilt from changed tiles.
+  std::shared_ptr<const void> owner;
+};
+
+struct TrajectoryEvent {
+  int64_t timestamp_ns = 0;
+  Event event;
+};
+
+class TrajectoryReader {
+ public:
+  // Maps the trajectory at 'path' and reads its index.
+  //
+  // Returns NOT_FOUND if the file doesn't exist, INVALID_ARGUMENT if it
+  // isn't a complete trajectory, e.g. because its recording wasn't closed,
+  // or uses zstd without a build with zstd, and INTERNAL if it can't be
+  // mapped.
+  static StatusOr<std::unique_ptr<TrajectoryReader>> open(
+      const std::string& path, const ReaderOptions& options = {});
+
+  ~TrajectoryReader();
+
+  TrajectoryReader(const TrajectoryReader&) = delete;
+  TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+  uint64_t num_frames() const { return footer_.num_frames; }
+  uint64_t num_events() const { return footer_.num_events; }
+  uint64_t num_chunks() const { return footer_.num_chunks; }
+  const std::string& path() const { return path_; }
+
+  // Returns frame 'n'. Reading is thread-safe.
+  //
+  // Returns NOT_FOUND if there's no frame 'n', and INVALID_ARGUMENT if its
+  // chunk is corrupt.
+  StatusOr<TrajectoryFrame> frame(uint64_t n);
+  // Returns frame 'n's timestamp, without rebuilding the frame.
+  StatusOr<int64_t> timestamp_ns(uint64_t n);
+  // Returns the number of the last frame recorded at or before
+  // 'timestamp_ns'.
+  //
+  // Returns NOT_FOUND if no frame was recorded by then.
+  StatusOr<uint64_t> frame_at(int64_t timestamp_ns);
+  // Returns the events recorded from 'start_ns' up to, but not including,
+  // 'end_ns'.
+  StatusOr<std::vector<TrajectoryEvent>> events(int64_t start_ns,
+                                                int64_t end_ns);
+
+ private:
+  struct Mapping;
+  // A chunk's records, and where its frames and events start.
+  struct Chunk {
+    // The records: in the mapping if the chunk's uncompressed, and
+    // decompressed otherwise.
+    std::shared_ptr<const uint8_t> data;
+    size_t size = 0;
+    // The offsets of the chunk's frame and event records' headers.
+    std::vector<size_t> frames;
+    std::vector<size_t> events;
+  };
+  struct CacheEntry {
+    // Whether a thread's decoding the chunk.
+    bool decoding = true;
+    StatusVal status = OkStatus();
+    std::shared_ptr<const Chunk> chunk = nullptr;
+    uint64_t last_used = 0;
+  };
+
+  TrajectoryReader(std::string path, std::shared_ptr<const Mapping> mapping,
+                   const ReaderOptions& options);
+
+  // Returns chunk 'c', decoding it on this thread unless another thread
+  // already is.
+  StatusOr<std::shared_ptr<const Chunk>> chunk(size_t c);
+  // Decompresses and parses chunk 'c'. Doesn't touch the cache.
+  StatusOr<std::shared_ptr<const Chunk>> decode(size_t c);
+  // Stores a decoded chunk. Must be called with 'mu_' held.
+  void finish_decode(size_t c, StatusOr<std::shared_ptr<const Chunk>>& chunk);
+  // Drops the least recently used chunks over 'cache_chunks'. Must be called
+  // with 'mu_' held.
+  void evict();
+  // Queues the frame_chunks_ after 'pos' for the decoders if frames are
+  // being read in order.
+  void prefetch(size_t pos);
+  void decode_loop();
+
+  // Returns the position in frame_chunks_ of the chunk that holds frame 'n',
+  // and the frame's index in the chunk.
+  StatusOr<std::pair<size_t, size_t>> find_frame(uint64_t n) const;
+  // Rebuilds frame 'k' of chunk 'c', a TILES frame, from the frame before it.
+  StatusOr<TrajectoryFrame> rebuild(size_t c, const Chunk& chunk, size_t k);
+
+  std::string path_;
+  std::shared_ptr<const Mapping> mapping_;
+  ReaderOptions options_;
+  trajectory::Footer footer_ = {};
+  std::vector<trajectory::IndexEntry> index_;
+  // The chunks that have frames, for finding frames by number.
+  std::vector<size_t> frame_chunks_;
+
+  std::mutex mu_;
+  // Signals decoders when chunks are queued, and readers when a chunk's
+  // decoded.
+  std::condition_variable cv_;
+  std::map<size_t, CacheEntry> cache_;
+  std::deque<size_t> queue_;
+  uint64_t uses_ = 0;
+  // The frame_chunks_ position of the last frame read, for detecting
+  // in-order reads.
+  size_t last_pos_ = SIZE_MAX;
+  bool exit_ = false;
+  std::vector<std::thread> decoders_;
+
+  // The last frame rebuilt from tiles, which the next one in its chunk is
+  // rebuilt from. Rebuilt frames are never modified, since they're returned.
+  std::mutex rebuilt_mu_;
+  size_t rebuilt_chunk_ = SIZE_MAX;
+  size_t rebuilt_index_ = 0;
+  std::shared_ptr<const uint8_t[]> rebuilt_pixels_;
+};
+
+#endif  // RECORD_TRAJECTORY_READER_H_
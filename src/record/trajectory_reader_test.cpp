@@ -0,0 +1,176 @@
+#include "record/trajectory_reader.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <filesystem>
+#include <format>
+#include <thread>
+
+#include "record/trajectory_recorder.h"
+#include "third_party/status/status_gtest.h"
+
+using namespace trajectory;
+
+namespace {
+// Returns a frame whose pixels all depend on 'seed', so that frames can be
+// told apart.
+Frame make_frame(int32_t width, int32_t height, int seed) {
+  size_t size = (size_t)width * height * 4;
+  Frame frame = {.width = width,
+                 .height = height,
+                 .pixels = UniquePtrBuf((uint8_t*)malloc(size))};
+  for (size_t i = 0; i < size; ++i) frame.pixels[i] = (i + seed) % 251;
+  return frame;
+}
+
+std::chrono::steady_clock::time_point at_ns(int64_t ns) {
+  return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(ns));
+}
+
+bool same_pixels(const TrajectoryFrame& frame, const Frame& expected) {
+  return frame.width == expected.width && frame.height == expected.height &&
+         memcmp(frame.pixels, expected.pixels.get(),
+                (size_t)frame.width * frame.height * 4) == 0;
+}
+}  // namespace
+
+class TrajectoryReaderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::format("/tmp/bounce_trajectory_reader_test_{}.traj",
+                        getpid());
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  // Records 'frames', one every 10 ns from 0, with a key press between each
+  // pair of frames, and returns what was recorded.
+  std::vector<Frame> record(int frames, const RecorderOptions& options) {
+    auto recorder = TrajectoryRecorder::create(path_, options).value_or_die();
+    std::vector<Frame> recorded;
+    for (int i = 0; i < frames; ++i) {
+      Frame frame = make_frame(20, 10, i);
+      // Changes only a few pixels between some frames, so that they're
+      // stored as tiles.
+      if (i % 3 != 0 && !recorded.empty()) {
+        memcpy(frame.pixels.get(), recorded.back().pixels.get(),
+               20 * 10 * 4);
+        frame.pixels[(i % 10) * 20 * 4 + (i % 20) * 4] = i;
+      }
+      CHECK(recorder->add_frame(frame, at_ns(i * 10)).ok());
+      CHECK(recorder->add_event(Event::key_press(i), at_ns(i * 10 + 5)).ok());
+      recorded.push_back(std::move(frame));
+    }
+    CHECK(recorder->close().ok());
+    return recorded;
+  }
+
+  std::string path_;
+};
+
+TEST_F(TrajectoryReaderTest, reads_frames_and_events) {
+  std::vector<Frame> recorded = record(5, {});
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryReader> reader,
+                       TrajectoryReader::open(path_));
+  EXPECT_EQ(reader->num_frames(), 5u);
+  EXPECT_EQ(reader->num_events(), 5u);
+
+  for (uint64_t n : {3, 0, 4, 1, 2}) {
+    ASSERT_OK_AND_ASSIGN(TrajectoryFrame frame, reader->frame(n));
+    EXPECT_EQ(frame.frame_number, n);
+    EXPECT_EQ(frame.timestamp_ns, (int64_t)n * 10);
+    EXPECT_TRUE(same_pixels(frame, recorded[n])) << n;
+    ASSERT_OK_AND_ASSIGN(int64_t timestamp_ns, reader->timestamp_ns(n));
+    EXPECT_EQ(timestamp_ns, (int64_t)n * 10);
+  }
+  EXPECT_THAT(reader->frame(5), StatusIs(StatusCode::NOT_FOUND));
+
+  ASSERT_OK_AND_ASSIGN(std::vector<TrajectoryEvent> events,
+                       reader->events(15, 35));
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0].timestamp_ns, 15);
+  EXPECT_EQ(events[0].event, Event::key_press(1));
+  EXPECT_EQ(events[1].event, Event::key_press(2));
+}
+
+TEST_F(TrajectoryReaderTest, returns_uncompressed_frames_in_place) {
+  std::vector<Frame> recorded = record(2, {});
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryReader> reader,
+                       TrajectoryReader::open(path_));
+  ASSERT_OK_AND_ASSIGN(TrajectoryFrame first, reader->frame(1));
+  ASSERT_OK_AND_ASSIGN(TrajectoryFrame second, reader->frame(1));
+  EXPECT_EQ(first.pixels, second.pixels);
+
+  // Frames outlive their reader.
+  reader.reset();
+  EXPECT_TRUE(same_pixels(first, recorded[1]));
+}
+
+TEST_F(TrajectoryReaderTest, seeks_by_time) {
+  record(5, RecorderOptions{.chunk_bytes = 1024});
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryReader> reader,
+                       TrajectoryReader::open(path_));
+  EXPECT_GT(reader->num_chunks(), 2u);
+  EXPECT_THAT(reader->frame_at(-1), StatusIs(StatusCode::NOT_FOUND));
+  for (int64_t t : {0, 5, 9, 10, 25, 39, 40, 1000}) {
+    ASSERT_OK_AND_ASSIGN(uint64_t n, reader->frame_at(t));
+    EXPECT_EQ(n, (uint64_t)std::min<int64_t>(t / 10, 4)) << t;
+  }
+}
+
+TEST_F(TrajectoryReaderTest, rebuilds_changed_tiles) {
+  std::vector<Frame> recorded = record(
+      12, RecorderOptions{.chunk_bytes = 4096, .changed_tiles = true,
+                          .tile_size = 4});
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryReader> reader,
+                       TrajectoryReader::open(path_));
+  for (uint64_t n : {0, 1, 2, 3, 4, 5, 11, 7, 2, 8, 8, 10, 6, 9}) {
+    ASSERT_OK_AND_ASSIGN(TrajectoryFrame frame, reader->frame(n));
+    EXPECT_TRUE(same_pixels(frame, recorded[n])) << n;
+  }
+}
+
+TEST_F(TrajectoryReaderTest, reads_zstd_chunks_concurrently) {
+  if (!has_zstd()) GTEST_SKIP() << "Built without zstd.";
+  std::vector<Frame> recorded = record(
+      40, RecorderOptions{.compression = Compression::ZSTD,
+                          .chunk_bytes = 2048,
+                          .changed_tiles = true,
+                          .tile_size = 8});
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryReader> reader,
+                       TrajectoryReader::open(path_));
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches = 0;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (uint64_t i = 0; i < recorded.size(); ++i) {
+        // Half the threads read in order, and half out of order.
+        uint64_t n = t % 2 ? (i * 7) % recorded.size() : i;
+        StatusOr<TrajectoryFrame> frame = reader->frame(n);
+        if (!frame.ok() || !same_pixels(*frame, recorded[n])) mismatches++;
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_EQ(mismatches, 0);
+}
+
+TEST_F(TrajectoryReaderTest, rejects_incomplete_files) {
+  EXPECT_THAT(TrajectoryReader::open(path_),
+              StatusIs(StatusCode::NOT_FOUND));
+
+  record(3, {});
+  // Cuts off the footer, as if the recording had never been closed.
+  std::filesystem::resize_file(path_,
+                               std::filesystem::file_size(path_) - 8);
+  EXPECT_THAT(TrajectoryReader::open(path_),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_THAT(
+      TrajectoryReader::open(
+          path_, ReaderOptions{.prefetch_chunks = 4, .cache_chunks = 4}),
+      StatusIs(StatusCode::INVALID_ARGUMENT));
+}
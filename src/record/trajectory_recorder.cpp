@@ -0,0 +1,381 @@
+#include "record/trajectory_recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+
+#ifdef BOUNCE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "libc_error.h"
+#include "third_party/status/logger.h"
+
+using namespace trajectory;
+
+namespace {
+int64_t to_ns(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+size_t frame_bytes(int32_t width, int32_t height) {
+  return (size_t)width * height * 4;
+}
+}  // namespace
+
+bool has_zstd() {
+#ifdef BOUNCE_HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+StatusOr<Compression> parse_compression(const std::string& name) {
+  if (name == "none") return Compression::NONE;
+  if (name == "zstd") return Compression::ZSTD;
+  return InvalidArgumentError(std::format(
+      "Unknown compression \"{}\". Expected none or zstd.", name));
+}
+
+StatusOr<std::unique_ptr<TrajectoryRecorder>> TrajectoryRecorder::create(
+    const std::string& path, const RecorderOptions& options) {
+  if (options.compression == Compression::ZSTD && !has_zstd()) {
+    return InvalidArgumentError(
+        "ZSTD compression needs a build with zstd.");
+  }
+  if (options.compression != Compression::NONE &&
+      options.compression != Compression::ZSTD) {
+    return InvalidArgumentError("Unknown compression.");
+  }
+  if (options.chunk_bytes == 0 || options.tile_size <= 0 ||
+      options.max_pending_chunks <= 0) {
+    return InvalidArgumentError(std::format(
+        "Invalid recorder options: chunk_bytes={}, tile_size={}, "
+        "max_pending_chunks={}",
+        options.chunk_bytes, options.tile_size, options.max_pending_chunks));
+  }
+
+  Fd fd = Fd::take(
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (*fd == -1) {
+    return InternalError("Failed to create " + path + ": " +
+                         libc_error_name(errno));
+  }
+
+  auto recorder = std::unique_ptr<TrajectoryRecorder>(
+      new TrajectoryRecorder(path, std::move(fd), options));
+  FileHeader header = {};
+  memcpy(header.magic, kFileMagic, sizeof(header.magic));
+  header.version = kVersion;
+  RETURN_IF_ERROR(recorder->write_all(&header, sizeof(header)));
+  recorder->writer_ = std::thread([r = recorder.get()]() { r->write_loop(); });
+  return recorder;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+  StatusVal s = close();
+  if (!s.ok()) {
+    ERROR("Failed to close trajectory %s: %s", path_.c_str(),
+          s.to_string().c_str());
+  }
+}
+
+uint8_t* TrajectoryRecorder::append_record(RecordType type, size_t size,
+                                           int64_t timestamp_ns) {
+  if (!chunk_) chunk_ = std::make_unique<Chunk>();
+  Chunk& chunk = *chunk_;
+  size_t record_size = sizeof(RecordHeader) + padded(size);
+  if (chunk.size + record_size > chunk.capacity) {
+    size_t capacity = std::max(chunk.size + record_size,
+                               std::max(chunk.capacity * 2, (size_t)4096));
+    uint8_t* data = (uint8_t*)realloc(chunk.data.get(), capacity);
+    CHECK(data);
+    chunk.data.release();
+    chunk.data.reset(data);
+    chunk.capacity = capacity;
+  }
+
+  uint8_t* record = chunk.data.get() + chunk.size;
+  RecordHeader header = {.type = type,
+                         .size = (uint32_t)padded(size),
+                         .timestamp_ns = timestamp_ns};
+  memcpy(record, &header, sizeof(header));
+  // Zero the padding, so that files don't leak old memory.
+  memset(record + sizeof(header) + size, 0, padded(size) - size);
+  chunk.size += record_size;
+
+  if (chunk.num_records == 0) chunk.entry.first_timestamp_ns = timestamp_ns;
+  chunk.entry.last_timestamp_ns = timestamp_ns;
+  chunk.num_records++;
+  stats_.raw_bytes += record_size;
+  return record + sizeof(header);
+}
+
+StatusVal TrajectoryRecorder::add_frame(
+    const Frame& frame, std::chrono::steady_clock::time_point time) {
+  if (!frame.pixels || frame.width <= 0 || frame.height <= 0) {
+    return InvalidArgumentError("Can't record a frame without pixels.");
+  }
+  std::unique_lock l(mu_);
+  if (closing_) return AbortedError("The recording's closed.");
+  RETURN_IF_ERROR(write_status_);
+
+  int64_t timestamp_ns = to_ns(time);
+  size_t size = frame_bytes(frame.width, frame.height);
+  // Each chunk starts with a whole frame, so that it decodes on its own.
+  bool tiled = options_.changed_tiles && chunk_ && chunk_->entry.num_frames &&
+               prev_width_ == frame.width && prev_height_ == frame.height;
+  if (tiled) {
+    append_tiles(frame, timestamp_ns);
+  } else {
+    uint8_t* payload =
+        append_record(RecordType::FRAME, sizeof(FrameRecord) + size,
+                      timestamp_ns);
+    FrameRecord record = {.frame_number = next_frame_,
+                          .width = frame.width,
+                          .height = frame.height,
+                          .encoding = FrameEncoding::FULL,
+                          .tile_size = 0,
+                          .num_tiles = 0,
+                          .reserved = 0};
+    memcpy(payload, &record, sizeof(record));
+    memcpy(payload + sizeof(record), frame.pixels.get(), size);
+  }
+
+  Chunk& chunk = *chunk_;
+  if (chunk.entry.num_frames == 0) chunk.entry.first_frame = next_frame_;
+  chunk.entry.num_frames++;
+  next_frame_++;
+  stats_.frames++;
+  if (options_.changed_tiles) {
+    prev_frame_.assign(frame.pixels.get(), frame.pixels.get() + size);
+    prev_width_ = frame.width;
+    prev_height_ = frame.height;
+  }
+
+  if (chunk.size >= options_.chunk_bytes) queue_chunk(l);
+  return OkStatus();
+}
+
+void TrajectoryRecorder::append_tiles(const Frame& frame,
+                                      int64_t timestamp_ns) {
+  const int tile = options_.tile_size;
+  const int tiles_x = (frame.width + tile - 1) / tile;
+  const int tiles_y = (frame.height + tile - 1) / tile;
+  const size_t stride = (size_t)frame.width * 4;
+  const uint8_t* pixels = frame.pixels.get();
+  const uint8_t* prev = prev_frame_.data();
+
+  // Finds the changed tiles and their pixels' size.
+  std::vector<uint32_t> changed;
+  size_t pixel_bytes = 0;
+  for (int ty = 0; ty < tiles_y; ++ty) {
+    int y0 = ty * tile;
+    int h = std::min(tile, frame.height - y0);
+    for (int tx = 0; tx < tiles_x; ++tx) {
+      int x0 = tx * tile;
+      size_t row_bytes = (size_t)std::min(tile, frame.width - x0) * 4;
+      size_t offset = y0 * stride + x0 * 4;
+      for (int y = 0; y < h; ++y, offset += stride) {
+        if (memcmp(pixels + offset, prev + offset, row_bytes) != 0) {
+          changed.push_back(ty * tiles_x + tx);
+          pixel_bytes += row_bytes * h;
+          break;
+        }
+      }
+    }
+  }
+
+  size_t indices_bytes = padded(changed.size() * sizeof(uint32_t));
+  uint8_t* payload = append_record(
+      RecordType::FRAME, sizeof(FrameRecord) + indices_bytes + pixel_bytes,
+      timestamp_ns);
+  FrameRecord record = {.frame_number = next_frame_,
+                        .width = frame.width,
+                        .height = frame.height,
+                        .encoding = FrameEncoding::TILES,
+                        .tile_size = (uint32_t)tile,
+                        .num_tiles = (uint32_t)changed.size(),
+                        .reserved = 0};
+  memcpy(payload, &record, sizeof(record));
+  uint8_t* out = payload + sizeof(record);
+  memset(out, 0, indices_bytes);
+  if (!changed.empty()) {
+    memcpy(out, changed.data(), changed.size() * sizeof(uint32_t));
+  }
+  out += indices_bytes;
+  for (uint32_t index : changed) {
+    int x0 = (index % tiles_x) * tile;
+    int y0 = (index / tiles_x) * tile;
+    int h = std::min(tile, frame.height - y0);
+    size_t row_bytes = (size_t)std::min(tile, frame.width - x0) * 4;
+    const uint8_t* in = pixels + y0 * stride + x0 * 4;
+    for (int y = 0; y < h; ++y, in += stride, out += row_bytes) {
+      memcpy(out, in, row_bytes);
+    }
+  }
+}
+
+StatusVal TrajectoryRecorder::add_event(
+    const Event& event, std::chrono::steady_clock::time_point time) {
+  std::unique_lock l(mu_);
+  if (closing_) return AbortedError("The recording's closed.");
+  RETURN_IF_ERROR(write_status_);
+
+  uint8_t* payload =
+      append_record(RecordType::EVENT, sizeof(EventRecord), to_ns(time));
+  EventRecord record = {.type = (int32_t)event.type,
+                        .keysym = event.keysym,
+                        .key_direction = (int32_t)event.key_direction,
+                        .mouse_x = event.mouse_x,
+                        .mouse_y = event.mouse_y,
+                        .button_mask = event.button_mask};
+  memcpy(payload, &record, sizeof(record));
+  chunk_->entry.num_events++;
+  stats_.events++;
+
+  if (chunk_->size >= options_.chunk_bytes) queue_chunk(l);
+  return OkStatus();
+}
+
+void TrajectoryRecorder::queue_chunk(std::unique_lock<std::mutex>& l) {
+  if (!chunk_ || chunk_->num_records == 0) return;
+  if ((int)pending_.size() >= options_.max_pending_chunks) {
+    auto start = std::chrono::steady_clock::now();
+    cv_.wait(l, [&]() {
+      return (int)pending_.size() < options_.max_pending_chunks ||
+             !write_status_.ok();
+    });
+    stats_.stall_s += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  }
+  pending_.push_back(std::move(chunk_));
+  cv_.notify_all();
+}
+
+void TrajectoryRecorder::write_loop() {
+  std::unique_lock l(mu_);
+  while (true) {
+    cv_.wait(l, [&]() { return !pending_.empty() || closing_; });
+    if (pending_.empty()) return;
+    std::unique_ptr<Chunk> chunk = std::move(pending_.front());
+    pending_.pop_front();
+    cv_.notify_all();
+    if (!write_status_.ok()) continue;
+
+    l.unlock();
+    StatusVal s = write_chunk(chunk.get());
+    chunk.reset();
+    l.lock();
+    if (!s.ok()) {
+      write_status_ = s;
+      cv_.notify_all();
+    }
+  }
+}
+
+StatusVal TrajectoryRecorder::write_chunk(Chunk* chunk) {
+  ChunkHeader header = {.magic = kChunkMagic,
+                        .compression = Compression::NONE,
+                        .raw_size = chunk->size,
+                        .stored_size = chunk->size,
+                        .num_records = chunk->num_records,
+                        .reserved = 0};
+  const uint8_t* stored = chunk->data.get();
+
+#ifdef BOUNCE_HAVE_ZSTD
+  UniquePtrBuf compressed;
+  if (options_.compression == Compression::ZSTD) {
+    size_t bound = ZSTD_compressBound(chunk->size);
+    compressed.reset((uint8_t*)malloc(bound));
+    CHECK(compressed);
+    size_t size = ZSTD_compress(compressed.get(), bound, chunk->data.get(),
+                                chunk->size, options_.zstd_level);
+    if (ZSTD_isError(size)) {
+      return InternalError(std::string("zstd failed: ") +
+                           ZSTD_getErrorName(size));
+    }
+    // Incompressible chunks are stored as is, so reading them is free.
+    if (size < chunk->size) {
+      header.compression = Compression::ZSTD;
+      header.stored_size = size;
+      stored = compressed.get();
+    }
+  }
+#endif
+
+  IndexEntry entry = chunk->entry;
+  entry.offset = offset_;
+  RETURN_IF_ERROR(write_all(&header, sizeof(header)));
+  RETURN_IF_ERROR(write_all(stored, header.stored_size));
+  static const uint8_t kZeros[8] = {};
+  RETURN_IF_ERROR(write_all(
+      kZeros, padded(header.stored_size) - header.stored_size));
+
+  std::lock_guard l(mu_);
+  index_.push_back(entry);
+  stats_.chunks++;
+  stats_.stored_bytes += header.stored_size;
+  return OkStatus();
+}
+
+StatusVal TrajectoryRecorder::write_all(const void* data, size_t size) {
+  const uint8_t* p = (const uint8_t*)data;
+  while (size > 0) {
+    ssize_t n = write(*fd_, p, size);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return InternalError("Failed to write to " + path_ + ": " +
+                           libc_error_name(errno));
+    }
+    p += n;
+    size -= n;
+    offset_ += n;
+  }
+  return OkStatus();
+}
+
+StatusVal TrajectoryRecorder::close() {
+  {
+    std::unique_lock l(mu_);
+    if (closed_) return close_status_;
+    if (write_status_.ok()) queue_chunk(l);
+    closing_ = true;
+    cv_.notify_all();
+  }
+  if (writer_.joinable()) writer_.join();
+
+  std::lock_guard l(mu_);
+  closed_ = true;
+  close_status_ = write_status_;
+  if (close_status_.ok()) {
+    Footer footer = {.index_offset = offset_,
+                     .num_chunks = index_.size(),
+                     .num_frames = stats_.frames,
+                     .num_events = stats_.events,
+                     .magic = {}};
+    memcpy(footer.magic, kFooterMagic, sizeof(footer.magic));
+    close_status_ =
+        write_all(index_.data(), index_.size() * sizeof(IndexEntry));
+    if (close_status_.ok()) close_status_ = write_all(&footer, sizeof(footer));
+  }
+  if (::close(fd_.release()) == -1 && close_status_.ok()) {
+    close_status_ = InternalError("Failed to close " + path_ + ": " +
+                                  libc_error_name(errno));
+  }
+  return close_status_;
+}
+
+RecorderStats TrajectoryRecorder::stats() {
+  std::lock_guard l(mu_);
+  return stats_;
+}
@@ -0,0 +1,157 @@
+// Records a client's frames and input events to a trajectory file (see
+// record/trajectory_format.h).
+//
+// Recording copies each frame into the current chunk's buffer, or, with
+// changed_tiles, just the tiles that differ from the previous frame. Full
+// chunks are compressed and written on a background thread, so that the
+// capture path only pays for the copy. If the writer falls behind by
+// 'max_pending_chunks', recording waits for it, which stats() reports.
+
+#ifndef RECORD_TRAJECTORY_RECORDER_H_
+#define RECORD_TRAJECTORY_RECORDER_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "desktop/event.h"
+#include "desktop/frame.h"
+#include "process/fd.h"
+#include "record/trajectory_format.h"
+#include "third_party/status/status_or.h"
+
+// Whether this build can compress chunks with zstd.
+bool has_zstd();
+
+// Parses "none" or "zstd".
+//
+// Returns INVALID_ARGUMENT for any other name.
+StatusOr<trajectory::Compression> parse_compression(const std::string& name);
+
+struct RecorderOptions {
+  // ZSTD needs a build with zstd (see has_zstd()).
+  trajectory::Compression compression = trajectory::Compression::NONE;
+  // zstd's level. Low levels are fast enough to keep up with capture.
+  int zstd_level = 1;
+  // A chunk's closed once its records reach this many bytes. Larger chunks
+  // compress better, but seeking has to decode more.
+  size_t chunk_bytes = 32 * 1024 * 1024;
+  // Store only the tiles of each frame that changed since the chunk's previous
+  // frame.
+  bool changed_tiles = false;
+  int tile_size = 64;
+  // How many full chunks can wait for the writer before recording blocks.
+  int max_pending_chunks = 4;
+};
+
+struct RecorderStats {
+  uint64_t frames = 0;
+  uint64_t events = 0;
+  uint64_t chunks = 0;
+  // The bytes of records before and after compression.
+  uint64_t raw_bytes = 0;
+  uint64_t stored_bytes = 0;
+  // How long recording has waited for the writer.
+  double stall_s = 0;
+};
+
+class TrajectoryRecorder {
+ public:
+  // Creates the trajectory file at 'path', replacing any existing file, and
+  // starts the writer thread.
+  //
+  // Returns INVALID_ARGUMENT for invalid options, e.g. ZSTD compression
+  // without zstd, and INTERNAL if the file can't be created.
+  static StatusOr<std::unique_ptr<TrajectoryRecorder>> create(
+      const std::string& path, const RecorderOptions& options = {});
+
+  // Closes the recording if it hasn't been closed.
+  ~TrajectoryRecorder();
+
+  TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+  TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+  // Records 'frame' or 'event' at 'time', which defaults to now. Recording
+  // is thread-safe.
+  //
+  // Returns INVALID_ARGUMENT for frames without pixels, ABORTED once the
+  // recording's closed, and the writer's error if it failed.
+  StatusVal add_frame(const Frame& frame,
+                      std::chrono::steady_clock::time_point time =
+                          std::chrono::steady_clock::now());
+  StatusVal add_event(const Event& event,
+                      std::chrono::steady_clock::time_point time =
+                          std::chrono::steady_clock::now());
+
+  // Writes any buffered records, the index, and the footer, and closes the
+  // file. Later calls return the first call's result.
+  StatusVal close();
+
+  RecorderStats stats();
+  const std::string& path() const { return path_; }
+
+ private:
+  // A chunk's records and its index entry, waiting to be written.
+  struct Chunk {
+    // Grown with realloc(), so that appending a frame doesn't first zero its
+    // space.
+    UniquePtrBuf data;
+    size_t size = 0;
+    size_t capacity = 0;
+    uint32_t num_records = 0;
+    trajectory::IndexEntry entry = {};
+  };
+
+  TrajectoryRecorder(std::string path, Fd fd, const RecorderOptions& options)
+      : path_(std::move(path)), fd_(std::move(fd)), options_(options) {}
+
+  // Appends a record to the current chunk and returns its payload, which
+  // has room for 'size' bytes. Must be called with 'mu_' held.
+  uint8_t* append_record(trajectory::RecordType type, size_t size,
+                         int64_t timestamp_ns);
+  // Queues the current chunk for the writer, waiting if the writer's behind.
+  // Must be called with 'mu_' held.
+  void queue_chunk(std::unique_lock<std::mutex>& l);
+  // Stores 'frame' as the tiles that changed since 'prev_frame_'. Must be
+  // called with 'mu_' held.
+  void append_tiles(const Frame& frame, int64_t timestamp_ns);
+
+  void write_loop();
+  // Compresses and writes 'chunk'. Called on the writer thread.
+  StatusVal write_chunk(Chunk* chunk);
+  StatusVal write_all(const void* data, size_t size);
+
+  std::string path_;
+  Fd fd_;
+  RecorderOptions options_;
+  uint64_t offset_ = 0;
+  std::thread writer_;
+
+  std::mutex mu_;
+  // Signals the writer when chunks are queued or the recording's closed, and
+  // the recorder when the writer's taken a chunk.
+  std::condition_variable cv_;
+  std::unique_ptr<Chunk> chunk_;
+  std::deque<std::unique_ptr<Chunk>> pending_;
+  bool closing_ = false;
+  bool closed_ = false;
+  StatusVal close_status_ = OkStatus();
+  // The first error the writer hit. Recording stops once it's set.
+  StatusVal write_status_ = OkStatus();
+  uint64_t next_frame_ = 0;
+  // The chunk's previous frame, for changed_tiles.
+  std::vector<uint8_t> prev_frame_;
+  int32_t prev_width_ = 0;
+  int32_t prev_height_ = 0;
+  std::vector<trajectory::IndexEntry> index_;
+  RecorderStats stats_;
+};
+
+#endif  // RECORD_TRAJECTORY_RECORDER_H_
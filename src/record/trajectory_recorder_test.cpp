@@ -0,0 +1,311 @@
+#include "record/trajectory_recorder.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+
+#include "third_party/status/status_gtest.h"
+
+using namespace trajectory;
+
+namespace {
+Frame make_frame(int32_t width, int32_t height, uint8_t value) {
+  size_t size = (size_t)width * height * 4;
+  Frame frame = {.width = width,
+                 .height = height,
+                 .pixels = UniquePtrBuf((uint8_t*)malloc(size))};
+  memset(frame.pixels.get(), value, size);
+  return frame;
+}
+
+std::chrono::steady_clock::time_point at_ns(int64_t ns) {
+  return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(ns));
+}
+
+template <typename T>
+T read_at(const std::vector<uint8_t>& data, size_t offset) {
+  T t;
+  CHECK(offset + sizeof(T) <= data.size());
+  memcpy(&t, data.data() + offset, sizeof(T));
+  return t;
+}
+
+struct ParsedRecord {
+  RecordHeader header;
+  // The record's payload.
+  std::vector<uint8_t> payload;
+};
+
+// A trajectory file, parsed without the recorder's code.
+struct ParsedFile {
+  Footer footer;
+  std::vector<IndexEntry> index;
+  std::vector<ChunkHeader> chunks;
+  // Each chunk's records. Only uncompressed chunks are parsed.
+  std::vector<std::vector<ParsedRecord>> records;
+};
+
+ParsedFile parse(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+  ParsedFile file;
+  FileHeader header = read_at<FileHeader>(data, 0);
+  EXPECT_EQ(memcmp(header.magic, kFileMagic, 8), 0);
+  EXPECT_EQ(header.version, kVersion);
+
+  file.footer = read_at<Footer>(data, data.size() - sizeof(Footer));
+  EXPECT_EQ(memcmp(file.footer.magic, kFooterMagic, 8), 0);
+  EXPECT_EQ(file.footer.index_offset % 8, 0u);
+  for (uint64_t i = 0; i < file.footer.num_chunks; ++i) {
+    file.index.push_back(read_at<IndexEntry>(
+        data, file.footer.index_offset + i * sizeof(IndexEntry)));
+  }
+
+  for (const IndexEntry& entry : file.index) {
+    EXPECT_EQ(entry.offset % 8, 0u);
+    ChunkHeader chunk = read_at<ChunkHeader>(data, entry.offset);
+    EXPECT_EQ(chunk.magic, kChunkMagic);
+    file.chunks.push_back(chunk);
+    file.records.emplace_back();
+    if (chunk.compression != Compression::NONE) continue;
+
+    size_t offset = entry.offset + sizeof(ChunkHeader);
+    size_t end = offset + chunk.raw_size;
+    while (offset < end) {
+      ParsedRecord record;
+      record.header = read_at<RecordHeader>(data, offset);
+      offset += sizeof(RecordHeader);
+      record.payload.assign(data.begin() + offset,
+                            data.begin() + offset + record.header.size);
+      offset += record.header.size;
+      file.records.back().push_back(std::move(record));
+    }
+    EXPECT_EQ(offset, end);
+    EXPECT_EQ(file.records.back().size(), chunk.num_records);
+  }
+  return file;
+}
+}  // namespace
+
+class TrajectoryRecorderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::format("/tmp/bounce_trajectory_test_{}.traj", getpid());
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  std::string path_;
+};
+
+TEST_F(TrajectoryRecorderTest, records_frames_and_events) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryRecorder> recorder,
+                       TrajectoryRecorder::create(path_));
+  StatusVal s = recorder->add_frame(make_frame(3, 2, 7), at_ns(100));
+  ASSERT_OK(s);
+  s = recorder->add_event(Event::key_press(42), at_ns(200));
+  ASSERT_OK(s);
+  s = recorder->add_event(Event::mouse_event(5, 6, 1), at_ns(300));
+  ASSERT_OK(s);
+  s = recorder->add_frame(make_frame(3, 2, 9), at_ns(400));
+  ASSERT_OK(s);
+  s = recorder->close();
+  ASSERT_OK(s);
+
+  RecorderStats stats = recorder->stats();
+  EXPECT_EQ(stats.frames, 2u);
+  EXPECT_EQ(stats.events, 2u);
+  EXPECT_EQ(stats.chunks, 1u);
+  EXPECT_EQ(stats.raw_bytes, stats.stored_bytes);
+
+  ParsedFile file = parse(path_);
+  EXPECT_EQ(file.footer.num_frames, 2u);
+  EXPECT_EQ(file.footer.num_events, 2u);
+  ASSERT_EQ(file.index.size(), 1u);
+  EXPECT_EQ(file.index[0].first_frame, 0u);
+  EXPECT_EQ(file.index[0].num_frames, 2u);
+  EXPECT_EQ(file.index[0].num_events, 2u);
+  EXPECT_EQ(file.index[0].first_timestamp_ns, 100);
+  EXPECT_EQ(file.index[0].last_timestamp_ns, 400);
+
+  const std::vector<ParsedRecord>& records = file.records[0];
+  ASSERT_EQ(records.size(), 4u);
+  EXPECT_EQ(records[0].header.type, RecordType::FRAME);
+  EXPECT_EQ(records[0].header.size, padded(sizeof(FrameRecord) + 3 * 2 * 4));
+  FrameRecord frame = read_at<FrameRecord>(records[0].payload, 0);
+  EXPECT_EQ(frame.frame_number, 0u);
+  EXPECT_EQ(frame.width, 3);
+  EXPECT_EQ(frame.height, 2);
+  EXPECT_EQ(frame.encoding, FrameEncoding::FULL);
+  EXPECT_EQ(records[0].payload[sizeof(FrameRecord)], 7);
+  EXPECT_EQ(records[0].payload[sizeof(FrameRecord) + 23], 7);
+
+  EXPECT_EQ(records[1].header.type, RecordType::EVENT);
+  EXPECT_EQ(records[1].header.timestamp_ns, 200);
+  EventRecord event = read_at<EventRecord>(records[1].payload, 0);
+  EXPECT_EQ(event.type, (int32_t)Event::Type::KEYBOARD);
+  EXPECT_EQ(event.keysym, 42);
+  EXPECT_EQ(event.key_direction, (int32_t)Event::Direction::PRESS);
+  event = read_at<EventRecord>(records[2].payload, 0);
+  EXPECT_EQ(event.type, (int32_t)Event::Type::MOUSE);
+  EXPECT_EQ(event.mouse_x, 5);
+  EXPECT_EQ(event.mouse_y, 6);
+  EXPECT_EQ(event.button_mask, 1);
+
+  frame = read_at<FrameRecord>(records[3].payload, 0);
+  EXPECT_EQ(frame.frame_number, 1u);
+  EXPECT_EQ(records[3].payload[sizeof(FrameRecord)], 9);
+}
+
+TEST_F(TrajectoryRecorderTest, splits_chunks) {
+  // Each frame fills a chunk.
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TrajectoryRecorder> recorder,
+      TrajectoryRecorder::create(
+          path_, RecorderOptions{.chunk_bytes = 64, .max_pending_chunks = 1}));
+  for (int i = 0; i < 5; ++i) {
+    StatusVal s = recorder->add_frame(make_frame(4, 4, i), at_ns(i * 10));
+    ASSERT_OK(s);
+  }
+  StatusVal s = recorder->add_event(Event::key_release(1), at_ns(45));
+  ASSERT_OK(s);
+  s = recorder->close();
+  ASSERT_OK(s);
+
+  ParsedFile file = parse(path_);
+  ASSERT_EQ(file.index.size(), 6u);
+  for (uint64_t i = 0; i < 5; ++i) {
+    EXPECT_EQ(file.index[i].first_frame, i);
+    EXPECT_EQ(file.index[i].num_frames, 1u);
+    EXPECT_EQ(file.index[i].first_timestamp_ns, (int64_t)i * 10);
+    EXPECT_GT(file.index[i + 1].offset, file.index[i].offset);
+  }
+  EXPECT_EQ(file.index[5].num_frames, 0u);
+  EXPECT_EQ(file.index[5].num_events, 1u);
+}
+
+TEST_F(TrajectoryRecorderTest, stores_changed_tiles) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TrajectoryRecorder> recorder,
+      TrajectoryRecorder::create(
+          path_, RecorderOptions{.changed_tiles = true, .tile_size = 2}));
+  // A 5x3 frame has 3x2 tiles, the last column and row cropped.
+  Frame frame = make_frame(5, 3, 0);
+  StatusVal s = recorder->add_frame(frame, at_ns(0));
+  ASSERT_OK(s);
+  // Changes pixel (4, 2), in tile 5, and (1, 0), in tile 0.
+  frame.pixels[(2 * 5 + 4) * 4] = 1;
+  frame.pixels[1 * 4 + 2] = 2;
+  s = recorder->add_frame(frame, at_ns(1));
+  ASSERT_OK(s);
+  s = recorder->add_frame(frame, at_ns(2));
+  ASSERT_OK(s);
+  s = recorder->close();
+  ASSERT_OK(s);
+
+  ParsedFile file = parse(path_);
+  ASSERT_EQ(file.records.size(), 1u);
+  const std::vector<ParsedRecord>& records = file.records[0];
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(read_at<FrameRecord>(records[0].payload, 0).encoding,
+            FrameEncoding::FULL);
+
+  FrameRecord tiles = read_at<FrameRecord>(records[1].payload, 0);
+  EXPECT_EQ(tiles.frame_number, 1u);
+  EXPECT_EQ(tiles.encoding, FrameEncoding::TILES);
+  EXPECT_EQ(tiles.tile_size, 2u);
+  ASSERT_EQ(tiles.num_tiles, 2u);
+  size_t offset = sizeof(FrameRecord);
+  EXPECT_EQ(read_at<uint32_t>(records[1].payload, offset), 0u);
+  EXPECT_EQ(read_at<uint32_t>(records[1].payload, offset + 4), 5u);
+  // Tile 0 is 2x2 pixels, and tile 5 is 1x1.
+  offset += 8;
+  EXPECT_EQ(records[1].payload[offset + 6], 2);
+  EXPECT_EQ(records[1].header.size,
+            padded(sizeof(FrameRecord) + 8 + 2 * 2 * 4 + 1 * 1 * 4));
+  EXPECT_EQ(records[1].payload[offset + 16], 1);
+
+  tiles = read_at<FrameRecord>(records[2].payload, 0);
+  EXPECT_EQ(tiles.encoding, FrameEncoding::TILES);
+  EXPECT_EQ(tiles.num_tiles, 0u);
+}
+
+TEST_F(TrajectoryRecorderTest, starts_chunks_with_whole_frames) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TrajectoryRecorder> recorder,
+      TrajectoryRecorder::create(
+          path_, RecorderOptions{.chunk_bytes = 64, .changed_tiles = true}));
+  for (int i = 0; i < 3; ++i) {
+    StatusVal s = recorder->add_frame(make_frame(4, 4, 0), at_ns(i));
+    ASSERT_OK(s);
+  }
+  StatusVal s = recorder->close();
+  ASSERT_OK(s);
+
+  ParsedFile file = parse(path_);
+  ASSERT_EQ(file.records.size(), 3u);
+  for (const std::vector<ParsedRecord>& records : file.records) {
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(read_at<FrameRecord>(records[0].payload, 0).encoding,
+              FrameEncoding::FULL);
+  }
+}
+
+TEST_F(TrajectoryRecorderTest, compresses_with_zstd) {
+  if (!has_zstd()) GTEST_SKIP() << "Built without zstd.";
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TrajectoryRecorder> recorder,
+      TrajectoryRecorder::create(
+          path_, RecorderOptions{.compression = Compression::ZSTD}));
+  StatusVal s = recorder->add_frame(make_frame(64, 64, 3));
+  ASSERT_OK(s);
+  s = recorder->close();
+  ASSERT_OK(s);
+
+  RecorderStats stats = recorder->stats();
+  EXPECT_LT(stats.stored_bytes, stats.raw_bytes);
+  ParsedFile file = parse(path_);
+  ASSERT_EQ(file.chunks.size(), 1u);
+  EXPECT_EQ(file.chunks[0].compression, Compression::ZSTD);
+  EXPECT_EQ(file.chunks[0].raw_size, stats.raw_bytes);
+}
+
+TEST(TrajectoryRecorder, parses_compressions) {
+  ASSERT_OK_AND_ASSIGN(Compression compression, parse_compression("none"));
+  EXPECT_EQ(compression, Compression::NONE);
+  ASSERT_OK_AND_ASSIGN(compression, parse_compression("zstd"));
+  EXPECT_EQ(compression, Compression::ZSTD);
+  EXPECT_THAT(parse_compression("lz4"),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST_F(TrajectoryRecorderTest, rejects_invalid_use) {
+  if (!has_zstd()) {
+    EXPECT_THAT(TrajectoryRecorder::create(
+                    path_, RecorderOptions{.compression = Compression::ZSTD}),
+                StatusIs(StatusCode::INVALID_ARGUMENT));
+  }
+  EXPECT_THAT(
+      TrajectoryRecorder::create(path_, RecorderOptions{.tile_size = 0}),
+      StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_THAT(TrajectoryRecorder::create("/nonexistent/dir/x.traj"),
+              StatusIs(StatusCode::INTERNAL));
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<TrajectoryRecorder> recorder,
+                       TrajectoryRecorder::create(path_));
+  EXPECT_THAT(recorder->add_frame(Frame{}),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+  StatusVal s = recorder->close();
+  ASSERT_OK(s);
+  s = recorder->close();
+  EXPECT_OK(s);
+  EXPECT_THAT(recorder->add_event(Event::key_press(1)),
+              StatusIs(StatusCode::ABORTED));
+}
@@ -1,10 +1,11 @@
-// Test that we can create a wayland backend running factorio, and that we
-// can randomly move the mouse across the screen via a client while viewing the
-// desktop with the SDL viewer.
+// Test that we can create two wayland backends running load_app, and that we
+// can move the mouse across both screens via clients while viewing the
+// desktops with SDL viewers.
 
 #include "desktop/client.h"
 #include "desktop/sdl_viewer.h"
 #include "desktop/weston_backend.h"
+#include "paths.h"
 #include "process/process.h"
 #include "src/time_aliases.h"
 #include "third_party/status/status_or.h"
@@ -23,10 +24,10 @@ int main(int argc, char** argv) {
   //    works around it by sleeping to prevent races at viewer start time, but
   //    it's still racing in that each viewer instance makes an unsafe call to
   //    poll the main event loop.
-  // 3. Our tested app, Factorio on Weston, unexpectedly exits fullscreen mode
-  //    if we try to start our second backend before connecting a client to
-  //    our first backend. I'm not sure where the in the stack the issue is,
-  //    but it's something to be aware of.
+  // 3. Factorio on Weston, which this test originally ran, unexpectedly exits
+  //    fullscreen mode if we try to start our second backend before
+  //    connecting a client to our first backend. I'm not sure where the in
+  //    the stack the issue is, but it's something to be aware of.
   //
   // For now, we're only going to support single instance per processes, but
   // it's good to have these issues identified and documented here.
@@ -42,7 +43,7 @@ int main(int argc, char** argv) {
   auto backend_0 =
       std::move(WestonBackend::start_server(
                     5900, kWidth, kHeight,
-                    {"/home/william/Games/factorio/bin/x64/factorio"},
+                    {get_load_app_path()},
                     std::move(out_conf_0))
                     .value_or_die());
   auto client_0_unique_ptr =
@@ -52,7 +53,7 @@ int main(int argc, char** argv) {
   auto backend_1 =
       std::move(WestonBackend::start_server(
                     5900, kWidth, kHeight,
-                    {"/home/william/Games/factorio_copy/bin/x64/factorio"},
+                    {get_load_app_path()},
                     std::move(out_conf_1))
                     .value_or_die());
   auto client_1_unique_ptr =
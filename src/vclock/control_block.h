@@ -0,0 +1,71 @@
+// The shared-memory block through which a VirtualClock (vclock/virtual_clock.h)
+// controls the time seen by processes running the time shim
+// (vclock/time_shim.cpp).
+//
+// The block describes virtual CLOCK_MONOTONIC time as a line through the
+// last update: virtual = base_virtual + (real - base_real) * speed. The
+// controller is the block's only writer, and updates it under a seqlock whose
+// sequence number doubles as a futex that the shim's sleepers wait on for the
+// clock to change.
+
+#ifndef VCLOCK_CONTROL_BLOCK_H_
+#define VCLOCK_CONTROL_BLOCK_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace vclock {
+
+// The shim reads the control block's path from this env var. Processes
+// without it keep real time.
+inline const char* const kControlFileEnvVar = "BOUNCE_VCLOCK_FILE";
+
+inline const uint32_t kMagic = 0x4b4c4356;  // "VCLK"
+inline const uint32_t kVersion = 1;
+
+struct ControlBlock {
+  uint32_t magic = kMagic;
+  uint32_t version = kVersion;
+  // Odd while the controller's updating the fields below. Incremented by two
+  // with every update.
+  std::atomic<uint32_t> seq = 0;
+  // The real and virtual CLOCK_MONOTONIC times of the last update, in ns.
+  std::atomic<int64_t> base_real_ns = 0;
+  std::atomic<int64_t> base_virtual_ns = 0;
+  // Virtual seconds per real second. 0 while paused.
+  std::atomic<double> speed = 1.0;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<int64_t>::is_always_lock_free);
+static_assert(std::atomic<double>::is_always_lock_free);
+
+struct ClockState {
+  uint32_t seq = 0;
+  int64_t base_real_ns = 0;
+  int64_t base_virtual_ns = 0;
+  double speed = 1.0;
+};
+
+// Returns a consistent snapshot of 'block'.
+inline ClockState read_state(const ControlBlock* block) {
+  while (true) {
+    ClockState s;
+    s.seq = block->seq.load(std::memory_order_acquire);
+    if (s.seq & 1) continue;
+    s.base_real_ns = block->base_real_ns.load(std::memory_order_relaxed);
+    s.base_virtual_ns = block->base_virtual_ns.load(std::memory_order_relaxed);
+    s.speed = block->speed.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (block->seq.load(std::memory_order_relaxed) == s.seq) return s;
+  }
+}
+
+// Returns the virtual CLOCK_MONOTONIC time at the real time 'real_ns'.
+inline int64_t virtual_ns(const ClockState& s, int64_t real_ns) {
+  return s.base_virtual_ns + (int64_t)((real_ns - s.base_real_ns) * s.speed);
+}
+
+}  // namespace vclock
+
+#endif  // VCLOCK_CONTROL_BLOCK_H_
@@ -0,0 +1,201 @@
+// An LD_PRELOAD library that runs its process on a VirtualClock's time (see
+// vclock/virtual_clock.h).
+//
+// Every clock but the CPU time clocks is shifted by virtual CLOCK_MONOTONIC's
+// offset from real CLOCK_MONOTONIC, so that the clocks stay consistent with
+// each other. Sleeps wait on the control block's futex until virtual time
+// reaches their deadlines, rechecking at least every kMaxWaitNs in case the
+// controller's gone. Without a control block, every call passes through.
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "vclock/control_block.h"
+
+namespace {
+using ClockGettimeFn = int (*)(clockid_t, timespec*);
+using NanosleepFn = int (*)(const timespec*, timespec*);
+using ClockNanosleepFn = int (*)(clockid_t, int, const timespec*, timespec*);
+
+const int64_t kNsPerSec = 1'000'000'000;
+const int64_t kMaxWaitNs = 100'000'000;
+
+ClockGettimeFn real_clock_gettime = nullptr;
+NanosleepFn real_nanosleep = nullptr;
+ClockNanosleepFn real_clock_nanosleep = nullptr;
+const vclock::ControlBlock* block = nullptr;
+pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+void init() {
+  real_clock_gettime = (ClockGettimeFn)dlsym(RTLD_NEXT, "clock_gettime");
+  real_nanosleep = (NanosleepFn)dlsym(RTLD_NEXT, "nanosleep");
+  real_clock_nanosleep =
+      (ClockNanosleepFn)dlsym(RTLD_NEXT, "clock_nanosleep");
+
+  const char* path = getenv(vclock::kControlFileEnvVar);
+  if (!path) return;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return;
+  void* mem = mmap(nullptr, sizeof(vclock::ControlBlock), PROT_READ,
+                   MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return;
+  auto* b = (const vclock::ControlBlock*)mem;
+  if (b->magic != vclock::kMagic || b->version != vclock::kVersion) {
+    munmap(mem, sizeof(vclock::ControlBlock));
+    return;
+  }
+  block = b;
+}
+
+// Returns the control block, or null if the process runs on real time.
+const vclock::ControlBlock* get_block() {
+  pthread_once(&init_once, init);
+  return block;
+}
+
+int64_t to_ns(const timespec& ts) {
+  return ts.tv_sec * kNsPerSec + ts.tv_nsec;
+}
+
+timespec to_timespec(int64_t ns) {
+  if (ns < 0) ns = 0;
+  return timespec{.tv_sec = ns / kNsPerSec, .tv_nsec = ns % kNsPerSec};
+}
+
+int64_t real_monotonic_ns() {
+  timespec ts;
+  real_clock_gettime(CLOCK_MONOTONIC, &ts);
+  return to_ns(ts);
+}
+
+bool is_cpu_clock(clockid_t clock) {
+  // Negative ids are per-process and per-thread CPU clocks.
+  return clock == CLOCK_PROCESS_CPUTIME_ID ||
+         clock == CLOCK_THREAD_CPUTIME_ID || clock < 0;
+}
+
+int64_t virtual_monotonic_ns() {
+  return vclock::virtual_ns(vclock::read_state(block), real_monotonic_ns());
+}
+
+// Sleeps until virtual CLOCK_MONOTONIC reaches 'deadline_ns'. Returns 0, or
+// EINTR if a signal interrupted the sleep.
+int sleep_until(int64_t deadline_ns) {
+  while (true) {
+    vclock::ClockState s = vclock::read_state(block);
+    int64_t now = vclock::virtual_ns(s, real_monotonic_ns());
+    if (now >= deadline_ns) return 0;
+    int64_t wait_ns = kMaxWaitNs;
+    if (s.speed > 0) {
+      wait_ns = std::min<int64_t>(wait_ns, (deadline_ns - now) / s.speed + 1);
+    }
+    timespec wait = to_timespec(wait_ns);
+    // Wakes early when the controller updates the clock.
+    long r = syscall(SYS_futex, &block->seq, FUTEX_WAIT, s.seq, &wait,
+                     nullptr, 0);
+    if (r == -1 && errno == EINTR) return EINTR;
+  }
+}
+}  // namespace
+
+extern "C" {
+
+int clock_gettime(clockid_t clock, timespec* tp) noexcept {
+  if (!get_block() || is_cpu_clock(clock)) {
+    return real_clock_gettime(clock, tp);
+  }
+  if (clock == CLOCK_MONOTONIC) {
+    *tp = to_timespec(virtual_monotonic_ns());
+    return 0;
+  }
+  int64_t real_mono = real_monotonic_ns();
+  int64_t offset =
+      vclock::virtual_ns(vclock::read_state(block), real_mono) - real_mono;
+  int r = real_clock_gettime(clock, tp);
+  if (r == 0) *tp = to_timespec(to_ns(*tp) + offset);
+  return r;
+}
+
+int gettimeofday(timeval* tv, void* tz) noexcept {
+  if (tz) {
+    // Nobody should use the obsolete timezone argument, so it's zeroed.
+    auto* zone = (struct timezone*)tz;
+    zone->tz_minuteswest = 0;
+    zone->tz_dsttime = 0;
+  }
+  timespec ts;
+  int r = clock_gettime(CLOCK_REALTIME, &ts);
+  if (r == 0) {
+    *tv = timeval{.tv_sec = ts.tv_sec, .tv_usec = ts.tv_nsec / 1000};
+  }
+  return r;
+}
+
+time_t time(time_t* out) noexcept {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  if (out) *out = ts.tv_sec;
+  return ts.tv_sec;
+}
+
+int timespec_get(timespec* ts, int base) noexcept {
+  if (base != TIME_UTC || clock_gettime(CLOCK_REALTIME, ts) != 0) return 0;
+  return base;
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const timespec* req,
+                    timespec* rem) {
+  if (!get_block() || is_cpu_clock(clock)) {
+    return real_clock_nanosleep(clock, flags, req, rem);
+  }
+  if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= kNsPerSec) {
+    return EINVAL;
+  }
+  int64_t now = virtual_monotonic_ns();
+  int64_t deadline = now + to_ns(*req);
+  if (flags & TIMER_ABSTIME) {
+    // Map the deadline on 'clock' to virtual CLOCK_MONOTONIC.
+    timespec clock_now;
+    clock_gettime(clock, &clock_now);
+    deadline = now + to_ns(*req) - to_ns(clock_now);
+  }
+  int r = sleep_until(deadline);
+  if (r == EINTR && rem && !(flags & TIMER_ABSTIME)) {
+    *rem = to_timespec(deadline - virtual_monotonic_ns());
+  }
+  return r;
+}
+
+int nanosleep(const timespec* req, timespec* rem) {
+  if (!get_block()) return real_nanosleep(req, rem);
+  int r = clock_nanosleep(CLOCK_MONOTONIC, 0, req, rem);
+  if (r == 0) return 0;
+  errno = r;
+  return -1;
+}
+
+int usleep(useconds_t usec) {
+  timespec req = to_timespec(usec * 1000LL);
+  return nanosleep(&req, nullptr);
+}
+
+unsigned int sleep(unsigned int seconds) {
+  timespec req = to_timespec(seconds * kNsPerSec);
+  timespec rem = {};
+  if (nanosleep(&req, &rem) == 0) return 0;
+  return rem.tv_sec + (rem.tv_nsec > 0);
+}
+
+}  // extern "C"
@@ -0,0 +1,118 @@
+#include "vclock/virtual_clock.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <new>
+
+#include "libc_error.h"
+#include "paths.h"
+#include "process/fd.h"
+
+namespace {
+int64_t real_monotonic_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+}
+}  // namespace
+
+StatusOr<std::unique_ptr<VirtualClock>> VirtualClock::create(
+    const std::string& dir, const std::string& shim_path) {
+  std::string block_dir =
+      dir.empty() ? std::format("/run/user/{}/bounce_desktop_vclock", getuid())
+                  : dir;
+  std::error_code error;
+  std::filesystem::create_directories(block_dir, error);
+  if (error) {
+    return InternalError(
+        std::format("Failed to create virtual clock dir {}: {}", block_dir,
+                    error.message()));
+  }
+
+  std::string path = block_dir + "/vclock_XXXXXX";
+  Fd fd = Fd::take(mkostemp(path.data(), O_CLOEXEC));
+  if (*fd == -1) {
+    return InternalError(std::format("Failed to create {}: {}", path,
+                                     libc_error_name(errno)));
+  }
+  void* mem = MAP_FAILED;
+  if (ftruncate(*fd, sizeof(vclock::ControlBlock)) == 0) {
+    mem = mmap(nullptr, sizeof(vclock::ControlBlock), PROT_READ | PROT_WRITE,
+               MAP_SHARED, *fd, 0);
+  }
+  if (mem == MAP_FAILED) {
+    int e = errno;
+    unlink(path.c_str());
+    return InternalError(std::format("Failed to map {}: {}", path,
+                                     libc_error_name(e)));
+  }
+  auto* block = new (mem) vclock::ControlBlock();
+  int64_t now = real_monotonic_ns();
+  block->base_real_ns = now;
+  block->base_virtual_ns = now;
+  return std::unique_ptr<VirtualClock>(new VirtualClock(
+      path, shim_path.empty() ? get_vclock_shim_path() : shim_path, block));
+}
+
+VirtualClock::~VirtualClock() {
+  munmap(block_, sizeof(vclock::ControlBlock));
+  unlink(path_.c_str());
+}
+
+void VirtualClock::set_env(EnvVars* env) const {
+  env->prepend_var("LD_PRELOAD", shim_path_ + ":");
+  env->set_var(vclock::kControlFileEnvVar, path_);
+}
+
+StatusVal VirtualClock::set_speed(double speed) {
+  if (!std::isfinite(speed) || speed < 0) {
+    return InvalidArgumentError(std::format("Invalid clock speed: {}", speed));
+  }
+  std::lock_guard l(mu_);
+  update(speed, 0);
+  return OkStatus();
+}
+
+double VirtualClock::speed() const {
+  return block_->speed.load(std::memory_order_relaxed);
+}
+
+StatusVal VirtualClock::advance(std::chrono::nanoseconds step) {
+  if (step.count() < 0) {
+    return InvalidArgumentError(
+        std::format("Can't move the clock back by {} ns.", -step.count()));
+  }
+  std::lock_guard l(mu_);
+  update(block_->speed.load(std::memory_order_relaxed), step.count());
+  return OkStatus();
+}
+
+std::chrono::nanoseconds VirtualClock::now() const {
+  vclock::ClockState s = vclock::read_state(block_);
+  return std::chrono::nanoseconds(vclock::virtual_ns(s, real_monotonic_ns()));
+}
+
+void VirtualClock::update(double speed, int64_t step_ns) {
+  int64_t now = real_monotonic_ns();
+  vclock::ClockState s = vclock::read_state(block_);
+  int64_t virtual_now = vclock::virtual_ns(s, now) + step_ns;
+
+  block_->seq.store(s.seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  block_->base_real_ns.store(now, std::memory_order_relaxed);
+  block_->base_virtual_ns.store(virtual_now, std::memory_order_relaxed);
+  block_->speed.store(speed, std::memory_order_relaxed);
+  block_->seq.store(s.seq + 2, std::memory_order_release);
+
+  syscall(SYS_futex, &block_->seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
@@ -0,0 +1,83 @@
+// A virtual clock for launched apps, so that environments whose logic runs on
+// wall time can be sped up, slowed down, paused, or stepped.
+//
+// Processes opt in through their environment (see set_env()), which preloads
+// the time shim (vclock/time_shim.cpp). The shim runs clock_gettime(),
+// gettimeofday(), time(), and the sleep functions on the clock's virtual
+// time, which the clock's owner controls through a shared-memory block (see
+// vclock/control_block.h). Children inherit the environment, so a whole app's
+// process tree shares its clock.
+//
+// Timeouts that libc handles internally, e.g. poll()'s, epoll_wait()'s, and
+// pthread_cond_timedwait()'s, and statically linked apps keep real time.
+
+#ifndef VCLOCK_VIRTUAL_CLOCK_H_
+#define VCLOCK_VIRTUAL_CLOCK_H_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "process/env_vars.h"
+#include "third_party/status/status_or.h"
+#include "vclock/control_block.h"
+
+class VirtualClock {
+ public:
+  // Creates a clock that starts at the current real time and speed, with its
+  // control block in a new file in 'dir', which defaults to
+  // /run/user/UID/bounce_desktop_vclock. 'shim_path' defaults to the
+  // package's time shim.
+  //
+  // Returns INTERNAL if the control block can't be created.
+  static StatusOr<std::unique_ptr<VirtualClock>> create(
+      const std::string& dir = "", const std::string& shim_path = "");
+
+  // Removes the control block. Processes that are still running on the clock
+  // keep its last state.
+  ~VirtualClock();
+
+  VirtualClock(const VirtualClock&) = delete;
+  VirtualClock& operator=(const VirtualClock&) = delete;
+
+  // Sets up 'env' so that the processes launched with it run on this clock.
+  void set_env(EnvVars* env) const;
+
+  // Runs virtual time at 'speed' virtual seconds per real second from now on.
+  // A speed of 0 pauses the clock.
+  //
+  // Returns INVALID_ARGUMENT if 'speed' is negative or not finite.
+  StatusVal set_speed(double speed);
+  double speed() const;
+
+  // Moves virtual time forward by 'step' at once, waking any sleeps that end
+  // by then. Stepping a paused clock runs the app in fixed time steps.
+  //
+  // Returns INVALID_ARGUMENT if 'step' is negative.
+  StatusVal advance(std::chrono::nanoseconds step);
+
+  // Returns the clock's virtual CLOCK_MONOTONIC time.
+  std::chrono::nanoseconds now() const;
+
+  const std::string& path() const { return path_; }
+
+ private:
+  VirtualClock(std::string path, std::string shim_path,
+               vclock::ControlBlock* block)
+      : path_(std::move(path)),
+        shim_path_(std::move(shim_path)),
+        block_(block) {}
+
+  // Rebases the clock on the current time, adding 'step_ns' to virtual time,
+  // and wakes the shim's sleepers. Must be called with 'mu_' held.
+  void update(double speed, int64_t step_ns);
+
+  std::string path_;
+  std::string shim_path_;
+  vclock::ControlBlock* block_;
+  // Serializes updates.
+  mutable std::mutex mu_;
+};
+
+#endif  // VCLOCK_VIRTUAL_CLOCK_H_
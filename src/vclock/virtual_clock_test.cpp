@@ -0,0 +1,136 @@
+#include "vclock/virtual_clock.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <filesystem>
+#include <format>
+
+#include "process/process.h"
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+// Runs 'command' on 'clock' and returns its stdout.
+std::string run_on_clock(const VirtualClock& clock,
+                         const std::vector<std::string>& command) {
+  EnvVars env = EnvVars::environ();
+  clock.set_env(&env);
+  Process p = launch_process(command, &env,
+                             ProcessOutConf{.stdout = StreamOutConf::Pipe()})
+                  .value_or_die();
+  std::string out;
+  char buf[256];
+  ssize_t r;
+  while ((r = read(p.stdout.fd(), buf, sizeof(buf))) > 0) out.append(buf, r);
+  p.wait_for(5s);
+  return out;
+}
+
+double real_time_s() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+}  // namespace
+
+class VirtualClockTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::format("/tmp/bounce_vclock_test_{}", getpid());
+    clock_ = VirtualClock::create(dir_).value_or_die();
+  }
+
+  void TearDown() override {
+    clock_.reset();
+    std::filesystem::remove_all(dir_);
+  }
+
+  std::string dir_;
+  std::unique_ptr<VirtualClock> clock_;
+};
+
+TEST(VirtualClockMath, virtual_time_follows_the_last_update) {
+  vclock::ClockState s{.base_real_ns = 100, .base_virtual_ns = 1000,
+                       .speed = 2.0};
+  EXPECT_EQ(vclock::virtual_ns(s, 100), 1000);
+  EXPECT_EQ(vclock::virtual_ns(s, 150), 1100);
+  s.speed = 0;
+  EXPECT_EQ(vclock::virtual_ns(s, 150), 1000);
+}
+
+TEST_F(VirtualClockTest, paused_clock_only_moves_when_advanced) {
+  ASSERT_OK(clock_->set_speed(0));
+  auto start = clock_->now();
+  sleep_for(20ms);
+  EXPECT_EQ(clock_->now(), start);
+  StatusVal s = clock_->advance(1s);
+  EXPECT_OK(s);
+  EXPECT_EQ(clock_->now(), start + 1s);
+}
+
+TEST_F(VirtualClockTest, rejects_invalid_controls) {
+  EXPECT_THAT(clock_->set_speed(-1), StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_THAT(clock_->set_speed(NAN), StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_THAT(clock_->advance(-1ns), StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_EQ(clock_->speed(), 1.0);
+}
+
+TEST_F(VirtualClockTest, apps_read_virtual_time) {
+  ASSERT_OK(clock_->set_speed(0));
+  StatusVal s = clock_->advance(1000s);
+  ASSERT_OK(s);
+  std::string out =
+      run_on_clock(*clock_, {"python3", "-c",
+                             "import time; print(time.time(), "
+                             "time.monotonic_ns())"});
+  double app_time = 0;
+  long long app_monotonic = 0;
+  ASSERT_EQ(sscanf(out.c_str(), "%lf %lld", &app_time, &app_monotonic), 2)
+      << out;
+  EXPECT_NEAR(app_time - real_time_s(), 1000, 5);
+  // The clock's paused, so the app sees exactly the clock's time.
+  EXPECT_EQ(app_monotonic, clock_->now().count());
+}
+
+TEST_F(VirtualClockTest, sleeps_run_at_clock_speed) {
+  ASSERT_OK(clock_->set_speed(20));
+  auto start = sc_now();
+  run_on_clock(*clock_, {"sleep", "4"});
+  run_on_clock(*clock_, {"python3", "-c", "import time; time.sleep(4)"});
+  EXPECT_LT(sc_now() - start, 2s);
+}
+
+TEST_F(VirtualClockTest, rejects_invalid_sleeps) {
+  ASSERT_OK(clock_->set_speed(0));
+  // Prints clock_nanosleep's result for a negative and an out of range
+  // request. Neither may sleep on the paused clock.
+  std::string out = run_on_clock(
+      *clock_,
+      {"python3", "-c",
+       "import ctypes\n"
+       "class T(ctypes.Structure):\n"
+       "  _fields_ = [('s', ctypes.c_long), ('ns', ctypes.c_long)]\n"
+       "libc = ctypes.CDLL(None)\n"
+       "print(libc.clock_nanosleep(1, 0, ctypes.byref(T(-1, 0)), None),\n"
+       "      libc.clock_nanosleep(1, 0, ctypes.byref(T(0, 10**9)), None))"});
+  EXPECT_EQ(out, std::format("{} {}\n", EINVAL, EINVAL));
+}
+
+TEST_F(VirtualClockTest, paused_sleeps_wait_for_steps) {
+  ASSERT_OK(clock_->set_speed(0));
+  EnvVars env = EnvVars::environ();
+  clock_->set_env(&env);
+  ASSERT_OK_AND_ASSIGN(Process p, launch_process({"sleep", "1"}, &env));
+  EXPECT_THAT(p.wait_for(300ms), StatusIs(StatusCode::DEADLINE_EXCEEDED));
+  StatusVal s = clock_->advance(500ms);
+  ASSERT_OK(s);
+  EXPECT_THAT(p.wait_for(300ms), StatusIs(StatusCode::DEADLINE_EXCEEDED));
+  s = clock_->advance(500ms);
+  ASSERT_OK(s);
+  ASSERT_OK_AND_ASSIGN(int status, p.wait_for(1s));
+  EXPECT_EQ(status, 0);
+}
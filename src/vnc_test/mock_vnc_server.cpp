@@ -56,6 +56,11 @@ void MockVncServer::handle_ptr(int button_mask, int x, int y) {
   add_event(Event::mouse_event(x, y, button_mask));
 }
 
+void MockVncServer::add_client(Fd&& fd) {
+  std::lock_guard l(pending_clients_mu_);
+  pending_clients_.push_back(std::move(fd));
+}
+
 std::vector<Event> MockVncServer::get_events() {
   std::vector<Event> events_cpy;
   {
@@ -70,6 +75,13 @@ void MockVncServer::add_event(Event&& event) {
   events_.push_back(std::move(event));
 }
 
+void MockVncServer::fill(int x, int y, int width, int height,
+                         uint32_t pixel) {
+  std::lock_guard l(fills_mu_);
+  fills_.push_back(Fill{
+      .x = x, .y = y, .width = width, .height = height, .pixel = pixel});
+}
+
 StatusVal MockVncServer::wait_for_connection() {
   auto start = std::chrono::steady_clock::now();
   auto timeout = std::chrono::seconds(1);
@@ -110,6 +122,27 @@ void MockVncServer::vnc_loop() {
   rfbInitServer(s);
 
   while (!stop_vnc_) {
-    rfbProcessEvents(s, 999'999);
+    {
+      std::lock_guard l(pending_clients_mu_);
+      for (Fd& fd : pending_clients_) {
+        // libvncserver closes the client's socket when the client's freed.
+        rfbNewClient(s, fd.release());
+      }
+      pending_clients_.clear();
+    }
+    {
+      std::lock_guard l(fills_mu_);
+      for (const Fill& f : fills_) {
+        uint32_t* pixels = (uint32_t*)s->frameBuffer;
+        for (int y = f.y; y < f.y + f.height; ++y) {
+          for (int x = f.x; x < f.x + f.width; ++x) {
+            pixels[y * width + x] = f.pixel;
+          }
+        }
+        rfbMarkRectAsModified(s, f.x, f.y, f.x + f.width, f.y + f.height);
+      }
+      fills_.clear();
+    }
+    rfbProcessEvents(s, 10'000);
   }
 }
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "desktop/event.h"
+#include "process/fd.h"
 #include "third_party/status/status_or.h"
 
 class MockVncServer {
@@ -16,6 +17,10 @@ class MockVncServer {
   static StatusOr<std::unique_ptr<MockVncServer>> start_server(int port);
   ~MockVncServer();
 
+  // Serves a client over an already connected socket, e.g. one end of a
+  // socketpair.
+  void add_client(Fd&& fd);
+
   // Returns a DEADLINE_EXCEEDED error if the server doesn't receive a
   // connection in a second.
   StatusVal wait_for_connection();
@@ -24,6 +29,10 @@ class MockVncServer {
   // them.
   std::vector<Event> get_events();
 
+  // Fills a rectangle of the server's framebuffer with 'pixel' and marks it as
+  // modified, which answers clients' incremental update requests.
+  void fill(int x, int y, int width, int height, uint32_t pixel);
+
  private:
   MockVncServer(int port);
   void vnc_loop();
@@ -44,6 +53,21 @@ class MockVncServer {
   std::thread vnc_loop_;
   rfbScreenInfo* screen_ = nullptr;
 
+  // Sockets passed to add_client() that the vnc loop hasn't picked up yet.
+  std::mutex pending_clients_mu_;
+  std::vector<Fd> pending_clients_;
+
+  struct Fill {
+    int x;
+    int y;
+    int width;
+    int height;
+    uint32_t pixel;
+  };
+  // Fills that the vnc loop hasn't drawn yet.
+  std::mutex fills_mu_;
+  std::vector<Fill> fills_;
+
   std::mutex events_mu_;
   std::vector<Event> events_;
 };
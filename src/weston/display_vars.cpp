@@ -1,73 +1,41 @@
 #include "weston/display_vars.h"
 
-#include <unistd.h>
-
 #include <cstdlib>
-#include <filesystem>
-#include <format>
-#include <fstream>
 
 namespace {
 const char* kXDisplay = "DISPLAY";
 const char* kWaylandDisplay = "WAYLAND_DISPLAY";
 const char* kDefaultXDisplay = "";
 const char* kDefaultWaylandDisplay = "";
-
-std::string get_instance_dir(const std::string& instance_name) {
-  uid_t uid = getuid();
-  return std::format("/run/user/{}/instance_{}", uid, instance_name);
-}
 }  // namespace
 
-void write_vars(const std::string& instance_name) {
-  const std::string instance_dir = get_instance_dir(instance_name);
+DisplayVars get_display_vars() {
   const char* x_display_var = getenv(kXDisplay);
   const char* wayland_display_var = getenv(kWaylandDisplay);
-  const char* x_display = x_display_var ? x_display_var : kDefaultXDisplay;
-  const char* wayland_display =
-      wayland_display_var ? wayland_display_var : kDefaultWaylandDisplay;
-
-  std::filesystem::create_directories(instance_dir);
-
-  const std::filesystem::path x_path =
-      std::filesystem::path(instance_dir) / "x_display";
-  const std::filesystem::path w_path =
-      std::filesystem::path(instance_dir) / "wayland_display";
-
-  std::ofstream write_x(x_path);
-  write_x << x_display;
-  std::ofstream write_wayland(w_path);
-  write_wayland << wayland_display;
+  return DisplayVars{
+      .x_display = x_display_var ? x_display_var : kDefaultXDisplay,
+      .wayland_display =
+          wayland_display_var ? wayland_display_var : kDefaultWaylandDisplay,
+  };
 }
 
-bool read_vars(const std::string& instance_name, DisplayVars* display_vars) {
-  const std::filesystem::path instance_dir = get_instance_dir(instance_name);
-  const std::filesystem::path x_path = instance_dir / "x_display";
-  const std::filesystem::path w_path = instance_dir / "wayland_display";
-
-  if (!std::filesystem::exists(x_path) || !std::filesystem::exists(w_path)) {
-    return false;
-  }
-
-  std::ifstream x_infile(x_path);
-  std::ifstream w_infile(w_path);
-  if (!x_infile.is_open() || !w_infile.is_open()) {
-    return false;
-  }
-
-  std::string x_val;
-  std::string w_val;
-  std::getline(x_infile, x_val);
-  std::getline(w_infile, w_val);
-
-  if (display_vars) {
-    display_vars->x_display = std::move(x_val);
-    display_vars->wayland_display = std::move(w_val);
-  }
-  return true;
+std::map<std::string, std::string> display_vars_to_fields(
+    const DisplayVars& vars) {
+  return {
+      {kXDisplay, vars.x_display},
+      {kWaylandDisplay, vars.wayland_display},
+  };
 }
 
-void clean_up_vars(const std::string& instance_name) {
-  std::error_code error_code;
-  std::filesystem::remove_all(get_instance_dir(instance_name), error_code);
+StatusOr<DisplayVars> display_vars_from_fields(
+    const std::map<std::string, std::string>& fields) {
+  auto x_display = fields.find(kXDisplay);
+  auto wayland_display = fields.find(kWaylandDisplay);
+  if (x_display == fields.end() || wayland_display == fields.end()) {
+    return NotFoundError("Display vars are missing from the ready fields.");
+  }
+  return DisplayVars{
+      .x_display = x_display->second,
+      .wayland_display = wayland_display->second,
+  };
 }
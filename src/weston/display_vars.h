@@ -1,25 +1,26 @@
 #ifndef DISPLAY_VARS_H
 #define DISPLAY_VARS_H
 
+#include <map>
 #include <string>
 
+#include "third_party/status/status_or.h"
+
 struct DisplayVars {
   std::string x_display;
   std::string wayland_display;
 };
 
-// Writes the values of environment variables X_DISPLAY and WAYLAND_DISPLAY
-// to /run/user/UID/instance_{instance_name}/x_display
-// and /run/user/UID/instance_{instance_name}/wayland_display
-void write_vars(const std::string& instance_name);
-
-// Read the display vars from /run/user/UID/instance_{instance_name}/...
-// and return them in 'display_vars' if it's not null. Returns false
-// and makes no changes to DisiplayVars if any of the expected display
-// var files are missing.
-bool read_vars(const std::string& instance_name, DisplayVars* display_vars);
+// Returns the values of this process's DISPLAY and WAYLAND_DISPLAY env vars,
+// using empty strings for unset vars.
+DisplayVars get_display_vars();
 
-// Deletes the display vars stored on disk for the given instance_name.
-void clean_up_vars(const std::string& instance_name);
+// Converts display vars to and from the KEY=VALUE fields sent over the ready
+// pipe (see weston/ready_pipe.h), keyed by their env var names.
+std::map<std::string, std::string> display_vars_to_fields(
+    const DisplayVars& vars);
+// Returns NOT_FOUND if either var is missing from 'fields'.
+StatusOr<DisplayVars> display_vars_from_fields(
+    const std::map<std::string, std::string>& fields);
 
 #endif
@@ -2,25 +2,27 @@
 
 #include <gtest/gtest.h>
 
-TEST(DisplayVars, read_write_vars_round_trip) {
+#include "third_party/status/status_gtest.h"
+
+TEST(DisplayVars, fields_round_trip) {
   setenv("DISPLAY", ":5", true);
   setenv("WAYLAND_DISPLAY", "wayland-2", true);
-  const std::string instance_name = "test_instance";
-  write_vars(instance_name);
-  DisplayVars vars;
-  bool read = read_vars(instance_name, &vars);
-  EXPECT_TRUE(read);
+  ASSERT_OK_AND_ASSIGN(
+      DisplayVars vars,
+      display_vars_from_fields(display_vars_to_fields(get_display_vars())));
   EXPECT_EQ(vars.x_display, ":5");
   EXPECT_EQ(vars.wayland_display, "wayland-2");
-  clean_up_vars(instance_name);
 }
 
-TEST(DisplayVars, clean_up_deletes_vars) {
-  setenv("DISPLAY", ":5", true);
-  setenv("WAYLAND_DISPLAY", "wayland-2", true);
-  const std::string instance_name = "delete_test_instance";
-  write_vars(instance_name);
-  DisplayVars vars;
-  clean_up_vars(instance_name);
-  EXPECT_FALSE(read_vars(instance_name, &vars));
+TEST(DisplayVars, unset_vars_are_empty) {
+  unsetenv("DISPLAY");
+  unsetenv("WAYLAND_DISPLAY");
+  DisplayVars vars = get_display_vars();
+  EXPECT_EQ(vars.x_display, "");
+  EXPECT_EQ(vars.wayland_display, "");
+}
+
+TEST(DisplayVars, missing_fields_are_not_found) {
+  EXPECT_THAT(display_vars_from_fields({{"DISPLAY", ":5"}}),
+              StatusIs(StatusCode::NOT_FOUND));
 }
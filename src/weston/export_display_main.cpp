@@ -1,4 +1,5 @@
-// Calls write_vars(argv[1]) and then runs until its parent exits.
+// Signals readiness over the ready pipe, sending our DISPLAY and
+// WAYLAND_DISPLAY with the signal, and then runs until its parent exits.
 //
 // This program enables us to launch processes under weston instances without
 // having to pass those programs as weston's launch command, which gives us
@@ -15,24 +16,34 @@
 
 #include <chrono>
 #include <cstdlib>
-#include <filesystem>
 #include <iostream>
 #include <thread>
 
-#include "weston/display_vars.h"
 #include "third_party/status/status_or.h"
+#include "weston/display_vars.h"
+#include "weston/ready_pipe.h"
 
 int main(int argc, char* argv[]) {
   printf("Starting .\n");
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <instance_name>" << std::endl;
+  if (argc != 1) {
+    std::cerr << "Usage: " << argv[0] << std::endl;
     return 1;
   }
 
   CHECK(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
 
-  std::string instance_name = argv[1];
-  write_vars(instance_name);
+  // Weston launches us once its VNC server's listening and its display env
+  // vars are set, so we're ready as soon as we start.
+  DisplayVars vars = get_display_vars();
+  StatusVal s = notify_ready(display_vars_to_fields(vars));
+  if (s.code() == StatusCode::NOT_FOUND) {
+    // We weren't launched by launch_weston(), so print the vars for whoever
+    // is running us.
+    printf("DISPLAY=%s\nWAYLAND_DISPLAY=%s\n", vars.x_display.c_str(),
+           vars.wayland_display.c_str());
+  } else if (!s.ok()) {
+    std::cerr << "Failed to signal readiness: " << s.to_string() << std::endl;
+  }
 
   while (true) {
     std::this_thread::sleep_for(std::chrono::seconds(100));
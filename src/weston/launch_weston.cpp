@@ -1,15 +1,20 @@
 #include "weston/launch_weston.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 
-#include <fstream>
-#include <sstream>
-#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
 
+#include "libc_error.h"
 #include "paths.h"
 #include "process/process.h"
 #include "time_aliases.h"
+#include "weston/ready_pipe.h"
+#include "weston/xwayland.h"
 
 namespace {
 void set_fd_nonblocking(int fd) {
@@ -20,6 +25,8 @@ void set_fd_nonblocking(int fd) {
   CHECK(fcntl(fd, F_SETFL, flags) != -1);
 }
 
+// Appends whatever's available to read on 'fd' to 'out'. Returns false on
+// read errors and EOF.
 bool read_fd(int fd, std::string* out) {
   char buf[1024];
   int r = read(fd, buf, 1023);
@@ -30,50 +37,58 @@ bool read_fd(int fd, std::string* out) {
     perror("run weston read");
     return false;
   }
+  if (r == 0) {
+    return false;
+  }
   buf[r] = '\0';
   *out += std::string(buf);
   return true;
 }
 
-bool has_child(int pid) {
-  const std::string path = std::format("/proc/{}/task/{}/children", pid, pid);
-  std::ifstream file(path);
-  if (!file) {
-    return false;
-  }
+const std::string kCompositorFailed =
+    "fatal: failed to create compositor backend";
+const std::string kWaylandPipeFailed =
+    "Failed to process Wayland connection: Broken pipe";
+const std::string kDisplayPipeFailed = "failed to create display: Broken pipe";
+const std::string kSharedLibraryFailure1 =
+    "error while loading shared libraries";
+const std::string kSharedLibraryFailure2 = "cannot open shared object file";
+const std::string kUnhandledOption = "fatal: unhandled option: ";
+// The length of the longest of the above messages.
+const size_t kMaxErrorLen = kWaylandPipeFailed.size();
 
-  std::stringstream r;
-  r << file.rdbuf();
-  return !r.str().empty();
-}
+// Searches 'out' for known Weston error messages. Only searches text that could
+// overlap out[new_start:], so that we can search Weston's output incrementally
+// as we read it.
+StatusVal search_for_error(const std::string& out, size_t new_start = 0) {
+  size_t start = new_start > kMaxErrorLen ? new_start - kMaxErrorLen : 0;
+  auto found = [&](const std::string& msg) {
+    return out.find(msg, start) != std::string::npos;
+  };
 
-StatusVal search_for_error(const std::string& out) {
-  const std::string kCompositorFailed =
-      "fatal: failed to create compositor backend";
-  const std::string kWaylandPipeFailed =
-      "Failed to process Wayland connection: Broken pipe";
-  const std::string kDisplayPipeFailed =
-      "failed to create display: Broken pipe";
-  const std::string kSharedLibraryFailure1 =
-      "error while loading shared libraries";
-  const std::string kSharedLibraryFailure2 = "cannot open shared object file";
-
-  if (out.find(kCompositorFailed) != std::string::npos) {
+  if (found(kCompositorFailed)) {
     printf("Port unavailable message: %s\n", out.c_str());
     return UnavailableError("Port already in use.");
   }
-  if (out.find(kWaylandPipeFailed) != std::string::npos) {
+  if (found(kWaylandPipeFailed)) {
     return UnknownError(std::format(
         "Weston launch failed to process the wayland connection because "
         "of a broken pipe.\nWeston log: {}",
         out));
   }
-  if (out.find(kDisplayPipeFailed) != std::string::npos) {
+  if (found(kDisplayPipeFailed)) {
     return UnknownError(
         "Weston launch failed to create display because of a broken pipe.");
   }
-  if ((out.find(kSharedLibraryFailure1) != std::string::npos) ||
-      (out.find(kSharedLibraryFailure2) != std::string::npos)) {
+  if (found(kUnhandledOption)) {
+    size_t pos = out.find(kUnhandledOption, start) + kUnhandledOption.size();
+    size_t end = out.find('\n', pos);
+    if (end == std::string::npos) end = out.size();
+    return InvalidArgumentError(
+        std::format("This Weston doesn't support the flag \"{}\".",
+                    out.substr(pos, end - pos)));
+  }
+  if (found(kSharedLibraryFailure1) || found(kSharedLibraryFailure2)) {
     printf("Shared library stdout: %s\n", out.c_str());
     return UnknownError("Couldn't find weston shared libraries.");
   }
@@ -81,61 +96,183 @@ StatusVal search_for_error(const std::string& out) {
 }
 }  // namespace
 
+StatusOr<Renderer> parse_renderer(const std::string& name) {
+  if (name == "auto") return Renderer::AUTO;
+  if (name == "gl") return Renderer::GL;
+  if (name == "pixman") return Renderer::PIXMAN;
+  return InvalidArgumentError(std::format(
+      "Unknown renderer \"{}\". Expected auto, gl, or pixman.", name));
+}
+
+const char* renderer_name(Renderer renderer) {
+  switch (renderer) {
+    case Renderer::AUTO:
+      return "auto";
+    case Renderer::GL:
+      return "gl";
+    case Renderer::PIXMAN:
+      return "pixman";
+  }
+  return "unknown";
+}
+
+bool has_render_node(const std::string& dri_dir) {
+  std::error_code error;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(dri_dir, error)) {
+    if (entry.path().filename().string().starts_with("renderD")) return true;
+  }
+  return false;
+}
+
+Renderer resolve_renderer(Renderer renderer, const std::string& dri_dir) {
+  if (renderer != Renderer::AUTO) return renderer;
+  return has_render_node(dri_dir) ? Renderer::GL : Renderer::PIXMAN;
+}
+
 StatusOr<Process> launch_weston(int port,
                                 const std::vector<std::string>& command,
-                                int width, int height) {
+                                int width, int height,
+                                DisplayVars* display_vars,
+                                const Spawner& spawn,
+                                const LaunchWestonOpts& opts,
+                                StartupProfile* profile) {
+  auto start = sc_now();
+  for (const std::string& flag : opts.extra_flags) {
+    if (!flag.starts_with("--") || flag == "--") {
+      return InvalidArgumentError(std::format(
+          "Extra Weston flags must be \"--\" flags, but got \"{}\".", flag));
+    }
+  }
+  Renderer renderer = resolve_renderer(opts.renderer);
+  LOG(kLogVnc, "Launching weston with the %s renderer%s.",
+      renderer_name(renderer), opts.xwayland ? "" : " and without Xwayland");
+
   std::vector<std::string> weston_command = {
       get_weston_bin(),
-      "--xwayland",
       "--backend=vnc",
       "--disable-transport-layer-security",
-      "--renderer=gl",
+      std::format("--renderer={}", renderer_name(renderer)),
       std::format("--width={}", width),
       std::format("--height={}", height),
-      std::format("--port={}", port),
-      "--"};
+      std::format("--port={}", port)};
+  if (opts.xwayland) weston_command.push_back("--xwayland");
+  if (!opts.config_file.empty()) {
+    weston_command.push_back("--config=" + opts.config_file);
+  }
+  weston_command.insert(weston_command.end(), opts.extra_flags.begin(),
+                        opts.extra_flags.end());
+  weston_command.push_back("--");
   weston_command.insert(weston_command.end(), command.begin(), command.end());
 
+  int ready_pipe[2];
+  if (pipe2(ready_pipe, O_CLOEXEC) == -1) {
+    return InternalError("Failed to create ready pipe: " +
+                         libc_error_name(errno));
+  }
+  Fd ready_read = Fd::take(ready_pipe[0]);
+  std::vector<InheritFd> inherit_fds;
+  inherit_fds.push_back(
+      InheritFd{.child_fd = kReadyChildFd, .fd = Fd::take(ready_pipe[1])});
+
+  EnvVars env = EnvVars::environ();
+  env.set_var(kReadyFdEnvVar, std::to_string(kReadyChildFd));
+  // Weston only sets DISPLAY when it starts Xwayland, so don't let the
+  // command inherit ours otherwise.
+  if (!opts.xwayland) env.unset_var("DISPLAY");
+  // Read by xwayland_wrapper, if the session's weston.ini runs it.
+  std::string xwayland_flags;
+  for (const std::string& arg : xwayland_args(renderer == Renderer::PIXMAN)) {
+    xwayland_flags += (xwayland_flags.empty() ? "" : " ") + arg;
+  }
+  env.set_var(kXwaylandArgsEnvVar, xwayland_flags);
   auto stream_conf = ProcessOutConf{
       .stdout = StreamOutConf::Pipe(),
       .stderr = StreamOutConf::StdoutPipe(),
+      .inherit_fds = std::move(inherit_fds),
   };
-  ASSIGN_OR_RETURN(Process p, launch_process(weston_command, nullptr,
-                                             std::move(stream_conf)));
+  StatusOr<Process> p_or =
+      spawn ? spawn(weston_command, &env, std::move(stream_conf))
+            : launch_process(weston_command, &env, std::move(stream_conf));
+  ASSIGN_OR_RETURN(Process p, std::move(p_or));
+  StartupProfile phases;
+  auto spawned = phases.add("spawn_weston", start);
   LOG(kLogVnc, "Launched weston as process: %d", p.pid);
-  auto start = sc_now();
-  std::string output;
   set_fd_nonblocking(p.stdout.fd());
-  int hits = 0;
-  int iter = 0;
-  while (sc_now() - start < 5s) {
-    read_fd(p.stdout.fd(), &output);
-    RETURN_IF_ERROR(search_for_error(output));
-    if (has_child(p.pid)) {
-      hits++;
-      if (hits > 20) {
+  set_fd_nonblocking(*ready_read);
+
+  // Wait for the launch command to signal readiness, or for Weston to report
+  // an error or exit. Weston's exit is also caught through its pidfd, since
+  // its stdout can outlive it when a spawner runs it under another process.
+  enum { kStdoutIdx = 0, kReadyIdx = 1, kExitIdx = 2 };
+  pollfd poll_fds[3] = {
+      pollfd{.fd = p.stdout.fd(), .events = POLLIN, .revents = 0},
+      pollfd{.fd = *ready_read, .events = POLLIN, .revents = 0},
+      pollfd{.fd = *p.pidfd, .events = POLLIN, .revents = 0},
+  };
+  std::string output;
+  ReadyParser ready;
+  const auto deadline = sc_now() + 5s;
+  while (sc_now() < deadline) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - sc_now());
+    int r = poll(poll_fds, 3, std::max<int>(remaining.count(), 0));
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) {
+      return InternalError("launch_weston poll failed: " +
+                           libc_error_name(errno));
+    }
+
+    if (poll_fds[kStdoutIdx].revents) {
+      size_t new_start = output.size();
+      bool open = read_fd(p.stdout.fd(), &output);
+      RETURN_IF_ERROR(search_for_error(output, new_start));
+      if (!open) {
+        return UnknownError(
+            "Weston exited before its command signaled readiness.\n\n"
+            "Weston output:\n" +
+            output);
+      }
+    }
+
+    if (poll_fds[kReadyIdx].revents) {
+      std::string data;
+      bool open = read_fd(*ready_read, &data);
+      if (ready.consume(data)) {
         printf("Weston output: %s\n", output.c_str());
+        if (display_vars) {
+          ASSIGN_OR_RETURN(*display_vars,
+                           display_vars_from_fields(ready.fields()));
+        }
+        phases.add("weston_ready", spawned);
+        LOG(kLogVnc, "Weston was ready %.3f s after launch.",
+            phases.total_s());
+        if (profile) profile->append(phases);
         return p;
       }
+      // Stop polling the ready pipe once all of its writers have closed it.
+      if (!open) poll_fds[kReadyIdx].fd = -1;
     }
 
-    iter++;
-    if (iter % 5 == 0) {
-      printf("Waiting for weston launch into a known state.\n");
-      std::chrono::duration<double> duration =
-          std::chrono::duration_cast<std::chrono::duration<double>>(sc_now() -
-                                                                    start);
-      printf("Waited for %f\n", duration.count());
+    if (poll_fds[kExitIdx].revents) {
+      // Collect any output Weston wrote before it exited.
+      size_t new_start = output.size();
+      size_t size;
+      do {
+        size = output.size();
+      } while (read_fd(p.stdout.fd(), &output) && output.size() > size);
+      RETURN_IF_ERROR(search_for_error(output, new_start));
+      return UnknownError(
+          "Weston exited before its command signaled readiness.\n\n"
+          "Weston output:\n" +
+          output);
     }
-    sleep_for(50ms);
   }
   return UnknownError(
-      "run_weston() never found weston's child. Maybe the command exited "
-      "without weston reporting a failure, weston is hanging, or the "
-      "executed command ran as a daemon. run_weston() verifies that weston "
-      "successfully launched a child in a poll loop and so to correctly handle "
-      "quickly exiting daemons, consider running them under a child "
-      "subreaper.\n\n"
+      "launch_weston() never received a ready signal from weston's command. "
+      "Maybe the command exited without weston reporting a failure, weston is "
+      "hanging, or the command doesn't write to the ready pipe (see "
+      "weston/ready_pipe.h).\n\n"
       "Weston output:\n" +
       output);
 }
@@ -1,6 +1,7 @@
 #ifndef WESTON_LAUNCH_WESTON_H_
 #define WESTON_LAUNCH_WESTON_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -8,21 +9,89 @@
 #include "process/process.h"
 #include "process/env_vars.h"
 #include "third_party/status/status_or.h"
+#include "weston/display_vars.h"
+#include "weston/startup_profile.h"
+
+// Spawns a process like launch_process() does. Lets launch_weston()'s callers
+// change how Weston's spawned, e.g. to run it under a reaper.
+using Spawner = std::function<StatusOr<Process>(
+    const std::vector<std::string>& args, EnvVars* env,
+    ProcessOutConf&& process_out)>;
+
+// Which of Weston's renderers composites the session.
+enum class Renderer {
+  // GL if the machine has a DRM render node, and pixman otherwise. Without a
+  // GPU, GL renders through llvmpipe and then reads every frame back for the
+  // VNC backend, which costs more CPU than pixman's direct rendering.
+  AUTO,
+  GL,
+  PIXMAN,
+};
+
+// Parses "auto", "gl", or "pixman".
+//
+// Returns INVALID_ARGUMENT for any other name.
+StatusOr<Renderer> parse_renderer(const std::string& name);
+const char* renderer_name(Renderer renderer);
+
+// Returns whether 'dri_dir' has a DRM render node, i.e. a renderD* device.
+bool has_render_node(const std::string& dri_dir = "/dev/dri");
+
+// Resolves AUTO to GL or PIXMAN, and returns other renderers unchanged.
+Renderer resolve_renderer(Renderer renderer,
+                          const std::string& dri_dir = "/dev/dri");
+
+struct LaunchWestonOpts {
+  Renderer renderer = Renderer::AUTO;
+  // If set, Weston reads its settings from this weston.ini, e.g. a
+  // WestonIniFile's (see weston/weston_config.h), instead of searching the
+  // user's config dirs.
+  std::string config_file = "";
+  // Start Xwayland, so that X11 apps can run in the session. Without it, the
+  // session only serves Wayland clients, but starts faster and uses less
+  // memory, and its DISPLAY is empty.
+  bool xwayland = true;
+  // Extra compositor flags, e.g. "--idle-time=0", passed to Weston after the
+  // flags launch_weston() sets.
+  std::vector<std::string> extra_flags = {};
+};
 
 // Try running a Weston VNC backend display that runs the given
 // command and uses the given port. We parse Weson's stdout to
 // try to determine what state Weston ends up in and return any
 // errors as statuses.
 //
+// The command must signal that it's running by writing to the ready pipe (see
+// weston/ready_pipe.h), which export_display does. launch_weston() returns as
+// soon as the command signals readiness. If 'display_vars' isn't null, it's
+// filled in with the display vars the command sent with its ready signal.
+//
 // Note: Weston doesn't reap the child command on exit, and weston's vnc backend
 // leaks the port to the child command, so if you want to get the port back when
 // exiting weston, run a command that exits when its parent does.
 //
 // Returns:
 //  - UNAVAILABLE_ERROR if the chosen port is taken.
-//  - UNKNOWN_ERROR if weston fails with any non-port related error.
+//  - UNKNOWN_ERROR if weston fails with any non-port related error, or if the
+//    command doesn't signal readiness within 5 seconds.
+//  - NOT_FOUND if 'display_vars' is given and the command doesn't send them.
+//
+// If 'spawn' is set, it's used to spawn Weston instead of launch_process().
+// The returned process's stdout must carry Weston's output.
+//
+// 'opts' picks Weston's renderer and adds compositor flags. Returns
+// INVALID_ARGUMENT if an extra flag isn't a "--" flag, or if Weston doesn't
+// support one of its flags.
+//
+// If 'profile' isn't null, a successful launch appends its "spawn_weston" and
+// "weston_ready" phases to it.
 StatusOr<Process> launch_weston(int port,
                                 const std::vector<std::string>& command,
-                                int width = 800, int height = 600);
+                                int width = 800, int height = 600,
+                                DisplayVars* display_vars = nullptr,
+                                const Spawner& spawn = nullptr,
+                                const LaunchWestonOpts& opts =
+                                    LaunchWestonOpts(),
+                                StartupProfile* profile = nullptr);
 
 #endif  // WESTON_LAUNCH_WESTON_H_
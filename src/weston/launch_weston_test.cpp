@@ -3,6 +3,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <thread>
 
 #include "paths.h"
@@ -17,16 +20,40 @@ void close_proc(int pid) {
 }
 
 TEST(LaunchWeston, launch_succeeds) {
-  auto r = launch_weston(5950, {get_export_display_path(), "test"});
+  auto r = launch_weston(5950, {get_export_display_path()});
   EXPECT_OK(r)
   if (r.ok()) {
     close_proc(r->pid);
   }
 }
 
+TEST(LaunchWeston, returns_display_vars) {
+  DisplayVars vars;
+  auto r = launch_weston(5953, {get_export_display_path()}, 800, 600, &vars);
+  EXPECT_OK(r)
+  EXPECT_NE(vars.wayland_display, "");
+  if (r.ok()) {
+    close_proc(r->pid);
+  }
+}
+
+TEST(LaunchWeston, profiles_successful_launches) {
+  StartupProfile profile;
+  auto r = launch_weston(5959, {get_export_display_path()}, 800, 600, nullptr,
+                         nullptr, LaunchWestonOpts(), &profile);
+  EXPECT_OK(r)
+  ASSERT_EQ(profile.phases.size(), 2u);
+  EXPECT_EQ(profile.phases[0].name, "spawn_weston");
+  EXPECT_EQ(profile.phases[1].name, "weston_ready");
+  EXPECT_GT(profile.total_s(), 0);
+  if (r.ok()) {
+    close_proc(r->pid);
+  }
+}
+
 TEST(LaunchWeston, port_taken_gives_unavailable_error) {
-  auto a = launch_weston(5951, {get_export_display_path(), "test"});
-  auto b = launch_weston(5951, {get_export_display_path(), "test"});
+  auto a = launch_weston(5951, {get_export_display_path()});
+  auto b = launch_weston(5951, {get_export_display_path()});
   EXPECT_THAT(b, StatusIs(StatusCode::UNAVAILABLE)) << b.status().to_string();
   if (a.ok()) {
     close_proc(a->pid);
@@ -38,3 +65,61 @@ TEST(LaunchWeston, launch_failure_gives_unknown_error) {
   EXPECT_FALSE(r.ok());
   EXPECT_THAT(r, StatusIs(StatusCode::UNKNOWN)) << r.to_string();
 }
+
+TEST(LaunchWeston, parses_renderers) {
+  for (Renderer r : {Renderer::AUTO, Renderer::GL, Renderer::PIXMAN}) {
+    ASSERT_OK_AND_ASSIGN(Renderer parsed, parse_renderer(renderer_name(r)));
+    EXPECT_EQ(parsed, r);
+  }
+  EXPECT_THAT(parse_renderer("vulkan"),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST(LaunchWeston, auto_renderer_uses_gl_only_with_a_render_node) {
+  std::string dri = std::format("/tmp/bounce_launch_weston_test_{}", getpid());
+  std::filesystem::remove_all(dri);
+  std::filesystem::create_directories(dri);
+  std::ofstream(dri + "/card0");
+  EXPECT_FALSE(has_render_node(dri));
+  EXPECT_EQ(resolve_renderer(Renderer::AUTO, dri), Renderer::PIXMAN);
+  EXPECT_EQ(resolve_renderer(Renderer::GL, dri), Renderer::GL);
+
+  std::ofstream(dri + "/renderD128");
+  EXPECT_TRUE(has_render_node(dri));
+  EXPECT_EQ(resolve_renderer(Renderer::AUTO, dri), Renderer::GL);
+  EXPECT_EQ(resolve_renderer(Renderer::PIXMAN, dri), Renderer::PIXMAN);
+  EXPECT_FALSE(has_render_node(dri + "/missing"));
+  std::filesystem::remove_all(dri);
+}
+
+TEST(LaunchWeston, launches_with_pixman_and_extra_flags) {
+  auto r = launch_weston(
+      5954, {get_export_display_path()}, 800, 600, nullptr, nullptr,
+      LaunchWestonOpts{.renderer = Renderer::PIXMAN,
+                       .extra_flags = {"--idle-time=0"}});
+  EXPECT_OK(r)
+  if (r.ok()) {
+    close_proc(r->pid);
+  }
+}
+
+TEST(LaunchWeston, rejects_non_flag_extra_args) {
+  auto r = launch_weston(5955, {get_export_display_path()}, 800, 600, nullptr,
+                         nullptr, LaunchWestonOpts{.extra_flags = {"--"}});
+  EXPECT_THAT(r, StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST(LaunchWeston, launches_without_xwayland) {
+  // The session's DISPLAY shouldn't fall back to ours.
+  setenv("DISPLAY", ":99", true);
+  DisplayVars vars;
+  auto r = launch_weston(5958, {get_export_display_path()}, 800, 600, &vars,
+                         nullptr, LaunchWestonOpts{.xwayland = false});
+  unsetenv("DISPLAY");
+  EXPECT_OK(r)
+  EXPECT_EQ(vars.x_display, "");
+  EXPECT_NE(vars.wayland_display, "");
+  if (r.ok()) {
+    close_proc(r->pid);
+  }
+}
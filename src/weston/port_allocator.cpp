@@ -0,0 +1,62 @@
+#include "weston/port_allocator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+
+#include "libc_error.h"
+
+namespace {
+std::string get_lock_dir() {
+  return std::format("/run/user/{}/bounce_desktop_ports", getuid());
+}
+
+// Returns whether 'port' can currently be bound on all interfaces, which is
+// where Weston's VNC backend listens.
+bool can_bind(int port) {
+  Fd sock = Fd::take(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (*sock == -1) return false;
+  int one = 1;
+  setsockopt(*sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  return bind(*sock, (sockaddr*)&addr, sizeof(addr)) == 0;
+}
+}  // namespace
+
+StatusOr<PortLease> reserve_port(int first_port, int num_ports) {
+  const std::string lock_dir = get_lock_dir();
+  std::error_code error;
+  std::filesystem::create_directories(lock_dir, error);
+  if (error) {
+    return InternalError(std::format("Failed to create port lock dir {}: {}",
+                                     lock_dir, error.message()));
+  }
+
+  for (int port = first_port; port < first_port + num_ports; ++port) {
+    std::string lock_path = std::format("{}/{}.lock", lock_dir, port);
+    Fd lock = Fd::take(open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                            0600));
+    if (*lock == -1) {
+      return InternalError(std::format("Failed to open port lock file {}: {}",
+                                       lock_path, libc_error_name(errno)));
+    }
+    if (flock(*lock, LOCK_EX | LOCK_NB) == -1) {
+      if (errno == EWOULDBLOCK) continue;
+      return InternalError(std::format("Failed to lock port lock file {}: {}",
+                                       lock_path, libc_error_name(errno)));
+    }
+    if (!can_bind(port)) continue;
+    return PortLease(port, std::move(lock));
+  }
+  return UnavailableError(std::format("No free ports in [{}, {}).", first_port,
+                                      first_port + num_ports));
+}
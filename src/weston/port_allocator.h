@@ -0,0 +1,37 @@
+// Reserves VNC ports for Weston instances before launching them, so that
+// concurrent desktop start ups don't race each other for the same port.
+//
+// A port's reserved by holding an flock() on a per-port lock file under
+// /run/user/UID/bounce_desktop_ports, and the allocator also bind-probes each
+// port so that it skips ports held by processes that don't use the allocator.
+// Lock files are left in place after their leases end, since unlinking a lock
+// file would race with other processes locking it.
+
+#ifndef WESTON_PORT_ALLOCATOR_H_
+#define WESTON_PORT_ALLOCATOR_H_
+
+#include "process/fd.h"
+#include "third_party/status/status_or.h"
+
+// A reserved port. The reservation lasts for as long as the lease exists.
+class PortLease {
+ public:
+  PortLease() = default;
+  PortLease(int port, Fd&& lock) : port_(port), lock_(std::move(lock)) {}
+
+  PortLease(PortLease&& other) = default;
+  PortLease& operator=(PortLease&& other) = default;
+
+  int port() const { return port_; }
+
+ private:
+  int port_ = -1;
+  Fd lock_;
+};
+
+// Reserves the first free port in [first_port, first_port + num_ports).
+//
+// Returns UNAVAILABLE if every port in the range is reserved or bound.
+StatusOr<PortLease> reserve_port(int first_port, int num_ports = 1000);
+
+#endif  // WESTON_PORT_ALLOCATOR_H_
@@ -0,0 +1,41 @@
+#include "weston/port_allocator.h"
+
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "third_party/status/status_gtest.h"
+
+TEST(PortAllocator, leases_are_exclusive) {
+  ASSERT_OK_AND_ASSIGN(PortLease a, reserve_port(6100, 10));
+  ASSERT_OK_AND_ASSIGN(PortLease b, reserve_port(6100, 10));
+  EXPECT_NE(a.port(), b.port());
+}
+
+TEST(PortAllocator, released_ports_are_reusable) {
+  int port;
+  {
+    ASSERT_OK_AND_ASSIGN(PortLease a, reserve_port(6110, 10));
+    port = a.port();
+  }
+  ASSERT_OK_AND_ASSIGN(PortLease b, reserve_port(6110, 10));
+  EXPECT_EQ(b.port(), port);
+}
+
+TEST(PortAllocator, skips_bound_ports) {
+  Fd sock = Fd::take(socket(AF_INET, SOCK_STREAM, 0));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(6120);
+  ASSERT_EQ(bind(*sock, (sockaddr*)&addr, sizeof(addr)), 0);
+  ASSERT_EQ(listen(*sock, 1), 0);
+
+  ASSERT_OK_AND_ASSIGN(PortLease lease, reserve_port(6120, 10));
+  EXPECT_NE(lease.port(), 6120);
+}
+
+TEST(PortAllocator, exhausted_range_is_unavailable) {
+  ASSERT_OK_AND_ASSIGN(PortLease a, reserve_port(6130, 1));
+  EXPECT_THAT(reserve_port(6130, 1), StatusIs(StatusCode::UNAVAILABLE));
+}
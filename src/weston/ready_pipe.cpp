@@ -0,0 +1,62 @@
+#include "weston/ready_pipe.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+#include "libc_error.h"
+
+StatusVal notify_ready(const std::map<std::string, std::string>& fields) {
+  const char* fd_var = getenv(kReadyFdEnvVar);
+  if (!fd_var) {
+    return NotFoundError(std::string(kReadyFdEnvVar) + " isn't set.");
+  }
+  int fd = atoi(fd_var);
+
+  std::string message;
+  for (const auto& [k, v] : fields) {
+    message += k + "=" + v + "\n";
+  }
+  message += "READY=1\n";
+
+  // Pipe writes under PIPE_BUF bytes are atomic, but we still handle partial
+  // writes in case the message is larger.
+  size_t written = 0;
+  while (written < message.size()) {
+    ssize_t r = write(fd, message.data() + written, message.size() - written);
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) {
+      int error = errno;
+      close(fd);
+      return InternalError("Ready pipe write failed: " +
+                           libc_error_name(error));
+    }
+    written += r;
+  }
+  close(fd);
+  return OkStatus();
+}
+
+bool ReadyParser::consume(const std::string& data) {
+  partial_line_ += data;
+  size_t start = 0;
+  size_t end;
+  while (!ready_ &&
+         (end = partial_line_.find('\n', start)) != std::string::npos) {
+    std::string line = partial_line_.substr(start, end - start);
+    start = end + 1;
+
+    size_t eq = line.find('=');
+    if (eq == std::string::npos) continue;
+    std::string key = line.substr(0, eq);
+    std::string value = line.substr(eq + 1);
+    if (key == "READY") {
+      ready_ = value == "1";
+    } else {
+      fields_[key] = value;
+    }
+  }
+  partial_line_.erase(0, start);
+  return ready_;
+}
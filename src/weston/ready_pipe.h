@@ -0,0 +1,45 @@
+// The ready pipe lets the command that Weston launches tell launch_weston()
+// that the desktop's ready, without launch_weston() having to poll.
+//
+// launch_weston() passes the pipe's write end to Weston, which passes it on to
+// its launch command, as fd kReadyChildFd and names the fd in the
+// kReadyFdEnvVar env var. The command writes "KEY=VALUE\n" lines to the pipe,
+// ending with a "READY=1\n" line.
+
+#ifndef WESTON_READY_PIPE_H_
+#define WESTON_READY_PIPE_H_
+
+#include <map>
+#include <string>
+
+#include "third_party/status/status_or.h"
+
+inline const char* const kReadyFdEnvVar = "BOUNCE_READY_FD";
+inline const int kReadyChildFd = 3;
+
+// Writes 'fields' and then READY=1 to the fd named by kReadyFdEnvVar and
+// closes the fd.
+//
+// Returns NOT_FOUND if kReadyFdEnvVar isn't set.
+StatusVal notify_ready(const std::map<std::string, std::string>& fields = {});
+
+// Incrementally parses the messages written by notify_ready().
+class ReadyParser {
+ public:
+  // Parses the next chunk of data read from the pipe. Returns true once the
+  // READY=1 line has been parsed.
+  bool consume(const std::string& data);
+
+  bool ready() const { return ready_; }
+
+  // The fields parsed so far, excluding READY.
+  const std::map<std::string, std::string>& fields() const { return fields_; }
+
+ private:
+  // Data after the last parsed newline.
+  std::string partial_line_;
+  std::map<std::string, std::string> fields_;
+  bool ready_ = false;
+};
+
+#endif  // WESTON_READY_PIPE_H_
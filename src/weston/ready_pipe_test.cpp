@@ -0,0 +1,40 @@
+#include "weston/ready_pipe.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "third_party/status/status_gtest.h"
+
+TEST(ReadyPipe, notify_ready_round_trip) {
+  int p[2];
+  ASSERT_EQ(pipe(p), 0);
+  setenv(kReadyFdEnvVar, std::to_string(p[1]).c_str(), true);
+  EXPECT_OK(notify_ready({{"A", "1"}, {"B", "two"}}));
+  unsetenv(kReadyFdEnvVar);
+
+  char buf[256];
+  int r = read(p[0], buf, sizeof(buf));
+  ASSERT_GT(r, 0);
+  close(p[0]);
+
+  ReadyParser parser;
+  EXPECT_TRUE(parser.consume(std::string(buf, r)));
+  EXPECT_EQ(parser.fields().at("A"), "1");
+  EXPECT_EQ(parser.fields().at("B"), "two");
+}
+
+TEST(ReadyPipe, notify_ready_without_fd_is_not_found) {
+  unsetenv(kReadyFdEnvVar);
+  EXPECT_THAT(notify_ready(), StatusIs(StatusCode::NOT_FOUND));
+}
+
+TEST(ReadyPipe, parser_handles_split_lines) {
+  ReadyParser parser;
+  EXPECT_FALSE(parser.consume("DISP"));
+  EXPECT_FALSE(parser.consume("LAY=:1\nREA"));
+  EXPECT_FALSE(parser.ready());
+  EXPECT_TRUE(parser.consume("DY=1\n"));
+  EXPECT_EQ(parser.fields().at("DISPLAY"), ":1");
+}
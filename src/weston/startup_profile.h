@@ -0,0 +1,63 @@
+// Timings of the phases of a desktop's startup, from preparing its session to
+// its first frame, so that startup optimizations can be justified and checked.
+
+#ifndef WESTON_STARTUP_PROFILE_H_
+#define WESTON_STARTUP_PROFILE_H_
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+struct StartupPhase {
+  std::string name = "";
+  double seconds = 0;
+};
+
+struct StartupProfile {
+  // The phases that ran one after another, in order. Phases that ran more
+  // than once, e.g. Weston launches retried because their port was taken,
+  // appear once per run.
+  std::vector<StartupPhase> phases = {};
+  // How many Weston launches were retried on another port.
+  int port_retries = 0;
+  // How long Xwayland took to start in the background after Weston was
+  // ready, or 0 if it wasn't measured. Not part of the phases, since it
+  // overlaps them.
+  double xwayland_s = 0;
+
+  // Appends the phase 'name' that ran from 'start' until now, and returns
+  // now, which the next phase can start from.
+  std::chrono::steady_clock::time_point add(
+      const std::string& name, std::chrono::steady_clock::time_point start) {
+    auto now = std::chrono::steady_clock::now();
+    phases.push_back(StartupPhase{
+        .name = name,
+        .seconds = std::chrono::duration<double>(now - start).count()});
+    return now;
+  }
+
+  // Appends 'other's phases and retries to ours.
+  void append(const StartupProfile& other) {
+    phases.insert(phases.end(), other.phases.begin(), other.phases.end());
+    port_retries += other.port_retries;
+    if (other.xwayland_s) xwayland_s = other.xwayland_s;
+  }
+
+  double total_s() const {
+    double total = 0;
+    for (const StartupPhase& phase : phases) total += phase.seconds;
+    return total;
+  }
+
+  // Returns each phase's total time over all of its runs.
+  std::map<std::string, double> totals() const {
+    std::map<std::string, double> totals;
+    for (const StartupPhase& phase : phases) {
+      totals[phase.name] += phase.seconds;
+    }
+    return totals;
+  }
+};
+
+#endif  // WESTON_STARTUP_PROFILE_H_
@@ -0,0 +1,37 @@
+#include "weston/startup_profile.h"
+
+#include <gtest/gtest.h>
+
+#include "time_aliases.h"
+
+TEST(StartupProfile, phases_chain_and_total) {
+  StartupProfile profile;
+  auto start = sc_now();
+  sleep_for(20ms);
+  start = profile.add("a", start);
+  start = profile.add("b", start);
+  profile.add("a", start - 10ms);
+
+  ASSERT_EQ(profile.phases.size(), 3u);
+  EXPECT_EQ(profile.phases[0].name, "a");
+  EXPECT_GE(profile.phases[0].seconds, 0.02);
+  EXPECT_LT(profile.phases[1].seconds, 0.01);
+  EXPECT_GE(profile.phases[2].seconds, 0.01);
+
+  std::map<std::string, double> totals = profile.totals();
+  ASSERT_EQ(totals.size(), 2u);
+  EXPECT_DOUBLE_EQ(totals["a"],
+                   profile.phases[0].seconds + profile.phases[2].seconds);
+  EXPECT_DOUBLE_EQ(profile.total_s(), totals["a"] + totals["b"]);
+}
+
+TEST(StartupProfile, append_keeps_order_and_counts) {
+  StartupProfile a{.phases = {{"x", 1}}, .port_retries = 1};
+  StartupProfile b{.phases = {{"y", 2}}, .port_retries = 2, .xwayland_s = 3};
+  a.append(b);
+  ASSERT_EQ(a.phases.size(), 2u);
+  EXPECT_EQ(a.phases[1].name, "y");
+  EXPECT_EQ(a.port_retries, 3);
+  EXPECT_EQ(a.xwayland_s, 3);
+  EXPECT_EQ(a.total_s(), 3);
+}
@@ -0,0 +1,86 @@
+#include "weston/weston_config.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+
+#include "libc_error.h"
+#include "process/fd.h"
+
+std::string weston_ini(const WestonConfig& config) {
+  const char* animation = config.animations ? "zoom" : "none";
+  const char* fade = config.animations ? "fade" : "none";
+  std::string ini;
+  ini += "[core]\n";
+  ini += std::format("idle-time={}\n", config.idle_time);
+  ini += "\n[shell]\n";
+  ini += std::format("animation={}\n", animation);
+  ini += std::format("close-animation={}\n", fade);
+  ini += std::format("startup-animation={}\n", fade);
+  ini += std::format("focus-animation={}\n", config.animations ? "dim-layer"
+                                                                : "none");
+  ini += std::format("locking={}\n", config.locking ? "true" : "false");
+  ini += std::format("panel-position={}\n", config.panel ? "top" : "none");
+  ini += std::format("cursor-theme={}\n", config.cursor_theme);
+  ini += std::format("cursor-size={}\n", config.cursor_size);
+  ini += std::format("background-color={}\n", config.background_color);
+  ini += "background-type=tile\n";
+  if (!config.xwayland_path.empty()) {
+    ini += "\n[xwayland]\n";
+    ini += std::format("path={}\n", config.xwayland_path);
+  }
+  return ini;
+}
+
+StatusOr<WestonIniFile> WestonIniFile::create(const WestonConfig& config,
+                                              const std::string& dir) {
+  std::string ini_dir =
+      dir.empty() ? std::format("/run/user/{}/bounce_desktop_weston", getuid())
+                  : dir;
+  std::error_code error;
+  std::filesystem::create_directories(ini_dir, error);
+  if (error) {
+    return InternalError(std::format("Failed to create weston.ini dir {}: {}",
+                                     ini_dir, error.message()));
+  }
+
+  std::string path = ini_dir + "/weston_XXXXXX.ini";
+  Fd fd = Fd::take(mkostemps(path.data(), 4, O_CLOEXEC));
+  if (*fd == -1) {
+    return InternalError(std::format("Failed to create {}: {}", path,
+                                     libc_error_name(errno)));
+  }
+  WestonIniFile file(path);
+  std::string ini = weston_ini(config);
+  size_t written = 0;
+  while (written < ini.size()) {
+    ssize_t r = write(*fd, ini.data() + written, ini.size() - written);
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) {
+      return InternalError(std::format("Failed to write {}: {}", path,
+                                       libc_error_name(errno)));
+    }
+    written += r;
+  }
+  return file;
+}
+
+WestonIniFile::~WestonIniFile() {
+  if (!path_.empty()) unlink(path_.c_str());
+}
+
+WestonIniFile::WestonIniFile(WestonIniFile&& other)
+    : path_(std::move(other.path_)) {
+  other.path_.clear();
+}
+
+WestonIniFile& WestonIniFile::operator=(WestonIniFile&& other) {
+  if (this == &other) return *this;
+  if (!path_.empty()) unlink(path_.c_str());
+  path_ = std::move(other.path_);
+  other.path_.clear();
+  return *this;
+}
@@ -0,0 +1,68 @@
+// Generates the weston.ini that each Weston instance is launched with.
+//
+// Weston's defaults suit people at a desk: windows animate open and closed,
+// the desktop fades in, and the screen blanks and locks when idle. For
+// automated sessions, each of those is a frame that changes for no
+// task-related reason and repaint work that nobody looks at, and it makes
+// waiting for the screen to settle unreliable. Passing our own config also
+// keeps a user's ~/.config/weston.ini out of the session.
+
+#ifndef WESTON_WESTON_CONFIG_H_
+#define WESTON_WESTON_CONFIG_H_
+
+#include <string>
+
+#include "third_party/status/status_or.h"
+
+struct WestonConfig {
+  // Window open, close, and focus animations, and the desktop's startup fade.
+  bool animations = false;
+  // Seconds without input before Weston idles and blanks the screen. 0 never
+  // idles.
+  int idle_time = 0;
+  // Whether the screen locks when Weston idles.
+  bool locking = false;
+  // Whether the desktop shell shows its panel, which has a clock that repaints.
+  bool panel = false;
+  // A fixed cursor, so that frames don't depend on the user's cursor settings.
+  std::string cursor_theme = "default";
+  int cursor_size = 24;
+  // The desktop's solid background color, as 0xAARRGGBB.
+  std::string background_color = "0xff000000";
+  // If set, Weston runs this binary as its Xwayland server, e.g. our
+  // xwayland_wrapper (see weston/xwayland.h).
+  std::string xwayland_path = "";
+};
+
+// Returns 'config' as weston.ini contents.
+std::string weston_ini(const WestonConfig& config);
+
+// A weston.ini file written for a single Weston instance, which is removed
+// when the file object's destroyed. Weston's shell client reads the file after
+// Weston's started, so it should outlive the instance.
+class WestonIniFile {
+ public:
+  // Writes 'config' to a new file in 'dir', which defaults to
+  // /run/user/UID/bounce_desktop_weston.
+  //
+  // Returns INTERNAL if the file can't be written.
+  static StatusOr<WestonIniFile> create(const WestonConfig& config,
+                                        const std::string& dir = "");
+
+  WestonIniFile() = default;
+  ~WestonIniFile();
+
+  WestonIniFile(WestonIniFile&& other);
+  WestonIniFile& operator=(WestonIniFile&& other);
+  WestonIniFile(const WestonIniFile&) = delete;
+  WestonIniFile& operator=(const WestonIniFile&) = delete;
+
+  const std::string& path() const { return path_; }
+
+ private:
+  explicit WestonIniFile(std::string path) : path_(std::move(path)) {}
+
+  std::string path_;
+};
+
+#endif  // WESTON_WESTON_CONFIG_H_
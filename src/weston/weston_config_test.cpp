@@ -0,0 +1,78 @@
+#include "weston/weston_config.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+
+#include "third_party/status/status_gtest.h"
+
+namespace {
+std::string read_file(const std::string& path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+bool has_line(const std::string& ini, const std::string& line) {
+  return ("\n" + ini).find("\n" + line + "\n") != std::string::npos;
+}
+}  // namespace
+
+TEST(WestonConfig, defaults_disable_animations_idle_and_locking) {
+  std::string ini = weston_ini(WestonConfig());
+  EXPECT_TRUE(has_line(ini, "[core]"));
+  EXPECT_TRUE(has_line(ini, "idle-time=0"));
+  EXPECT_TRUE(has_line(ini, "[shell]"));
+  EXPECT_TRUE(has_line(ini, "animation=none"));
+  EXPECT_TRUE(has_line(ini, "close-animation=none"));
+  EXPECT_TRUE(has_line(ini, "startup-animation=none"));
+  EXPECT_TRUE(has_line(ini, "focus-animation=none"));
+  EXPECT_TRUE(has_line(ini, "locking=false"));
+  EXPECT_TRUE(has_line(ini, "panel-position=none"));
+  EXPECT_TRUE(has_line(ini, "cursor-theme=default"));
+  EXPECT_TRUE(has_line(ini, "cursor-size=24"));
+  EXPECT_FALSE(has_line(ini, "[xwayland]"));
+}
+
+TEST(WestonConfig, writes_settings) {
+  std::string ini = weston_ini(WestonConfig{.animations = true,
+                                            .idle_time = 300,
+                                            .locking = true,
+                                            .panel = true,
+                                            .cursor_theme = "Adwaita",
+                                            .cursor_size = 32,
+                                            .xwayland_path = "/bin/xw"});
+  EXPECT_TRUE(has_line(ini, "idle-time=300"));
+  EXPECT_TRUE(has_line(ini, "animation=zoom"));
+  EXPECT_TRUE(has_line(ini, "startup-animation=fade"));
+  EXPECT_TRUE(has_line(ini, "locking=true"));
+  EXPECT_TRUE(has_line(ini, "panel-position=top"));
+  EXPECT_TRUE(has_line(ini, "cursor-theme=Adwaita"));
+  EXPECT_TRUE(has_line(ini, "cursor-size=32"));
+  EXPECT_TRUE(has_line(ini, "[xwayland]"));
+  EXPECT_TRUE(has_line(ini, "path=/bin/xw"));
+}
+
+TEST(WestonConfig, ini_files_are_unique_and_removed) {
+  std::string dir = std::format("/tmp/bounce_weston_config_test_{}", getpid());
+  std::filesystem::remove_all(dir);
+  std::string path;
+  {
+    ASSERT_OK_AND_ASSIGN(WestonIniFile a, WestonIniFile::create({}, dir));
+    ASSERT_OK_AND_ASSIGN(WestonIniFile b, WestonIniFile::create({}, dir));
+    EXPECT_NE(a.path(), b.path());
+    EXPECT_EQ(read_file(a.path()), weston_ini(WestonConfig()));
+
+    WestonIniFile moved = std::move(a);
+    path = moved.path();
+    EXPECT_TRUE(std::filesystem::exists(path));
+  }
+  EXPECT_FALSE(std::filesystem::exists(path));
+  EXPECT_TRUE(std::filesystem::is_empty(dir));
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,106 @@
+#include "weston/xwayland.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <bit>
+#include <format>
+
+#include "libc_error.h"
+#include "time_aliases.h"
+
+std::vector<std::string> xwayland_args(bool software_rendering) {
+  std::vector<std::string> args = {"+extension", "MIT-SHM"};
+  if (software_rendering) args.push_back("-shm");
+  return args;
+}
+
+StatusOr<std::string> x_socket_path(const std::string& display,
+                                    const std::string& socket_dir) {
+  auto invalid = [&]() {
+    return InvalidArgumentError(
+        std::format("\"{}\" isn't a local X display.", display));
+  };
+  if (!display.starts_with(":")) return invalid();
+  size_t end = display.find('.');
+  std::string number = display.substr(1, end == std::string::npos
+                                             ? std::string::npos
+                                             : end - 1);
+  if (number.empty() ||
+      !std::all_of(number.begin(), number.end(),
+                   [](char c) { return c >= '0' && c <= '9'; })) {
+    return invalid();
+  }
+  return std::format("{}/X{}", socket_dir, number);
+}
+
+StatusOr<XwaylandWarmup> XwaylandWarmup::start(const std::string& display,
+                                               const std::string& socket_dir) {
+  ASSIGN_OR_RETURN(std::string path, x_socket_path(display, socket_dir));
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return InvalidArgumentError("X socket path is too long: " + path);
+  }
+  strcpy(addr.sun_path, path.c_str());
+
+  Fd fd = Fd::take(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (*fd == -1) {
+    return InternalError("Failed to create unix socket: " +
+                         libc_error_name(errno));
+  }
+  if (connect(*fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+    return UnavailableError("Failed to connect to " + path + ": " +
+                            libc_error_name(errno));
+  }
+
+  // An X connection setup request for protocol 11.0 with no auth, in our
+  // byte order. Weston's already accepted the connection, so the send
+  // doesn't wait on Xwayland.
+  uint8_t request[12] = {};
+  request[0] = std::endian::native == std::endian::little ? 'l' : 'B';
+  uint16_t major_version = 11;
+  memcpy(request + 2, &major_version, sizeof(major_version));
+  if (send(*fd, request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+    return UnavailableError("Failed to send an X setup request to " + path +
+                            ": " + libc_error_name(errno));
+  }
+  return XwaylandWarmup(std::move(fd));
+}
+
+StatusVal XwaylandWarmup::wait(std::chrono::milliseconds timeout) {
+  if (done_) return OkStatus();
+
+  const auto deadline = sc_now() + timeout;
+  while (true) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - sc_now());
+    pollfd p = {.fd = *fd_, .events = POLLIN, .revents = 0};
+    int r = poll(&p, 1, std::max<int>(remaining.count(), 0));
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) {
+      return InternalError("Xwayland warm-up poll failed: " +
+                           libc_error_name(errno));
+    }
+    if (r == 0) {
+      return DeadlineExceededError("Xwayland didn't start before the timeout.");
+    }
+
+    // The first byte of the server's answer says whether it accepted us.
+    uint8_t answer;
+    ssize_t n = recv(*fd_, &answer, 1, 0);
+    if (n == -1 && errno == EINTR) continue;
+    if (n != 1) {
+      return UnavailableError(
+          "The X server closed the connection without answering.");
+    }
+    done_ = true;
+    fd_ = Fd();
+    return OkStatus();
+  }
+}
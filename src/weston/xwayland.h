@@ -0,0 +1,78 @@
+// Tuning and warm-up for the Xwayland server that Weston runs for X11 apps.
+//
+// Weston starts Xwayland lazily: it listens on the session's X socket and only
+// spawns Xwayland when the first X client connects, so that client pays for
+// Xwayland's whole startup. To take that off the app's launch, the backend
+// connects to the X socket as soon as Weston's up (see XwaylandWarmup), which
+// starts Xwayland while the rest of the session's set up.
+//
+// Weston runs whatever binary its weston.ini's [xwayland] path names, which
+// we point at xwayland_wrapper (weston/xwayland_wrapper_main.cpp). The wrapper
+// appends the args launch_weston() chose for the session's renderer and runs
+// the Xwayland that Weston itself would have run (meson's xwayland_path).
+
+#ifndef WESTON_XWAYLAND_H_
+#define WESTON_XWAYLAND_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "process/fd.h"
+#include "third_party/status/status_or.h"
+
+// The wrapper appends this env var's space-separated args to Xwayland's.
+inline const char* const kXwaylandArgsEnvVar = "BOUNCE_XWAYLAND_ARGS";
+// The wrapper runs this binary if it's set, and the build's xwayland_path
+// otherwise.
+inline const char* const kXwaylandBinEnvVar = "BOUNCE_XWAYLAND_BIN";
+
+// Returns the args to run Xwayland with. MIT-SHM's always enabled, so that X
+// apps can share images with the server instead of sending them over the
+// socket. With 'software_rendering', glamor's turned off in favor of plain
+// shared-memory buffers, since glamor on llvmpipe only adds a GL round trip to
+// every draw.
+std::vector<std::string> xwayland_args(bool software_rendering);
+
+// Returns the path of the X socket for 'display', e.g. "/tmp/.X11-unix/X1"
+// for ":1".
+//
+// Returns INVALID_ARGUMENT if 'display' isn't a local display like ":1" or
+// ":1.0".
+StatusOr<std::string> x_socket_path(
+    const std::string& display,
+    const std::string& socket_dir = "/tmp/.X11-unix");
+
+// Starts an X server by connecting to it, and waits for it to answer.
+class XwaylandWarmup {
+ public:
+  // Connects to 'display's socket and sends an X connection setup request,
+  // without waiting for the server's reply.
+  //
+  // Returns INVALID_ARGUMENT for non-local displays and UNAVAILABLE if the
+  // socket can't be connected to.
+  static StatusOr<XwaylandWarmup> start(
+      const std::string& display,
+      const std::string& socket_dir = "/tmp/.X11-unix");
+
+  XwaylandWarmup() = default;
+
+  // Waits for the server to answer the setup request. The answer needn't
+  // accept the connection, since any answer means the server's running.
+  // Returns OK immediately once the server has answered.
+  //
+  // Returns DEADLINE_EXCEEDED if the server doesn't answer within 'timeout',
+  // and UNAVAILABLE if it closes the connection without answering.
+  StatusVal wait(std::chrono::milliseconds timeout);
+
+  // Whether wait() has seen the server's answer.
+  bool done() const { return done_; }
+
+ private:
+  explicit XwaylandWarmup(Fd fd) : fd_(std::move(fd)) {}
+
+  Fd fd_;
+  bool done_ = false;
+};
+
+#endif  // WESTON_XWAYLAND_H_
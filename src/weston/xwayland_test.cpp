@@ -0,0 +1,107 @@
+#include "weston/xwayland.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+#include <thread>
+
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+// Listens on 'dir'/X7 like an X server for display ":7" would.
+Fd listen_x(const std::string& dir) {
+  std::filesystem::create_directories(dir);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  std::string path = dir + "/X7";
+  unlink(path.c_str());
+  strcpy(addr.sun_path, path.c_str());
+  Fd fd = Fd::take(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  CHECK(bind(*fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+  CHECK(listen(*fd, 1) == 0);
+  return fd;
+}
+}  // namespace
+
+class XwaylandWarmupTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::format("/tmp/bounce_xwayland_test_{}", getpid());
+    listener_ = listen_x(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  // Accepts the warm-up's connection and returns it once its setup request's
+  // arrived.
+  Fd accept_setup() {
+    Fd conn = Fd::take(accept(*listener_, nullptr, nullptr));
+    char request[12];
+    EXPECT_EQ(recv(*conn, request, sizeof(request), MSG_WAITALL),
+              (ssize_t)sizeof(request));
+    EXPECT_TRUE(request[0] == 'l' || request[0] == 'B');
+    return conn;
+  }
+
+  std::string dir_;
+  Fd listener_;
+};
+
+TEST(Xwayland, software_rendering_turns_off_glamor) {
+  EXPECT_THAT(xwayland_args(false),
+              ::testing::ElementsAre("+extension", "MIT-SHM"));
+  EXPECT_THAT(xwayland_args(true),
+              ::testing::ElementsAre("+extension", "MIT-SHM", "-shm"));
+}
+
+TEST(Xwayland, finds_local_display_sockets) {
+  ASSERT_OK_AND_ASSIGN(std::string path, x_socket_path(":1"));
+  EXPECT_EQ(path, "/tmp/.X11-unix/X1");
+  ASSERT_OK_AND_ASSIGN(path, x_socket_path(":12.0", "/x"));
+  EXPECT_EQ(path, "/x/X12");
+  for (const char* display : {"", ":", "host:1", ":a", ":1a"}) {
+    EXPECT_THAT(x_socket_path(display),
+                StatusIs(StatusCode::INVALID_ARGUMENT))
+        << display;
+  }
+}
+
+TEST_F(XwaylandWarmupTest, waits_for_the_server_to_answer) {
+  ASSERT_OK_AND_ASSIGN(XwaylandWarmup warmup,
+                       XwaylandWarmup::start(":7", dir_));
+  Fd conn = accept_setup();
+  EXPECT_THAT(warmup.wait(50ms), StatusIs(StatusCode::DEADLINE_EXCEEDED));
+  EXPECT_FALSE(warmup.done());
+
+  // Even a refusal means the server's up.
+  std::thread answer([&]() {
+    sleep_for(50ms);
+    char failed = 0;
+    send(*conn, &failed, 1, MSG_NOSIGNAL);
+  });
+  StatusVal s = warmup.wait(1s);
+  EXPECT_OK(s);
+  EXPECT_TRUE(warmup.done());
+  s = warmup.wait(0ms);
+  EXPECT_OK(s);
+  answer.join();
+}
+
+TEST_F(XwaylandWarmupTest, fails_if_the_server_hangs_up) {
+  ASSERT_OK_AND_ASSIGN(XwaylandWarmup warmup,
+                       XwaylandWarmup::start(":7", dir_));
+  accept_setup();
+  EXPECT_THAT(warmup.wait(1s), StatusIs(StatusCode::UNAVAILABLE));
+}
+
+TEST_F(XwaylandWarmupTest, fails_without_a_server) {
+  EXPECT_THAT(XwaylandWarmup::start(":8", dir_),
+              StatusIs(StatusCode::UNAVAILABLE));
+}
@@ -0,0 +1,38 @@
+// Runs Xwayland with the args Weston passes plus the ones in
+// BOUNCE_XWAYLAND_ARGS (see weston/xwayland.h). Weston runs this in place of
+// Xwayland when our weston.ini's [xwayland] path names it, so by default it
+// runs the Xwayland that Weston was built to run, XWAYLAND_PATH.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "weston/xwayland.h"
+
+#ifndef XWAYLAND_PATH
+#define XWAYLAND_PATH "/usr/bin/Xwayland"
+#endif
+
+int main(int argc, char* argv[]) {
+  const char* bin = getenv(kXwaylandBinEnvVar);
+  if (!bin || !*bin) bin = XWAYLAND_PATH;
+
+  std::vector<std::string> args = {bin};
+  args.insert(args.end(), argv + 1, argv + argc);
+  if (const char* extra = getenv(kXwaylandArgsEnvVar)) {
+    std::istringstream in(extra);
+    std::string arg;
+    while (in >> arg) args.push_back(arg);
+  }
+
+  std::vector<char*> exec_args;
+  for (std::string& arg : args) exec_args.push_back(arg.data());
+  exec_args.push_back(nullptr);
+  execvp(bin, exec_args.data());
+  perror("xwayland_wrapper execvp");
+  return 127;
+}
@@ -0,0 +1,51 @@
+// The protocol between Zygote (zygote.h) and the zygote process
+// (bounce_desktop/zygote.py). Messages are fixed size and sent over a
+// SOCK_SEQPACKET IPC. zygote.py packs and unpacks them with struct format
+// "=iiii4096s", so keep the two in sync.
+
+#ifndef ZYGOTE_PROTOCOL_H_
+#define ZYGOTE_PROTOCOL_H_
+
+#include <stdint.h>
+
+// The zygote reads its IPC connection token from this env var.
+inline const char* const kZygoteIpcFileEnvVar = "BOUNCE_ZYGOTE_IPC_FILE";
+// The zygote reads the comma separated modules to import before it forks
+// any apps from this env var.
+inline const char* const kZygotePreloadEnvVar = "BOUNCE_ZYGOTE_PRELOAD";
+// The zygote reads how long killed apps get to exit after SIGTERM before
+// they're SIGKILLed, in milliseconds, from this env var.
+inline const char* const kZygoteGraceMsEnvVar = "BOUNCE_ZYGOTE_GRACE_MS";
+
+inline const int kZygoteArgsSize = 4096;
+
+enum class ZygoteMessageCode : int32_t {
+  // Requests
+  // Fork an app that runs 'args', a python command line without the
+  // interpreter, e.g. "game.py --level=2", "-m game", or "-c <code>".
+  FORK = 0,
+  // Terminate the app with pid 'pid' and its process group.
+  KILL = 1,
+
+  // Responses
+  // Sent once the zygote's imported its preload modules.
+  READY = 2,
+  // 'pid' is the forked app's pid.
+  FORKED = 3,
+  FORK_FAILED = 4,
+  KILLED = 5,
+};
+
+struct ZygoteMessage {
+  ZygoteMessageCode code;
+  // Set on requests and copied to their responses, so that a response that
+  // arrives after its request timed out isn't taken for a later request's.
+  // READY's is 0.
+  int32_t request_id = 0;
+  int32_t pid = -1;
+  // The number of null terminated args in 'args'.
+  int32_t argc = 0;
+  char args[kZygoteArgsSize] = {};
+};
+
+#endif  // ZYGOTE_PROTOCOL_H_
@@ -0,0 +1,137 @@
+#include "zygote/zygote.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+
+#include <algorithm>
+#include <format>
+
+#include "paths.h"
+#include "third_party/status/logger.h"
+#include "time_aliases.h"
+
+namespace {
+using std::chrono::milliseconds;
+}  // namespace
+
+StatusOr<std::unique_ptr<Zygote>> Zygote::create(const std::string& ipc_dir,
+                                                 const std::string& python,
+                                                 const ZygoteOptions& options) {
+  Token token;
+  ASSIGN_OR_RETURN(auto ipc, IPC<ZygoteMessage>::create(ipc_dir, &token,
+                                                        SOCK_SEQPACKET));
+  return std::unique_ptr<Zygote>(
+      new Zygote(std::move(ipc), std::move(token), python, options));
+}
+
+std::vector<std::string> Zygote::command() const {
+  return {python_, get_zygote_path()};
+}
+
+void Zygote::set_env(EnvVars* env) const {
+  std::string preload;
+  for (const std::string& module : options_.preload) {
+    if (!preload.empty()) preload += ",";
+    preload += module;
+  }
+  env->set_var(kZygoteIpcFileEnvVar, token_);
+  env->set_var(kZygotePreloadEnvVar, preload);
+  env->set_var(kZygoteGraceMsEnvVar, std::to_string(options_.grace.count()));
+}
+
+StatusVal Zygote::wait_ready(milliseconds timeout) {
+  auto start = std::chrono::steady_clock::now();
+  RETURN_IF_ERROR(ipc_.wait_for_connection(timeout));
+  auto remaining = timeout - std::chrono::duration_cast<milliseconds>(
+                                 std::chrono::steady_clock::now() - start);
+  ASSIGN_OR_RETURN(ZygoteMessage m, receive(/*request_id=*/0, remaining));
+  if (m.code != ZygoteMessageCode::READY) {
+    return InternalError(
+        std::format("Zygote sent {} instead of READY.", (int)m.code));
+  }
+  return OkStatus();
+}
+
+bool Zygote::can_fork(const std::vector<std::string>& command) const {
+  return command.size() >= 2 && command[0] == python_;
+}
+
+StatusOr<int> Zygote::fork(const std::vector<std::string>& command) {
+  if (!can_fork(command)) {
+    return InvalidArgumentError(std::format(
+        "The zygote can only fork commands that run {}.", python_));
+  }
+
+  ZygoteMessage m{.code = ZygoteMessageCode::FORK};
+  size_t offset = 0;
+  for (size_t i = 1; i < command.size(); ++i) {
+    const std::string& arg = command[i];
+    if (offset + arg.size() + 1 > sizeof(m.args)) {
+      return InvalidArgumentError(std::format(
+          "The zygote's args are limited to {} bytes.", sizeof(m.args)));
+    }
+    memcpy(m.args + offset, arg.c_str(), arg.size() + 1);
+    offset += arg.size() + 1;
+    m.argc++;
+  }
+
+  ASSIGN_OR_RETURN(ZygoteMessage response,
+                   request(m, options_.response_timeout));
+  if (response.code != ZygoteMessageCode::FORKED) {
+    return InvalidArgumentError("The zygote failed to fork the app.");
+  }
+  return response.pid;
+}
+
+StatusVal Zygote::kill(int pid) {
+  ZygoteMessage m{.code = ZygoteMessageCode::KILL, .pid = pid};
+  ASSIGN_OR_RETURN(ZygoteMessage response,
+                   request(m, options_.grace + options_.response_timeout));
+  if (response.code != ZygoteMessageCode::KILLED) {
+    return InternalError(std::format(
+        "Zygote sent {} in response to a kill.", (int)response.code));
+  }
+  return OkStatus();
+}
+
+StatusOr<ZygoteMessage> Zygote::request(ZygoteMessage m,
+                                        milliseconds timeout) {
+  m.request_id = next_request_++;
+  RETURN_IF_ERROR(ipc_.send(m));
+  return receive(m.request_id, timeout);
+}
+
+StatusOr<ZygoteMessage> Zygote::receive(int32_t request_id,
+                                        milliseconds timeout) {
+  const auto deadline = sc_now() + timeout;
+  while (true) {
+    auto remaining =
+        std::chrono::duration_cast<milliseconds>(deadline - sc_now());
+    pollfd p = {.fd = ipc_.socket(), .events = POLLIN, .revents = 0};
+    int r = poll(&p, 1, std::max<int>(remaining.count(), 0));
+    if (r == -1 && errno == EINTR) continue;
+    if (r == 0) {
+      return DeadlineExceededError("Timed out waiting for the zygote.");
+    }
+    if (r == -1) {
+      return InternalError("Zygote poll failed: " + libc_error_name(errno));
+    }
+    ASSIGN_OR_RETURN(ZygoteMessage m, ipc_.receive(/*block=*/true));
+    if (m.request_id == request_id) return m;
+
+    LOG(kLogSubprocess, "Dropping the zygote's late response to request %d.",
+        m.request_id);
+    if (m.code == ZygoteMessageCode::FORKED) {
+      // Nobody knows the app's pid, so take it down. The kill's response is
+      // dropped in turn.
+      StatusVal s = ipc_.send(ZygoteMessage{.code = ZygoteMessageCode::KILL,
+                                            .request_id = next_request_++,
+                                            .pid = m.pid});
+      if (!s.ok()) {
+        ERROR("Failed to kill late zygote app %d: %s", m.pid,
+              s.to_string().c_str());
+      }
+    }
+  }
+}
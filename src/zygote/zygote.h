@@ -0,0 +1,100 @@
+// A fork server for Python apps.
+//
+// A zygote is a Python process (bounce_desktop/zygote.py) that imports an
+// app's modules once and then forks the app from that warm state each time
+// it's launched, so that relaunches skip interpreter start up and imports.
+//
+// Zygote is the launching side. It doesn't start the zygote process itself,
+// so that callers can run it however they run apps, e.g. under a reaper and
+// inside a desktop's environment: run command() with the env vars from
+// set_env(), and then call wait_ready().
+
+#ifndef ZYGOTE_ZYGOTE_H_
+#define ZYGOTE_ZYGOTE_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "process/env_vars.h"
+#include "reaper/ipc.h"
+#include "third_party/status/status_or.h"
+#include "zygote/protocol.h"
+
+struct ZygoteOptions {
+  // Modules the zygote imports before it forks any apps.
+  std::vector<std::string> preload;
+  // How long killed apps get to exit after SIGTERM before they're SIGKILLed.
+  std::chrono::milliseconds grace = std::chrono::milliseconds(1000);
+  // How long requests wait beyond any grace period for the zygote to respond.
+  std::chrono::milliseconds response_timeout =
+      std::chrono::milliseconds(10'000);
+};
+
+class Zygote {
+ public:
+  // Creates a Zygote for a zygote process that runs 'python', with its IPC
+  // socket in 'ipc_dir'.
+  static StatusOr<std::unique_ptr<Zygote>> create(
+      const std::string& ipc_dir, const std::string& python,
+      const ZygoteOptions& options = ZygoteOptions());
+
+  Zygote(const Zygote&) = delete;
+  Zygote& operator=(const Zygote&) = delete;
+
+  // The command that runs the zygote process.
+  std::vector<std::string> command() const;
+
+  // Sets the env vars that the zygote process needs in 'env'.
+  void set_env(EnvVars* env) const;
+
+  // Waits for the zygote process to connect and import its preloads.
+  //
+  // Returns DEADLINE_EXCEEDED if it isn't ready within 'timeout', and ABORTED
+  // if it exits first, e.g. because a preload failed to import.
+  StatusVal wait_ready(std::chrono::milliseconds timeout);
+
+  // Returns whether the zygote can fork 'command', i.e. whether it runs the
+  // zygote's python.
+  bool can_fork(const std::vector<std::string>& command) const;
+
+  // Forks an app that runs 'command' and returns its pid. The app runs in its
+  // own process group, with the zygote's environment and output.
+  //
+  // Returns INVALID_ARGUMENT if the zygote can't fork 'command', and
+  // DEADLINE_EXCEEDED if the zygote doesn't respond in time. An app that's
+  // forked after its request timed out is killed.
+  StatusOr<int> fork(const std::vector<std::string>& command);
+
+  // Terminates the app 'pid' and its process group.
+  StatusVal kill(int pid);
+
+  const std::string& python() const { return python_; }
+  const ZygoteOptions& options() const { return options_; }
+
+ private:
+  Zygote(IPC<ZygoteMessage> ipc, Token token, const std::string& python,
+         const ZygoteOptions& options)
+      : ipc_(std::move(ipc)),
+        token_(std::move(token)),
+        python_(python),
+        options_(options) {}
+
+  // Sends 'm' with the next request id and waits up to 'timeout' for the
+  // response.
+  StatusOr<ZygoteMessage> request(ZygoteMessage m,
+                                  std::chrono::milliseconds timeout);
+  // Waits up to 'timeout' for the response to 'request_id', dropping late
+  // responses to requests that already timed out.
+  StatusOr<ZygoteMessage> receive(int32_t request_id,
+                                  std::chrono::milliseconds timeout);
+
+  IPC<ZygoteMessage> ipc_;
+  Token token_;
+  std::string python_;
+  ZygoteOptions options_;
+  int32_t next_request_ = 1;
+};
+
+#endif  // ZYGOTE_ZYGOTE_H_
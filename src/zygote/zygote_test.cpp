@@ -0,0 +1,207 @@
+#include "zygote/zygote.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "process/process.h"
+#include "third_party/status/status_gtest.h"
+#include "time_aliases.h"
+
+namespace {
+
+bool is_running(int pid) {
+  std::ifstream stat(std::format("/proc/{}/stat", pid));
+  if (!stat.is_open()) return false;
+  std::string line;
+  std::getline(stat, line);
+  size_t state = line.rfind(')') + 2;
+  return state < line.size() && line[state] != 'Z';
+}
+
+// Returns the running children of 'pid'.
+std::vector<int> children_of(int pid) {
+  std::vector<int> children;
+  for (const auto& entry : std::filesystem::directory_iterator("/proc")) {
+    std::string name = entry.path().filename();
+    if (name.find_first_not_of("0123456789") != std::string::npos) continue;
+    std::ifstream stat(entry.path() / "stat");
+    std::string line;
+    if (!std::getline(stat, line)) continue;
+    // The fields after the command are the state and then the parent's pid.
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    char state;
+    int ppid;
+    if (fields >> state >> ppid && ppid == pid && state != 'Z') {
+      children.push_back(std::stoi(name));
+    }
+  }
+  return children;
+}
+
+// Waits for 'path' to have contents and returns them.
+std::string wait_for_file(const std::string& path) {
+  auto start = sc_now();
+  while (sc_now() - start < 5s) {
+    std::ifstream in(path);
+    std::string contents;
+    if (in && std::getline(in, contents) && !contents.empty()) {
+      return contents;
+    }
+    sleep_for(10ms);
+  }
+  return "";
+}
+
+}  // namespace
+
+class ZygoteTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::format("/run/user/{}/bounce_zygote_test", getuid());
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+  }
+
+  void TearDown() override {
+    zygote_process_ = Process();
+    std::filesystem::remove_all(dir_);
+  }
+
+  // Starts a zygote that preloads 'preload'.
+  void start_zygote(const std::vector<std::string>& preload,
+                    std::chrono::milliseconds response_timeout = 10s) {
+    ASSERT_OK_AND_ASSIGN(
+        zygote_,
+        Zygote::create(dir_, "python3",
+                       ZygoteOptions{.preload = preload,
+                                     .grace = 500ms,
+                                     .response_timeout = response_timeout}));
+    EnvVars env = EnvVars::environ();
+    zygote_->set_env(&env);
+    ASSERT_OK_AND_ASSIGN(zygote_process_,
+                         launch_process(zygote_->command(), &env));
+  }
+
+  // Writes a python script named 'name' and returns its path.
+  std::string write_script(const std::string& name, const std::string& code) {
+    std::string path = dir_ + "/" + name;
+    std::ofstream(path) << code;
+    return path;
+  }
+
+  std::string dir_;
+  std::unique_ptr<Zygote> zygote_;
+  Process zygote_process_;
+};
+
+TEST_F(ZygoteTest, forks_apps_from_preloaded_state) {
+  start_zygote({"decimal"});
+  StatusVal ready = zygote_->wait_ready(10s);
+  ASSERT_OK(ready);
+
+  std::string out = dir_ + "/out";
+  std::string script = write_script(
+      "app.py", std::format("import sys\n"
+                            "open('{}', 'w').write(\n"
+                            "    str('decimal' in sys.modules) + ' ' +\n"
+                            "    ' '.join(sys.argv[1:]) + '\\n')\n",
+                            out));
+  ASSERT_OK_AND_ASSIGN(int pid,
+                       zygote_->fork({"python3", script, "a b", "c"}));
+  EXPECT_GT(pid, 0);
+  EXPECT_EQ(wait_for_file(out), "True a b c");
+}
+
+TEST_F(ZygoteTest, forks_inline_code) {
+  start_zygote({});
+  StatusVal ready = zygote_->wait_ready(10s);
+  ASSERT_OK(ready);
+
+  std::string out = dir_ + "/out";
+  std::string code = std::format(
+      "import sys; open('{}', 'w').write(sys.argv[1] + '\\n')", out);
+  ASSERT_OK_AND_ASSIGN(int pid,
+                       zygote_->fork({"python3", "-c", code, "hello"}));
+  EXPECT_GT(pid, 0);
+  EXPECT_EQ(wait_for_file(out), "hello");
+}
+
+TEST_F(ZygoteTest, kill_terminates_the_apps_process_group) {
+  start_zygote({});
+  StatusVal ready = zygote_->wait_ready(10s);
+  ASSERT_OK(ready);
+
+  std::string out = dir_ + "/out";
+  std::string script = write_script(
+      "app.py", std::format("import subprocess, time\n"
+                            "p = subprocess.Popen(['sleep', '100'])\n"
+                            "open('{}', 'w').write(f'{{p.pid}}\\n')\n"
+                            "time.sleep(100)\n",
+                            out));
+  ASSERT_OK_AND_ASSIGN(int pid, zygote_->fork({"python3", script}));
+  int sleep_pid = std::stoi(wait_for_file(out));
+  EXPECT_TRUE(is_running(pid));
+  EXPECT_TRUE(is_running(sleep_pid));
+
+  StatusVal s = zygote_->kill(pid);
+  EXPECT_OK(s);
+  EXPECT_FALSE(is_running(pid));
+  EXPECT_FALSE(is_running(sleep_pid));
+}
+
+TEST_F(ZygoteTest, rejects_commands_for_other_interpreters) {
+  start_zygote({});
+  StatusVal ready = zygote_->wait_ready(10s);
+  ASSERT_OK(ready);
+
+  EXPECT_THAT(zygote_->fork({"sh", "-c", "true"}),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+  EXPECT_THAT(zygote_->fork({"python3"}),
+              StatusIs(StatusCode::INVALID_ARGUMENT));
+}
+
+TEST_F(ZygoteTest, drops_late_responses) {
+  start_zygote({}, 300ms);
+  StatusVal ready = zygote_->wait_ready(10s);
+  ASSERT_OK(ready);
+
+  // The zygote only answers the fork once it's continued, after the fork's
+  // timed out.
+  std::string late_out = dir_ + "/late";
+  std::string script = write_script(
+      "app.py", "import os, sys, time\n"
+                "open(sys.argv[1], 'w').write(f'{os.getpid()}\\n')\n"
+                "time.sleep(100)\n");
+  ASSERT_OK(zygote_process_.signal(SIGSTOP));
+  EXPECT_THAT(zygote_->fork({"python3", script, late_out}),
+              StatusIs(StatusCode::DEADLINE_EXCEEDED));
+  ASSERT_OK(zygote_process_.signal(SIGCONT));
+
+  // Later requests get their own responses.
+  std::string out = dir_ + "/out";
+  ASSERT_OK_AND_ASSIGN(int pid, zygote_->fork({"python3", script, out}));
+  EXPECT_EQ(wait_for_file(out), std::to_string(pid));
+  StatusVal s = zygote_->kill(pid);
+  EXPECT_OK(s);
+
+  // And the late app's killed, since nobody has its pid. It may be killed
+  // before it's written its pid, so look for it among the zygote's children.
+  auto start = sc_now();
+  while (!children_of(zygote_process_.pid).empty() && sc_now() - start < 5s) {
+    sleep_for(10ms);
+  }
+  EXPECT_THAT(children_of(zygote_process_.pid), testing::IsEmpty());
+}
+
+TEST_F(ZygoteTest, failed_preload_aborts_wait_ready) {
+  start_zygote({"bounce_zygote_test_missing_module"});
+  EXPECT_THAT(zygote_->wait_ready(10s), StatusIs(StatusCode::ABORTED));
+}
@@ -1,9 +1,11 @@
 #ifndef EXCEPTIONS_H_
 #define EXCEPTIONS_H_
 
+#include <stdexcept>
+
 #include "status_or.h"
 
-void raise_status(const StatusVal& status) {
+inline void raise_status(const StatusVal& status) {
   if (!status.ok()) {
     if (status.code() == StatusCode::INVALID_ARGUMENT) {
       throw std::invalid_argument(status.to_string());